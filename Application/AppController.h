@@ -164,6 +164,7 @@ typedef struct {
 - (void)notifyBufferPlayed:(UInt32)bufferDirty;
 
 - (bool)fillBufferWithNext:(int)bufferToFill;
+- (NSArray*)upcomingFiles:(NSUInteger)maxCount;
 @end
 
 #define NSLocalizedStringWithDefault(key, default) \
@@ -66,10 +66,24 @@
 	[defaultValues setObject:@"Built-in Output" forKey:AUDPreferredAudioDeviceName];
     [defaultValues setObject:[NSNumber numberWithInt:kAUDSRCMaxSplRateNoLimit] forKey:AUDMaxSampleRateLimit];
     [defaultValues setObject:[NSNumber numberWithInt:kAUDSRCSplRateSwitchingLatencyNone] forKey:AUDSampleRateSwitchingLatency];
+	[defaultValues setObject:[NSNumber numberWithInt:kAudioSampleRatePolicyBitPerfect] forKey:AUDSampleRateSwitchPolicy];
+	[defaultValues setObject:[NSNumber numberWithInt:4] forKey:AUDSampleRateSwitchLookahead];
 	[defaultValues setObject:[NSNumber numberWithInt:kAUDSRCModelAppleCoreAudio] forKey:AUDSampleRateConverterModel];
 	[defaultValues setObject:[NSNumber numberWithInt:kAUDSRCQualityMax] forKey:AUDSampleRateConverterQuality];
 	[defaultValues setObject:[NSNumber numberWithInt:kAUDSRCNoForcedUpsampling] forKey:AUDForceUpsamlingType];
 	[defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDForceMaxIOBufferSize];
+	[defaultValues setObject:[NSNumber numberWithBool:NO] forKey:AUDBufferPoolHugePages];
+	[defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDStreamingEngine];
+	[defaultValues setObject:[NSNumber numberWithInt:kAudioOutputSinkDevice] forKey:AUDOutputSinkType];
+	[defaultValues setObject:@"~/Audirvana Output.wav" forKey:AUDOutputSinkFilePath];
+	[defaultValues setObject:[NSNumber numberWithDouble:1.0] forKey:AUDOutputSinkSpeedFactor];
+	[defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDMultichannelPlayback];
+	[defaultValues setObject:[NSNumber numberWithInt:kAudioDitheringTriangle] forKey:AUDDitheringMode];
+	[defaultValues setObject:[NSNumber numberWithBool:NO] forKey:AUDBitPerfectVerification];
+	[defaultValues setObject:[NSNumber numberWithBool:NO] forKey:AUDPCMCacheEnabled];
+	[defaultValues setObject:[NSNumber numberWithInt:4096] forKey:AUDPCMCacheMaxSize];
+	[defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDFLACParallelDecoding];
+	[defaultValues setObject:[NSNumber numberWithBool:NO] forKey:AUDDuplicateMonoToStereo];
 	[defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDUseAppleRemote];
     [defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDUseMediaKeys];
     [defaultValues setObject:[NSNumber numberWithBool:YES] forKey:AUDUseMediaKeysForVolumeControl];
@@ -371,6 +385,7 @@
 	}
 	[debugController showWindow:sender];
 	[debugController setInfoText:[audioOut description]];
+	[debugController appendPropertyList:[audioOut ioStatistics] withTitle:@"IO proc statistics:"];
 }
 
 - (IBAction)openDonationPage:(id)sender
@@ -1386,6 +1401,11 @@
 	return result;
 }
 
+- (NSArray*)upcomingFiles:(NSUInteger)maxCount
+{
+	return [mPlaylistDoc upcomingFiles:maxCount];
+}
+
 #pragma mark Notifications handlers
 
 - (void)notifyBufferPlayed:(UInt32)bufferDirty
@@ -10,6 +10,8 @@
 #import "PlaylistDocument.h"
 #import "AppController.h"
 #import "PreferenceController.h"
+#import "AudioSRCBenchmark.h"
+#import "AudioFileProbeBenchmark.h"
 
 @implementation Audirvana_AppDelegate
 
@@ -270,6 +272,35 @@
  */
 - (void)applicationDidFinishLaunching:(NSNotification *)aNotification
 {
+	//Headless sample rate converters benchmark, requested on the command line
+	NSString *benchmarkReportPath = [[NSUserDefaults standardUserDefaults] stringForKey:AUDSRCBenchmarkReportPath];
+	if (benchmarkReportPath) {
+		[benchmarkReportPath retain];
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			if (![AudioSRCBenchmark writeReport:benchmarkReportPath])
+				NSLog(@"Error writing the SRC benchmark report to %@",benchmarkReportPath);
+			[benchmarkReportPath release];
+			dispatch_async(dispatch_get_main_queue(), ^{[NSApp terminate:nil];});
+		});
+		return;
+	}
+
+	//Headless playlist insertion benchmark, requested on the command line
+	benchmarkReportPath = [[NSUserDefaults standardUserDefaults] stringForKey:AUDProbeBenchmarkReportPath];
+	NSString *benchmarkFolder = [[NSUserDefaults standardUserDefaults] stringForKey:AUDProbeBenchmarkFolder];
+	if (benchmarkReportPath && benchmarkFolder) {
+		[benchmarkReportPath retain];
+		[benchmarkFolder retain];
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			if (![AudioFileProbeBenchmark writeReport:benchmarkReportPath forFolder:benchmarkFolder])
+				NSLog(@"Error writing the probe benchmark report of %@ to %@",benchmarkFolder,benchmarkReportPath);
+			[benchmarkReportPath release];
+			[benchmarkFolder release];
+			dispatch_async(dispatch_get_main_queue(), ^{[NSApp terminate:nil];});
+		});
+		return;
+	}
+
     if (!openedWithFile && [[NSUserDefaults standardUserDefaults] boolForKey:AUDAutosavePlaylist])
 		[playlistDoc loadPlaylist:[NSURL fileURLWithPath:[[self applicationSupportDirectory] stringByAppendingPathComponent:@"playlistAutosaved.m3u8"]]
 				 appendToExisting:YES];
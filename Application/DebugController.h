@@ -27,4 +27,9 @@
 	IBOutlet NSTextView *textView;
 }
 - (void)setInfoText:(NSString*)text;
+/** appendPropertyList
+ Appends a machine readable dump (XML property list) to the displayed text
+ @param title the dump header line
+ */
+- (void)appendPropertyList:(id)plist withTitle:(NSString*)title;
 @end
\ No newline at end of file
@@ -35,4 +35,22 @@
 {
 	[textView setString:text];
 }
+
+- (void)appendPropertyList:(id)plist withTitle:(NSString*)title
+{
+	NSString *errorDesc = nil;
+	NSData *plistData = [NSPropertyListSerialization dataFromPropertyList:plist
+																   format:NSPropertyListXMLFormat_v1_0
+														 errorDescription:&errorDesc];
+	NSString *plistStr;
+
+	if (!plistData) {
+		[errorDesc release];
+		return;
+	}
+
+	plistStr = [[NSString alloc] initWithData:plistData encoding:NSUTF8StringEncoding];
+	[textView setString:[NSString stringWithFormat:@"%@\n%@\n%@",[textView string],title,plistStr]];
+	[plistStr release];
+}
 @end
\ No newline at end of file
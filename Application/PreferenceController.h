@@ -31,8 +31,22 @@ extern NSString * const AUDIntegerMode;
 extern NSString * const AUDPreferredAudioDeviceUID;
 extern NSString * const AUDPreferredAudioDeviceName;
 extern NSString * const AUDSampleRateSwitchingLatency;
+extern NSString * const AUDSampleRateSwitchPolicy; //kAudioSampleRatePolicyXXX mode of the tracks transitions at another sample rate
+extern NSString * const AUDSampleRateSwitchLookahead; //Number of upcoming playlist tracks examined by the adaptive policy
 extern NSString * const AUDMaxSampleRateLimit;
 extern NSString * const AUDMaxAudioBufferSize;
+extern NSString * const AUDBufferPoolHugePages; //Audio buffers backed by superpages, which are wired memory
+extern NSString * const AUDStreamingEngine;
+extern NSString * const AUDOutputSinkType;
+extern NSString * const AUDOutputSinkFilePath;
+extern NSString * const AUDOutputSinkSpeedFactor;
+extern NSString * const AUDMultichannelPlayback;
+extern NSString * const AUDDitheringMode;
+extern NSString * const AUDBitPerfectVerification;
+extern NSString * const AUDPCMCacheEnabled;
+extern NSString * const AUDPCMCacheMaxSize;
+extern NSString * const AUDFLACParallelDecoding;
+extern NSString * const AUDDuplicateMonoToStereo;
 extern NSString * const AUDForceMaxIOBufferSize;
 extern NSString * const AUDForceUpsamlingType;
 extern NSString * const AUDSampleRateConverterModel;
@@ -40,6 +54,9 @@ extern NSString * const AUDSampleRateConverterQuality;
 extern NSString * const AUDUseUTF8forM3U;
 extern NSString * const AUDOutsideOpenedPlaylistPlaybackAutoStart;
 extern NSString * const AUDAutosavePlaylist;
+extern NSString * const AUDSRCBenchmarkReportPath; //Command line only (-SRCBenchmarkReportPath file.csv): runs the converters benchmark and quits
+extern NSString * const AUDProbeBenchmarkReportPath; //Command line only (-ProbeBenchmarkReportPath file.csv -ProbeBenchmarkFolder folder): runs the playlist insertion benchmark and quits
+extern NSString * const AUDProbeBenchmarkFolder;
 
 //UI elements remembrance
 extern NSString * const AUDLoopModeActive;
@@ -89,7 +106,8 @@ enum {
  */
 enum {
     kAUDSRCModelAppleCoreAudio = 0,
-    kAUDSRCModelSRClibSampleRate
+    kAUDSRCModelSRClibSampleRate,
+    kAUDSRCModelPolyphaseFIR //Built-in polyphase FIR, for the ratios between integer sample rates. libSampleRate otherwise
 };
 
 /*
@@ -37,8 +37,22 @@ NSString * const AUDIntegerMode = @"IntegerMode";
 NSString * const AUDPreferredAudioDeviceUID = @"PreferredAudioDeviceUID";
 NSString * const AUDPreferredAudioDeviceName = @"PreferredAudioDeviceName";
 NSString * const AUDSampleRateSwitchingLatency = @"SampleRateSwitchingLatencyIndex";
+NSString * const AUDSampleRateSwitchPolicy = @"SampleRateSwitchPolicy";
+NSString * const AUDSampleRateSwitchLookahead = @"SampleRateSwitchLookahead";
 NSString * const AUDMaxSampleRateLimit = @"MaxSampleRateLimitIndex";
 NSString * const AUDMaxAudioBufferSize = @"MaxAudioBufferSize";
+NSString * const AUDBufferPoolHugePages = @"BufferPoolHugePages";
+NSString * const AUDStreamingEngine = @"UseStreamingEngine";
+NSString * const AUDOutputSinkType = @"OutputSinkType";
+NSString * const AUDOutputSinkFilePath = @"OutputSinkFilePath";
+NSString * const AUDOutputSinkSpeedFactor = @"OutputSinkSpeedFactor";
+NSString * const AUDMultichannelPlayback = @"MultichannelPlayback";
+NSString * const AUDDitheringMode = @"DitheringMode";
+NSString * const AUDBitPerfectVerification = @"BitPerfectVerification";
+NSString * const AUDPCMCacheEnabled = @"PCMCacheEnabled";
+NSString * const AUDPCMCacheMaxSize = @"PCMCacheMaxSize";
+NSString * const AUDFLACParallelDecoding = @"FLACParallelDecoding";
+NSString * const AUDDuplicateMonoToStereo = @"DuplicateMonoToStereo";
 NSString * const AUDForceUpsamlingType = @"ForceUpsamplingType";
 NSString * const AUDSampleRateConverterModel = @"SampleRateConverterModelIndex";
 NSString * const AUDSampleRateConverterQuality = @"SampleRateConverterQuality";
@@ -46,6 +60,9 @@ NSString * const AUDForceMaxIOBufferSize = @"UseMaximumIOBufferSize";
 NSString * const AUDUseUTF8forM3U = @"UseUTF8forM3U";
 NSString * const AUDOutsideOpenedPlaylistPlaybackAutoStart = @"OutsideOpenedPlaylistPlaybackAutoStart";
 NSString * const AUDAutosavePlaylist = @"AutosavePlaylist";
+NSString * const AUDSRCBenchmarkReportPath = @"SRCBenchmarkReportPath";
+NSString * const AUDProbeBenchmarkReportPath = @"ProbeBenchmarkReportPath";
+NSString * const AUDProbeBenchmarkFolder = @"ProbeBenchmarkFolder";
 
 NSString * const AUDLoopModeActive = @"LoopModeActive";
 NSString * const AUDShuffleModeActive = @"ShuffleModeActive";
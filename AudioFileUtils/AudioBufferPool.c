@@ -0,0 +1,274 @@
+/*
+ AudioBufferPool.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mach/mach.h>
+#include <libkern/OSAtomic.h>
+
+#include "AudioBufferPool.h"
+
+UInt64 AudioBufferPoolSizeClass(UInt64 size)
+{
+	UInt64 octave = kAudioBufferPoolMinClassSize;
+	UInt64 step;
+
+	if (size <= kAudioBufferPoolMinClassSize) return kAudioBufferPoolMinClassSize;
+
+	while ((octave << 1) < size) octave <<= 1;
+	step = octave / kAudioBufferPoolClassSteps;
+	if (step < kAudioBufferPoolMinClassSize) step = kAudioBufferPoolMinClassSize;
+
+	return (size + step - 1) / step * step;
+}
+
+static void unlockRegion(AudioBufferPoolRegion *region)
+{
+	if (region->lockedSize > 0)
+		munlock((UInt8*)region->data + region->lockedOffset, (size_t)region->lockedSize);
+	region->lockedOffset = 0;
+	region->lockedSize = 0;
+}
+
+static void deallocateRegion(AudioBufferPoolRegion *region)
+{
+	unlockRegion(region);
+	vm_deallocate(mach_task_self(), (vm_address_t)region->data, (vm_size_t)region->size);
+	memset(region, 0, sizeof(AudioBufferPoolRegion));
+}
+
+static AudioBufferPoolRegion* findRegion(AudioBufferPool *pool, void *data)
+{
+	UInt32 i;
+
+	for (i=0;i<kAudioBufferPoolMaxRegions;i++)
+		if ((pool->regions[i].data == data) && (data != NULL)) return &pool->regions[i];
+
+	return NULL;
+}
+
+/* Returns the least recently used free regions to the system, down to maxFreeBytes of free regions */
+static void trimFreeRegions(AudioBufferPool *pool, UInt64 maxFreeBytes)
+{
+	AudioBufferPoolRegion *oldest;
+	UInt64 freeBytes;
+	UInt32 i;
+
+	for (;;) {
+		oldest = NULL;
+		freeBytes = 0;
+		for (i=0;i<kAudioBufferPoolMaxRegions;i++) {
+			if ((pool->regions[i].data == NULL) || pool->regions[i].isInUse) continue;
+			freeBytes += pool->regions[i].size;
+			if ((oldest == NULL) || (pool->regions[i].lastRelease < oldest->lastRelease)) oldest = &pool->regions[i];
+		}
+		if ((oldest == NULL) || (freeBytes <= maxFreeBytes)) return;
+		deallocateRegion(oldest);
+	}
+}
+
+void AudioBufferPoolInit(AudioBufferPool *pool, UInt32 options, UInt64 maxFreeBytes)
+{
+	memset(pool, 0, sizeof(AudioBufferPool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->options = options;
+	pool->maxFreeBytes = maxFreeBytes;
+}
+
+void AudioBufferPoolDispose(AudioBufferPool *pool)
+{
+	UInt32 i;
+
+	for (i=0;i<kAudioBufferPoolMaxRegions;i++)
+		if (pool->regions[i].data) deallocateRegion(&pool->regions[i]);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+void AudioBufferPoolSetOptions(AudioBufferPool *pool, UInt32 options, UInt64 maxFreeBytes)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->options = options;
+	pool->maxFreeBytes = maxFreeBytes;
+	trimFreeRegions(pool, maxFreeBytes);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void* AudioBufferPoolAcquire(AudioBufferPool *pool, UInt64 size)
+{
+	UInt64 sizeClass = AudioBufferPoolSizeClass(size);
+	UInt64 maxReusedSize = AudioBufferPoolSizeClass(sizeClass + 1); //Request class, or the one above
+	AudioBufferPoolRegion *region = NULL;
+	vm_address_t address = 0;
+	bool isHugePages = false;
+	UInt32 i;
+
+	pthread_mutex_lock(&pool->lock);
+
+	//Best fitting free region
+	for (i=0;i<kAudioBufferPoolMaxRegions;i++) {
+		if ((pool->regions[i].data == NULL) || pool->regions[i].isInUse
+			|| (pool->regions[i].size < sizeClass) || (pool->regions[i].size > maxReusedSize)) continue;
+		if ((region == NULL) || (pool->regions[i].size < region->size)) region = &pool->regions[i];
+	}
+
+	if (region) {
+		region->isInUse = true;
+		pool->recycles++;
+		pthread_mutex_unlock(&pool->lock);
+		return region->data;
+	}
+
+	//New region in an empty slot, making room by releasing the least recently used free region
+	for (i=0;(i<kAudioBufferPoolMaxRegions) && (pool->regions[i].data != NULL);i++);
+	if (i == kAudioBufferPoolMaxRegions) {
+		trimFreeRegions(pool, 0);
+		for (i=0;(i<kAudioBufferPoolMaxRegions) && (pool->regions[i].data != NULL);i++);
+	}
+
+	//All regions in use: plain allocation of the requested size, deallocated on release with this size
+	if (i == kAudioBufferPoolMaxRegions)
+		sizeClass = size;
+
+#ifdef VM_FLAGS_SUPERPAGE_SIZE_2MB
+	if ((pool->options & kAudioBufferPoolHugePages) && (i < kAudioBufferPoolMaxRegions)
+		&& (vm_allocate(mach_task_self(), &address, (vm_size_t)sizeClass,
+						VM_FLAGS_ANYWHERE | VM_FLAGS_SUPERPAGE_SIZE_2MB) == KERN_SUCCESS)) {
+		isHugePages = true;
+		pool->hugePagesAllocations++;
+	}
+	else
+#endif
+	if (vm_allocate(mach_task_self(), &address, (vm_size_t)sizeClass, VM_FLAGS_ANYWHERE) != KERN_SUCCESS) {
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	pool->allocations++;
+
+	if (i < kAudioBufferPoolMaxRegions) {
+		region = &pool->regions[i];
+		region->data = (void*)address;
+		region->size = sizeClass;
+		region->isInUse = true;
+		region->isHugePages = isHugePages;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return (void*)address;
+}
+
+void AudioBufferPoolRelease(AudioBufferPool *pool, void *data, UInt64 size)
+{
+	AudioBufferPoolRegion *region;
+
+	pthread_mutex_lock(&pool->lock);
+
+	region = findRegion(pool, data);
+	if (region == NULL) {
+		pthread_mutex_unlock(&pool->lock);
+		vm_deallocate(mach_task_self(), (vm_address_t)data, (vm_size_t)size);
+		return;
+	}
+
+	unlockRegion(region);
+	region->isInUse = false;
+	region->lastRelease = ++pool->releases;
+	trimFreeRegions(pool, pool->maxFreeBytes);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void AudioBufferPoolTrim(AudioBufferPool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	trimFreeRegions(pool, 0);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* Mapped buffers: reads the window pages from the file now, so that the IO proc does not fault on them */
+static void prefaultWindow(AudioBufferPool *pool, void *data, UInt64 size, UInt64 offset, UInt64 length)
+{
+	const UInt64 pageSize = (UInt64)getpagesize();
+	const SInt32 generation = pool->prefaultGeneration;
+	UInt8 *start, *end, *page;
+	volatile UInt8 sum = 0;
+
+	if ((data == NULL) || (offset >= size)) return;
+	if (length > size - offset) length = size - offset;
+
+	start = (UInt8*)((UInt64)((UInt8*)data + offset) & ~(pageSize - 1));
+	end = (UInt8*)data + offset + length;
+	madvise(start, (size_t)(end - start), MADV_WILLNEED);
+	for (page=start;(page<end) && (pool->prefaultGeneration == generation);page+=pageSize) sum += *page;
+}
+
+void AudioBufferPoolCancelPrefault(AudioBufferPool *pool)
+{
+	OSAtomicIncrement32(&pool->prefaultGeneration);
+}
+
+void AudioBufferPoolLockWindow(AudioBufferPool *pool, void *data, UInt64 size, UInt64 offset, UInt64 length)
+{
+	AudioBufferPoolRegion *region;
+	UInt64 pageMask = (UInt64)getpagesize() - 1;
+	UInt64 end;
+
+	pthread_mutex_lock(&pool->lock);
+
+	region = findRegion(pool, data);
+	if (region == NULL) {
+		pthread_mutex_unlock(&pool->lock);
+		prefaultWindow(pool, data, size, offset, length);
+		return;
+	}
+	if (region->isHugePages || !region->isInUse || (offset >= region->size)) {
+		pthread_mutex_unlock(&pool->lock);
+		return;
+	}
+
+	end = (offset + length > region->size) ? region->size : ((offset + length + pageMask) & ~pageMask);
+	offset &= ~pageMask;
+
+	//Moving forward (playing): only the pages left behind are unwired, and the new ones wired
+	if ((region->lockedSize > 0) && (offset >= region->lockedOffset)
+		&& (offset <= region->lockedOffset + region->lockedSize) && (end >= region->lockedOffset + region->lockedSize)) {
+		UInt64 lockedEnd = region->lockedOffset + region->lockedSize;
+
+		if (offset > region->lockedOffset)
+			munlock((UInt8*)region->data + region->lockedOffset, (size_t)(offset - region->lockedOffset));
+		//Over the wired memory limit: the range stays the pages still wired, extended at the next tick
+		if ((end > lockedEnd) && (mlock((UInt8*)region->data + lockedEnd, (size_t)(end - lockedEnd)) != 0))
+			end = lockedEnd;
+	}
+	else {
+		unlockRegion(region);
+		//Over the wired memory limit: the pages are paged in on access as without the pool
+		if (mlock((UInt8*)region->data + offset, (size_t)(end - offset)) != 0) {
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+	}
+	region->lockedOffset = offset;
+	region->lockedSize = end - offset;
+
+	pthread_mutex_unlock(&pool->lock);
+}
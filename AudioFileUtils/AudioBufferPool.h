@@ -0,0 +1,129 @@
+/*
+ AudioBufferPool.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOBUFFERPOOL_H__
+#define __AUDIOBUFFERPOOL_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioBufferPoolMaxRegions 8 //Regions owned by the pool, in use or free
+#define kAudioBufferPoolMinClassSize (2*1024*1024) //Smallest size class, and size of the huge pages
+#define kAudioBufferPoolClassSteps 4 //Size classes per octave: less than 20% of a region unused
+
+/*
+ Pool options
+ */
+enum {
+	kAudioBufferPoolHugePages = 1 //Regions backed by 2MB superpages when the system provides them. These are wired memory
+};
+
+typedef struct {
+	void *data;
+	UInt64 size; //Size class of the region
+	UInt64 lockedOffset; //Pages wired ahead of the play head
+	UInt64 lockedSize;
+	UInt64 lastRelease; //Release order, the least recently used free region being returned to the system first
+	bool isInUse;
+	bool isHugePages;
+} AudioBufferPoolRegion;
+
+/*
+ AudioBufferPool
+ Recycles the big audio buffers regions across tracks and seeks, instead of mapping new zero-filled pages for each load.
+ Regions are allocated by size classes, a free region being reused for any request of its class or of the class below
+ */
+typedef struct {
+	AudioBufferPoolRegion regions[kAudioBufferPoolMaxRegions];
+	pthread_mutex_t lock;
+	UInt64 maxFreeBytes; //Free regions above this total are returned to the system
+	UInt64 releases;
+	UInt32 options;
+	volatile SInt32 prefaultGeneration; //Incremented to stop the prefault in progress
+	//Statistics
+	UInt64 allocations; //Regions allocated from the system
+	UInt64 hugePagesAllocations;
+	UInt64 recycles; //Requests served by a free region
+} AudioBufferPool;
+
+/** AudioBufferPoolInit
+ @param options kAudioBufferPoolXXX flags
+ @param maxFreeBytes the total size of the free regions kept for reuse
+ */
+void AudioBufferPoolInit(AudioBufferPool *pool, UInt32 options, UInt64 maxFreeBytes);
+
+/** AudioBufferPoolDispose
+ Returns all the regions to the system. None must be in use anymore
+ */
+void AudioBufferPoolDispose(AudioBufferPool *pool);
+
+/** AudioBufferPoolSetOptions
+ @comment Applies to the next regions allocated from the system, and to the free regions limit
+ */
+void AudioBufferPoolSetOptions(AudioBufferPool *pool, UInt32 options, UInt64 maxFreeBytes);
+
+/** AudioBufferPoolAcquire
+ @param size the buffer size in bytes
+ @return a page aligned buffer of at least size bytes, NULL if the memory can't be allocated.
+ Its content is not cleared when recycled
+ */
+void* AudioBufferPoolAcquire(AudioBufferPool *pool, UInt64 size);
+
+/** AudioBufferPoolRelease
+ Puts back a region acquired from the pool. Buffers not from the pool (e.g. mapped files) are deallocated
+ @param data the buffer, the size in bytes being used only for the buffers not from the pool
+ */
+void AudioBufferPoolRelease(AudioBufferPool *pool, void *data, UInt64 size);
+
+/** AudioBufferPoolTrim
+ Returns the free regions to the system
+ */
+void AudioBufferPoolTrim(AudioBufferPool *pool);
+
+/** AudioBufferPoolLockWindow
+ Faults in and wires the pages of a buffer range (e.g. ahead of the play head), unwiring the previous range of the buffer.
+ The buffers not from the pool (mapped files and PCM cache entries) are only faulted in, from the file
+ @param data a buffer. No-op for the huge pages regions that are always wired
+ @param size the buffer size in bytes, used only for the buffers not from the pool
+ @param offset,length the byte range to wire, clipped to the buffer
+ @comment May wait for disk reads: not to be called on the IO proc or main threads
+ */
+void AudioBufferPoolLockWindow(AudioBufferPool *pool, void *data, UInt64 size, UInt64 offset, UInt64 length);
+
+/** AudioBufferPoolCancelPrefault
+ Stops the faulting in of a buffer not from the pool in progress, at its next page
+ @comment Does not wait: to be called before releasing such a buffer from the main thread
+ */
+void AudioBufferPoolCancelPrefault(AudioBufferPool *pool);
+
+UInt64 AudioBufferPoolSizeClass(UInt64 size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
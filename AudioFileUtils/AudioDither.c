@@ -0,0 +1,207 @@
+/*
+ AudioDither.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "AudioDither.h"
+
+#define kAudioDitherModeMask 0xFF
+
+/* Lipshitz 5 taps E-weighted error feedback filter, noise pushed above 15kHz at 44.1kHz */
+static const Float32 kShapingFilter[kAudioDitherShapingOrder] = { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f };
+
+/* Bound of the fed back error: keeps the shaping loop stable when the input clips */
+#define kShapingErrorLimit 2.0f
+
+static inline UInt32 xorshift32(UInt32 *state)
+{
+	UInt32 x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/* Uniform value in [-0.5,0.5[ LSB from the 24 upper bits of the generator output */
+static inline Float32 uniformDither(UInt32 *state)
+{
+	return (Float32)((SInt32)xorshift32(state) >> 8) * (1.0f/16777216.0f);
+}
+
+void AudioDitherInit(AudioDitherState *dither, UInt32 mode)
+{
+	UInt32 i;
+
+	dither->mode = mode;
+	//Any non zero seed is valid, each generator just needs its own sequence
+	for (i=0;i<4;i++)
+		dither->prngLanes[i] = 0x9E3779B9u * (i+1);
+	for (i=0;i<kAudioDitherMaxChannels;i++)
+		dither->prngChannels[i] = 0x85EBCA6Bu * (i+1) + 0x27D4EB2Fu;
+	AudioDitherReset(dither);
+}
+
+void AudioDitherReset(AudioDitherState *dither)
+{
+	memset(dither->shapingError, 0, sizeof(dither->shapingError));
+}
+
+bool AudioDitherIsNeeded(const AudioDitherState *dither, UInt32 targetBits)
+{
+	if ((dither->mode & kAudioDitherModeMask) == kAudioNoDithering) return false;
+	if ((targetBits == 0) || (targetBits >= 32)) return false;
+	if ((dither->mode & kAudioDither16bit) && (targetBits > 16)) return false;
+	return true;
+}
+
+#pragma mark Scalar kernel
+
+/* One sample requantization, in LSB units of the target format. Returns the rounded and clipped value */
+static inline Float64 requantizeSample(AudioDitherState *dither, UInt32 mode, UInt32 channel, Float64 value, Float64 maxValue)
+{
+	Float64 outValue;
+
+	switch (mode) {
+		case kAudioDitheringLinear:
+			outValue = floor(value + uniformDither(&dither->prngChannels[channel]) + 0.5);
+			break;
+
+		case kAudioDitheringTriangle:
+			outValue = floor(value + uniformDither(&dither->prngChannels[channel])
+							 + uniformDither(&dither->prngChannels[channel]) + 0.5);
+			break;
+
+		case kAudioDitheringNoiseShaping:
+		{
+			Float32 *error = dither->shapingError[channel];
+			Float32 newError;
+			int k;
+
+			for (k=0;k<kAudioDitherShapingOrder;k++)
+				value -= kShapingFilter[k] * error[k];
+			outValue = floor(value + uniformDither(&dither->prngChannels[channel])
+							 + uniformDither(&dither->prngChannels[channel]) + 0.5);
+
+			newError = (Float32)(outValue - value);
+			if (newError > kShapingErrorLimit) newError = kShapingErrorLimit;
+			else if (newError < -kShapingErrorLimit) newError = -kShapingErrorLimit;
+			for (k=kAudioDitherShapingOrder-1;k>0;k--)
+				error[k] = error[k-1];
+			error[0] = newError;
+		}
+			break;
+
+		default:
+			outValue = floor(value + 0.5);
+			break;
+	}
+
+	if (outValue > (maxValue - 1.0)) outValue = maxValue - 1.0;
+	else if (outValue < -maxValue) outValue = -maxValue;
+	return outValue;
+}
+
+#pragma mark SSE2 kernel
+
+#ifdef __SSE2__
+static inline __m128i xorshift32x4(__m128i x)
+{
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+/* Rectangular and triangular dithers, 4 samples per iteration
+ The dither being independent from one sample to the next, the frames layout does not matter
+ @return the number of samples processed, the remaining ones (less than 4) being left to the scalar kernel */
+static UInt32 requantizeFloat32SSE2(AudioDitherState *dither, Float32 *samples, UInt32 nbSamples, Float32 maxValue, bool isTriangle)
+{
+	__m128i lanes = _mm_loadu_si128((__m128i*)dither->prngLanes);
+	const __m128 scale = _mm_set1_ps(maxValue);
+	const __m128 invScale = _mm_set1_ps(1.0f/maxValue);
+	const __m128 lowLimit = _mm_set1_ps(-maxValue);
+	const __m128 highLimit = _mm_set1_ps(maxValue - 1.0f);
+	const __m128 ditherUnit = _mm_set1_ps(1.0f/16777216.0f);
+	__m128 value,noise;
+	UInt32 i;
+
+	for (i=0;(i+4)<=nbSamples;i+=4) {
+		value = _mm_mul_ps(_mm_loadu_ps(samples+i), scale);
+
+		lanes = xorshift32x4(lanes);
+		noise = _mm_cvtepi32_ps(_mm_srai_epi32(lanes, 8));
+		if (isTriangle) {
+			lanes = xorshift32x4(lanes);
+			noise = _mm_add_ps(noise, _mm_cvtepi32_ps(_mm_srai_epi32(lanes, 8)));
+		}
+		value = _mm_add_ps(value, _mm_mul_ps(noise, ditherUnit));
+
+		//Round to nearest with the default MXCSR mode, after clipping to the integer range
+		value = _mm_min_ps(_mm_max_ps(value, lowLimit), highLimit);
+		value = _mm_cvtepi32_ps(_mm_cvtps_epi32(value));
+		_mm_storeu_ps(samples+i, _mm_mul_ps(value, invScale));
+	}
+
+	_mm_storeu_si128((__m128i*)dither->prngLanes, lanes);
+	return i;
+}
+#endif
+
+#pragma mark Public kernels
+
+void AudioDitherRequantizeFloat32(AudioDitherState *dither, Float32 *samples, UInt32 nbFrames, UInt32 channels, UInt32 targetBits)
+{
+	UInt32 mode = dither->mode & kAudioDitherModeMask;
+	UInt32 nbSamples = nbFrames * channels;
+	Float64 maxValue = ldexp(1.0, targetBits - 1);
+	UInt32 i = 0;
+
+	if (!AudioDitherIsNeeded(dither, targetBits) || (channels > kAudioDitherMaxChannels)) return;
+
+#ifdef __SSE2__
+	//Noise shaping is a recursion on each channel samples: it stays on the scalar kernel
+	if ((mode == kAudioDitheringLinear) || (mode == kAudioDitheringTriangle))
+		i = requantizeFloat32SSE2(dither, samples, nbSamples, (Float32)maxValue, mode == kAudioDitheringTriangle);
+#endif
+
+	for (;i<nbSamples;i++)
+		samples[i] = (Float32)(requantizeSample(dither, mode, i % channels, samples[i] * maxValue, maxValue) / maxValue);
+}
+
+void AudioDitherRequantizeFloat64(AudioDitherState *dither, Float64 *samples, UInt32 nbFrames, UInt32 channels, UInt32 targetBits)
+{
+	UInt32 mode = dither->mode & kAudioDitherModeMask;
+	UInt32 nbSamples = nbFrames * channels;
+	Float64 maxValue = ldexp(1.0, targetBits - 1);
+	UInt32 i;
+
+	if (!AudioDitherIsNeeded(dither, targetBits) || (channels > kAudioDitherMaxChannels)) return;
+
+	for (i=0;i<nbSamples;i++)
+		samples[i] = requantizeSample(dither, mode, i % channels, samples[i] * maxValue, maxValue) / maxValue;
+}
@@ -0,0 +1,99 @@
+/*
+ AudioDither.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIODITHER_H__
+#define __AUDIODITHER_H__
+
+#include <stdbool.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Dithering modes
+ */
+enum
+{
+	kAudioNoDithering = 0,
+	kAudioDitheringLinear = 1, //Rectangular PDF dither, 1 LSB peak to peak
+	kAudioDitheringTriangle = 2, //Triangular PDF dither, 2 LSB peak to peak
+	kAudioDitheringNoiseShaping = 3, //Triangular PDF dither and error feedback pushing the noise out of the ear most sensitive band
+
+	kAudioDither16bit = 0x100 //Flag: dither only when requantizing to 16bit, the 24bit noise floor being below the DACs one
+};
+
+#define kAudioDitherMaxChannels 8
+#define kAudioDitherShapingOrder 5
+
+/*
+ AudioDitherState
+ Requantization state of one decoded stream, owned by its loader
+ */
+typedef struct {
+	UInt32 mode; //kAudioDitheringXXX, kAudioDither16bit flag included
+	UInt32 prngLanes[4]; //xorshift generators of the SSE2 kernels, one per vector lane
+	UInt32 prngChannels[kAudioDitherMaxChannels]; //xorshift generators of the scalar kernels, one per channel
+	Float32 shapingError[kAudioDitherMaxChannels][kAudioDitherShapingOrder]; //Last requantization errors, most recent first
+} AudioDitherState;
+
+/** AudioDitherInit
+ Seeds the generators and clears the noise shaping history
+ @param dither the state to initialize
+ @param mode kAudioDitheringXXX mode, optionally or'ed with kAudioDither16bit
+ */
+void AudioDitherInit(AudioDitherState *dither, UInt32 mode);
+
+/** AudioDitherReset
+ Clears the noise shaping history, to be called when the decoding restarts at another position
+ */
+void AudioDitherReset(AudioDitherState *dither);
+
+/** AudioDitherIsNeeded
+ @param targetBits significant bits of the integer samples the float ones are to be converted to
+ @return true if the dithering mode requantizes the samples for this bit depth
+ @comment 32bit integer samples hold the whole float mantissa, and are never dithered
+ */
+bool AudioDitherIsNeeded(const AudioDitherState *dither, UInt32 targetBits);
+
+/** AudioDitherRequantizeFloat32
+ Dithers and rounds in place the interleaved float samples to the targetBits integer grid
+ @param samples interleaved samples, in the [-1.0,1.0[ range
+ @param nbFrames number of frames to requantize
+ @param channels number of channels of the frames, up to kAudioDitherMaxChannels
+ @param targetBits significant bits of the integer format the samples are then converted to
+ @comment The output values being exactly representable, the following float to integer conversion
+ (AudioConverter) is lossless. Clipped samples are saturated to the integer format range.
+ */
+void AudioDitherRequantizeFloat32(AudioDitherState *dither, Float32 *samples, UInt32 nbFrames, UInt32 channels, UInt32 targetBits);
+
+/** AudioDitherRequantizeFloat64
+ Same as AudioDitherRequantizeFloat32, for the double precision decoders output
+ */
+void AudioDitherRequantizeFloat64(AudioDitherState *dither, Float64 *samples, UInt32 nbFrames, UInt32 channels, UInt32 targetBits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
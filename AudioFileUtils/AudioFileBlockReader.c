@@ -0,0 +1,350 @@
+/*
+ AudioFileBlockReader.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <sys/mount.h>
+#else
+#include <sys/vfs.h>
+#endif
+#include <dispatch/dispatch.h>
+
+#include "AudioFileBlockReader.h"
+
+#define kMaxMappedSize32bit (256*1024*1024) //Address space limit of the mapping in 32bit processes
+
+static AudioFileBlockReaderReadProc gReadProc = pread;
+
+enum
+{
+	kBlockEmpty = 0,
+	kBlockLoading = 1,
+	kBlockReady = 2,
+	kBlockError = 3
+};
+
+typedef struct {
+	AudioFileBlockReader *reader;
+	void *data;
+	SInt64 offset; //File offset of the block, multiple of the block size
+	SInt64 length; //Bytes read, less than the block size only for the last block of the file
+	int state;
+} BlockReaderBlock;
+
+struct AudioFileBlockReader {
+	int fd;
+	SInt64 fileLength;
+	SInt64 position;
+	void *mappedData; //Whole file mapping, NULL when reading by blocks
+	BlockReaderBlock blocks[kAudioFileBlockReaderBlocks];
+	int pendingLoads;
+	pthread_mutex_t lock;
+	pthread_cond_t blockLoaded;
+	dispatch_queue_t ioQueue;
+};
+
+#pragma mark I/O queue
+
+static void loadBlock(void *context)
+{
+	BlockReaderBlock *block = (BlockReaderBlock*)context;
+	AudioFileBlockReader *reader = block->reader;
+	SInt64 bytesRead = 0;
+	ssize_t readResult = 0;
+
+	//Hint the file system (and network redirector) about the next block
+	if ((block->offset + kAudioFileBlockReaderBlockSize) < reader->fileLength) {
+#ifdef F_RDADVISE
+		struct radvisory advisory;
+		advisory.ra_offset = (off_t)(block->offset + kAudioFileBlockReaderBlockSize);
+		advisory.ra_count = kAudioFileBlockReaderBlockSize;
+		fcntl(reader->fd, F_RDADVISE, &advisory);
+#else
+		posix_fadvise(reader->fd, (off_t)(block->offset + kAudioFileBlockReaderBlockSize), kAudioFileBlockReaderBlockSize,
+					  POSIX_FADV_WILLNEED);
+#endif
+	}
+
+	while (bytesRead < kAudioFileBlockReaderBlockSize) {
+		readResult = gReadProc(reader->fd, (UInt8*)block->data + bytesRead,
+						   (size_t)(kAudioFileBlockReaderBlockSize - bytesRead), (off_t)(block->offset + bytesRead));
+		if (readResult <= 0) break;
+		bytesRead += readResult;
+	}
+
+	pthread_mutex_lock(&reader->lock);
+	block->length = bytesRead;
+	block->state = (readResult < 0) ? kBlockError : kBlockReady;
+	reader->pendingLoads--;
+	pthread_cond_broadcast(&reader->blockLoaded);
+	pthread_mutex_unlock(&reader->lock);
+}
+
+/* @return true if the file is on a local volume, the network shares being read by blocks */
+static bool isOnLocalVolume(int fd)
+{
+	struct statfs volumeStat;
+
+	if (fstatfs(fd, &volumeStat) != 0) return false;
+#ifdef __APPLE__
+	return (volumeStat.f_flags & MNT_LOCAL) != 0;
+#else
+	switch ((UInt32)volumeStat.f_type) {
+		case 0x6969: //NFS
+		case 0x517B: //SMB
+		case 0xFF534D42: //CIFS
+		case 0xFE534D42: //SMB2
+		case 0x65735546: //FUSE
+			return false;
+		default:
+			return true;
+	}
+#endif
+}
+
+#pragma mark Blocks management
+
+/* Must be called with the lock held */
+static BlockReaderBlock* findBlock(AudioFileBlockReader *reader, SInt64 blockOffset)
+{
+	int i;
+
+	for (i=0;i<kAudioFileBlockReaderBlocks;i++)
+		if ((reader->blocks[i].state != kBlockEmpty) && (reader->blocks[i].offset == blockOffset))
+			return &reader->blocks[i];
+	return NULL;
+}
+
+/* Starts the load of a block, reusing the one the farthest from the read position
+ Must be called with the lock held
+ @return the loading block, NULL if all the blocks are loading */
+static BlockReaderBlock* requestBlock(AudioFileBlockReader *reader, SInt64 blockOffset, SInt64 readBlockOffset)
+{
+	BlockReaderBlock *victim = NULL;
+	SInt64 distance, maxDistance = -1;
+	int i;
+
+	for (i=0;i<kAudioFileBlockReaderBlocks;i++) {
+		BlockReaderBlock *block = &reader->blocks[i];
+
+		if (block->state == kBlockLoading) continue;
+		if (block->state == kBlockEmpty) { victim = block; break; }
+		if (block->offset == readBlockOffset) continue; //Block being read
+
+		//Already read blocks first, then the farthest ahead
+		distance = (block->offset > readBlockOffset) ? block->offset - readBlockOffset
+													 : readBlockOffset - block->offset + reader->fileLength;
+		if (distance > maxDistance) {
+			maxDistance = distance;
+			victim = block;
+		}
+	}
+	if (victim == NULL) return NULL;
+
+	victim->offset = blockOffset;
+	victim->length = 0;
+	victim->state = kBlockLoading;
+	reader->pendingLoads++;
+	dispatch_async_f(reader->ioQueue, victim, loadBlock);
+	return victim;
+}
+
+#pragma mark Public functions
+
+AudioFileBlockReader* AudioFileBlockReaderOpen(const char *path, UInt32 options)
+{
+	AudioFileBlockReader *reader;
+	struct stat fileStat;
+	int i;
+
+	if (path == NULL) return NULL;
+
+	reader = (AudioFileBlockReader*)calloc(1, sizeof(AudioFileBlockReader));
+	if (reader == NULL) return NULL;
+
+	reader->fd = open(path, O_RDONLY);
+	if ((reader->fd < 0) || (fstat(reader->fd, &fileStat) != 0)) {
+		if (reader->fd >= 0) close(reader->fd);
+		free(reader);
+		return NULL;
+	}
+	reader->fileLength = fileStat.st_size;
+	reader->position = 0;
+
+	//Local files: let the VM pager do the read-ahead
+	if ((options & kAudioFileBlockReaderAllowMapping) && (reader->fileLength > 0)
+		&& ((sizeof(void*) == 8) || (reader->fileLength <= kMaxMappedSize32bit))
+		&& isOnLocalVolume(reader->fd)) {
+		reader->mappedData = mmap(NULL, (size_t)reader->fileLength, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+		if (reader->mappedData == MAP_FAILED)
+			reader->mappedData = NULL;
+		else {
+			madvise(reader->mappedData, (size_t)reader->fileLength, MADV_SEQUENTIAL);
+			return reader;
+		}
+	}
+
+	//Network and large files: aligned block reads, not polluting the unified buffer cache
+#ifdef F_NOCACHE
+	fcntl(reader->fd, F_NOCACHE, 1);
+#endif
+	pthread_mutex_init(&reader->lock, NULL);
+	pthread_cond_init(&reader->blockLoaded, NULL);
+	reader->ioQueue = dispatch_queue_create("fr.dplisson.audirvana.blockReader", NULL);
+	for (i=0;i<kAudioFileBlockReaderBlocks;i++) {
+		reader->blocks[i].reader = reader;
+		reader->blocks[i].state = kBlockEmpty;
+		if (posix_memalign(&reader->blocks[i].data, getpagesize(), kAudioFileBlockReaderBlockSize) != 0) {
+			reader->blocks[i].data = NULL;
+			AudioFileBlockReaderClose(reader);
+			return NULL;
+		}
+	}
+	return reader;
+}
+
+void AudioFileBlockReaderClose(AudioFileBlockReader *reader)
+{
+	int i;
+
+	if (reader == NULL) return;
+
+	if (reader->mappedData)
+		munmap(reader->mappedData, (size_t)reader->fileLength);
+	else {
+		pthread_mutex_lock(&reader->lock);
+		while (reader->pendingLoads > 0)
+			pthread_cond_wait(&reader->blockLoaded, &reader->lock);
+		pthread_mutex_unlock(&reader->lock);
+
+		dispatch_release(reader->ioQueue);
+		pthread_cond_destroy(&reader->blockLoaded);
+		pthread_mutex_destroy(&reader->lock);
+		for (i=0;i<kAudioFileBlockReaderBlocks;i++)
+			free(reader->blocks[i].data);
+	}
+
+	close(reader->fd);
+	free(reader);
+}
+
+SInt64 AudioFileBlockReaderRead(AudioFileBlockReader *reader, void *buffer, SInt64 size)
+{
+	SInt64 bytesCopied = 0, blockOffset, copySize, nextOffset;
+	BlockReaderBlock *block;
+	int i;
+
+	if (reader->position >= reader->fileLength) return 0;
+	if (size > (reader->fileLength - reader->position))
+		size = reader->fileLength - reader->position;
+
+	if (reader->mappedData) {
+		memcpy(buffer, (UInt8*)reader->mappedData + reader->position, (size_t)size);
+		reader->position += size;
+		return size;
+	}
+
+	pthread_mutex_lock(&reader->lock);
+	while (bytesCopied < size) {
+		blockOffset = reader->position & ~((SInt64)kAudioFileBlockReaderBlockSize - 1);
+
+		block = findBlock(reader, blockOffset);
+		while ((block == NULL) && ((block = requestBlock(reader, blockOffset, blockOffset)) == NULL))
+			pthread_cond_wait(&reader->blockLoaded, &reader->lock); //All blocks loading: wait for one to be reusable
+
+		//Keep the next blocks loading while this one is consumed
+		for (i=1;i<kAudioFileBlockReaderBlocks;i++) {
+			nextOffset = blockOffset + i*(SInt64)kAudioFileBlockReaderBlockSize;
+			if ((nextOffset < reader->fileLength) && (findBlock(reader, nextOffset) == NULL))
+				requestBlock(reader, nextOffset, blockOffset);
+		}
+
+		while (block->state == kBlockLoading)
+			pthread_cond_wait(&reader->blockLoaded, &reader->lock);
+
+		if (block->state == kBlockError) {
+			block->state = kBlockEmpty; //Retried at the next read
+			pthread_mutex_unlock(&reader->lock);
+			return (bytesCopied > 0) ? bytesCopied : -1;
+		}
+
+		copySize = block->offset + block->length - reader->position;
+		if (copySize <= 0) break; //File truncated since opened
+		if (copySize > (size - bytesCopied)) copySize = size - bytesCopied;
+
+		memcpy((UInt8*)buffer + bytesCopied, (UInt8*)block->data + (reader->position - block->offset), (size_t)copySize);
+		bytesCopied += copySize;
+		reader->position += copySize;
+	}
+	pthread_mutex_unlock(&reader->lock);
+
+	return bytesCopied;
+}
+
+SInt64 AudioFileBlockReaderSeek(AudioFileBlockReader *reader, SInt64 offset, int whence)
+{
+	SInt64 newPosition;
+
+	switch (whence) {
+		case SEEK_CUR:
+			newPosition = reader->position + offset;
+			break;
+		case SEEK_END:
+			newPosition = reader->fileLength + offset;
+			break;
+		case SEEK_SET:
+		default:
+			newPosition = offset;
+			break;
+	}
+	if ((newPosition < 0) || (newPosition > reader->fileLength)) return -1;
+
+	reader->position = newPosition;
+	return newPosition;
+}
+
+void AudioFileBlockReaderSetReadProc(AudioFileBlockReaderReadProc readProc)
+{
+	gReadProc = readProc ? readProc : pread;
+}
+
+SInt64 AudioFileBlockReaderTell(AudioFileBlockReader *reader)
+{
+	return reader->position;
+}
+
+SInt64 AudioFileBlockReaderLength(AudioFileBlockReader *reader)
+{
+	return reader->fileLength;
+}
+
+bool AudioFileBlockReaderIsAtEnd(AudioFileBlockReader *reader)
+{
+	return (reader->position >= reader->fileLength);
+}
@@ -0,0 +1,101 @@
+/*
+ AudioFileBlockReader.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOFILEBLOCKREADER_H__
+#define __AUDIOFILEBLOCKREADER_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioFileBlockReaderBlockSize (2*1024*1024) //Size and alignment of the reads issued to the file system
+#define kAudioFileBlockReaderBlocks 3 //The block being read and the two next ones being prefetched
+
+/*
+ Open options
+ */
+enum
+{
+	kAudioFileBlockReaderAllowMapping = 1 //Files on local volumes are memory mapped instead of read by blocks
+};
+
+/*
+ AudioFileBlockReader
+ Sequential file reader for the decoders: large aligned reads, prefetched ahead of the read position on a dedicated
+ I/O queue. Replaces the small stdio reads of the decoding libraries, which perform poorly over network shares.
+ One reader has a single consumer thread
+ */
+typedef struct AudioFileBlockReader AudioFileBlockReader;
+
+/** AudioFileBlockReaderOpen
+ @param path the file to read
+ @param options kAudioFileBlockReaderXXX flags
+ @return the reader, NULL if the file can't be opened
+ */
+AudioFileBlockReader* AudioFileBlockReaderOpen(const char *path, UInt32 options);
+
+/** AudioFileBlockReaderClose
+ Waits for the prefetching in progress, closes the file and frees the reader
+ */
+void AudioFileBlockReaderClose(AudioFileBlockReader *reader);
+
+/** AudioFileBlockReaderRead
+ @param buffer the destination of the bytes read
+ @param size number of bytes to read
+ @return the number of bytes read, less than size only at the end of the file. -1 on read error
+ */
+SInt64 AudioFileBlockReaderRead(AudioFileBlockReader *reader, void *buffer, SInt64 size);
+
+/** AudioFileBlockReaderSeek
+ @param offset the new position, relative to whence
+ @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ @return the new position, -1 if out of the file
+ */
+SInt64 AudioFileBlockReaderSeek(AudioFileBlockReader *reader, SInt64 offset, int whence);
+
+/*
+ AudioFileBlockReaderReadProc
+ Reads of the blocks, pread semantics
+ */
+typedef ssize_t (*AudioFileBlockReaderReadProc)(int fd, void *buffer, size_t size, off_t offset);
+
+/** AudioFileBlockReaderSetReadProc
+ Replaces pread for the reads by blocks of all the readers, e.g. by a throttled one standing in for a network share
+ in the benchmarks
+ @param readProc the read function, NULL to restore pread
+ @comment To be called when no reader is open
+ */
+void AudioFileBlockReaderSetReadProc(AudioFileBlockReaderReadProc readProc);
+
+SInt64 AudioFileBlockReaderTell(AudioFileBlockReader *reader);
+SInt64 AudioFileBlockReaderLength(AudioFileBlockReader *reader);
+bool AudioFileBlockReaderIsAtEnd(AudioFileBlockReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -36,6 +36,10 @@
 #define TMP_SRC_BUFFER_SIZE 4096
 #define LIBSRC_OUTPUTBUF_SECONDS 5
 
+/* Default WAVE_FORMAT_EXTENSIBLE channel masks by channels count, up to 7.1: the channel order of the WAV and FLAC
+ decoders. CoreAudio channel bitmaps use the same speaker position bits */
+static const UInt32 waveChannelBitmaps[] = { 0, 0x4, 0x3, 0x7, 0x33, 0x37, 0x3F, 0x70F, 0x63F };
+
 @interface AudioFileCoreAudioLoader (mp4Metadata)
 - (bool)getMp4Metadata:(NSURL*)fileURL;
 - (bool)getMp3Metadata:(NSURL*)fileURL;
@@ -51,6 +55,50 @@ static long sampleRateCallBack(void *cb_data, float **data)
 	return [coreAudioFileLoader readSRCdata:data];
 }
 
+#pragma mark Metadata helpers
+
+/* Fills a metadata dictionary from the tag of MP4 files
+ The cover art is read only if requested */
+static void addMp4Tags(NSMutableDictionary *fileMetadata, TagLib::MP4::Tag *tag, bool withCoverArt)
+{
+	TagLib::String str;
+	TagLib::uint trackNumber;
+
+	str = tag->title();
+	if (!str.isNull())
+		[fileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
+	str = tag->artist();
+	if (!str.isNull())
+		[fileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
+	str = tag->album();
+	if (!str.isNull())
+		[fileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
+
+	trackNumber = tag->track();
+	if (trackNumber != 0)
+		[fileMetadata setObject:[NSNumber numberWithInt:trackNumber]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
+
+	if (!tag->itemListMap().isEmpty() && tag->itemListMap().contains("\251wrt")) {
+		[fileMetadata setObject:[NSString stringWithUTF8String:tag->itemListMap()["\251wrt"].toStringList().toString().toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
+	}
+
+	if (withCoverArt && !tag->itemListMap().isEmpty() && tag->itemListMap().contains("covr")) {
+		TagLib::MP4::CoverArtList coverartlist = tag->itemListMap()["covr"].toCoverArtList();
+		if (!coverartlist.isEmpty()) {
+			AudioFileCoverArt *albumArt = [[AudioFileCoverArtCache sharedCache] coverArtWithBytes:coverartlist.front().data().data()
+																						  length:coverartlist.front().data().size()];
+			if(albumArt)
+				[fileMetadata setObject:albumArt
+								 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
+		}
+	}
+}
+
 @implementation AudioFileCoreAudioLoader
 
 
@@ -80,6 +128,52 @@ static long sampleRateCallBack(void *cb_data, float **data)
 }
 
 
++ (NSDictionary*)probeMetadata:(NSURL*)fileURL
+{
+	NSMutableDictionary *fileMetadata = nil;
+	NSDictionary *infoDictionary = nil;
+	NSString *fileExtension;
+	AudioFileID audioFileID;
+	AudioStreamBasicDescription dataFormat;
+	Float64 duration = 0.0;
+	UInt32 propertySize;
+
+	//AudioFile only parses the file header, the packet tables and the decoder are left untouched
+	if (AudioFileOpenURL((CFURLRef)fileURL, kAudioFileReadPermission, 0, &audioFileID) != noErr)
+		return nil;
+
+	propertySize = sizeof(CFDictionaryRef);
+	if ((AudioFileGetProperty(audioFileID, kAudioFilePropertyInfoDictionary, &propertySize, &infoDictionary) == noErr)
+		&& infoDictionary) {
+		fileMetadata = [NSMutableDictionary dictionaryWithDictionary:infoDictionary];
+		CFRelease((CFDictionaryRef)infoDictionary);
+	}
+	else fileMetadata = [NSMutableDictionary dictionaryWithCapacity:6];
+
+	propertySize = sizeof(Float64);
+	if (AudioFileGetProperty(audioFileID, kAudioFilePropertyEstimatedDuration, &propertySize, &duration) == noErr)
+		[fileMetadata setObject:[NSNumber numberWithFloat:(float)duration]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_ApproximateDurationInSeconds]];
+	propertySize = sizeof(AudioStreamBasicDescription);
+	if ((AudioFileGetProperty(audioFileID, kAudioFilePropertyDataFormat, &propertySize, &dataFormat) == noErr)
+		&& (dataFormat.mSampleRate > 0))
+		[fileMetadata setObject:[NSNumber numberWithDouble:dataFormat.mSampleRate]
+						 forKey:[NSString stringWithUTF8String: kAudioFileLoaderInfo_NativeSampleRate]];
+	AudioFileClose(audioFileID);
+
+	fileExtension = [[fileURL pathExtension] lowercaseString];
+	if (([fileExtension isEqualToString:@"mp4"]) || ([fileExtension isEqualToString:@"m4a"])) {
+		const char *filePathStr = [[fileURL path] fileSystemRepresentation];
+		if (filePathStr) {
+			TagLib::MP4::File mp4file(filePathStr, false);
+			if (mp4file.isValid() && mp4file.tag())
+				addMp4Tags(fileMetadata, mp4file.tag(), false);
+		}
+	}
+
+	return fileMetadata;
+}
+
 - (id)initWithURL:(NSURL*)urlToOpen
 {
 	OSStatus err;
@@ -130,7 +224,7 @@ static long sampleRateCallBack(void *cb_data, float **data)
 
 	mNativeSampleRate = mInputStreamFormat.mSampleRate;
 
-	mChannels = 2; //TODO: Implement multi-channel
+	mChannels = mInputStreamFormat.mChannelsPerFrame;
 
 	propertySize = sizeof(SInt64);
 	ExtAudioFileGetProperty(mInputFileRef, kExtAudioFileProperty_FileLengthFrames, &propertySize, &mLengthFrames);
@@ -171,7 +265,7 @@ static long sampleRateCallBack(void *cb_data, float **data)
 	UInt32 framesRead = TMP_SRC_BUFFER_SIZE;
 
 	readData.mNumberBuffers = 1;
-	readData.mBuffers[0].mNumberChannels = 2;
+	readData.mBuffers[0].mNumberChannels = mOutputChannels;
 	readData.mBuffers[0].mData = mTmpSRCdata;
 	readData.mBuffers[0].mDataByteSize = (UInt32)(framesRead*readData.mBuffers[0].mNumberChannels*sizeof(Float32)); //libSampleRate expects 32bit float data
 
@@ -194,14 +288,14 @@ static long sampleRateCallBack(void *cb_data, float **data)
 	AudioConverterRef audioConverter;
 	UInt32 propertySize,tmpInt;
 
-	if (mIsUsingSRC && (mSRCModel == kAUDSRCModelSRClibSampleRate)) {
+	if (mIsUsingSRC && ((mSRCModel == kAUDSRCModelSRClibSampleRate) || (mSRCModel == kAUDSRCModelPolyphaseFIR))) {
 		AudioStreamBasicDescription CAoutputFormat;
 
 		CAoutputFormat.mFormatID = kAudioFormatLinearPCM;
 		CAoutputFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 		CAoutputFormat.mBitsPerChannel = 32;
 		CAoutputFormat.mSampleRate = mNativeSampleRate;
-		CAoutputFormat.mChannelsPerFrame = 2;
+		CAoutputFormat.mChannelsPerFrame = mOutputChannels;
 		CAoutputFormat.mBytesPerPacket = CAoutputFormat.mChannelsPerFrame * (CAoutputFormat.mBitsPerChannel / 8);
 		CAoutputFormat.mFramesPerPacket = 1;
 		CAoutputFormat.mBytesPerFrame = CAoutputFormat.mBytesPerPacket;
@@ -213,19 +307,25 @@ static long sampleRateCallBack(void *cb_data, float **data)
 	}
 
 
-	propertySize = sizeof(AudioChannelLayout);
-	err = ExtAudioFileGetProperty(mInputFileRef, kExtAudioFileProperty_FileChannelLayout, &propertySize, &outLayout);
-	outLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Stereo;
+	//Decoded channels in the order of the other decoders, stereo pair first: the ExtAudioFile converter reorders
+	//the file channels (e.g. AAC center first) by speaker position, and downmixes the ones beyond the output channels
+	memset(&outLayout, 0, sizeof(AudioChannelLayout));
+	if ((mOutputChannels > 2) && (mOutputChannels < (int)(sizeof(waveChannelBitmaps)/sizeof(waveChannelBitmaps[0])))) {
+		outLayout.mChannelLayoutTag = kAudioChannelLayoutTag_UseChannelBitmap;
+		outLayout.mChannelBitmap = waveChannelBitmaps[mOutputChannels];
+	}
+	else outLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Stereo;
 	err = ExtAudioFileSetProperty(mInputFileRef, kExtAudioFileProperty_ClientChannelLayout, sizeof(AudioChannelLayout), &outLayout);
 
 	if (mIsUsingSRC) {
 		switch (mSRCModel) {
+			case kAUDSRCModelPolyphaseFIR:
 			case kAUDSRCModelSRClibSampleRate:
 			{
 				int srcError;
-				mLibSrcState = src_callback_new(&sampleRateCallBack, mSRCQuality, 2, &srcError, self);
-				if (mLibSrcState == NULL) return srcError;
-				mTmpSRCdata = (Float32*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float32)*2);
+				srcError = [self newFloatSRC:&sampleRateCallBack channels:mOutputChannels libSrcState:&mLibSrcState];
+				if (srcError != 0) return srcError;
+				mTmpSRCdata = (Float32*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float32)*mOutputChannels);
 
 				if (mIsIntegerModeOn) {
 					AudioStreamBasicDescription inStreamFormat;
@@ -236,7 +336,7 @@ static long sampleRateCallBack(void *cb_data, float **data)
 					inStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 					inStreamFormat.mBitsPerChannel = 32;
 					inStreamFormat.mSampleRate = mTargetSampleRate;
-					inStreamFormat.mChannelsPerFrame = 2;
+					inStreamFormat.mChannelsPerFrame = mOutputChannels;
 					inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 					inStreamFormat.mFramesPerPacket = 1;
 					inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
@@ -244,7 +344,7 @@ static long sampleRateCallBack(void *cb_data, float **data)
 					err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
 					if (err != noErr) return -1;
 
-					mTmplibSampleRateOutBuf = (Float32*)malloc((size_t)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate * sizeof(Float32) * 2)); //Output of libSampleRate is Float32
+					mTmplibSampleRateOutBuf = (Float32*)malloc((size_t)([self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)] * sizeof(Float32) * mOutputChannels)); //Output of libSampleRate is Float32
 				}
 			}
 				break;
@@ -298,8 +398,19 @@ NextInputPosition:(SInt64*)nextInputPosition
 	OSStatus err=noErr;
 	__block bool loadWholeFile;
 
+	if (mStreamingRing) {
+		*outBufferData = NULL;
+		*outBufferDataSize = 0;
+		return [self streamChunk:startInputPosition
+				  NumTotalFrames:numTotalFrames
+				 NumLoadedFrames:numLoadedFrames
+						  Status:status
+			   NextInputPosition:nextInputPosition
+					   ForBuffer:bufIdx];
+	}
+
 	//Get uncompressed file size
-	sizeInBytes = mLengthFrames * mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate; //TODO: allow multiple channels
+	sizeInBytes = mLengthFrames * mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate;
     sizeInBytes -= startInputPosition * mOutputStreamFormat.mBytesPerFrame;
 
 	if (maxBufSize > INT32_MAX) maxBufSize = INT32_MAX;
@@ -314,10 +425,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 	*numTotalFrames = sizeInBytes / mOutputStreamFormat.mBytesPerFrame;
 	*numLoadedFrames = 0;
 
-	kern_return_t theKernelError = vm_allocate(mach_task_self(),
-											   (vm_address_t*)outBufferData,
-											   (vm_size_t)sizeInBytes,
-											   VM_FLAGS_ANYWHERE);
+	kern_return_t theKernelError = [self allocateBuffer:outBufferData size:sizeInBytes];
 
 	if (theKernelError != KERN_SUCCESS) {
 		*status = 0;
@@ -328,14 +436,13 @@ NextInputPosition:(SInt64*)nextInputPosition
 	*outBufferDataSize = sizeInBytes;
 
 	//Check if need to seek the file read position
-	if (startInputPosition != mNextFrameToLoadPosition) {
-		ExtAudioFileSeek(mInputFileRef, (SInt64)(startInputPosition*mNativeSampleRate/mTargetSampleRate));
-	}
+	if (startInputPosition != mNextFrameToLoadPosition)
+		[self seekDecoderTo:startInputPosition];
 
 	*status = (loadWholeFile?kAudioFileLoaderStatusEOF:0) | kAudioFileLoaderStatusLoading;
 	mIsMakingBackgroundTask |= kAudioFileLoaderLoadingBuffer;
 
-	if (mIsUsingSRC && (mSRCModel == kAUDSRCModelSRClibSampleRate)) {
+	if (mIsUsingSRC && ((mSRCModel == kAUDSRCModelSRClibSampleRate) || (mSRCModel == kAUDSRCModelPolyphaseFIR))) {
 		dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
 			long readStep = (long)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate);
 			long framesRead;
@@ -348,25 +455,18 @@ NextInputPosition:(SInt64*)nextInputPosition
 					readStep = (long)(*numTotalFrames - *numLoadedFrames);
 
 				if (mIsIntegerModeOn) {
-					UInt32 bytesConverted;
-
-					framesRead = src_callback_read(mLibSrcState, mTargetSampleRate / mNativeSampleRate,
-												   readStep , mTmplibSampleRateOutBuf);
+					framesRead = [self readFloatSRC:mLibSrcState frames:readStep to:mTmplibSampleRateOutBuf];
 
 					if (framesRead > 0) {
-						bytesConverted = (UInt32)(framesRead*mOutputStreamFormat.mBytesPerFrame);
-						err = AudioConverterConvertBuffer(mCoreAudioConverterRef, (UInt32)(framesRead * sizeof(Float32) * 2),
-													mTmplibSampleRateOutBuf, &bytesConverted,
-													((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame));
-						framesRead = bytesConverted / mOutputStreamFormat.mBytesPerFrame;
-
-						if ((err == noErr) && (mIntModeAlignedLowZeroBits > 0))
-							[self alignAudioBufferFromHighToLow:(UInt32*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame))
-												framesToConvert:framesRead];
+						AudioDitherRequantizeFloat32(&mDither, mTmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+						err = [self writeIntegerFrames:(UInt32)framesRead from:mTmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+													to:((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)
+											 converter:mCoreAudioConverterRef];
+						if (err != noErr) framesRead = 0;
 					}
 				}
-				else framesRead = src_callback_read(mLibSrcState, mTargetSampleRate / mNativeSampleRate,
-													readStep ,(float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)));
+				else framesRead = [self readFloatSRC:mLibSrcState frames:readStep
+													to:(float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame))];
 
 				if (framesRead <=0) break;
 				*numLoadedFrames += framesRead;
@@ -412,7 +512,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 			OSStatus readErr = noErr;
 
 			outData.mNumberBuffers = 1;
-			outData.mBuffers[0].mNumberChannels = 2;
+			outData.mBuffers[0].mNumberChannels = mOutputChannels;
 			outData.mBuffers[0].mData = *outBufferData;
 			outData.mBuffers[0].mDataByteSize = (UInt32)sizeInBytes;
 
@@ -470,6 +570,56 @@ NextInputPosition:(SInt64*)nextInputPosition
 	}
 }
 
+- (void)seekDecoderTo:(UInt64)startInputPosition
+{
+	ExtAudioFileSeek(mInputFileRef, (SInt64)(startInputPosition*mNativeSampleRate/mTargetSampleRate));
+	AudioDitherReset(&mDither);
+	if (mPolyphaseResampler)
+		AudioPolyphaseResamplerReset(mPolyphaseResampler);
+}
+
+- (SInt64)decodeFrames:(void*)outData maxFrames:(UInt32)maxFrames
+{
+	if (mIsUsingSRC && ((mSRCModel == kAUDSRCModelSRClibSampleRate) || (mSRCModel == kAUDSRCModelPolyphaseFIR))) {
+		long framesRead;
+
+		if (mIsIntegerModeOn) {
+			OSStatus err;
+
+			if (maxFrames > [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)])
+				maxFrames = [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)];
+
+			framesRead = [self readFloatSRC:mLibSrcState frames:maxFrames to:mTmplibSampleRateOutBuf];
+			if (framesRead <= 0) return framesRead;
+
+			AudioDitherRequantizeFloat32(&mDither, mTmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+			err = [self writeIntegerFrames:(UInt32)framesRead from:mTmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+										to:outData converter:mCoreAudioConverterRef];
+			if (err != noErr) return -1;
+		}
+		else framesRead = [self readFloatSRC:mLibSrcState frames:maxFrames to:(float*)outData];
+		return framesRead;
+	}
+	else {
+		UInt32 readStep = maxFrames;
+		AudioBufferList outBufList;
+		OSStatus err;
+
+		outBufList.mNumberBuffers = 1;
+		outBufList.mBuffers[0].mNumberChannels = mOutputChannels;
+		outBufList.mBuffers[0].mData = outData;
+		outBufList.mBuffers[0].mDataByteSize = maxFrames*mOutputStreamFormat.mBytesPerFrame;
+
+		err = ExtAudioFileRead(mInputFileRef, &readStep, &outBufList);
+		if (err != noErr) return -1;
+
+		if (mIntModeAlignedLowZeroBits > 0)
+			[self alignAudioBufferFromHighToLow:(UInt32*)outData framesToConvert:readStep];
+
+		return readStep;
+	}
+}
+
 using namespace std;
 
 -(bool)getMp4Metadata:(NSURL*)fileURL
@@ -479,46 +629,8 @@ using namespace std;
 
 	TagLib::MP4::File mp4file(filePathStr, false);
 
-	if (mp4file.isValid() && mp4file.tag() ) {
-		TagLib::MP4::Tag *tag = mp4file.tag();
-		TagLib::String str;
-		TagLib::uint trackNumber;
-
-		str = tag->title();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
-		str = tag->artist();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
-		str = tag->album();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
-
-		trackNumber = tag->track();
-		if (trackNumber != 0)
-			[mFileMetadata setObject:[NSNumber numberWithInt:trackNumber]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
-
-		if (!tag->itemListMap().isEmpty() && tag->itemListMap().contains("\251wrt")) {
-			[mFileMetadata setObject:[NSString stringWithUTF8String:tag->itemListMap()["\251wrt"].toStringList().toString().toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
-		}
-
-		if (!tag->itemListMap().isEmpty() && tag->itemListMap().contains("covr")) {
-			TagLib::MP4::CoverArtList coverartlist = tag->itemListMap()["covr"].toCoverArtList();
-			if (!coverartlist.isEmpty()) {
-				NSImage	*albumArt = [[NSImage alloc] initWithData:[NSData dataWithBytes:coverartlist.front().data().data() length:coverartlist.front().data().size()]];
-				if(albumArt) {
-					[mFileMetadata setObject:albumArt
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
-					[albumArt release];
-				}
-			}
-		}
-	}
+	if (mp4file.isValid() && mp4file.tag() )
+		addMp4Tags(mFileMetadata, mp4file.tag(), true);
 
 	return true;
 }
@@ -536,19 +648,16 @@ using namespace std;
 		if (!tag->frameListMap().isEmpty() && tag->frameListMap().contains("APIC")) {
 			TagLib::ID3v2::FrameList coverartList = tag->frameListMap()["APIC"];
 			if (!coverartList.isEmpty()) {
-				NSImage	*albumArt = nil;
+				AudioFileCoverArt *albumArt = nil;
 				for(TagLib::ID3v2::FrameList::Iterator coverartIter = coverartList.begin(); coverartIter != coverartList.end(); coverartIter++) {
 					TagLib::ID3v2::AttachedPictureFrame *coverart =  dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*coverartIter);
-					if (coverart && (!albumArt || (coverart->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover))) {
-						if (albumArt) [albumArt release];
-						albumArt = [[NSImage alloc] initWithData:[NSData dataWithBytes:coverart->picture().data() length:coverart->picture().size()]];
-					}
+					if (coverart && (!albumArt || (coverart->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover)))
+						albumArt = [[AudioFileCoverArtCache sharedCache] coverArtWithBytes:coverart->picture().data()
+																					length:coverart->picture().size()];
 				}
-				if (albumArt) {
+				if (albumArt)
 					[mFileMetadata setObject:albumArt
 									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
-					[albumArt release];
-				}
 			}
 		}
 	}
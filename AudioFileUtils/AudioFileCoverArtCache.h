@@ -0,0 +1,93 @@
+/*
+ AudioFileCoverArtCache.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOFILECOVERARTCACHE_H__
+#define __AUDIOFILECOVERARTCACHE_H__
+
+#include <dispatch/dispatch.h>
+#import <Cocoa/Cocoa.h>
+
+#define kAudioFileCoverArtThumbnailSize 512 //Max width or height in pixels of the displayed cover images
+
+/**
+ class AudioFileCoverArt
+ Compressed cover art image, shared by all the tracks of an album
+ The image is decoded, and downscaled to a thumbnail, only when first displayed
+ */
+@interface AudioFileCoverArt : NSObject
+{
+	NSData *mData;
+	NSImage *mThumbnail;
+}
+
+- (id)initWithData:(NSData*)data;
+
+/** image
+ @return the thumbnail of the cover art, decoded at the first call. nil if the data is not a valid image
+ */
+- (NSImage*)image;
+
+/** sizeInBytes
+ @return the memory used by the compressed data
+ */
+- (NSUInteger)sizeInBytes;
+@end
+
+
+/**
+ class AudioFileCoverArtCache
+ Thread safe cache of the cover arts, avoiding each track of an album to scan its folder and decode the same image
+ Folder covers are keyed by directory, embedded pictures by content hash.
+ Entries are released when the cache is over its size limit, the loaders keeping the ones they use.
+ */
+@interface AudioFileCoverArtCache : NSObject
+{
+	NSMutableDictionary *mFolderCovers; //Folder path => AudioFileCoverArt, or NSNull if the folder has no cover
+	NSMutableDictionary *mEmbeddedCovers; //Content hash => AudioFileCoverArt
+	NSMutableArray *mEntriesOrder; //Cache keys, least recently added first
+	NSUInteger mSizeInBytes;
+	NSUInteger mMaxSizeInBytes;
+	dispatch_queue_t mQueue; //Serial queue protecting the cache state
+}
+
++ (AudioFileCoverArtCache*)sharedCache;
+
+- (id)initWithMaxSize:(NSUInteger)maxSizeInBytes;
+
+/** coverArtForFolder
+ Looks for the album cover image of a folder: folder.jpg, cover.jpg, *Sleeve.png, or else the first jpg file
+ The folder is scanned only once, its result being kept in the cache
+ @param folderURL the folder of the audio file
+ @return the cover art, nil if the folder has none
+ */
+- (AudioFileCoverArt*)coverArtForFolder:(NSURL*)folderURL;
+
+/** coverArtWithBytes
+ Gets the shared cover art of a picture embedded in an audio file
+ @param bytes the compressed picture
+ @param length size of the picture
+ @return the cover art, a new one only if the picture is not already in the cache
+ */
+- (AudioFileCoverArt*)coverArtWithBytes:(const void*)bytes length:(NSUInteger)length;
+@end
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ AudioFileCoverArtCache.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#include <CommonCrypto/CommonDigest.h>
+#include <ApplicationServices/ApplicationServices.h>
+
+#import "AudioFileCoverArtCache.h"
+
+#define COVERART_CACHE_MAX_SIZE (32*1024*1024) //Compressed images kept by the shared cache
+
+@implementation AudioFileCoverArt
+
+- (id)initWithData:(NSData*)data
+{
+	mData = [data retain];
+	mThumbnail = nil;
+	return [super init];
+}
+
+- (void)dealloc
+{
+	[mData release];
+	[mThumbnail release];
+	[super dealloc];
+}
+
+- (NSImage*)image
+{
+	@synchronized(self) {
+		if (!mThumbnail && mData) {
+			//ImageIO decodes JPEG straight at the reduced size, and is thread safe unlike NSImage drawing
+			CGImageSourceRef imageSource = CGImageSourceCreateWithData((CFDataRef)mData, NULL);
+			NSDictionary *options = [NSDictionary dictionaryWithObjectsAndKeys:
+									 (id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailFromImageAlways,
+									 (id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailWithTransform,
+									 [NSNumber numberWithInt:kAudioFileCoverArtThumbnailSize], (id)kCGImageSourceThumbnailMaxPixelSize,
+									 nil];
+
+			if (imageSource) {
+				CGImageRef thumbnail = CGImageSourceCreateThumbnailAtIndex(imageSource, 0, (CFDictionaryRef)options);
+				if (thumbnail) {
+					mThumbnail = [[NSImage alloc] initWithCGImage:thumbnail
+															 size:NSMakeSize(CGImageGetWidth(thumbnail), CGImageGetHeight(thumbnail))];
+					CGImageRelease(thumbnail);
+				}
+				CFRelease(imageSource);
+			}
+
+			//Never decoded again, even if not valid
+			if (!mThumbnail) {
+				[mData release];
+				mData = nil;
+			}
+		}
+	}
+	return mThumbnail;
+}
+
+- (NSUInteger)sizeInBytes
+{
+	return [mData length];
+}
+
+@end
+
+
+@interface AudioFileCoverArtCache (PrivateMethods)
+- (void)addEntry:(AudioFileCoverArt*)coverArt forKey:(NSString*)key;
+@end
+
+@implementation AudioFileCoverArtCache
+
++ (AudioFileCoverArtCache*)sharedCache
+{
+	static AudioFileCoverArtCache *sharedCache = nil;
+	static dispatch_once_t onceToken;
+
+	dispatch_once(&onceToken, ^{
+		sharedCache = [[AudioFileCoverArtCache alloc] initWithMaxSize:COVERART_CACHE_MAX_SIZE];
+	});
+	return sharedCache;
+}
+
+- (id)initWithMaxSize:(NSUInteger)maxSizeInBytes
+{
+	mFolderCovers = [[NSMutableDictionary alloc] init];
+	mEmbeddedCovers = [[NSMutableDictionary alloc] init];
+	mEntriesOrder = [[NSMutableArray alloc] init];
+	mSizeInBytes = 0;
+	mMaxSizeInBytes = maxSizeInBytes;
+	mQueue = dispatch_queue_create("fr.dplisson.audirvana.coverArtCache", NULL);
+
+	return [super init];
+}
+
+- (void)dealloc
+{
+	if (mQueue) dispatch_release(mQueue);
+	[mFolderCovers release];
+	[mEmbeddedCovers release];
+	[mEntriesOrder release];
+	[super dealloc];
+}
+
+/* Must be called from the cache queue */
+- (void)addEntry:(AudioFileCoverArt*)coverArt forKey:(NSString*)key
+{
+	[mEntriesOrder addObject:key];
+	mSizeInBytes += [coverArt sizeInBytes];
+
+	//Evict the oldest entries. Folder scans without cover are kept, being only a path
+	while ((mSizeInBytes > mMaxSizeInBytes) && ([mEntriesOrder count] > 1)) {
+		NSString *oldestKey = [mEntriesOrder objectAtIndex:0];
+		AudioFileCoverArt *oldestEntry = [mFolderCovers objectForKey:oldestKey];
+
+		if (oldestEntry) {
+			mSizeInBytes -= [oldestEntry sizeInBytes];
+			[mFolderCovers removeObjectForKey:oldestKey];
+		}
+		else {
+			oldestEntry = [mEmbeddedCovers objectForKey:oldestKey];
+			mSizeInBytes -= [oldestEntry sizeInBytes];
+			[mEmbeddedCovers removeObjectForKey:oldestKey];
+		}
+		[mEntriesOrder removeObjectAtIndex:0];
+	}
+}
+
+- (AudioFileCoverArt*)coverArtForFolder:(NSURL*)folderURL
+{
+	__block AudioFileCoverArt *coverArt = nil;
+	NSString *folderPath = [folderURL path];
+
+	if (folderPath == nil) return nil;
+
+	dispatch_sync(mQueue, ^{
+		id entry = [mFolderCovers objectForKey:folderPath];
+		NSURL *imageURL = nil;
+		NSData *imageData;
+
+		if (entry) {
+			if (entry != [NSNull null]) coverArt = [entry retain];
+			return;
+		}
+
+		//Single directory listing, instead of probing each candidate name
+		NSFileManager *fileMgr = [[NSFileManager alloc] init];
+		NSArray *folderContents = [fileMgr contentsOfDirectoryAtPath:folderPath error:NULL];
+		NSString *imageName = nil, *sleevePng = nil, *otherJpg = nil;
+
+		for (NSString *fileName in folderContents) {
+			if ([fileName isEqualToString:@"folder.jpg"]) {
+				imageName = fileName;
+				break;
+			}
+			else if ([fileName isEqualToString:@"cover.jpg"])
+				imageName = fileName;
+			else if (!sleevePng && [fileName hasSuffix:@"Sleeve.png"])
+				sleevePng = fileName;
+			else if (!otherJpg && [fileName hasSuffix:@".jpg"])
+				otherJpg = fileName;
+		}
+
+		if (!imageName) imageName = sleevePng ? sleevePng : otherJpg;
+		if (imageName) imageURL = [folderURL URLByAppendingPathComponent:imageName];
+		[fileMgr release];
+
+		imageData = imageURL ? [NSData dataWithContentsOfURL:imageURL options:NSDataReadingUncached error:NULL] : nil;
+		if (imageData) {
+			coverArt = [[AudioFileCoverArt alloc] initWithData:imageData];
+			[mFolderCovers setObject:coverArt forKey:folderPath];
+			[self addEntry:coverArt forKey:folderPath];
+		}
+		else [mFolderCovers setObject:[NSNull null] forKey:folderPath];
+	});
+
+	return [coverArt autorelease];
+}
+
+- (AudioFileCoverArt*)coverArtWithBytes:(const void*)bytes length:(NSUInteger)length
+{
+	__block AudioFileCoverArt *coverArt = nil;
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	NSMutableString *key = [NSMutableString stringWithCapacity:2*CC_SHA1_DIGEST_LENGTH];
+	int i;
+
+	if ((bytes == NULL) || (length == 0)) return nil;
+
+	CC_SHA1(bytes, (CC_LONG)length, digest);
+	for (i=0;i<CC_SHA1_DIGEST_LENGTH;i++)
+		[key appendFormat:@"%02x",digest[i]];
+
+	dispatch_sync(mQueue, ^{
+		coverArt = [[mEmbeddedCovers objectForKey:key] retain];
+		if (!coverArt) {
+			coverArt = [[AudioFileCoverArt alloc] initWithData:[NSData dataWithBytes:bytes length:length]];
+			[mEmbeddedCovers setObject:coverArt forKey:key];
+			[self addEntry:coverArt forKey:key];
+		}
+	});
+
+	return [coverArt autorelease];
+}
+
+@end
@@ -21,14 +21,23 @@
 
 
 #import "AudioFileLoader.h"
+#import "AudioSampleConvert.h"
+#import "AudioFileBlockReader.h"
+#import "AudioFileSeekIndex.h"
 #include <FLAC/stream_decoder.h>
 #include <samplerate/samplerate.h>
+#include <CommonCrypto/CommonDigest.h>
 
 @interface AudioFileFLACLoader : AudioFileLoader {
 	FLAC__StreamDecoder *mFLACStreamDecoder;
+	AudioFileBlockReader *mFLACreader; //File reads of the decoder
+	AudioFileSeekIndex *mSeekIndex; //Seek points of the files having no SEEKTABLE, nil otherwise
+	SInt64 mFLACskipToSample; //Seek target of an indexed seek, the frames before being dropped. -1 if not seeking
+	bool mFLAChasSeekTable;
 
 	int mFLACchannels;
 	int mFLACmaxBlockSize;
+	AudioSampleConvertKernel mFLACconvertKernel; //Planar decoded samples to interleaved frames, selected once per stream
 
 	//Private data used by the FLAC decoding callback
 	UInt64 mFLACreadFrames;
@@ -39,8 +48,16 @@
 	Float32 *tmpSRCbuf;
 	Float32 *tmplibSampleRateOutBuf; //Used for Integer Mode with libSampleRate
 	SInt32 *tmpInt32buf; //Used for Integer mode with no SRC
+	void *mFLACstreamingBuffer; //Used by the streaming engine with no SRC: one decoded FLAC frame
+	UInt64 mFLACstreamingBufferReadFrames;
 	SRC_STATE *mlibSrcState;
 	AudioConverterRef mCoreAudioConverterRef;
+
+	//Bit-perfect verification: MD5 of the decoded samples, checked against the STREAMINFO one
+	CC_MD5_CTX mFLACmd5Context;
+	FLAC__byte mFLACmd5Signature[16];
+	SInt64 mFLACmd5NextSample; //Next sample to add to the MD5, -1 if the MD5 cannot be checked (seek, no signature)
+	UInt32 mFLACmd5Status;
 }
 @property (readonly,getter=FLACmaxBlockSize) int mFLACmaxBlockSize;
 @end
\ No newline at end of file
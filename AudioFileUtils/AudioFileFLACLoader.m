@@ -24,23 +24,91 @@
 
 #include <FLAC/metadata.h>
 #include <dispatch/dispatch.h>
+#include <libkern/OSAtomic.h>
 #include </usr/include/mach/vm_map.h>
 
 #import "AppController.h"
 #import "PreferenceController.h"
 
 #define LIBSRC_OUTPUTBUF_SECONDS 5
+#define PARALLEL_DECODE_MIN_RANGE_SECONDS 10 //Shorter tracks parts are not worth their own decoder
+
+/* Part of the file decoded by one worker of the parallel decoding, each range having its own FLAC decoder */
+typedef struct {
+	AudioFileFLACLoader *loader;
+	AudioFileBlockReader *reader; //Each range reads its own part of the file
+	AudioConverterRef converter; //Integer Mode conversion, AudioConverters not being shared between threads
+	SInt32 *int32buf;
+	UInt8 *outData; //Destination of the range first frame in the loaded buffer
+	SInt64 startFrame;
+	SInt64 endFrame;
+	volatile SInt64 decodedFrames;
+	bool isStreamEnd; //Decoding stopped by the actual end of the stream, not by an error
+} FLACDecodeRange;
+
+/* Frames decoded from the first range start without a gap: the first range decoded frames,
+ extended through each following range once the previous one is complete */
+static SInt64 contiguousDecodedFrames(const FLACDecodeRange *ranges, int rangesCount)
+{
+	SInt64 loadedFrames = 0;
+	int i;
+
+	for (i=0;i<rangesCount;i++) {
+		loadedFrames += ranges[i].decodedFrames;
+		if (ranges[i].decodedFrames < (ranges[i].endFrame - ranges[i].startFrame)) break;
+	}
+	return loadedFrames;
+}
 
 @interface AudioFileFLACLoader (PrivateMethods)
 - (void)setMetadata:(const FLAC__StreamMetadata *)metadata;
+- (AudioFileBlockReader*)blockReader;
+- (void)indexFrame:(const FLAC__Frame *)frame decoder:(const FLAC__StreamDecoder *)decoder;
+- (bool)seekDecoder:(FLAC__StreamDecoder*)decoder reader:(AudioFileBlockReader*)reader toIndexedSample:(UInt64)sample;
+- (FLAC__bool)processSingleFrame;
 - (FLAC__StreamDecoderWriteStatus)fillAudioBuffer:(const FLAC__Frame *)frame
 									   FLACbuffer:(const FLAC__int32 * const[])buffer;
+- (FLAC__StreamDecoderWriteStatus)fillRange:(FLACDecodeRange*)range
+									  frame:(const FLAC__Frame *)frame
+								 FLACbuffer:(const FLAC__int32 * const[])buffer;
+- (int)parallelDecodingRanges:(SInt64)nbFrames;
+- (void)decodeRange:(FLACDecodeRange*)range;
+- (void)loadInParallel:(UInt64)startInputPosition
+				ranges:(int)nbRanges
+		NumTotalFrames:(SInt64*)numTotalFrames
+	   NumLoadedFrames:(SInt64*)numLoadedFrames
+				Status:(UInt32*)status
+	 NextInputPosition:(SInt64*)nextInputPosition
+			 ForBuffer:(int)bufIdx;
 - (long)readSRCdata:(float**)data;
 - (UInt32)readSRCdata:(SInt32 **)data forFrames:(UInt32)nbFramesToRead; //For CoreAudio SRC
 @end
 
 #pragma mark FLAC decoder callbacks
 
+/* Adds the frame samples to the MD5, in the STREAMINFO signature layout:
+ interleaved little endian signed samples of the smallest whole number of bytes */
+static void md5UpdateWithFrame(CC_MD5_CTX *md5Context, const FLAC__Frame *frame, const FLAC__int32 * const buffer[])
+{
+	UInt8 packedSamples[4096];
+	const unsigned int bytesPerSample = (frame->header.bits_per_sample + 7) / 8;
+	const unsigned int bytesPerFrame = bytesPerSample * frame->header.channels;
+	unsigned int sample,channel,byte,length = 0;
+
+	for (sample=0;sample<frame->header.blocksize;sample++) {
+		for (channel=0;channel<frame->header.channels;channel++)
+			for (byte=0;byte<bytesPerSample;byte++)
+				packedSamples[length++] = (UInt8)(buffer[channel][sample] >> (8*byte));
+
+		if ((length + bytesPerFrame) > sizeof(packedSamples)) {
+			CC_MD5_Update(md5Context, packedSamples, length);
+			length = 0;
+		}
+	}
+	if (length > 0)
+		CC_MD5_Update(md5Context, packedSamples, length);
+}
+
 static FLAC__StreamDecoderWriteStatus writeCallback(const FLAC__StreamDecoder *decoder,
 													const FLAC__Frame *frame,
 													const FLAC__int32 * const buffer[],
@@ -48,10 +116,22 @@ static FLAC__StreamDecoderWriteStatus writeCallback(const FLAC__StreamDecoder *d
 {
 	AudioFileFLACLoader *flacLoader = (AudioFileFLACLoader*) client_data;
 
+	[flacLoader indexFrame:frame decoder:decoder];
 	return [flacLoader fillAudioBuffer:frame FLACbuffer:buffer];
 }
 
 
+static FLAC__StreamDecoderWriteStatus rangeWriteCallback(const FLAC__StreamDecoder *decoder,
+														 const FLAC__Frame *frame,
+														 const FLAC__int32 * const buffer[],
+														 void *client_data)
+{
+	FLACDecodeRange *range = (FLACDecodeRange*) client_data;
+
+	[range->loader indexFrame:frame decoder:decoder];
+	return [range->loader fillRange:range frame:frame FLACbuffer:buffer];
+}
+
 static void metadataCallback(const FLAC__StreamDecoder *decoder,
 							 const FLAC__StreamMetadata *metadata,
 							 void *client_data)
@@ -67,6 +147,128 @@ static void errorCallback(const FLAC__StreamDecoder *decoder,
 {
 }
 
+#pragma mark FLAC decoder I/O callbacks
+
+/* The decoder reads the file through the block reader instead of stdio
+ The main decoder client data is the loader, the parallel decoding ones are their range */
+
+static FLAC__StreamDecoderReadStatus readFromBlockReader(AudioFileBlockReader *reader, FLAC__byte buffer[], size_t *bytes)
+{
+	SInt64 bytesRead = AudioFileBlockReaderRead(reader, buffer, (SInt64)*bytes);
+
+	if (bytesRead < 0) {
+		*bytes = 0;
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+	}
+	*bytes = (size_t)bytesRead;
+	return (bytesRead == 0) ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderSeekStatus seekBlockReader(AudioFileBlockReader *reader, FLAC__uint64 absolute_byte_offset)
+{
+	return (AudioFileBlockReaderSeek(reader, (SInt64)absolute_byte_offset, SEEK_SET) < 0) ?
+		FLAC__STREAM_DECODER_SEEK_STATUS_ERROR : FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamDecoderReadStatus readCallback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes,
+												  void *client_data)
+{
+	return readFromBlockReader([(AudioFileFLACLoader*)client_data blockReader], buffer, bytes);
+}
+
+static FLAC__StreamDecoderSeekStatus seekCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset,
+												  void *client_data)
+{
+	return seekBlockReader([(AudioFileFLACLoader*)client_data blockReader], absolute_byte_offset);
+}
+
+static FLAC__StreamDecoderTellStatus tellCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset,
+												  void *client_data)
+{
+	*absolute_byte_offset = (FLAC__uint64)AudioFileBlockReaderTell([(AudioFileFLACLoader*)client_data blockReader]);
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus lengthCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length,
+													  void *client_data)
+{
+	*stream_length = (FLAC__uint64)AudioFileBlockReaderLength([(AudioFileFLACLoader*)client_data blockReader]);
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool eofCallback(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	return AudioFileBlockReaderIsAtEnd([(AudioFileFLACLoader*)client_data blockReader]);
+}
+
+static FLAC__StreamDecoderReadStatus rangeReadCallback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes,
+													   void *client_data)
+{
+	return readFromBlockReader(((FLACDecodeRange*)client_data)->reader, buffer, bytes);
+}
+
+static FLAC__StreamDecoderSeekStatus rangeSeekCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset,
+													   void *client_data)
+{
+	return seekBlockReader(((FLACDecodeRange*)client_data)->reader, absolute_byte_offset);
+}
+
+static FLAC__StreamDecoderTellStatus rangeTellCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset,
+													   void *client_data)
+{
+	*absolute_byte_offset = (FLAC__uint64)AudioFileBlockReaderTell(((FLACDecodeRange*)client_data)->reader);
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus rangeLengthCallback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length,
+														   void *client_data)
+{
+	*stream_length = (FLAC__uint64)AudioFileBlockReaderLength(((FLACDecodeRange*)client_data)->reader);
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool rangeEofCallback(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	return AudioFileBlockReaderIsAtEnd(((FLACDecodeRange*)client_data)->reader);
+}
+
+/* Fills a metadata dictionary from the fields of a VORBIS_COMMENT block */
+static void addVorbisComments(NSMutableDictionary *fileMetadata, const FLAC__StreamMetadata *metadata)
+{
+	char *FLACfieldName, *FLACfieldValue;
+	NSString *fieldKey;
+	unsigned int i;
+
+	for(i = 0; i < metadata->data.vorbis_comment.num_comments; ++i) {
+
+		if(FLAC__metadata_object_vorbiscomment_entry_to_name_value_pair(metadata->data.vorbis_comment.comments[i],
+																		&FLACfieldName,
+																		&FLACfieldValue) == NO) {
+			continue;
+		}
+
+		if(strcasecmp(FLACfieldName,"TITLE")==0)
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Title];
+		else if(strcasecmp(FLACfieldName,"ARTIST")==0)
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Artist];
+		else if(strcasecmp(FLACfieldName,"ALBUM")==0)
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Album];
+		else if(strcasecmp(FLACfieldName,"COMPOSER")==0)
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Composer];
+		else if(strcasecmp(FLACfieldName,"TRACKNUMBER")==0)
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber];
+		else fieldKey = nil;
+
+		if (fieldKey) {
+			NSString *fieldValue = [NSString stringWithUTF8String:FLACfieldValue];
+			if (fieldValue) [fileMetadata setObject:fieldValue forKey:fieldKey];
+		}
+
+		free(FLACfieldValue);
+		free(FLACfieldName);
+	}
+}
+
 static long sampleRateCallBack(void *cb_data, float **data)
 {
 	AudioFileFLACLoader *flacLoader = (AudioFileFLACLoader*) cb_data;
@@ -82,8 +284,8 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	AudioFileFLACLoader *flacLoader = (AudioFileFLACLoader*) inUserData;
 
 	*ioNumberDataPackets = (UInt32)[flacLoader readSRCdata:(SInt32**)&ioData->mBuffers[0].mData forFrames:*ioNumberDataPackets];
-	ioData->mBuffers[0].mDataByteSize = (UInt32)(*ioNumberDataPackets*2*sizeof(SInt32));
-	ioData->mBuffers[0].mNumberChannels = 2;
+	ioData->mBuffers[0].mNumberChannels = [flacLoader outputChannels];
+	ioData->mBuffers[0].mDataByteSize = (UInt32)(*ioNumberDataPackets*ioData->mBuffers[0].mNumberChannels*sizeof(SInt32));
 
 	return noErr;
 }
@@ -113,17 +315,82 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	return false;
 }
 
++ (NSDictionary*)probeMetadata:(NSURL*)fileURL
+{
+	FLAC__StreamMetadata streamInfo;
+	FLAC__StreamMetadata *tags;
+	NSMutableDictionary *fileMetadata;
+	const char *str = [[fileURL path] fileSystemRepresentation];
+
+	//The metadata level 0 interface does not handle the Ogg container
+	if ([[[fileURL pathExtension] lowercaseString] isEqualToString:@"oga"])
+		return [super probeMetadata:fileURL];
+
+	if ((str == NULL) || !FLAC__metadata_get_streaminfo(str, &streamInfo))
+		return nil;
+
+	fileMetadata = [NSMutableDictionary dictionaryWithCapacity:6];
+
+	if (streamInfo.data.stream_info.sample_rate > 0) {
+		[fileMetadata setObject:[NSNumber numberWithFloat:((float)streamInfo.data.stream_info.total_samples)
+								 / ((float)streamInfo.data.stream_info.sample_rate)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_ApproximateDurationInSeconds]];
+		[fileMetadata setObject:[NSNumber numberWithDouble:streamInfo.data.stream_info.sample_rate]
+						 forKey:[NSString stringWithUTF8String: kAudioFileLoaderInfo_NativeSampleRate]];
+	}
+
+	//Skips the PICTURE blocks without reading them
+	if (FLAC__metadata_get_tags(str, &tags)) {
+		addVorbisComments(fileMetadata, tags);
+		FLAC__metadata_object_delete(tags);
+	}
+
+	return fileMetadata;
+}
+
 
 - (FLAC__StreamDecoderWriteStatus)fillAudioBuffer:(const FLAC__Frame *)frame
 									   FLACbuffer:(const FLAC__int32 * const[])buffer
 {
-	unsigned int sample;
-	float bitDepthFactor = (float)(1L << ((((frame->header.bits_per_sample + 7) / 8) * 8) - 1));
+	const unsigned int outChannels = mOutputStreamFormat.mChannelsPerFrame;
+	const unsigned int convertedChannels = (mFLACchannels < (int)outChannels) ? mFLACchannels : outChannels;
+	const SInt32 *frameSamples[FLAC__MAX_CHANNELS];
+	unsigned int channel, firstSample = 0, blockSize;
 
 	if (!mFLACbufferData) return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
+	//Decoder checksum, only valid for a decoding done in one pass from the stream start
+	if (mFLACmd5NextSample >= 0) {
+		if ((SInt64)frame->header.number.sample_number == mFLACmd5NextSample) {
+			md5UpdateWithFrame(&mFLACmd5Context, frame, buffer);
+			mFLACmd5NextSample += frame->header.blocksize;
+
+			if (mFLACmd5NextSample >= mLengthFrames) {
+				FLAC__byte md5Digest[CC_MD5_DIGEST_LENGTH];
+
+				CC_MD5_Final(md5Digest, &mFLACmd5Context);
+				mFLACmd5Status = (memcmp(md5Digest, mFLACmd5Signature, CC_MD5_DIGEST_LENGTH) == 0)?
+					kAudioOutputVerifierMD5Match:kAudioOutputVerifierMD5Mismatch;
+				mFLACmd5NextSample = -1;
+			}
+		}
+		else mFLACmd5NextSample = -1;
+	}
+
+	//Indexed seek: the frames decoded from the index point are dropped up to the seek target
+	if (mFLACskipToSample >= 0) {
+		if ((SInt64)(frame->header.number.sample_number + frame->header.blocksize) <= mFLACskipToSample)
+			return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+		if (mFLACskipToSample > (SInt64)frame->header.number.sample_number)
+			firstSample = (unsigned int)(mFLACskipToSample - (SInt64)frame->header.number.sample_number);
+		mFLACskipToSample = -1;
+	}
+	for (channel=0;channel<convertedChannels;channel++)
+		frameSamples[channel] = buffer[channel] + firstSample;
+	blockSize = frame->header.blocksize - firstSample;
+
 	if (!mIsUsingSRC) {
-        unsigned int samplesToConvert = frame->header.blocksize;
+        unsigned int samplesToConvert = blockSize;
 
         if ((samplesToConvert*mOutputStreamFormat.mBytesPerFrame) > (mFLACbufferSizeInBytes - mFLACreadFrames*mOutputStreamFormat.mBytesPerFrame))
             samplesToConvert = (unsigned int)((mFLACbufferSizeInBytes - mFLACreadFrames*mOutputStreamFormat.mBytesPerFrame)/mOutputStreamFormat.mBytesPerFrame);
@@ -131,57 +398,84 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 
 		if (mIsIntegerModeOn) {
 			if (tmpInt32buf) {
-				OSErr err;
-				UInt32 readData;
-                for (sample=0;sample<samplesToConvert;sample++) {
-					tmpInt32buf[sample*2] = buffer[0][sample] << (32 - frame->header.bits_per_sample);
-					tmpInt32buf[sample*2+1] = mFLACchannels>1 ? buffer[1][sample] << (32 - frame->header.bits_per_sample) : 0;
-				}
-
-				readData = (UInt32)(frame->header.blocksize*mOutputStreamFormat.mBytesPerFrame);
-				err = AudioConverterConvertBuffer(mCoreAudioConverterRef,
-											(UInt32)(frame->header.blocksize*sizeof(SInt32)*2), tmpInt32buf,
-											&readData,
-											((UInt8*)mFLACbufferData) + (mFLACreadFrames*mOutputStreamFormat.mBytesPerFrame));
-
-				if ((err == noErr) && (mIntModeAlignedLowZeroBits > 0))
-					[self alignAudioBufferFromHighToLow:(UInt32*)(((UInt8*)mFLACbufferData) + (mFLACreadFrames*mOutputStreamFormat.mBytesPerFrame))
-										framesToConvert:(readData / mOutputStreamFormat.mBytesPerFrame)];
+				mFLACconvertKernel(tmpInt32buf, frameSamples, samplesToConvert,
+								   convertedChannels, outChannels, frame->header.bits_per_sample);
 
-				mFLACreadFrames += readData / mOutputStreamFormat.mBytesPerFrame;
+				if ([self writeIntegerFrames:samplesToConvert from:tmpInt32buf sourceFormat:kAudioIntegerWriterSourceInt32
+										  to:((UInt8*)mFLACbufferData) + (mFLACreadFrames*mOutputStreamFormat.mBytesPerFrame)
+								   converter:mCoreAudioConverterRef] == noErr)
+					mFLACreadFrames += samplesToConvert;
 			}
 		} else {
-			for (sample=0;sample<samplesToConvert;sample++) {
-				mFLACbufferData[mFLACreadFrames*2] = buffer[0][sample] / bitDepthFactor;
-				mFLACbufferData[mFLACreadFrames*2+1] = mFLACchannels>1 ? buffer[1][sample] / bitDepthFactor : (float)0.0;
-				mFLACreadFrames++;
-			}
+			mFLACconvertKernel(mFLACbufferData + mFLACreadFrames*outChannels, frameSamples, samplesToConvert,
+							   convertedChannels, outChannels, frame->header.bits_per_sample);
+			mFLACreadFrames += samplesToConvert;
 		}
 	} else {
 		//Fill SRC conversion
-		if (tmpInt32buf)
-			for (sample=0;sample<frame->header.blocksize;sample++) {
-				tmpInt32buf[mFLACreadFrames*2] = buffer[0][sample] << (32 - frame->header.bits_per_sample);
-				tmpInt32buf[mFLACreadFrames*2+1] = mFLACchannels>1 ? buffer[1][sample] << (32 - frame->header.bits_per_sample) : 0;
-				mFLACreadFrames++;
-			}
-		else if (tmpSRCbuf)
-			for (sample=0;sample<frame->header.blocksize;sample++) {
-				tmpSRCbuf[mFLACreadFrames*2] = buffer[0][sample] / bitDepthFactor;
-				tmpSRCbuf[mFLACreadFrames*2+1] = mFLACchannels>1 ? buffer[1][sample] / bitDepthFactor : (float)0.0;
-				mFLACreadFrames++;
-			}
+		if (tmpInt32buf) {
+			mFLACconvertKernel(tmpInt32buf + mFLACreadFrames*outChannels, frameSamples, blockSize,
+							   convertedChannels, outChannels, frame->header.bits_per_sample);
+			mFLACreadFrames += blockSize;
+		}
+		else if (tmpSRCbuf) {
+			mFLACconvertKernel(tmpSRCbuf + mFLACreadFrames*outChannels, frameSamples, blockSize,
+							   convertedChannels, outChannels, frame->header.bits_per_sample);
+			mFLACreadFrames += blockSize;
+		}
 	}
 
 
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
+- (FLAC__StreamDecoderWriteStatus)fillRange:(FLACDecodeRange*)range
+									  frame:(const FLAC__Frame *)frame
+								 FLACbuffer:(const FLAC__int32 * const[])buffer
+{
+	const unsigned int outChannels = mOutputStreamFormat.mChannelsPerFrame;
+	const unsigned int convertedChannels = (mFLACchannels < (int)outChannels) ? mFLACchannels : outChannels;
+	const SInt32 *rangeSamples[FLAC__MAX_CHANNELS];
+	unsigned int channel;
+	SInt64 position = range->startFrame + range->decodedFrames;
+	SInt64 firstSample = position - (SInt64)frame->header.number.sample_number;
+	SInt64 nbSamples;
+	UInt8 *outData = range->outData + range->decodedFrames*mOutputStreamFormat.mBytesPerFrame;
+
+	if ((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) == 0) return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+	//Keep only the samples of the range, the frames at its boundaries being shared with the neighbour ranges
+	//Frames ending before the next position (decoded from an index point up to the range start) are skipped,
+	//a frame starting after it would leave a gap in the range: its decoding is aborted
+	if (firstSample < 0) return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	if (firstSample >= frame->header.blocksize) return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	nbSamples = frame->header.blocksize - firstSample;
+	if (nbSamples > (range->endFrame - position)) nbSamples = range->endFrame - position;
+	if (nbSamples <= 0) return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+
+	for (channel=0;channel<convertedChannels;channel++)
+		rangeSamples[channel] = buffer[channel] + firstSample;
+
+	if (mIsIntegerModeOn) {
+		mFLACconvertKernel(range->int32buf, rangeSamples, (UInt32)nbSamples,
+						   convertedChannels, outChannels, frame->header.bits_per_sample);
+
+		if ([self writeIntegerFrames:(UInt32)nbSamples from:range->int32buf sourceFormat:kAudioIntegerWriterSourceInt32
+								  to:outData converter:range->converter] != noErr)
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	} else
+		mFLACconvertKernel(outData, rangeSamples, (UInt32)nbSamples,
+						   convertedChannels, outChannels, frame->header.bits_per_sample);
+
+	range->decodedFrames += nbSamples;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
 - (long)readSRCdata:(float**)data
 {
 	mFLACreadFrames = 0;
 
-	FLAC__stream_decoder_process_single(mFLACStreamDecoder);
+	[self processSingleFrame];
 
 	*data = tmpSRCbuf;
 
@@ -192,12 +486,12 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 {
 	if (mFLACtmpInt32bufUnreadFrames > 0) {
 		//Remaining frames in the tmpSrcBuffer : read them first
-		*data = (tmpInt32buf + 2*(mFLACreadFrames - mFLACtmpInt32bufUnreadFrames));
+		*data = (tmpInt32buf + mOutputStreamFormat.mChannelsPerFrame*(mFLACreadFrames - mFLACtmpInt32bufUnreadFrames));
 	}
 	else {
 		//Need to fetch a new frame
 		mFLACreadFrames = 0;
-		FLAC__stream_decoder_process_single(mFLACStreamDecoder);
+		[self processSingleFrame];
 		*data = tmpInt32buf;
 		mFLACtmpInt32bufUnreadFrames = mFLACreadFrames;
 	}
@@ -215,8 +509,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 
 -(void)setMetadata:(const FLAC__StreamMetadata *)metadata
 {
-	char *FLACfieldName, *FLACfieldValue;
-	NSImage *albumArt;
+	AudioFileCoverArt *albumArt;
 	unsigned int i;
 
 	if (!mFileMetadata)
@@ -229,39 +522,25 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 			mLengthFrames = metadata->data.stream_info.total_samples;
 			mFLACchannels = metadata->data.stream_info.channels;
 			mFLACmaxBlockSize = metadata->data.stream_info.max_blocksize;
-			break;
 
-		case FLAC__METADATA_TYPE_VORBIS_COMMENT:
-			for(i = 0; i < metadata->data.vorbis_comment.num_comments; ++i) {
-
-				if(FLAC__metadata_object_vorbiscomment_entry_to_name_value_pair(metadata->data.vorbis_comment.comments[i],
-																				&FLACfieldName,
-																				&FLACfieldValue) == NO) {
-					continue;
+			//An all zeroes signature means the encoder did not compute it
+			memcpy(mFLACmd5Signature, metadata->data.stream_info.md5sum, sizeof(mFLACmd5Signature));
+			mFLACmd5Status = kAudioOutputVerifierMD5Unavailable;
+			mFLACmd5NextSample = -1;
+			for (i=0;i<sizeof(mFLACmd5Signature);i++)
+				if (mFLACmd5Signature[i] != 0) {
+					CC_MD5_Init(&mFLACmd5Context);
+					mFLACmd5NextSample = 0;
+					break;
 				}
+			break;
 
-				if(strcasecmp(FLACfieldName,"TITLE")==0) {
-					[mFileMetadata setObject:[NSString stringWithUTF8String:FLACfieldValue]
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
-				} else if(strcasecmp(FLACfieldName,"ARTIST")==0){
-					[mFileMetadata setObject:[NSString stringWithUTF8String:FLACfieldValue]
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
-				} else if(strcasecmp(FLACfieldName,"ALBUM")==0){
-					[mFileMetadata setObject:[NSString stringWithUTF8String:FLACfieldValue]
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
-				} else if(strcasecmp(FLACfieldName,"COMPOSER")==0){
-					[mFileMetadata setObject:[NSString stringWithUTF8String:FLACfieldValue]
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
-				} else if(strcasecmp(FLACfieldName,"TRACKNUMBER")==0){
-					[mFileMetadata setObject:[NSString stringWithUTF8String:FLACfieldValue]
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
-				}
+		case FLAC__METADATA_TYPE_SEEKTABLE:
+			mFLAChasSeekTable = (metadata->data.seek_table.num_points > 0);
+			break;
 
-				free(FLACfieldValue);
-				free(FLACfieldName);
-				FLACfieldValue = NULL;
-				FLACfieldName = NULL;
-			}
+		case FLAC__METADATA_TYPE_VORBIS_COMMENT:
+			addVorbisComments(mFileMetadata, metadata);
 			break;
 
 		case FLAC__METADATA_TYPE_PICTURE:
@@ -269,12 +548,11 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 				&& ([mFileMetadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]] != nil))
 				break; //Keep only the front cover picture in case of several pictures
 
-			albumArt = [[NSImage alloc] initWithData:[NSData dataWithBytes:metadata->data.picture.data length:metadata->data.picture.data_length]];
-			if (albumArt) {
+			albumArt = [[AudioFileCoverArtCache sharedCache] coverArtWithBytes:metadata->data.picture.data
+																		length:metadata->data.picture.data_length];
+			if (albumArt)
 				[mFileMetadata setObject:albumArt
 								  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
-				[albumArt release];
-			}
 			break;
 
 		default:
@@ -283,6 +561,45 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 }
 
 
+- (AudioFileBlockReader*)blockReader
+{
+	return mFLACreader;
+}
+
+- (void)indexFrame:(const FLAC__Frame *)frame decoder:(const FLAC__StreamDecoder *)decoder
+{
+	FLAC__uint64 nextFrameOffset;
+
+	//Called once the frame is read: the decode position is the start of the next frame
+	if (mSeekIndex && FLAC__stream_decoder_get_decode_position(decoder, &nextFrameOffset))
+		[mSeekIndex addPoint:frame->header.number.sample_number + frame->header.blocksize offset:nextFrameOffset];
+}
+
+- (bool)seekDecoder:(FLAC__StreamDecoder*)decoder reader:(AudioFileBlockReader*)reader toIndexedSample:(UInt64)sample
+{
+	UInt64 pointSample, pointOffset;
+
+	if (!mSeekIndex || ![mSeekIndex getPointBefore:sample pointSample:&pointSample offset:&pointOffset])
+		return false;
+
+	//The decoder resynchronizes on the frame at the index point, the frames up to the target being dropped by the write callback
+	return FLAC__stream_decoder_flush(decoder)
+		&& (AudioFileBlockReaderSeek(reader, (SInt64)pointOffset, SEEK_SET) == (SInt64)pointOffset);
+}
+
+- (FLAC__bool)processSingleFrame
+{
+	FLAC__bool result;
+
+	//Frames dropped after an indexed seek don't count as decoded ones
+	do {
+		result = FLAC__stream_decoder_process_single(mFLACStreamDecoder);
+	} while (result && (mFLACskipToSample >= 0)
+			 && (FLAC__stream_decoder_get_state(mFLACStreamDecoder) < FLAC__STREAM_DECODER_END_OF_STREAM));
+	return result;
+}
+
+
 #pragma mark loader public functions
 
 - (id)initWithURL:(NSURL*)urlToOpen
@@ -295,28 +612,42 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 		return nil;
 	}
 
+	mFLACreader = AudioFileBlockReaderOpen([[urlToOpen path] fileSystemRepresentation], kAudioFileBlockReaderAllowMapping);
+	if (mFLACreader == NULL) {
+		[self release];
+		return nil;
+	}
+
 	mFLACStreamDecoder = FLAC__stream_decoder_new();
 	if (mFLACStreamDecoder == NULL) {
+		AudioFileBlockReaderClose(mFLACreader);
+		mFLACreader = NULL;
 		[self release];
 		return nil;
 	}
 
 	FLAC__stream_decoder_set_metadata_respond(mFLACStreamDecoder, FLAC__METADATA_TYPE_VORBIS_COMMENT);
 	FLAC__stream_decoder_set_metadata_respond(mFLACStreamDecoder, FLAC__METADATA_TYPE_PICTURE);
+	FLAC__stream_decoder_set_metadata_respond(mFLACStreamDecoder, FLAC__METADATA_TYPE_SEEKTABLE);
+	mFLAChasSeekTable = NO;
 
 	if ([[[urlToOpen pathExtension] lowercaseString] isEqualToString:@"oga"])
-		FLACstatus = FLAC__stream_decoder_init_ogg_file(mFLACStreamDecoder, str,
-														writeCallback, metadataCallback,
-														errorCallback, self);
+		FLACstatus = FLAC__stream_decoder_init_ogg_stream(mFLACStreamDecoder,
+														  readCallback, seekCallback, tellCallback, lengthCallback, eofCallback,
+														  writeCallback, metadataCallback,
+														  errorCallback, self);
 	else
-		FLACstatus = FLAC__stream_decoder_init_file(mFLACStreamDecoder, str,
-													writeCallback, metadataCallback,
-													errorCallback, self);
+		FLACstatus = FLAC__stream_decoder_init_stream(mFLACStreamDecoder,
+													  readCallback, seekCallback, tellCallback, lengthCallback, eofCallback,
+													  writeCallback, metadataCallback,
+													  errorCallback, self);
 
 	if (FLACstatus != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
 		NSLog(@"Error opening the FLAC file for decoding: file=%s error = 0x%x",str,FLACstatus);
 		FLAC__stream_decoder_delete(mFLACStreamDecoder);
 		mFLACStreamDecoder = NULL;
+		AudioFileBlockReaderClose(mFLACreader);
+		mFLACreader = NULL;
 		[self release];
 		return nil;
 	}
@@ -327,17 +658,30 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 		FLAC__stream_decoder_finish(mFLACStreamDecoder);
 		FLAC__stream_decoder_delete(mFLACStreamDecoder);
 		mFLACStreamDecoder = NULL;
+		AudioFileBlockReaderClose(mFLACreader);
+		mFLACreader = NULL;
 		[self release];
 		return nil;
 	}
 
-	mChannels = 2; //TODO: implement multi-channel
+	mChannels = mFLACchannels;
+
+	//Without SEEKTABLE, seeking bisects the file: use the seek points recorded by previous decodings instead
+	//The Ogg container has no byte accurate decode position
+	mFLACskipToSample = -1;
+	if (!mFLAChasSeekTable && ![[[urlToOpen pathExtension] lowercaseString] isEqualToString:@"oga"])
+		mSeekIndex = [[AudioFileSeekIndex alloc] initWithFile:urlToOpen lengthFrames:mLengthFrames sampleRate:mNativeSampleRate];
+	else
+		mSeekIndex = nil;
 
 	mlibSrcState = NULL;
 	mCoreAudioConverterRef = NULL;
 	tmpSRCbuf = NULL;
 	tmpInt32buf = NULL;
 	tmplibSampleRateOutBuf = NULL;
+	mFLACstreamingBuffer = NULL;
+	mFLACstreamingBufferReadFrames = 0;
+	mFLACconvertKernel = NULL;
 
 	return [super initWithURL:urlToOpen];
 }
@@ -349,9 +693,12 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 		FLAC__stream_decoder_delete(mFLACStreamDecoder);
 		mFLACStreamDecoder = NULL;
 	}
+	if (mFLACreader) { AudioFileBlockReaderClose(mFLACreader); mFLACreader = NULL; }
+	if (mSeekIndex) { [mSeekIndex save]; [mSeekIndex release]; mSeekIndex = nil; }
 	if (tmpSRCbuf) { free(tmpSRCbuf); tmpSRCbuf = NULL; }
 	if (tmplibSampleRateOutBuf) { free(tmplibSampleRateOutBuf); tmplibSampleRateOutBuf = NULL; }
 	if (tmpInt32buf) { free(tmpInt32buf); tmpInt32buf = NULL; }
+	if (mFLACstreamingBuffer) { free(mFLACstreamingBuffer); mFLACstreamingBuffer = NULL; }
 	if (mlibSrcState) { src_delete(mlibSrcState); mlibSrcState = NULL; }
 	if (mCoreAudioConverterRef) { AudioConverterDispose(mCoreAudioConverterRef); mCoreAudioConverterRef = NULL; }
 
@@ -368,15 +715,18 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	   NextInputPosition:(SInt64*)nextInputPosition
 			   ForBuffer:(int)bufIdx
 {
+	UInt32 convertOptions;
+
 	//Perform SRC initialization
 	if (mIsUsingSRC) {
 		switch (mSRCModel) {
+			case kAUDSRCModelPolyphaseFIR:
 			case kAUDSRCModelSRClibSampleRate:
 			{
 				int srcError;
-				mlibSrcState = src_callback_new(&sampleRateCallBack, mSRCQuality, 2, &srcError, self);
-				if (mlibSrcState == NULL) return srcError;
-				tmpSRCbuf = malloc(mFLACmaxBlockSize* sizeof(Float32) * 2);
+				srcError = [self newFloatSRC:&sampleRateCallBack channels:mOutputChannels libSrcState:&mlibSrcState];
+				if (srcError != 0) return srcError;
+				tmpSRCbuf = malloc(mFLACmaxBlockSize* sizeof(Float32) * mOutputChannels);
 
 				if (mIsIntegerModeOn) {
 					AudioStreamBasicDescription inStreamFormat;
@@ -387,7 +737,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 					inStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 					inStreamFormat.mBitsPerChannel = 32;
 					inStreamFormat.mSampleRate = mTargetSampleRate;
-					inStreamFormat.mChannelsPerFrame = 2;
+					inStreamFormat.mChannelsPerFrame = mOutputChannels;
 					inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 					inStreamFormat.mFramesPerPacket = 1;
 					inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
@@ -395,7 +745,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 					err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
 					if (err != noErr) return -1;
 
-					tmplibSampleRateOutBuf = (Float32*)malloc((size_t)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate * sizeof(Float32) * 2)); //Output of libSampleRate is Float32
+					tmplibSampleRateOutBuf = (Float32*)malloc((size_t)([self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)] * sizeof(Float32) * mOutputChannels)); //Output of libSampleRate is Float32
 				}
 			}
 				break;
@@ -410,7 +760,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 				inStreamFormat.mBitsPerChannel = 32;
 				inStreamFormat.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
 				inStreamFormat.mSampleRate = mNativeSampleRate;
-				inStreamFormat.mChannelsPerFrame = 2; //TODO : implement optional multi-channel
+				inStreamFormat.mChannelsPerFrame = mOutputChannels;
 				inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 				inStreamFormat.mFramesPerPacket = 1;
 				inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
@@ -423,7 +773,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 				tmpInt = mSRCQuality;
 				AudioConverterSetProperty(mCoreAudioConverterRef, kAudioConverterSampleRateConverterQuality, sizeof(tmpInt), &tmpInt);
 
-				tmpInt32buf = malloc(mFLACmaxBlockSize * sizeof(SInt32) * 2); //Native FLAC library format
+				tmpInt32buf = malloc(mFLACmaxBlockSize * sizeof(SInt32) * mOutputChannels); //Native FLAC library format
 			}
 				break;
 		}
@@ -437,7 +787,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 		inStreamFormat.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
 		inStreamFormat.mBitsPerChannel = 32;
 		inStreamFormat.mSampleRate = mTargetSampleRate;
-		inStreamFormat.mChannelsPerFrame = 2;
+		inStreamFormat.mChannelsPerFrame = mOutputChannels;
 		inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 		inStreamFormat.mFramesPerPacket = 1;
 		inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
@@ -445,7 +795,22 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 		err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
 		if (err != noErr) return -1;
 
-		tmpInt32buf = malloc(mFLACmaxBlockSize * sizeof(SInt32) * 2); //Native FLAC library format
+		tmpInt32buf = malloc(mFLACmaxBlockSize * sizeof(SInt32) * mOutputChannels); //Native FLAC library format
+	}
+
+	//Conversion of the decoded samples: to 32bit integers for the AudioConverters, to float otherwise
+	convertOptions = [[NSUserDefaults standardUserDefaults] boolForKey:AUDDuplicateMonoToStereo] ? kAudioSampleConvertDuplicateMono : 0;
+	if (tmpInt32buf)
+		mFLACconvertKernel = AudioSampleSelectPlanarToInt32Kernel((mFLACchannels < mOutputChannels) ? mFLACchannels : mOutputChannels,
+																  mOutputChannels, convertOptions, NULL);
+	else
+		mFLACconvertKernel = AudioSampleSelectPlanarToFloat32Kernel((mFLACchannels < mOutputChannels) ? mFLACchannels : mOutputChannels,
+																	mOutputChannels, convertOptions, NULL);
+
+	//Streaming engine: the free space in the ring can be smaller than a FLAC frame, so decode it in an intermediate buffer
+	if (mStreamingRing && !mIsUsingSRC) {
+		mFLACstreamingBuffer = malloc(mFLACmaxBlockSize * mOutputStreamFormat.mBytesPerFrame);
+		if (mFLACstreamingBuffer == NULL) return -1;
 	}
 
 	return [self loadChunk:0
@@ -472,8 +837,19 @@ NextInputPosition:(SInt64*)nextInputPosition
 	UInt64 sizeInBytes;
 	__block bool loadWholeFile;
 
+	if (mStreamingRing) {
+		*outBufferData = NULL;
+		*outBufferDataSize = 0;
+		return [self streamChunk:startInputPosition
+				  NumTotalFrames:numTotalFrames
+				 NumLoadedFrames:numLoadedFrames
+						  Status:status
+			   NextInputPosition:nextInputPosition
+					   ForBuffer:bufIdx];
+	}
+
 	//Get uncompressed file size
-	sizeInBytes = mLengthFrames* mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate; //TODO: allow multiple channels
+	sizeInBytes = mLengthFrames* mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate;
     sizeInBytes -= startInputPosition * mOutputStreamFormat.mBytesPerFrame;
 
 	if (sizeInBytes > maxBufSize) {
@@ -485,10 +861,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 
 	*numTotalFrames = sizeInBytes / mOutputStreamFormat.mBytesPerFrame;
 
-	kern_return_t theKernelError = vm_allocate(mach_task_self(),
-											   (vm_address_t*)outBufferData,
-											   (vm_size_t)sizeInBytes,
-											   VM_FLAGS_ANYWHERE);
+	kern_return_t theKernelError = [self allocateBuffer:outBufferData size:sizeInBytes];
 
 	mFLACreadFrames = 0;
 	mFLACtmpInt32bufUnreadFrames = 0;
@@ -507,23 +880,28 @@ NextInputPosition:(SInt64*)nextInputPosition
     mFLACbufferSizeInBytes = sizeInBytes;
 
 	//Check if need to seek the file read position
-	if (startInputPosition != mNextFrameToLoadPosition) {
-		FLAC__stream_decoder_seek_absolute(mFLACStreamDecoder, (FLAC__uint64)(startInputPosition*mNativeSampleRate/mTargetSampleRate));
-        if (mIsUsingSRC && mSRCModel == kAUDSRCModelAppleCoreAudio)
-            AudioConverterReset(mCoreAudioConverterRef);
-	}
+	if (startInputPosition != mNextFrameToLoadPosition)
+		[self seekDecoderTo:startInputPosition];
 
 	*status = (loadWholeFile?kAudioFileLoaderStatusEOF:0) | kAudioFileLoaderStatusLoading;
 	mIsMakingBackgroundTask |= kAudioFileLoaderLoadingBuffer;
 
-	if (!mIsUsingSRC) {
+	if (!mIsUsingSRC && loadWholeFile && ([self parallelDecodingRanges:*numTotalFrames] > 1)) {
+		[self loadInParallel:startInputPosition
+					  ranges:[self parallelDecodingRanges:*numTotalFrames]
+			  NumTotalFrames:numTotalFrames
+			 NumLoadedFrames:numLoadedFrames
+					  Status:status
+		   NextInputPosition:nextInputPosition
+				   ForBuffer:bufIdx];
+	} else if (!mIsUsingSRC) {
 		dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
             BOOL reachedEOF = NO;
 
 			while (((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0)
 				   && (loadWholeFile || ((mFLACreadFrames * mOutputStreamFormat.mBytesPerFrame + mFLACmaxBlockSize) < sizeInBytes))) {
 
-				if (!FLAC__stream_decoder_process_single(mFLACStreamDecoder)) {
+				if (![self processSingleFrame]) {
                     reachedEOF = YES;
                     break;
                 }
@@ -576,6 +954,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 	} else {
 		//Use sample rate converter
 		switch (mSRCModel) {
+			case kAUDSRCModelPolyphaseFIR:
 			case kAUDSRCModelSRClibSampleRate:
 				dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
 					long readStep;
@@ -588,26 +967,18 @@ NextInputPosition:(SInt64*)nextInputPosition
 						if ((*numLoadedFrames + readStep) > *numTotalFrames)
 							readStep = (long)(*numTotalFrames - *numLoadedFrames);
 						if (mIsIntegerModeOn) {
-							UInt32 bytesConverted;
-
-							framesRead = src_callback_read(mlibSrcState, mTargetSampleRate / mNativeSampleRate,
-														   readStep , tmplibSampleRateOutBuf);
+							framesRead = [self readFloatSRC:mlibSrcState frames:readStep to:tmplibSampleRateOutBuf];
 
 							if (framesRead > 0) {
-								bytesConverted = (UInt32)(framesRead*mOutputStreamFormat.mBytesPerFrame);
-								err = AudioConverterConvertBuffer(mCoreAudioConverterRef, (UInt32)(framesRead * sizeof(Float32) * 2),
-															tmplibSampleRateOutBuf, &bytesConverted,
-															((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame));
-
-								if ((err == noErr) && (mIntModeAlignedLowZeroBits > 0))
-									[self alignAudioBufferFromHighToLow:(UInt32*)(((UInt8*)mFLACbufferData) + (mFLACreadFrames*mOutputStreamFormat.mBytesPerFrame))
-														framesToConvert:(bytesConverted / mOutputStreamFormat.mBytesPerFrame)];
-
-								framesRead = bytesConverted / mOutputStreamFormat.mBytesPerFrame;
+								AudioDitherRequantizeFloat32(&mDither, tmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+								err = [self writeIntegerFrames:(UInt32)framesRead from:tmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+															to:((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)
+													 converter:mCoreAudioConverterRef];
+								if (err != noErr) framesRead = 0;
 							}
 						}
-						else framesRead = src_callback_read(mlibSrcState, mTargetSampleRate / mNativeSampleRate,
-													   readStep , (float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)));
+						else framesRead = [self readFloatSRC:mlibSrcState frames:readStep
+													   to:(float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame))];
 						if (framesRead <=0) break;
 						*numLoadedFrames += framesRead;
 						dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
@@ -653,7 +1024,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 					OSStatus readErr = noErr;
 
 					outData.mNumberBuffers = 1;
-					outData.mBuffers[0].mNumberChannels = 2;
+					outData.mBuffers[0].mNumberChannels = mOutputChannels;
 					outData.mBuffers[0].mData = *outBufferData;
 					outData.mBuffers[0].mDataByteSize = (UInt32)sizeInBytes;
 
@@ -716,4 +1087,291 @@ NextInputPosition:(SInt64*)nextInputPosition
 }
 
 
+#pragma mark Parallel decoding
+
+- (int)parallelDecodingRanges:(SInt64)nbFrames
+{
+	SInt64 nbRanges;
+
+	//Decoder checksum can only be computed in one pass, and Ogg FLAC seeking is too slow to split the file
+	if (![[NSUserDefaults standardUserDefaults] boolForKey:AUDFLACParallelDecoding]
+		|| (mVerifierSerial != 0) || (mLengthFrames <= 0)
+		|| [[[mInputFileURL pathExtension] lowercaseString] isEqualToString:@"oga"])
+		return 1;
+
+	nbRanges = nbFrames / (SInt64)(PARALLEL_DECODE_MIN_RANGE_SECONDS * mNativeSampleRate);
+	if (nbRanges > (SInt64)[[NSProcessInfo processInfo] activeProcessorCount])
+		nbRanges = [[NSProcessInfo processInfo] activeProcessorCount];
+
+	return (nbRanges < 1) ? 1 : (int)nbRanges;
+}
+
+- (void)decodeRange:(FLACDecodeRange*)range
+{
+	FLAC__StreamDecoder *decoder;
+	AudioStreamBasicDescription inStreamFormat;
+	UInt32 propertySize = sizeof(inStreamFormat);
+
+	//Integer Mode: same conversion as the main decoder one. Integer writers being stateless, they are shared
+	if (mIsIntegerModeOn) {
+		if (!mIsUsingIntegerWriter
+			&& ((AudioConverterGetProperty(mCoreAudioConverterRef, kAudioConverterCurrentInputStreamDescription,
+									   &propertySize, &inStreamFormat) != noErr)
+				|| (AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &range->converter) != noErr)))
+			return;
+		range->int32buf = malloc(mFLACmaxBlockSize * sizeof(SInt32) * mOutputChannels);
+		if (range->int32buf == NULL) {
+			if (range->converter) AudioConverterDispose(range->converter);
+			return;
+		}
+	}
+
+	range->reader = AudioFileBlockReaderOpen([[mInputFileURL path] fileSystemRepresentation], kAudioFileBlockReaderAllowMapping);
+	decoder = range->reader ? FLAC__stream_decoder_new() : NULL;
+	if (decoder) {
+		FLAC__stream_decoder_set_metadata_ignore_all(decoder);
+
+		if (FLAC__stream_decoder_init_stream(decoder,
+											 rangeReadCallback, rangeSeekCallback, rangeTellCallback, rangeLengthCallback, rangeEofCallback,
+											 rangeWriteCallback, NULL, errorCallback, range) == FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+			//The seek (using the SEEKTABLE if any) decodes the frame holding the range start
+			//An indexed seek needs the STREAMINFO read first, the frame headers referring to it
+			if ((range->startFrame == 0)
+				|| (FLAC__stream_decoder_process_until_end_of_metadata(decoder)
+					&& [self seekDecoder:decoder reader:range->reader toIndexedSample:(UInt64)range->startFrame])
+				|| FLAC__stream_decoder_seek_absolute(decoder, (FLAC__uint64)range->startFrame)) {
+				while (((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0)
+					   && (range->decodedFrames < (range->endFrame - range->startFrame))) {
+					if (!FLAC__stream_decoder_process_single(decoder)) break;
+					if (FLAC__stream_decoder_get_state(decoder) >= FLAC__STREAM_DECODER_END_OF_STREAM) {
+						range->isStreamEnd = (FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM);
+						break;
+					}
+				}
+			}
+			FLAC__stream_decoder_finish(decoder);
+		}
+		FLAC__stream_decoder_delete(decoder);
+	}
+
+	if (range->reader) { AudioFileBlockReaderClose(range->reader); range->reader = NULL; }
+	if (range->int32buf) { free(range->int32buf); range->int32buf = NULL; }
+	if (range->converter) { AudioConverterDispose(range->converter); range->converter = NULL; }
+}
+
+- (void)loadInParallel:(UInt64)startInputPosition
+				ranges:(int)nbRanges
+		NumTotalFrames:(SInt64*)numTotalFrames
+	   NumLoadedFrames:(SInt64*)numLoadedFrames
+				Status:(UInt32*)status
+	 NextInputPosition:(SInt64*)nextInputPosition
+			 ForBuffer:(int)bufIdx
+{
+	dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		FLACDecodeRange *ranges = calloc(nbRanges, sizeof(FLACDecodeRange));
+		dispatch_group_t rangesGroup;
+		SInt64 rangeLength = *numTotalFrames / nbRanges;
+		SInt64 loadedFrames;
+		bool isStreamEnd = true;
+		int i,rangesCount = (ranges == NULL) ? 0 : nbRanges;
+
+		rangesGroup = dispatch_group_create();
+
+		//Each range is decoded straight to its place in the buffer
+		for (i=0;i<rangesCount;i++) {
+			ranges[i].loader = self;
+			ranges[i].startFrame = startInputPosition + i*rangeLength;
+			ranges[i].endFrame = (i == (rangesCount-1)) ? (SInt64)startInputPosition + *numTotalFrames : ranges[i].startFrame + rangeLength;
+			ranges[i].outData = ((UInt8*)mFLACbufferData) + i*rangeLength*mOutputStreamFormat.mBytesPerFrame;
+			dispatch_group_async(rangesGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+				[self decodeRange:&ranges[i]];
+			});
+		}
+
+		//Report load progress every second, publishing only the frames playable without a gap
+		//so that playback can start on the first range while the next ones are decoded
+		while (dispatch_group_wait(rangesGroup, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC)) != 0) {
+			loadedFrames = contiguousDecodedFrames(ranges, rangesCount);
+			OSMemoryBarrier(); //Decoded frames visible before the IO proc reads up to them
+			*numLoadedFrames = loadedFrames;
+			dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																					  to:loadedFrames
+																					upTo:*numTotalFrames
+																			   forBuffer:bufIdx
+																			   completed:NO
+																				   reset:NO];});
+		}
+		dispatch_release(rangesGroup);
+
+		//Loaded part is up to the first range not completely decoded
+		loadedFrames = contiguousDecodedFrames(ranges, rangesCount);
+		for (i=0;i<rangesCount;i++)
+			if (ranges[i].decodedFrames < (ranges[i].endFrame - ranges[i].startFrame)) {
+				isStreamEnd = ranges[i].isStreamEnd;
+				break;
+			}
+		if (rangesCount == 0) isStreamEnd = false;
+		free(ranges);
+
+		*numLoadedFrames = loadedFrames;
+		//The main decoder was not used: it is still at the chunk start
+		mNextFrameToLoadPosition = startInputPosition;
+
+		//Range not decoded up to its end by an error (allocation, decoder setup, seek, or a gap in the stream):
+		//the undecoded part is decoded serially by the main decoder, writing after the contiguous frames
+		if (!isStreamEnd && ((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0)) {
+			mFLACbufferData = (Float32*)(((UInt8*)mFLACbufferData) + loadedFrames*mOutputStreamFormat.mBytesPerFrame);
+			mFLACbufferSizeInBytes -= loadedFrames*mOutputStreamFormat.mBytesPerFrame;
+			[self seekDecoderTo:startInputPosition + loadedFrames];
+
+			while (((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0)
+				   && [self processSingleFrame]
+				   && (FLAC__stream_decoder_get_state(mFLACStreamDecoder) < FLAC__STREAM_DECODER_END_OF_STREAM)) {
+				if ((mFLACreadFrames /mTargetSampleRate) > (mFLACLoadedSeconds + 1)) {
+					SInt64 resumedFrames = loadedFrames + mFLACreadFrames;
+
+					mFLACLoadedSeconds = (UInt32)(mFLACreadFrames /mTargetSampleRate);
+					OSMemoryBarrier();
+					*numLoadedFrames = resumedFrames;
+					dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																							  to:resumedFrames
+																							upTo:*numTotalFrames
+																					   forBuffer:bufIdx
+																					   completed:NO
+																						   reset:NO];});
+				}
+			}
+
+			*numLoadedFrames = loadedFrames + mFLACreadFrames;
+			mNextFrameToLoadPosition = startInputPosition + *numLoadedFrames;
+		}
+
+		//As with the serial loading, the track ends at the last decoded frame
+		*status |= kAudioFileLoaderStatusEOF;
+
+		if ((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0) {
+			*numTotalFrames = *numLoadedFrames;
+			dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateCurrentTrackTotalLength:startInputPosition+*numTotalFrames
+																							 duration:(startInputPosition+*numTotalFrames)/mTargetSampleRate
+																							forBuffer:bufIdx];});
+		}
+
+		*status &= ~kAudioFileLoaderStatusLoading;
+		*nextInputPosition = startInputPosition + *numLoadedFrames;
+
+		dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																				  to:*numLoadedFrames
+																				upTo:*numTotalFrames
+																		   forBuffer:bufIdx
+																		   completed:YES
+																			   reset:NO];});
+	});
+}
+
+#pragma mark Decoding
+
+- (void)seekDecoderTo:(UInt64)startInputPosition
+{
+	//Drop the frames decoded before the seek, the seek itself decoding the first frames at the new position
+	mFLACreadFrames = 0;
+	mFLACtmpInt32bufUnreadFrames = 0;
+	AudioDitherReset(&mDither);
+	if (mFLACstreamingBuffer) {
+		mFLACbufferData = mFLACstreamingBuffer;
+		mFLACbufferSizeInBytes = mFLACmaxBlockSize * mOutputStreamFormat.mBytesPerFrame;
+		mFLACstreamingBufferReadFrames = 0;
+	}
+
+	mFLACskipToSample = -1;
+	if ([self seekDecoder:mFLACStreamDecoder reader:mFLACreader toIndexedSample:(UInt64)(startInputPosition*mNativeSampleRate/mTargetSampleRate)])
+		mFLACskipToSample = (SInt64)(startInputPosition*mNativeSampleRate/mTargetSampleRate);
+	else
+		FLAC__stream_decoder_seek_absolute(mFLACStreamDecoder, (FLAC__uint64)(startInputPosition*mNativeSampleRate/mTargetSampleRate));
+	if (mIsUsingSRC && mSRCModel == kAUDSRCModelAppleCoreAudio)
+		AudioConverterReset(mCoreAudioConverterRef);
+	else if (mPolyphaseResampler)
+		AudioPolyphaseResamplerReset(mPolyphaseResampler);
+}
+
+- (UInt32)sourceMD5Status
+{
+	return mFLACmd5Status;
+}
+
+- (SInt64)decodeFrames:(void*)outData maxFrames:(UInt32)maxFrames
+{
+	if (!mIsUsingSRC) {
+		UInt64 framesToCopy;
+
+		//Decode the next FLAC frame only once the previous one is completely consumed
+		while (mFLACstreamingBufferReadFrames >= mFLACreadFrames) {
+			mFLACbufferData = mFLACstreamingBuffer;
+			mFLACbufferSizeInBytes = mFLACmaxBlockSize * mOutputStreamFormat.mBytesPerFrame;
+			mFLACreadFrames = 0;
+			mFLACstreamingBufferReadFrames = 0;
+
+			if (![self processSingleFrame]
+				|| (FLAC__stream_decoder_get_state(mFLACStreamDecoder) >= FLAC__STREAM_DECODER_END_OF_STREAM)) {
+				if (mFLACreadFrames == 0) return 0;
+				break;
+			}
+		}
+
+		framesToCopy = mFLACreadFrames - mFLACstreamingBufferReadFrames;
+		if (framesToCopy > maxFrames) framesToCopy = maxFrames;
+
+		memcpy(outData, ((UInt8*)mFLACstreamingBuffer) + mFLACstreamingBufferReadFrames*mOutputStreamFormat.mBytesPerFrame,
+			   framesToCopy*mOutputStreamFormat.mBytesPerFrame);
+		mFLACstreamingBufferReadFrames += framesToCopy;
+
+		return (SInt64)framesToCopy;
+	}
+
+	switch (mSRCModel) {
+		case kAUDSRCModelPolyphaseFIR:
+		case kAUDSRCModelSRClibSampleRate:
+		{
+			long framesRead;
+
+			if (mIsIntegerModeOn) {
+				OSStatus err;
+
+				if (maxFrames > [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)])
+					maxFrames = [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)];
+
+				framesRead = [self readFloatSRC:mlibSrcState frames:maxFrames to:tmplibSampleRateOutBuf];
+				if (framesRead <= 0) return framesRead;
+
+				AudioDitherRequantizeFloat32(&mDither, tmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+				err = [self writeIntegerFrames:(UInt32)framesRead from:tmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+											to:outData converter:mCoreAudioConverterRef];
+				if (err != noErr) return -1;
+			}
+			else framesRead = [self readFloatSRC:mlibSrcState frames:maxFrames to:(float*)outData];
+			return framesRead;
+		}
+
+		case kAUDSRCModelAppleCoreAudio:
+		default:
+		{
+			UInt32 readStep = maxFrames;
+			AudioBufferList outBufList;
+			OSStatus err;
+
+			outBufList.mNumberBuffers = 1;
+			outBufList.mBuffers[0].mNumberChannels = mOutputChannels;
+			outBufList.mBuffers[0].mData = outData;
+			outBufList.mBuffers[0].mDataByteSize = maxFrames*mOutputStreamFormat.mBytesPerFrame;
+
+			err = AudioConverterFillComplexBuffer(mCoreAudioConverterRef, CoreAudioEncoderDataProc, self, &readStep, &outBufList, NULL);
+			if (err != noErr) return -1;
+
+			if (mIntModeAlignedLowZeroBits > 0)
+				[self alignAudioBufferFromHighToLow:(UInt32*)outData framesToConvert:readStep];
+
+			return readStep;
+		}
+	}
+}
+
 @end
\ No newline at end of file
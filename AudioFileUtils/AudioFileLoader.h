@@ -24,9 +24,30 @@
 
 #include <dispatch/dispatch.h>
 #include <AudioToolbox/AudioToolbox.h>
+#include <samplerate/samplerate.h>
+
+#import "AudioRingBuffer.h"
+#import "AudioDither.h"
+#import "AudioIntegerWriter.h"
+#import "AudioPolyphaseResampler.h"
+#import "AudioOutputVerifier.h"
+#import "AudioFilePCMCache.h"
+#import "AudioBufferPool.h"
+#import "AudioFileCoverArtCache.h"
 
 @class AppController;
 
+/* probeMetadata key of the file native sample rate, an NSNumber */
+#define kAudioFileLoaderInfo_NativeSampleRate "native sample rate"
+
+/** AudioFileLoaderApplyConcurrently
+ AudioPolyphaseApplyProc running the blocks on the global queue threads
+ */
+static inline void AudioFileLoaderApplyConcurrently(size_t iterations, void *context, void (*work)(void *context, size_t iteration))
+{
+	dispatch_apply_f(iterations, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), context, work);
+}
+
 /**
  class AudioFileLoader
  Provides utilities for loading and converting files
@@ -41,15 +62,30 @@
 	AppController *mAppController;
 	AudioStreamBasicDescription mOutputStreamFormat;
 	dispatch_group_t mBackgroundLoadGroup;
+	AudioRingBuffer *mStreamingRing;
+	void *mStreamingBlock; //Decoded frames narrower than the ring ones, before their copy to the ring
+	AudioDitherState mDither; //Requantization of the float samples converted to the integer mode format
+	AudioIntegerWriter mIntegerWriter; //Direct conversion to the integer mode format, replacing the AudioConverter
+	AudioPolyphaseResampler *mPolyphaseResampler; //Sample rate converter of the kAUDSRCModelPolyphaseFIR model
+	AudioOutputVerifier *mVerifier; //Bit-perfect verification of the frames streamed to the ring
+	SInt32 mVerifierSerial;
+	AudioFilePCMCache *mPCMCache; //Decoded tracks cache, nil if not used
+	NSString *mPCMCacheKey;
+	void *mPCMCacheData; //Cache entry mapped for the streaming engine
+	UInt64 mPCMCacheDataSize;
+	bool mIsPCMCacheStored; //The decoded track is already cached
+	AudioBufferPool *mBufferPool; //Player pool the buffers are acquired from, NULL to allocate them from the system
 	int mBitDepth;
 	int mChannels;
+	int mOutputChannels; //Channels of the decoded stream: the file ones, up to the limit set by setOutputChannels
 	int mIsMakingBackgroundTask;
 	int mSRCModel;
-	int mSRCQuality;
-	int mSRCComplexity;
+	int mSRCQuality; //Taps per phase for the polyphase FIR model
+	int mSRCComplexity; //Stopband attenuation in dB for the polyphase FIR model
 	int mIntModeAlignedLowZeroBits; //used for the AudioConverter missing feature: #bits to shift right in the 32bit chunks
 	bool mIsIntegerModeOn;
 	bool mIsUsingSRC;
+	bool mIsUsingIntegerWriter;
 }
 @property (readonly, getter=inputFileURL) NSURL *mInputFileURL;
 @property (readonly, getter=bitDepth) int mBitDepth;
@@ -82,6 +118,28 @@
  */
 + (id)createWithURL:(NSURL*)urlToOpen;
 
+/**
+ probeMetadata
+ Reads the playlist metadata of an audio file, without creating a loader: only the tag chunks are parsed,
+ no decoder is opened and no cover art image is decoded
+ @param fileURL the file to probe
+ @return a dictionary of the kAFInfoDictionary_XXX metadata found, the duration being an NSNumber
+ for kAFInfoDictionary_ApproximateDurationInSeconds, and the kAudioFileLoaderInfo_NativeSampleRate one.
+ nil if the file can't be probed
+ @comment Thread safe, to be called concurrently on several files
+ */
++ (NSDictionary*)probeMetadata:(NSURL*)fileURL;
+
+/**
+ getSRCSettingsForModel
+ Converter settings of a sample rate converter model, for a quality preference
+ @param model kAUDSRCModelXXX converter model
+ @param quality kAUDSRCQualityXXX quality preference
+ @param SRCQuality set to the libSampleRate converter type, the AudioConverter quality or the polyphase FIR taps per phase
+ @param SRCComplexity set to the AudioConverter complexity or the polyphase FIR stopband attenuation in dB, 0 for libSampleRate
+ */
++ (void)getSRCSettingsForModel:(int)model quality:(NSInteger)quality SRCQuality:(int*)SRCQuality complexity:(int*)SRCComplexity;
+
 - (id)initWithURL:(NSURL*)urlToOpen;
 
 - (void)close;
@@ -115,6 +173,106 @@
  */
 - (void)setIntegerMode:(BOOL)intEnable streamFormat:(AudioStreamBasicDescription*)intStreamFormat;
 
+/** setOutputChannels
+ Sets the maximum number of channels to decode. Channels of the file beyond this limit are dropped
+ @param maxChannels the number of channels the player can route to the device
+ @comment Mono files are still decoded as stereo frames, right channel being silent
+ */
+- (void)setOutputChannels:(UInt32)maxChannels;
+- (UInt32)outputChannels;
+
+/** setDitheringMode
+ Sets the dither applied when float samples (sample rate converter output, float files) are requantized to a shorter integer format
+ @param ditheringMode kAudioDitheringXXX mode, optionally or'ed with kAudioDither16bit
+ @comment Only used in Integer Mode, the requantization being done in the background decoding, before the AudioConverter
+ */
+- (void)setDitheringMode:(UInt32)ditheringMode;
+
+/** setVerifier
+ Sets the bit-perfect verification track of the file
+ @param verifier the player verifier
+ @param serial the verification serial number of the track, 0 if the track is not verified
+ @comment The loader hashes itself only the frames it writes to the streaming ring, the buffers being hashed by the player
+ */
+- (void)setVerifier:(AudioOutputVerifier*)verifier serial:(SInt32)serial;
+
+/** sourceMD5Status
+ @return the check status of the decoded frames against the checksum stored in the file, kAudioOutputVerifierMD5XXX
+ @comment The default implementation returns kAudioOutputVerifierMD5Unavailable
+ */
+- (UInt32)sourceMD5Status;
+
+/** setPCMCache
+ Sets the cache of the decoded tracks
+ @param cache the cache to read the track from if already decoded, and to store it to once decoded. nil to disable caching
+ @comment The entry key includes the output format and the sample rate conversion settings: to be called once the loader is set up
+ */
+- (void)setPCMCache:(AudioFilePCMCache*)cache;
+
+/** setBufferPool
+ Sets the pool the loaded buffers are acquired from
+ @param pool the player buffers pool, NULL to allocate the buffers with vm_allocate
+ */
+- (void)setBufferPool:(AudioBufferPool*)pool;
+
+/** allocateBuffer
+ Allocates the buffer returned by loadInitialBuffer and loadChunk, from the buffers pool if set
+ @param outBufferData On output: the page aligned buffer
+ @param sizeInBytes the buffer size
+ @return KERN_SUCCESS, or the vm_allocate error
+ */
+- (kern_return_t)allocateBuffer:(void**)outBufferData size:(UInt64)sizeInBytes;
+
+/** loadCachedBuffer
+ Loads the whole decoded track from the cache, the entry being mapped in memory
+ @param outBufferData On output: the mapped audio buffer data. Released by the application with AudioBufferPoolRelease,
+ which unmaps it with vm_deallocate as it is not a pool region
+ @param outBufferDataSize The mapped buffer size in bytes
+ @param maxBufSize Maximum allowed buffer size in bytes
+ @param numTotalFrames The total number of audio frames of the track
+ @param numLoadedFrames The number of audio frames loaded, the whole track
+ @param status Status flags (see enum)
+ @param nextInputPosition The position in frames after the track end
+ @param bufIdx Index of the loaded buffer
+ @return 0 if the track was cached, the other parameters being unchanged otherwise
+ @comment Buffer based loading only, the streaming engine reading the cache by itself
+ */
+- (int)loadCachedBuffer:(void**)outBufferData
+	   AllocatedBufSize:(UInt64*)outBufferDataSize
+		  MaxBufferSize:(UInt64)maxBufSize
+		 NumTotalFrames:(SInt64*)numTotalFrames
+		NumLoadedFrames:(SInt64*)numLoadedFrames
+				 Status:(UInt32*)status
+	  NextInputPosition:(SInt64*)nextInputPosition
+			  ForBuffer:(int)bufIdx;
+
+/** loadMappedBuffer
+ Uses a memory mapped file region, holding the whole track in the output format, as the loaded buffer
+ @param mappedData the mapped frames, the mapping being owned by the buffer from then on.
+ Not page aligned when the frames do not start at a page boundary of the file (e.g. after a WAV header)
+ @param dataSize the size in bytes of the mapped frames
+ @param bufIdx Index of the loaded buffer
+ @comment The other parameters are the loadInitialBuffer ones. The buffer is released by the application with
+ AudioBufferPoolRelease, which unmaps it with vm_deallocate as it is not a pool region. vm_deallocate truncating
+ the address to its page and rounding the end up to the next page, the whole mapping is unmapped from the
+ unaligned pointer and size
+ */
+- (void)loadMappedBuffer:(void*)mappedData
+			 sizeInBytes:(UInt64)dataSize
+		   OutBufferData:(void**)outBufferData
+		AllocatedBufSize:(UInt64*)outBufferDataSize
+		  NumTotalFrames:(SInt64*)numTotalFrames
+		 NumLoadedFrames:(SInt64*)numLoadedFrames
+				  Status:(UInt32*)status
+	   NextInputPosition:(SInt64*)nextInputPosition
+			   ForBuffer:(int)bufIdx;
+
+/** storeBufferInPCMCache
+ Stores the completely loaded track in the cache, in the background. Only the first call does it
+ @param bufferData the audio buffer holding the whole track
+ @param nbFrames the track length in frames
+ */
+- (void)storeBufferInPCMCache:(const void*)bufferData frames:(SInt64)nbFrames;
 
 /** alignAudioBufferFromHighToLow
  Converts an integer buffer with 32-mIntModeAlignedLowZeroBits significant bits aligned high to aligned low in 32bit
@@ -124,9 +282,39 @@
  */
 - (void)alignAudioBufferFromHighToLow:(UInt32*)buffer framesToConvert:(UInt64)nbFrames;
 
+/** writeIntegerFrames
+ Converts decoded frames to the integer mode format, in one pass by the integer writer of the format
+ @param nbFrames number of frames to convert
+ @param srcData the decoded frames, mOutputChannels interleaved samples per frame
+ @param sourceFormat kAudioIntegerWriterSourceXXX format of the decoded samples
+ @param dstData the destination of the frames in the integer mode format
+ @param converter AudioConverter from the decoded format, only used when the format has no integer writer
+ @return noErr if success
+ */
+- (OSStatus)writeIntegerFrames:(UInt32)nbFrames from:(const void*)srcData sourceFormat:(UInt32)sourceFormat
+							to:(void*)dstData converter:(AudioConverterRef)converter;
+
+/** newFloatSRC
+ Creates the Float32 sample rate converter of the libSampleRate and polyphase FIR models
+ @param callback the input frames supplier of the loader, mOutputChannels interleaved Float32 samples per frame
+ @param channels number of channels of the frames
+ @param libSrcState set to the libSampleRate converter, NULL for the polyphase FIR model
+ @return 0 if success, the libSampleRate error code otherwise
+ */
+- (int)newFloatSRC:(src_callback_t)callback channels:(int)channels libSrcState:(SRC_STATE**)libSrcState;
+
+/** readFloatSRC
+ Reads converted frames from the converter created by newFloatSRC
+ @param libSrcState the libSampleRate converter, unused for the polyphase FIR model
+ @param nbFrames number of frames to read
+ @param outData the interleaved Float32 frames read
+ @return the number of frames read, 0 at the end of the file
+ */
+- (long)readFloatSRC:(SRC_STATE*)libSrcState frames:(long)nbFrames to:(float*)outData;
+
 /** loadInitialBuffer
  Attempts to load and decode the whole file
- @param outBufferData On output: the audio buffer data (32bit float or other format samples) To be freed by application using vm_deallocate
+ @param outBufferData On output: the audio buffer data (32bit float or other format samples) To be freed by application using AudioBufferPoolRelease
  @param outBufferDataSize The actual allocated buffer size in bytes
  @param maxBufSize Maximum allowed buffer size in bytes
  @param numTotalFrames The total number of audio frames in the file, may be updated at end of read if the initial value was just an estimate
@@ -150,7 +338,7 @@
  @comment Used when loadInitialBuffer was unable to load the whole file due to buffer size limitation.
  @param startInputPosition The start position to read from in the input file in frames in target sample rate.
 						   Usually is given by previous call to loadInitialBuffer or to this function
- @param outBufferData On output: the audio buffer data (32bit float or other format samples) To be freed by application using vm_deallocate.
+ @param outBufferData On output: the audio buffer data (32bit float or other format samples) To be freed by application using AudioBufferPoolRelease.
  @param outBufferDataSize The actual allocated buffer size in bytes
  @param maxBufSize Maximum allowed buffer size in bytes
  @param numTotalFrames The total number of audio frames in the file, may be updated at end of read if the initial value was just an estimate
@@ -169,6 +357,55 @@ AllocatedBufSize:(UInt64*)outBufferDataSize
 NextInputPosition:(SInt64*)nextInputPosition
 	   ForBuffer:(int)bufIdx;
 
+/** setStreamingRing
+ Switches the loader to the streaming engine: decoded frames are written continuously to the ring
+ instead of a buffer allocated for the whole file or chunk.
+ @param ring The ring shared with the IO proc, NULL for the buffer based loading
+ @comment loadInitialBuffer and loadChunk then return no buffer, and the total length is only set once the end of file is reached.
+ The ring frames can have more channels than the decoded ones, the additional channels being silent
+ */
+- (void)setStreamingRing:(AudioRingBuffer*)ring;
+
+/** decodingBlockFrames
+ Size of the intermediate decoding buffers (SRC output, 64bit float samples)
+ @param bufferLoadFrames the size used to load whole track buffers, usually a few seconds
+ @return bufferLoadFrames, limited to a small constant for the streaming engine, which decodes the ring in small steps
+ */
+- (UInt32)decodingBlockFrames:(UInt32)bufferLoadFrames;
+
+/** streamChunk
+ Starts the background decoding of the file into the streaming ring, from the start position up to the end of the file
+ @param startInputPosition The start position to read from in the input file in frames in target sample rate.
+ @param numTotalFrames Set to the track total length in frames when the end of file is reached
+ @param numLoadedFrames The position in frames of the last frame written in the ring, incremented during background decode
+ @param status Status flags (see enum)
+ @param nextInputPosition The next position in frames in target sample rate, once the decoding is stopped
+ @param bufIdx Index of the buffer controlling the track, used for the track marker
+ @return 0 if success
+ */
+- (int)streamChunk:(UInt64)startInputPosition
+	NumTotalFrames:(SInt64*)numTotalFrames
+   NumLoadedFrames:(SInt64*)numLoadedFrames
+			Status:(UInt32*)status
+ NextInputPosition:(SInt64*)nextInputPosition
+		 ForBuffer:(int)bufIdx;
+
+/** decodeFrames
+ Decodes (and converts) the next frames of the file, in the output stream format
+ @param outData the destination of the decoded frames
+ @param maxFrames the maximum number of frames to decode
+ @return the number of decoded frames, 0 at end of file, negative on error
+ @comment To be implemented by the subclasses, called from the background streaming task
+ */
+- (SInt64)decodeFrames:(void*)outData maxFrames:(UInt32)maxFrames;
+
+/** seekDecoderTo
+ Moves the decoder read position, and resets the sample rate converter if needed
+ @param startInputPosition the new position in frames in target sample rate
+ @comment To be implemented by the subclasses
+ */
+- (void)seekDecoderTo:(UInt64)startInputPosition;
+
 /** abortLoading
  Aborts the background loading operation. Returns only when the background operation is completely aborted.
  */
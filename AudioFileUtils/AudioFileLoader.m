@@ -27,10 +27,23 @@
 #import "AudioFileCoreAudioLoader.h"
 #import	"AudioFileSndFileLoader.h"
 #import "AudioFileFLACLoader.h"
+#import "AudioFileVorbisLoader.h"
 
 #include <dispatch/dispatch.h>
+#include <sys/mman.h>
 #include <samplerate/samplerate.h>
 
+#define STREAMING_BLOCK_FRAMES 16384 //Decoding block size of the streaming engine intermediate buffers
+
+/* Copies decoded frames to wider ring frames, the missing channels being silent */
+static void widenFrames(UInt8 *dst, UInt32 dstBytesPerFrame, const UInt8 *src, UInt32 srcBytesPerFrame, SInt64 frames)
+{
+	for (;frames>0;frames--,dst+=dstBytesPerFrame,src+=srcBytesPerFrame) {
+		memcpy(dst, src, srcBytesPerFrame);
+		memset(dst + srcBytesPerFrame, 0, dstBytesPerFrame - srcBytesPerFrame);
+	}
+}
+
 @implementation AudioFileLoader
 @synthesize mInputFileURL,mBitDepth,mNativeSampleRate,mTargetSampleRate,mLengthFrames,mChannels;
 
@@ -39,6 +52,7 @@
 	NSMutableArray *fileExts = [[NSMutableArray alloc] init];
 
 	[fileExts addObjectsFromArray:[AudioFileFLACLoader supportedFileExtensions]];
+	[fileExts addObjectsFromArray:[AudioFileVorbisLoader supportedFileExtensions]];
 	[fileExts addObjectsFromArray:[AudioFileSndFileLoader supportedFileExtensions]];
 	[fileExts addObjectsFromArray:[AudioFileCoreAudioLoader supportedFileExtensions]];
 
@@ -48,6 +62,7 @@
 + (bool)isFormatSupported:(NSURL*)fileURL
 {
 	return ([AudioFileFLACLoader isFormatSupported:fileURL]
+			|| [AudioFileVorbisLoader isFormatSupported:fileURL]
 			|| [AudioFileSndFileLoader isFormatSupported:fileURL]
 			|| [AudioFileCoreAudioLoader isFormatSupported:fileURL]);
 }
@@ -59,6 +74,9 @@
 	if ([AudioFileFLACLoader isFormatSupported:urlToOpen]) {
 		newLoaderObject = [[AudioFileFLACLoader alloc] initWithURL:urlToOpen];
 	}
+	else if ([AudioFileVorbisLoader isFormatSupported:urlToOpen]) {
+		newLoaderObject = [[AudioFileVorbisLoader alloc] initWithURL:urlToOpen];
+	}
 	else if ([AudioFileSndFileLoader isFormatSupported:urlToOpen]) {
 		newLoaderObject = [[AudioFileSndFileLoader alloc] initWithURL:urlToOpen];
 	}
@@ -69,6 +87,130 @@
 	return [newLoaderObject autorelease];
 }
 
++ (NSDictionary*)probeMetadata:(NSURL*)fileURL
+{
+	NSDictionary *metadata = nil;
+	AudioFileLoader *fileLoader;
+
+	if ([self class] == [AudioFileLoader class]) {
+		if ([AudioFileFLACLoader isFormatSupported:fileURL])
+			metadata = [AudioFileFLACLoader probeMetadata:fileURL];
+		else if ([AudioFileVorbisLoader isFormatSupported:fileURL])
+			metadata = [AudioFileVorbisLoader probeMetadata:fileURL];
+		else if ([AudioFileSndFileLoader isFormatSupported:fileURL])
+			metadata = [AudioFileSndFileLoader probeMetadata:fileURL];
+		else if ([AudioFileCoreAudioLoader isFormatSupported:fileURL])
+			metadata = [AudioFileCoreAudioLoader probeMetadata:fileURL];
+		return metadata;
+	}
+
+	//Formats without a specific probe: read the metadata from a loader
+	fileLoader = [[self alloc] initWithURL:fileURL];
+	if (fileLoader) {
+		NSMutableDictionary *loaderMetadata = [NSMutableDictionary dictionaryWithCapacity:7];
+
+		[loaderMetadata setObject:[fileLoader title] forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
+		if ([fileLoader artist])
+			[loaderMetadata setObject:[fileLoader artist] forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
+		if ([fileLoader album])
+			[loaderMetadata setObject:[fileLoader album] forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
+		if ([fileLoader composer])
+			[loaderMetadata setObject:[fileLoader composer] forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
+		if ([fileLoader trackNumber] != 0)
+			[loaderMetadata setObject:[NSNumber numberWithUnsignedLongLong:[fileLoader trackNumber]]
+							   forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
+		[loaderMetadata setObject:[NSNumber numberWithFloat:[fileLoader durationInSeconds]]
+						   forKey:[NSString stringWithUTF8String: kAFInfoDictionary_ApproximateDurationInSeconds]];
+		[loaderMetadata setObject:[NSNumber numberWithDouble:[fileLoader nativeSampleRate]]
+						   forKey:[NSString stringWithUTF8String: kAudioFileLoaderInfo_NativeSampleRate]];
+		[fileLoader close];
+		[fileLoader release];
+		metadata = loaderMetadata;
+	}
+	return metadata;
+}
+
++ (void)getSRCSettingsForModel:(int)model quality:(NSInteger)quality SRCQuality:(int*)SRCQuality complexity:(int*)SRCComplexity
+{
+	switch (model) {
+		case kAUDSRCModelSRClibSampleRate:
+			*SRCComplexity = 0;
+			switch (quality) {
+				case kAUDSRCQualityLowest:
+					*SRCQuality = SRC_LINEAR;
+					break;
+				case kAUDSRCQualityLow:
+					*SRCQuality = SRC_ZERO_ORDER_HOLD;
+					break;
+				case kAUDSRCQualityMedium:
+					*SRCQuality = SRC_SINC_FASTEST;
+					break;
+				case kAUDSRCQualityHigh:
+					*SRCQuality = SRC_SINC_MEDIUM_QUALITY;
+					break;
+				case kAUDSRCQualityMax:
+				default:
+					*SRCQuality = SRC_SINC_BEST_QUALITY;
+					break;
+			}
+			break;
+
+		case kAUDSRCModelPolyphaseFIR:
+			//Filter length (taps per phase) and stopband attenuation
+			switch (quality) {
+				case kAUDSRCQualityLowest:
+					*SRCQuality = 24;
+					*SRCComplexity = 70;
+					break;
+				case kAUDSRCQualityLow:
+					*SRCQuality = 32;
+					*SRCComplexity = 80;
+					break;
+				case kAUDSRCQualityMedium:
+					*SRCQuality = 48;
+					*SRCComplexity = 100;
+					break;
+				case kAUDSRCQualityHigh:
+					*SRCQuality = 64;
+					*SRCComplexity = 120;
+					break;
+				case kAUDSRCQualityMax:
+				default:
+					*SRCQuality = 128;
+					*SRCComplexity = 140;
+					break;
+			}
+			break;
+
+		case kAUDSRCModelAppleCoreAudio:
+		default:
+			switch (quality) {
+				case kAUDSRCQualityLowest:
+					*SRCComplexity = kAudioConverterSampleRateConverterComplexity_Linear;
+					*SRCQuality = kAudioConverterQuality_Min;
+					break;
+				case kAUDSRCQualityLow:
+					*SRCComplexity = kAudioConverterSampleRateConverterComplexity_Normal;
+					*SRCQuality = kAudioConverterQuality_Medium;
+					break;
+				case kAUDSRCQualityMedium:
+					*SRCComplexity = kAudioConverterSampleRateConverterComplexity_Normal;
+					*SRCQuality = kAudioConverterQuality_High;
+					break;
+				case kAUDSRCQualityHigh:
+					*SRCComplexity = kAudioConverterSampleRateConverterComplexity_Mastering;
+					*SRCQuality = kAudioConverterQuality_Medium;
+					break;
+				case kAUDSRCQualityMax:
+				default:
+					*SRCComplexity = kAudioConverterSampleRateConverterComplexity_Mastering;
+					*SRCQuality = kAudioConverterQuality_Max;
+					break;
+			}
+			break;
+	}
+}
+
 - (id)initWithURL:(NSURL*)urlToOpen
 {
 	//Vars initializations
@@ -79,11 +221,24 @@
 	mIsUsingSRC = NO;
 	mIsMakingBackgroundTask = 0;
 	mBackgroundLoadGroup = dispatch_group_create();
+	mStreamingRing = NULL;
+	mStreamingBlock = NULL;
 
 	mIntModeAlignedLowZeroBits = 0;
 	mIsIntegerModeOn = FALSE;
+	mIsUsingIntegerWriter = NO;
+	mOutputChannels = 2;
+	AudioDitherInit(&mDither, kAudioNoDithering);
+	mVerifier = NULL;
+	mVerifierSerial = 0;
+	mPCMCache = nil;
+	mPCMCacheKey = nil;
+	mPCMCacheData = NULL;
+	mPCMCacheDataSize = 0;
+	mIsPCMCacheStored = NO;
+	mBufferPool = NULL;
 	mOutputStreamFormat.mBitsPerChannel = 32;
-	mOutputStreamFormat.mChannelsPerFrame = 2;
+	mOutputStreamFormat.mChannelsPerFrame = mOutputChannels;
 	mOutputStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 	mOutputStreamFormat.mBytesPerFrame = mOutputStreamFormat.mChannelsPerFrame * mOutputStreamFormat.mBitsPerChannel / 8;
 	mOutputStreamFormat.mBytesPerPacket = mOutputStreamFormat.mBytesPerFrame;
@@ -92,100 +247,39 @@
 	mOutputStreamFormat.mSampleRate = mTargetSampleRate;
 
 	//Sample rate conversion settings
-	if ([[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterModel] == kAUDSRCModelSRClibSampleRate) {
-		mSRCModel = kAUDSRCModelSRClibSampleRate;
-		switch ([[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterQuality]) {
-			case kAUDSRCQualityLowest:
-				mSRCQuality = SRC_LINEAR;
-				break;
-			case kAUDSRCQualityLow:
-				mSRCQuality = SRC_ZERO_ORDER_HOLD;
-				break;
-			case kAUDSRCQualityMedium:
-				mSRCQuality = SRC_SINC_FASTEST;
-				break;
-			case kAUDSRCQualityHigh:
-				mSRCQuality = SRC_SINC_MEDIUM_QUALITY;
-				break;
-			case kAUDSRCQualityMax:
-			default:
-				mSRCQuality = SRC_SINC_BEST_QUALITY;
-				break;
-		}
+	mPolyphaseResampler = NULL;
+	switch ([[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterModel]) {
+		case kAUDSRCModelSRClibSampleRate:
+		case kAUDSRCModelPolyphaseFIR:
+			mSRCModel = (int)[[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterModel];
+			break;
+		default:
+			mSRCModel = kAUDSRCModelAppleCoreAudio; //Defaults to Apple Core Audio
+			break;
 	}
-	else {
-		mSRCModel = kAUDSRCModelAppleCoreAudio; //Defaults to Apple Core Audio
-		switch ([[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterQuality]) {
-			case kAUDSRCQualityLowest:
-				mSRCComplexity = kAudioConverterSampleRateConverterComplexity_Linear;
-				mSRCQuality = kAudioConverterQuality_Min;
-				break;
-			case kAUDSRCQualityLow:
-				mSRCComplexity = kAudioConverterSampleRateConverterComplexity_Normal;
-				mSRCQuality = kAudioConverterQuality_Medium;
-				break;
-			case kAUDSRCQualityMedium:
-				mSRCComplexity = kAudioConverterSampleRateConverterComplexity_Normal;
-				mSRCQuality = kAudioConverterQuality_High;
-				break;
-			case kAUDSRCQualityHigh:
-				mSRCComplexity = kAudioConverterSampleRateConverterComplexity_Mastering;
-				mSRCQuality = kAudioConverterQuality_Medium;
-				break;
-			case kAUDSRCQualityMax:
-			default:
-				mSRCComplexity = kAudioConverterSampleRateConverterComplexity_Mastering;
-				mSRCQuality = kAudioConverterQuality_Max;
-				break;
-		}
-	}
-
-
-	//Get album cover from folder.jpg if not already loaded from file metadata
-	if ([self coverImage] == nil) {
-		NSError *err;
-		NSImage *albumArt = nil;
-		NSURL *fileFolder = [mInputFileURL URLByDeletingLastPathComponent];
-
-		NSURL *folderImage = [fileFolder URLByAppendingPathComponent:@"folder.jpg"];
-
-		if ([folderImage checkResourceIsReachableAndReturnError:&err]) {
-			albumArt = [[NSImage alloc] initWithContentsOfURL:folderImage];
-		} else {
-			folderImage = [fileFolder URLByAppendingPathComponent:@"cover.jpg"];
-			if ([folderImage checkResourceIsReachableAndReturnError:&err]) {
-				albumArt = [[NSImage alloc] initWithContentsOfURL:folderImage];
-			}
-			else {
-				NSFileManager *fileMgr = [[NSFileManager alloc] init];
-				NSArray *folderContents = [fileMgr contentsOfDirectoryAtPath:[fileFolder path] error:NULL];
-				NSArray *sleevePngs = [folderContents filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self ENDSWITH 'Sleeve.png'"]];
-
-				if ([sleevePngs count]>0) {
-					albumArt = [[NSImage alloc] initWithContentsOfURL:[fileFolder URLByAppendingPathComponent:[sleevePngs objectAtIndex:0]]];
-				}
-                else {
-                    NSArray *sleeveOtherJpgs = [folderContents filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self ENDSWITH '.jpg'"]];
-                    if ([sleeveOtherJpgs count]>0) {
-                        albumArt = [[NSImage alloc] initWithContentsOfURL:[fileFolder URLByAppendingPathComponent:[sleeveOtherJpgs objectAtIndex:0]]];
-                    }
-                }
-				[fileMgr release];
-			}
-
-		}
-
-		if (albumArt) {
+	[AudioFileLoader getSRCSettingsForModel:mSRCModel
+									quality:[[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterQuality]
+								 SRCQuality:&mSRCQuality
+								 complexity:&mSRCComplexity];
+
+
+	//Get album cover from the folder if not already loaded from file metadata
+	//(shared by all the tracks of the folder, decoded only when displayed)
+	if ([mFileMetadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]] == nil) {
+		AudioFileCoverArt *albumArt = [[AudioFileCoverArtCache sharedCache]
+									   coverArtForFolder:[mInputFileURL URLByDeletingLastPathComponent]];
+		if (albumArt)
 			[mFileMetadata setObject:albumArt
 							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
-			[albumArt release];
-		}
 	}
 	return [super init];
 }
 
 -(void)close
 {
+	if (mStreamingBlock) { free(mStreamingBlock); mStreamingBlock = NULL; }
+	if (mPolyphaseResampler) { AudioPolyphaseResamplerDelete(mPolyphaseResampler); mPolyphaseResampler = NULL; }
+	if (mPCMCacheData) { munmap(mPCMCacheData, (size_t)mPCMCacheDataSize); mPCMCacheData = NULL; }
 }
 
 -(void)dealloc
@@ -202,6 +296,8 @@
 	}
 	if (mBackgroundLoadGroup)
 		dispatch_release(mBackgroundLoadGroup);
+	[mPCMCacheKey release];
+	[mPCMCache release];
 	[super dealloc];
 }
 
@@ -216,6 +312,9 @@
 	if (intEnable && intStreamFormat) {
 		memcpy(&mOutputStreamFormat, intStreamFormat,sizeof(AudioStreamBasicDescription));
 		mOutputStreamFormat.mSampleRate = mTargetSampleRate;
+		mOutputStreamFormat.mBytesPerFrame = (mOutputStreamFormat.mBytesPerFrame / mOutputStreamFormat.mChannelsPerFrame) * mOutputChannels;
+		mOutputStreamFormat.mBytesPerPacket = mOutputStreamFormat.mBytesPerFrame;
+		mOutputStreamFormat.mChannelsPerFrame = mOutputChannels;
 
 		// Need to use workaround for missing format conversion by AudioConverter ?
 		// The workaround consists in getting an aligned high stream, and shift right the frame bits to get an aligned low stream
@@ -231,10 +330,26 @@
 		}
 		else
 			mIntModeAlignedLowZeroBits = 0;
+
+		//Direct writers for the interleaved signed integer formats
+		mIsUsingIntegerWriter = NO;
+		if ((mOutputStreamFormat.mFormatID == kAudioFormatLinearPCM)
+			&& ((mOutputStreamFormat.mFormatFlags & (kAudioFormatFlagIsFloat | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsNonInterleaved))
+				== kAudioFormatFlagIsSignedInteger)
+			&& (mOutputStreamFormat.mChannelsPerFrame > 0)) {
+			AudioIntegerWriterFormat writerFormat;
+
+			writerFormat.bytesPerSample = mOutputStreamFormat.mBytesPerFrame / mOutputStreamFormat.mChannelsPerFrame;
+			writerFormat.bitsPerSample = mOutputStreamFormat.mBitsPerChannel;
+			writerFormat.isBigEndian = (mOutputStreamFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) != 0;
+			writerFormat.isAlignedLow = (mIntModeAlignedLowZeroBits > 0);
+			mIsUsingIntegerWriter = AudioIntegerWriterSelect(&mIntegerWriter, &writerFormat);
+		}
 	}
 	else {
+		mIsUsingIntegerWriter = NO;
 		mOutputStreamFormat.mBitsPerChannel = 32;
-		mOutputStreamFormat.mChannelsPerFrame = 2;
+		mOutputStreamFormat.mChannelsPerFrame = mOutputChannels;
 		mOutputStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 		mOutputStreamFormat.mBytesPerFrame = mOutputStreamFormat.mChannelsPerFrame * mOutputStreamFormat.mBitsPerChannel / 8;
 		mOutputStreamFormat.mBytesPerPacket = mOutputStreamFormat.mBytesPerFrame;
@@ -245,6 +360,158 @@
 
 }
 
+- (void)setOutputChannels:(UInt32)maxChannels
+{
+	UInt32 bytesPerSample = mOutputStreamFormat.mBytesPerFrame / mOutputStreamFormat.mChannelsPerFrame;
+
+	mOutputChannels = (mChannels < (int)maxChannels) ? mChannels : (int)maxChannels;
+	if (mOutputChannels < 2) mOutputChannels = 2;
+
+	mOutputStreamFormat.mChannelsPerFrame = mOutputChannels;
+	mOutputStreamFormat.mBytesPerFrame = bytesPerSample * mOutputChannels;
+	mOutputStreamFormat.mBytesPerPacket = mOutputStreamFormat.mBytesPerFrame;
+}
+
+- (UInt32)outputChannels
+{
+	return mOutputChannels;
+}
+
+- (void)setDitheringMode:(UInt32)ditheringMode
+{
+	AudioDitherInit(&mDither, ditheringMode);
+}
+
+- (void)setVerifier:(AudioOutputVerifier*)verifier serial:(SInt32)serial
+{
+	mVerifier = verifier;
+	mVerifierSerial = serial;
+}
+
+- (UInt32)sourceMD5Status
+{
+	return kAudioOutputVerifierMD5Unavailable;
+}
+
+- (void)setPCMCache:(AudioFilePCMCache*)cache
+{
+	[cache retain];
+	[mPCMCache release];
+	mPCMCache = cache;
+	[mPCMCacheKey release];
+	mPCMCacheKey = nil;
+}
+
+- (void)setBufferPool:(AudioBufferPool*)pool
+{
+	mBufferPool = pool;
+}
+
+- (kern_return_t)allocateBuffer:(void**)outBufferData size:(UInt64)sizeInBytes
+{
+	if (mBufferPool) {
+		*outBufferData = AudioBufferPoolAcquire(mBufferPool, sizeInBytes);
+		return (*outBufferData != NULL) ? KERN_SUCCESS : KERN_NO_SPACE;
+	}
+
+	return vm_allocate(mach_task_self(), (vm_address_t*)outBufferData, (vm_size_t)sizeInBytes, VM_FLAGS_ANYWHERE);
+}
+
+- (NSString*)PCMCacheKey
+{
+	if ((mPCMCacheKey == nil) && mPCMCache) {
+		//Everything changing the decoded frames: output format, sample rate conversion and requantization settings
+		mPCMCacheKey = [[mPCMCache keyForFile:mInputFileURL
+						   decodingParameters:[NSString stringWithFormat:@"%.3f|%u|%u|%u|%u|%u|%d|%d|%d|%d|%d|%u",
+											   mOutputStreamFormat.mSampleRate,
+											   (unsigned int)mOutputStreamFormat.mFormatID,
+											   (unsigned int)mOutputStreamFormat.mFormatFlags,
+											   (unsigned int)mOutputStreamFormat.mBitsPerChannel,
+											   (unsigned int)mOutputStreamFormat.mBytesPerFrame,
+											   (unsigned int)mOutputStreamFormat.mChannelsPerFrame,
+											   mIntModeAlignedLowZeroBits,
+											   mIsUsingSRC?1:0, mSRCModel, mSRCQuality, mSRCComplexity,
+											   (unsigned int)mDither.mode]] retain];
+	}
+	return mPCMCacheKey;
+}
+
+- (int)loadCachedBuffer:(void**)outBufferData
+	   AllocatedBufSize:(UInt64*)outBufferDataSize
+		  MaxBufferSize:(UInt64)maxBufSize
+		 NumTotalFrames:(SInt64*)numTotalFrames
+		NumLoadedFrames:(SInt64*)numLoadedFrames
+				 Status:(UInt32*)status
+	  NextInputPosition:(SInt64*)nextInputPosition
+			  ForBuffer:(int)bufIdx
+{
+	void *cachedData;
+	UInt64 cachedDataSize;
+	SInt64 cachedFrames;
+
+	if ((mPCMCache == nil) || mStreamingRing) return -1;
+
+	cachedData = [mPCMCache mapEntry:[self PCMCacheKey] sizeInBytes:&cachedDataSize];
+	if (cachedData == NULL) return -1;
+
+	cachedFrames = (SInt64)(cachedDataSize / mOutputStreamFormat.mBytesPerFrame);
+	if ((cachedDataSize > maxBufSize) || (cachedFrames == 0)) {
+		munmap(cachedData, (size_t)cachedDataSize);
+		return -1;
+	}
+
+	[self loadMappedBuffer:cachedData
+			   sizeInBytes:cachedDataSize
+			 OutBufferData:outBufferData
+		  AllocatedBufSize:outBufferDataSize
+			NumTotalFrames:numTotalFrames
+		   NumLoadedFrames:numLoadedFrames
+					Status:status
+		 NextInputPosition:nextInputPosition
+				 ForBuffer:bufIdx];
+	return 0;
+}
+
+- (void)loadMappedBuffer:(void*)mappedData
+			 sizeInBytes:(UInt64)dataSize
+		   OutBufferData:(void**)outBufferData
+		AllocatedBufSize:(UInt64*)outBufferDataSize
+		  NumTotalFrames:(SInt64*)numTotalFrames
+		 NumLoadedFrames:(SInt64*)numLoadedFrames
+				  Status:(UInt32*)status
+	   NextInputPosition:(SInt64*)nextInputPosition
+			   ForBuffer:(int)bufIdx
+{
+	SInt64 mappedFrames = (SInt64)(dataSize / mOutputStreamFormat.mBytesPerFrame);
+
+	*outBufferData = mappedData;
+	*outBufferDataSize = dataSize;
+	*numTotalFrames = mappedFrames;
+	*numLoadedFrames = mappedFrames;
+	*nextInputPosition = mappedFrames;
+	*status = kAudioFileLoaderStatusEOF;
+	mIsPCMCacheStored = YES; //Nothing to store: the frames are read from the mapped file
+
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[mAppController updateCurrentTrackTotalLength:mappedFrames
+											 duration:mappedFrames/mTargetSampleRate
+											forBuffer:bufIdx];
+		[mAppController updateLoadStatus:0
+									  to:mappedFrames
+									upTo:mappedFrames
+							   forBuffer:bufIdx
+							   completed:YES
+								   reset:NO];});
+}
+
+- (void)storeBufferInPCMCache:(const void*)bufferData frames:(SInt64)nbFrames
+{
+	if ((mPCMCache == nil) || mIsPCMCacheStored || (nbFrames <= 0)) return;
+
+	mIsPCMCacheStored = YES;
+	[mPCMCache storeEntry:[self PCMCacheKey] data:bufferData sizeInBytes:(UInt64)nbFrames*mOutputStreamFormat.mBytesPerFrame];
+}
+
 - (void)alignAudioBufferFromHighToLow:(UInt32*)buffer framesToConvert:(UInt64)nbFrames
 {
 	UInt64 frameIdx;
@@ -274,6 +541,26 @@
 
 }
 
+- (OSStatus)writeIntegerFrames:(UInt32)nbFrames from:(const void*)srcData sourceFormat:(UInt32)sourceFormat
+							to:(void*)dstData converter:(AudioConverterRef)converter
+{
+	static const UInt32 sourceBytesPerSample[kAudioIntegerWriterSourceCount] = { sizeof(SInt32), sizeof(Float32), sizeof(Float64) };
+	UInt32 bytesConverted;
+	OSStatus err;
+
+	if (mIsUsingIntegerWriter) {
+		AudioIntegerWriterWrite(&mIntegerWriter, sourceFormat, dstData, srcData, (UInt64)nbFrames*mOutputChannels);
+		return noErr;
+	}
+
+	bytesConverted = nbFrames*mOutputStreamFormat.mBytesPerFrame;
+	err = AudioConverterConvertBuffer(converter, nbFrames*sourceBytesPerSample[sourceFormat]*mOutputChannels,
+									  srcData, &bytesConverted, dstData);
+	if ((err == noErr) && (mIntModeAlignedLowZeroBits > 0))
+		[self alignAudioBufferFromHighToLow:(UInt32*)dstData framesToConvert:(bytesConverted / mOutputStreamFormat.mBytesPerFrame)];
+	return err;
+}
+
 -(NSString*)title
 {
 	NSString *fileTitle = [mFileMetadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
@@ -299,7 +586,12 @@
 
 - (NSImage*)coverImage
 {
-	return [mFileMetadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
+	id albumArt = [mFileMetadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
+
+	if ([albumArt isKindOfClass:[AudioFileCoverArt class]])
+		return [albumArt image];
+	else
+		return albumArt;
 }
 
 - (float)durationInSeconds
@@ -324,6 +616,16 @@
 	mTargetSampleRate = targetSampleRate;
 	mOutputStreamFormat.mSampleRate = mTargetSampleRate;
 	if (mTargetSampleRate != mNativeSampleRate) mIsUsingSRC = YES;
+
+	//Ratio not handled by the polyphase FIR: libSampleRate at the same quality
+	if (mIsUsingSRC && (mSRCModel == kAUDSRCModelPolyphaseFIR)
+		&& !AudioPolyphaseResamplerIsRatioSupported(mNativeSampleRate, mTargetSampleRate)) {
+		mSRCModel = kAUDSRCModelSRClibSampleRate;
+		[AudioFileLoader getSRCSettingsForModel:mSRCModel
+										quality:[[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateConverterQuality]
+									 SRCQuality:&mSRCQuality
+									 complexity:&mSRCComplexity];
+	}
 }
 
 - (int)loadInitialBuffer:(void**)outBufferData
@@ -351,10 +653,230 @@ NextInputPosition:(SInt64*)nextInputPosition
 	return -1;
 }
 
+- (void)setStreamingRing:(AudioRingBuffer*)ring
+{
+	mStreamingRing = ring;
+}
+
+- (int)newFloatSRC:(src_callback_t)callback channels:(int)channels libSrcState:(SRC_STATE**)libSrcState
+{
+	int srcError = 0;
+
+	*libSrcState = NULL;
+	if (mSRCModel == kAUDSRCModelPolyphaseFIR) {
+		mPolyphaseResampler = AudioPolyphaseResamplerNew(callback, self, mNativeSampleRate, mTargetSampleRate,
+														 (UInt32)mSRCQuality, (Float64)mSRCComplexity, (UInt32)channels,
+														 AudioFileLoaderApplyConcurrently);
+		return (mPolyphaseResampler == NULL) ? -1 : 0;
+	}
+
+	*libSrcState = src_callback_new(callback, mSRCQuality, channels, &srcError, self);
+	return (*libSrcState == NULL) ? srcError : 0;
+}
+
+- (long)readFloatSRC:(SRC_STATE*)libSrcState frames:(long)nbFrames to:(float*)outData
+{
+	if (mPolyphaseResampler)
+		return AudioPolyphaseResamplerRead(mPolyphaseResampler, nbFrames, outData);
+	return src_callback_read(libSrcState, mTargetSampleRate / mNativeSampleRate, nbFrames, outData);
+}
+
+- (UInt32)decodingBlockFrames:(UInt32)bufferLoadFrames
+{
+	if (mStreamingRing && (bufferLoadFrames > STREAMING_BLOCK_FRAMES))
+		return STREAMING_BLOCK_FRAMES;
+	return bufferLoadFrames;
+}
+
+- (SInt64)decodeFrames:(void*)outData maxFrames:(UInt32)maxFrames
+{
+	return -1;
+}
+
+- (void)seekDecoderTo:(UInt64)startInputPosition
+{
+}
+
+/* Next frames of the track: copied from the mapped cache entry if the track is cached, decoded otherwise */
+- (SInt64)streamFrames:(void*)outData maxFrames:(UInt32)maxFrames at:(SInt64)position
+{
+	SInt64 cachedFrames;
+
+	if (mPCMCacheData == NULL)
+		return [self decodeFrames:outData maxFrames:maxFrames];
+
+	cachedFrames = (SInt64)(mPCMCacheDataSize / mOutputStreamFormat.mBytesPerFrame) - position;
+	if (cachedFrames <= 0) return 0;
+	if (cachedFrames > maxFrames) cachedFrames = maxFrames;
+
+	memcpy(outData, (UInt8*)mPCMCacheData + position*mOutputStreamFormat.mBytesPerFrame,
+		   (size_t)(cachedFrames*mOutputStreamFormat.mBytesPerFrame));
+	return cachedFrames;
+}
+
+- (int)streamChunk:(UInt64)startInputPosition
+	NumTotalFrames:(SInt64*)numTotalFrames
+   NumLoadedFrames:(SInt64*)numLoadedFrames
+			Status:(UInt32*)status
+ NextInputPosition:(SInt64*)nextInputPosition
+		 ForBuffer:(int)bufIdx
+{
+	AudioRingBuffer *ring = mStreamingRing;
+	SInt64 framesToLoad = (SInt64)(mLengthFrames * mTargetSampleRate / mNativeSampleRate) - startInputPosition;
+	__block int cacheFd = -1;
+	__block NSString *cacheTempPath = nil;
+
+	if (ring == NULL) return -1;
+
+	//Decoded frames are widened to the ring ones, never narrowed: wider frames would overrun the ring
+	NSAssert(mOutputStreamFormat.mBytesPerFrame <= ring->bytesPerFrame, @"Decoded frames wider than the streaming ring ones");
+	if (mOutputStreamFormat.mBytesPerFrame > ring->bytesPerFrame) return -1;
+
+	//Ring frames wider than the track ones (multichannel ring): decode in a fixed block, then widen to the ring
+	if ((mOutputStreamFormat.mBytesPerFrame < ring->bytesPerFrame) && (mStreamingBlock == NULL)) {
+		mStreamingBlock = malloc(STREAMING_BLOCK_FRAMES * mOutputStreamFormat.mBytesPerFrame);
+		if (mStreamingBlock == NULL) return -1;
+	}
+
+	//Decoded PCM cache: the track is read from its entry if already cached, else stored once decoded from its start
+	if (mPCMCache && (mPCMCacheData == NULL)) {
+		mPCMCacheData = [mPCMCache mapEntry:[self PCMCacheKey] sizeInBytes:&mPCMCacheDataSize];
+		if (mPCMCacheData) mIsPCMCacheStored = YES;
+	}
+	if (mPCMCacheData)
+		framesToLoad = (SInt64)(mPCMCacheDataSize / mOutputStreamFormat.mBytesPerFrame) - startInputPosition;
+	else if (mPCMCache && !mIsPCMCacheStored && (startInputPosition == 0)) {
+		cacheFd = [mPCMCache createEntryFile:[self PCMCacheKey] tempPath:&cacheTempPath];
+		[cacheTempPath retain];
+	}
+
+	//Check if need to seek the file read position
+	if ((mPCMCacheData == NULL) && (startInputPosition != mNextFrameToLoadPosition))
+		[self seekDecoderTo:startInputPosition];
+	mNextFrameToLoadPosition = startInputPosition;
+
+	if (mVerifierSerial != 0)
+		AudioOutputVerifierRestartSource(mVerifier, mVerifierSerial, startInputPosition);
+
+	//Track length is known only once the end of file is reached
+	*numTotalFrames = 0;
+	*numLoadedFrames = startInputPosition;
+	*nextInputPosition = startInputPosition;
+	*status = kAudioFileLoaderStatusEOF | kAudioFileLoaderStatusLoading;
+	mIsMakingBackgroundTask |= kAudioFileLoaderLoadingBuffer;
+
+	dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		SInt64 framesDecoded = 0;
+		SInt64 nextReportPosition = startInputPosition;
+		UInt32 framesToWrite;
+		void *ringRegion,*decodedFrames;
+		bool isTrackStarted = NO;
+
+		//Tracks are written in playing order: wait for the previous one to be completely decoded
+		while (((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0)
+			   && (ring->nextProducerBuffer != bufIdx))
+			AudioRingBufferWaitForTurn(ring, bufIdx);
+
+		while ((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0) {
+			framesToWrite = AudioRingBufferGetWriteRegion(ring, &ringRegion);
+
+			//Ring full: wait for the IO proc to play a decoding block worth of frames
+			if (framesToWrite == 0) {
+				AudioRingBufferWaitForSpace(ring, STREAMING_BLOCK_FRAMES, false);
+				continue;
+			}
+			if (!isTrackStarted && !AudioRingBufferPushMarker(ring, bufIdx)) {
+				AudioRingBufferWaitForSpace(ring, 0, true);
+				continue;
+			}
+			isTrackStarted = YES;
+
+			if (mOutputStreamFormat.mBytesPerFrame < ring->bytesPerFrame) {
+				if (framesToWrite > STREAMING_BLOCK_FRAMES) framesToWrite = STREAMING_BLOCK_FRAMES;
+				decodedFrames = mStreamingBlock;
+				framesDecoded = [self streamFrames:decodedFrames maxFrames:framesToWrite at:*numLoadedFrames];
+				if (framesDecoded <= 0) break;
+				widenFrames((UInt8*)ringRegion, ring->bytesPerFrame, (const UInt8*)mStreamingBlock, mOutputStreamFormat.mBytesPerFrame, framesDecoded);
+			}
+			else {
+				decodedFrames = ringRegion;
+				framesDecoded = [self streamFrames:decodedFrames maxFrames:framesToWrite at:*numLoadedFrames];
+				if (framesDecoded <= 0) break;
+			}
+
+			//Cache entry written in the track frames format, not the ring one
+			if ((cacheFd >= 0)
+				&& (write(cacheFd, decodedFrames, (size_t)(framesDecoded*mOutputStreamFormat.mBytesPerFrame))
+					!= (ssize_t)(framesDecoded*mOutputStreamFormat.mBytesPerFrame))) {
+				[mPCMCache discardEntryFile:cacheFd tempPath:cacheTempPath];
+				cacheFd = -1;
+			}
+
+			if (mVerifierSerial != 0) {
+				AudioOutputVerifierHashSource(mVerifier, mVerifierSerial, ringRegion, *numLoadedFrames, framesDecoded, ring->bytesPerFrame);
+				AudioOutputVerifierPostSource(mVerifier, mVerifierSerial, *numLoadedFrames + framesDecoded, NO, [self sourceMD5Status]);
+			}
+
+			AudioRingBufferCommitWrite(ring, (UInt32)framesDecoded);
+			*numLoadedFrames += framesDecoded;
+
+			//Report decode progress every second, the first report allowing playback to start
+			if (*numLoadedFrames >= nextReportPosition) {
+				SInt64 loadedFrames = *numLoadedFrames - startInputPosition;
+				nextReportPosition = *numLoadedFrames + (SInt64)mTargetSampleRate;
+				dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																						  to:loadedFrames
+																						upTo:framesToLoad
+																				   forBuffer:bufIdx
+																				   completed:NO
+																					   reset:NO];});
+			}
+		}
+
+		if ((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0) {
+			//End of file (or decoding error): the actual length is now known
+			*numTotalFrames = *numLoadedFrames;
+			if (mVerifierSerial != 0)
+				AudioOutputVerifierPostSource(mVerifier, mVerifierSerial, *numTotalFrames, (framesDecoded == 0), [self sourceMD5Status]);
+			dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateCurrentTrackTotalLength:*numTotalFrames
+																							 duration:*numTotalFrames/mTargetSampleRate
+																							forBuffer:bufIdx];});
+			//Let the next track be decoded
+			AudioRingBufferSetNextProducer(ring, (bufIdx == 0)?1:0);
+		}
+
+		//Only a track decoded up to its end is cached
+		if (cacheFd >= 0) {
+			if (((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0) && (framesDecoded == 0)) {
+				[mPCMCache commitEntryFile:cacheFd tempPath:cacheTempPath key:[self PCMCacheKey]];
+				mIsPCMCacheStored = YES;
+			}
+			else
+				[mPCMCache discardEntryFile:cacheFd tempPath:cacheTempPath];
+		}
+		[cacheTempPath release];
+
+		*status &= ~kAudioFileLoaderStatusLoading;
+		*nextInputPosition = *numLoadedFrames;
+		mNextFrameToLoadPosition = *nextInputPosition;
+
+		dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																				  to:*numLoadedFrames - startInputPosition
+																				upTo:framesToLoad
+																		   forBuffer:bufIdx
+																		   completed:YES
+																			   reset:NO];});
+	});
+
+	return 0;
+}
+
 - (void)abortLoading
 {
 	if (mIsMakingBackgroundTask != 0) {
 		mIsMakingBackgroundTask = 0;
+		//Streaming producer may be blocked on the ring
+		if (mStreamingRing) AudioRingBufferWakeProducers(mStreamingRing);
 		dispatch_group_wait(mBackgroundLoadGroup, DISPATCH_TIME_FOREVER);
 	}
 }
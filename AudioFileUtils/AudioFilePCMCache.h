@@ -0,0 +1,98 @@
+/*
+ AudioFilePCMCache.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOFILEPCMCACHE_H__
+#define __AUDIOFILEPCMCACHE_H__
+
+#include <dispatch/dispatch.h>
+#import <Cocoa/Cocoa.h>
+
+/**
+ class AudioFilePCMCache
+ On-disk cache of decoded tracks, in the final buffer format (after sample rate conversion and integer mode conversion)
+ Each entry is a raw PCM file, the frames starting at offset 0 for the file to be mapped page aligned straight into
+ the audio buffers. Entries are evicted least recently used first, once the cache size is over its limit.
+ */
+@interface AudioFilePCMCache : NSObject
+{
+	NSString *mDirectory;
+	UInt64 mMaxSizeInBytes;
+	dispatch_queue_t mQueue; //Serial queue of the entries writing and eviction
+}
+
+/** sharedCache
+ @return the cache of the application, in the user caches folder. Its size limit is read from the preferences at each call
+ */
++ (AudioFilePCMCache*)sharedCache;
+
+- (id)initWithDirectory:(NSString*)directory maxSize:(UInt64)maxSizeInBytes;
+- (void)setMaxSize:(UInt64)maxSizeInBytes;
+
+/** keyForFile
+ Builds the key of a decoded track
+ @param fileURL the source file, its modification date and size being part of the key
+ @param parameters the decoding parameters (output format, sample rate converter settings, ...)
+ @return the entry key, nil if the file attributes can't be read
+ */
+- (NSString*)keyForFile:(NSURL*)fileURL decodingParameters:(NSString*)parameters;
+
+/** mapEntry
+ Maps the entry file in memory. The entry is marked as the most recently used one
+ @param key the entry key
+ @param sizeInBytes On output: the size of the frames data
+ @return the page aligned mapped frames, to be released by munmap (or vm_deallocate), NULL if the entry is not cached
+ */
+- (void*)mapEntry:(NSString*)key sizeInBytes:(UInt64*)sizeInBytes;
+
+/** storeEntry
+ Writes a decoded track in the background
+ @param key the entry key
+ @param data the frames data. It is copied (copy-on-write) before returning, the caller keeping its ownership
+ @param sizeInBytes the frames data size
+ */
+- (void)storeEntry:(NSString*)key data:(const void*)data sizeInBytes:(UInt64)sizeInBytes;
+
+/** createEntryFile
+ Starts the incremental writing of an entry, for tracks decoded in small steps
+ @param key the entry key
+ @param tempPath On output: the path of the temporary file, to be given to commitEntryFile or discardEntryFile
+ @return the file descriptor to write the frames to, -1 on error
+ */
+- (int)createEntryFile:(NSString*)key tempPath:(NSString**)tempPath;
+
+/** commitEntryFile
+ Closes the file, and makes it the entry of the key
+ */
+- (void)commitEntryFile:(int)fd tempPath:(NSString*)tempPath key:(NSString*)key;
+
+/** discardEntryFile
+ Closes and deletes an incomplete entry file
+ */
+- (void)discardEntryFile:(int)fd tempPath:(NSString*)tempPath;
+
+/** evict
+ Deletes in the background the least recently used entries, until the cache size is under its limit
+ */
+- (void)evict;
+@end
+
+#endif
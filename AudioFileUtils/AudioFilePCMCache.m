@@ -0,0 +1,280 @@
+/*
+ AudioFilePCMCache.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mach/mach_init.h>
+#include </usr/include/mach/vm_map.h>
+#include <CommonCrypto/CommonDigest.h>
+
+#import "AudioFilePCMCache.h"
+#import "PreferenceController.h"
+
+#define PCMCACHE_ENTRY_EXTENSION @"pcm"
+#define PCMCACHE_TEMP_EXTENSION @"part"
+#define PCMCACHE_STALE_TEMP_SECONDS (24*3600) //Temporary files left by a crash are deleted by the eviction after this delay
+
+@implementation AudioFilePCMCache
+
++ (AudioFilePCMCache*)sharedCache
+{
+	static AudioFilePCMCache *sharedCache = nil;
+	static dispatch_once_t onceToken;
+	UInt64 maxSize = (UInt64)[[NSUserDefaults standardUserDefaults] integerForKey:AUDPCMCacheMaxSize]*1024*1024;
+
+	dispatch_once(&onceToken, ^{
+		NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+		NSString *basePath = ([paths count] > 0) ? [paths objectAtIndex:0] : NSTemporaryDirectory();
+
+		sharedCache = [[AudioFilePCMCache alloc] initWithDirectory:[[basePath stringByAppendingPathComponent:@"Audirvana"]
+																	stringByAppendingPathComponent:@"PCMCache"]
+														  maxSize:maxSize];
+	});
+
+	[sharedCache setMaxSize:maxSize];
+	return sharedCache;
+}
+
+- (id)initWithDirectory:(NSString*)directory maxSize:(UInt64)maxSizeInBytes
+{
+	NSFileManager *fileMgr = [[NSFileManager alloc] init];
+
+	mDirectory = [directory retain];
+	mMaxSizeInBytes = maxSizeInBytes;
+	mQueue = dispatch_queue_create("fr.dplisson.audirvana.PCMCache", NULL);
+
+	[fileMgr createDirectoryAtPath:mDirectory withIntermediateDirectories:YES attributes:nil error:NULL];
+	[fileMgr release];
+
+	return [super init];
+}
+
+- (void)dealloc
+{
+	if (mQueue) {
+		dispatch_sync(mQueue, ^{});
+		dispatch_release(mQueue);
+	}
+	[mDirectory release];
+	[super dealloc];
+}
+
+- (void)setMaxSize:(UInt64)maxSizeInBytes
+{
+	mMaxSizeInBytes = maxSizeInBytes;
+}
+
+- (NSString*)keyForFile:(NSURL*)fileURL decodingParameters:(NSString*)parameters
+{
+	struct stat fileStat;
+	NSString *keyString;
+	const char *keyUTF8;
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	NSMutableString *key;
+	int i;
+
+	if (![fileURL isFileURL] || (stat([[fileURL path] fileSystemRepresentation], &fileStat) != 0))
+		return nil;
+
+	//Any change of the source file or of the decoding gives a new entry, the previous one being evicted when no longer used
+	keyString = [NSString stringWithFormat:@"%@|%lld|%ld.%09ld|%@", [fileURL path], (long long)fileStat.st_size,
+				 (long)fileStat.st_mtimespec.tv_sec, (long)fileStat.st_mtimespec.tv_nsec, parameters];
+	keyUTF8 = [keyString UTF8String];
+	CC_SHA1(keyUTF8, (CC_LONG)strlen(keyUTF8), digest);
+
+	key = [NSMutableString stringWithCapacity:2*CC_SHA1_DIGEST_LENGTH];
+	for (i=0;i<CC_SHA1_DIGEST_LENGTH;i++)
+		[key appendFormat:@"%02x", digest[i]];
+
+	return key;
+}
+
+- (NSString*)pathForKey:(NSString*)key
+{
+	return [mDirectory stringByAppendingPathComponent:[key stringByAppendingPathExtension:PCMCACHE_ENTRY_EXTENSION]];
+}
+
+- (void*)mapEntry:(NSString*)key sizeInBytes:(UInt64*)sizeInBytes
+{
+	const char *entryPath;
+	struct stat entryStat;
+	void *data;
+	int fd;
+
+	if (key == nil) return NULL;
+
+	entryPath = [[self pathForKey:key] fileSystemRepresentation];
+	fd = open(entryPath, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	if ((fstat(fd, &entryStat) != 0) || (entryStat.st_size == 0)) {
+		close(fd);
+		return NULL;
+	}
+
+	//Private writable mapping: the buffer can be handled as an allocated one, the file being never modified
+	data = mmap(NULL, (size_t)entryStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return NULL;
+
+	//Least recently used order is the entries files modification date one
+	utimes(entryPath, NULL);
+
+	*sizeInBytes = (UInt64)entryStat.st_size;
+	return data;
+}
+
+- (void)storeEntry:(NSString*)key data:(const void*)data sizeInBytes:(UInt64)sizeInBytes
+{
+	vm_address_t dataCopy;
+	NSString *tempPath = nil;
+	int fd;
+
+	if ((key == nil) || (sizeInBytes == 0) || (sizeInBytes > mMaxSizeInBytes)) return;
+
+	//Copy-on-write snapshot: the buffer may be released by the player while the entry is being written
+	if (vm_allocate(mach_task_self(), &dataCopy, (vm_size_t)sizeInBytes, VM_FLAGS_ANYWHERE) != KERN_SUCCESS)
+		return;
+	if (vm_copy(mach_task_self(), (vm_address_t)data, (vm_size_t)round_page(sizeInBytes), dataCopy) != KERN_SUCCESS) {
+		vm_deallocate(mach_task_self(), dataCopy, (vm_size_t)sizeInBytes);
+		return;
+	}
+
+	fd = [self createEntryFile:key tempPath:&tempPath];
+	if (fd < 0) {
+		vm_deallocate(mach_task_self(), dataCopy, (vm_size_t)sizeInBytes);
+		return;
+	}
+
+	[key retain];
+	[tempPath retain];
+	dispatch_async(mQueue, ^{
+		const UInt8 *src = (const UInt8*)dataCopy;
+		UInt64 remaining = sizeInBytes;
+		ssize_t written = 0;
+
+		while (remaining > 0) {
+			written = write(fd, src, (remaining > (1<<30)) ? (1<<30) : (size_t)remaining);
+			if (written <= 0) break;
+			src += written;
+			remaining -= written;
+		}
+		vm_deallocate(mach_task_self(), dataCopy, (vm_size_t)sizeInBytes);
+
+		if (remaining == 0)
+			[self commitEntryFile:fd tempPath:tempPath key:key];
+		else
+			[self discardEntryFile:fd tempPath:tempPath];
+
+		[tempPath release];
+		[key release];
+	});
+}
+
+- (int)createEntryFile:(NSString*)key tempPath:(NSString**)tempPath
+{
+	char pathTemplate[PATH_MAX];
+	NSString *templateString;
+	int fd;
+
+	if (key == nil) return -1;
+
+	templateString = [mDirectory stringByAppendingPathComponent:
+					  [NSString stringWithFormat:@"%@.XXXXXX.%@", key, PCMCACHE_TEMP_EXTENSION]];
+	if (![templateString getFileSystemRepresentation:pathTemplate maxLength:PATH_MAX])
+		return -1;
+
+	fd = mkstemps(pathTemplate, (int)[PCMCACHE_TEMP_EXTENSION length] + 1);
+	if (fd < 0) return -1;
+
+	*tempPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:pathTemplate length:strlen(pathTemplate)];
+	return fd;
+}
+
+- (void)commitEntryFile:(int)fd tempPath:(NSString*)tempPath key:(NSString*)key
+{
+	if (close(fd) != 0) {
+		unlink([tempPath fileSystemRepresentation]);
+		return;
+	}
+
+	//Atomic replacement: a reader maps either the previous entry or the complete new one
+	if (rename([tempPath fileSystemRepresentation], [[self pathForKey:key] fileSystemRepresentation]) != 0) {
+		unlink([tempPath fileSystemRepresentation]);
+		return;
+	}
+
+	[self evict];
+}
+
+- (void)discardEntryFile:(int)fd tempPath:(NSString*)tempPath
+{
+	close(fd);
+	unlink([tempPath fileSystemRepresentation]);
+}
+
+- (void)evict
+{
+	dispatch_async(mQueue, ^{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSFileManager *fileMgr = [[NSFileManager alloc] init];
+		NSArray *entries = [fileMgr contentsOfDirectoryAtPath:mDirectory error:NULL];
+		NSMutableArray *lruEntries = [NSMutableArray arrayWithCapacity:[entries count]];
+		NSDictionary *attributes;
+		NSString *entryPath;
+		UInt64 totalSize = 0;
+
+		for (NSString *entryName in entries) {
+			entryPath = [mDirectory stringByAppendingPathComponent:entryName];
+			attributes = [fileMgr attributesOfItemAtPath:entryPath error:NULL];
+			if (attributes == nil) continue;
+
+			if ([[entryName pathExtension] isEqualToString:PCMCACHE_TEMP_EXTENSION]) {
+				if ([[attributes fileModificationDate] timeIntervalSinceNow] < -PCMCACHE_STALE_TEMP_SECONDS)
+					[fileMgr removeItemAtPath:entryPath error:NULL];
+				continue;
+			}
+			if (![[entryName pathExtension] isEqualToString:PCMCACHE_ENTRY_EXTENSION]) continue;
+
+			totalSize += [attributes fileSize];
+			[lruEntries addObject:[NSDictionary dictionaryWithObjectsAndKeys:entryPath, @"path",
+								   [attributes fileModificationDate], @"date",
+								   [NSNumber numberWithUnsignedLongLong:[attributes fileSize]], @"size", nil]];
+		}
+
+		//Oldest used first. An entry mapped by the player stays readable until unmapped
+		[lruEntries sortUsingDescriptors:[NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:@"date" ascending:YES] autorelease]]];
+		for (NSDictionary *entry in lruEntries) {
+			if (totalSize <= mMaxSizeInBytes) break;
+			if ([fileMgr removeItemAtPath:[entry objectForKey:@"path"] error:NULL])
+				totalSize -= [[entry objectForKey:@"size"] unsignedLongLongValue];
+		}
+
+		[fileMgr release];
+		[pool drain];
+	});
+}
+
+@end
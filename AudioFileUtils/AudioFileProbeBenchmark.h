@@ -0,0 +1,51 @@
+/*
+ AudioFileProbeBenchmark.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+#ifndef __AUDIOFILEPROBEBENCHMARK_H__
+#define __AUDIOFILEPROBEBENCHMARK_H__
+
+#import <Cocoa/Cocoa.h>
+
+/**
+ class AudioFileProbeBenchmark
+ Playlist insertion throughput, in files per second: metadata probes of every supported file of a folder,
+ serial and concurrent as when a folder is added to the playlist, against the loaders they replaced
+ */
+@interface AudioFileProbeBenchmark : NSObject
+{
+}
+
+/** writeReport
+ Runs the benchmark on the files of a folder, and writes one CSV line per method
+ @param path the CSV file to write
+ @param folderPath the folder whose files are probed, recursively
+ @return true if success
+ @comment The first pass also warms the file system cache, to measure the parsing and not the disk.
+ Takes as long as opening the folder files several times: not to be run on the main thread
+ */
++ (bool)writeReport:(NSString*)path forFolder:(NSString*)folderPath;
+
+@end
+
+#endif
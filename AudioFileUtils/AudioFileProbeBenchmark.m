@@ -0,0 +1,143 @@
+/*
+ AudioFileProbeBenchmark.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+#include <dispatch/dispatch.h>
+#include <libkern/OSAtomic.h>
+
+#import "AudioFileProbeBenchmark.h"
+#import "AudioFileLoader.h"
+
+#define PROBE_BENCHMARK_BATCH_FILES 64 //Same batches as the playlist folder insertion
+
+enum {
+	kProbeBenchmarkLoader = 0, //Loader created for each file, as before the probes
+	kProbeBenchmarkSerial = 1,
+	kProbeBenchmarkConcurrent = 2,
+	kProbeBenchmarkMethodsCount = 3
+};
+
+static const char * const kProbeBenchmarkMethodNames[] = { "loader", "probe serial", "probe concurrent" };
+
+@implementation AudioFileProbeBenchmark
+
+/* Supported files of the folder, in the playlist insertion order */
++ (NSArray*)filesOfFolder:(NSString*)folderPath
+{
+	NSFileManager *fileManager = [[NSFileManager alloc] init];
+	NSDirectoryEnumerator *dirEnum = [fileManager enumeratorAtURL:[NSURL fileURLWithPath:folderPath]
+									   includingPropertiesForKeys:[NSArray arrayWithObject:NSURLIsDirectoryKey]
+														  options:NSDirectoryEnumerationSkipsHiddenFiles errorHandler:nil];
+	NSMutableArray *files = [NSMutableArray array];
+	NSNumber *isDirectory;
+
+	for (NSURL *fileURL in dirEnum) {
+		if ((![fileURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL] || ![isDirectory boolValue])
+			&& [AudioFileLoader isFormatSupported:fileURL])
+			[files addObject:fileURL];
+	}
+	[fileManager release];
+	return files;
+}
+
+/* @return the number of files whose metadata was read */
++ (NSUInteger)readFiles:(NSArray*)files method:(int)method
+{
+	__block NSUInteger nbFilesRead = 0;
+	NSUInteger nbFiles = [files count];
+	NSUInteger batchStart,i;
+
+	switch (method) {
+		case kProbeBenchmarkLoader:
+			for (i=0;i<nbFiles;i++) {
+				NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+				AudioFileLoader *loader = [AudioFileLoader createWithURL:[files objectAtIndex:i]];
+				if (loader) {
+					//Playlist metadata, as the insertion read it
+					[loader title]; [loader album]; [loader artist]; [loader composer];
+					[loader durationInSeconds]; [loader trackNumber];
+					[loader close];
+					nbFilesRead++;
+				}
+				[pool drain];
+			}
+			break;
+
+		case kProbeBenchmarkSerial:
+			for (i=0;i<nbFiles;i++) {
+				NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+				if ([AudioFileLoader probeMetadata:[files objectAtIndex:i]]) nbFilesRead++;
+				[pool drain];
+			}
+			break;
+
+		case kProbeBenchmarkConcurrent:
+			for (batchStart=0;batchStart<nbFiles;batchStart+=PROBE_BENCHMARK_BATCH_FILES) {
+				NSUInteger batchSize = MIN(PROBE_BENCHMARK_BATCH_FILES, nbFiles - batchStart);
+				__block volatile int32_t batchFilesRead = 0;
+
+				dispatch_apply(batchSize, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t fileIdx) {
+					NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+					if ([AudioFileLoader probeMetadata:[files objectAtIndex:batchStart + fileIdx]])
+						OSAtomicIncrement32(&batchFilesRead);
+					[pool drain];
+				});
+				nbFilesRead += batchFilesRead;
+			}
+			break;
+	}
+	return nbFilesRead;
+}
+
++ (bool)writeReport:(NSString*)path forFolder:(NSString*)folderPath
+{
+	NSArray *files = [self filesOfFolder:folderPath];
+	NSUInteger nbFilesRead;
+	CFAbsoluteTime startTime;
+	double elapsedTime;
+	FILE *csvFile;
+	int method;
+
+	if ([files count] == 0) return false;
+
+	csvFile = fopen([path fileSystemRepresentation], "w");
+	if (csvFile == NULL) return false;
+
+	[self readFiles:files method:kProbeBenchmarkSerial]; //Warm up the file system cache
+
+	fprintf(csvFile, "Method,Files,Files read,Seconds,Files/s\n");
+	for (method=0;method<kProbeBenchmarkMethodsCount;method++) {
+		startTime = CFAbsoluteTimeGetCurrent();
+		nbFilesRead = [self readFiles:files method:method];
+		elapsedTime = CFAbsoluteTimeGetCurrent() - startTime;
+
+		fprintf(csvFile, "%s,%lu,%lu,%.3f,%.1f\n", kProbeBenchmarkMethodNames[method], (unsigned long)[files count],
+				(unsigned long)nbFilesRead, elapsedTime, (elapsedTime > 0) ? (double)nbFilesRead/elapsedTime : 0.0);
+		fflush(csvFile);
+	}
+
+	fclose(csvFile);
+	return true;
+}
+
+@end
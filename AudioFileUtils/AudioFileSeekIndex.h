@@ -0,0 +1,79 @@
+/*
+ AudioFileSeekIndex.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOFILESEEKINDEX_H__
+#define __AUDIOFILESEEKINDEX_H__
+
+#include <dispatch/dispatch.h>
+#import <Cocoa/Cocoa.h>
+
+#define kAudioFileSeekIndexIntervalSeconds 1 //Interval between two index points
+
+/**
+ class AudioFileSeekIndex
+ Sample to byte offset index of a compressed file having no seek table of its own
+ Points are added while the file is decoded (the first frame starting in each interval), and saved to a sidecar file
+ in the user caches folder: seeking next times reads the file from the frame preceding the target, with no bisection.
+ */
+@interface AudioFileSeekIndex : NSObject
+{
+	NSString *mPath; //Sidecar file path
+	UInt64 mLengthFrames;
+	UInt64 mIntervalFrames;
+	UInt32 mNbPoints;
+	UInt64 *mPoints; //Pairs of (first frame sample, its byte offset) for each interval, 0 offset if not known yet
+	bool mIsModified;
+}
+
+/** initWithFile
+ Creates the index of a file, reading its sidecar file if the index was already saved
+ @param fileURL the indexed file, its modification date and size being part of the sidecar file name
+ @param lengthFrames the file length in frames
+ @param sampleRate the file sample rate
+ @return the index, nil if the file attributes can't be read
+ */
+- (id)initWithFile:(NSURL*)fileURL lengthFrames:(UInt64)lengthFrames sampleRate:(Float64)sampleRate;
+
+/** addPoint
+ Records the start of a decoded frame. Can be called from several decoding threads
+ @param sample the frame first sample
+ @param byteOffset the frame offset in the file
+ */
+- (void)addPoint:(UInt64)sample offset:(UInt64)byteOffset;
+
+/** getPointBefore
+ Finds the frame to start decoding from to seek to a sample
+ @param sample the seek target
+ @param pointSample On output: the first sample of the frame, at most two intervals before the target
+ @param byteOffset On output: the frame offset in the file
+ @return true if the point is known
+ */
+- (bool)getPointBefore:(UInt64)sample pointSample:(UInt64*)pointSample offset:(UInt64*)byteOffset;
+
+/** save
+ Writes the sidecar file in the background, if points were added
+ */
+- (void)save;
+
+@end
+
+#endif
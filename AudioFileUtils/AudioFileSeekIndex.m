@@ -0,0 +1,191 @@
+/*
+ AudioFileSeekIndex.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <sys/stat.h>
+#include <CommonCrypto/CommonDigest.h>
+
+#import "AudioFileSeekIndex.h"
+
+#define SEEKINDEX_FILE_EXTENSION @"idx"
+#define SEEKINDEX_MAGIC 'AUSI'
+#define SEEKINDEX_VERSION 1
+
+/* Sidecar file header, followed by the points */
+typedef struct {
+	UInt32 magic;
+	UInt32 version;
+	UInt64 lengthFrames;
+	UInt64 intervalFrames;
+	UInt64 nbPoints;
+} AudioFileSeekIndexHeader;
+
+@implementation AudioFileSeekIndex
+
+/* Serial queue of the sidecar files writing */
++ (dispatch_queue_t)saveQueue
+{
+	static dispatch_queue_t saveQueue = NULL;
+	static dispatch_once_t onceToken;
+
+	dispatch_once(&onceToken, ^{
+		saveQueue = dispatch_queue_create("fr.dplisson.audirvana.SeekIndex", NULL);
+	});
+	return saveQueue;
+}
+
++ (NSString*)directory
+{
+	NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+	NSString *basePath = ([paths count] > 0) ? [paths objectAtIndex:0] : NSTemporaryDirectory();
+
+	return [[basePath stringByAppendingPathComponent:@"Audirvana"] stringByAppendingPathComponent:@"SeekIndex"];
+}
+
+- (id)initWithFile:(NSURL*)fileURL lengthFrames:(UInt64)lengthFrames sampleRate:(Float64)sampleRate
+{
+	struct stat fileStat;
+	NSString *keyString;
+	const char *keyUTF8;
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	NSMutableString *key;
+	NSData *savedIndex;
+	const AudioFileSeekIndexHeader *header;
+	int i;
+
+	if (![fileURL isFileURL] || (stat([[fileURL path] fileSystemRepresentation], &fileStat) != 0)
+		|| (lengthFrames == 0) || (sampleRate <= 0)) {
+		[self release];
+		return nil;
+	}
+
+	//A modified file gets a new index, the stale sidecar file being left to the caches folder cleaning
+	keyString = [NSString stringWithFormat:@"%@|%lld|%ld.%09ld", [fileURL path], (long long)fileStat.st_size,
+				 (long)fileStat.st_mtimespec.tv_sec, (long)fileStat.st_mtimespec.tv_nsec];
+	keyUTF8 = [keyString UTF8String];
+	CC_SHA1(keyUTF8, (CC_LONG)strlen(keyUTF8), digest);
+
+	key = [NSMutableString stringWithCapacity:2*CC_SHA1_DIGEST_LENGTH];
+	for (i=0;i<CC_SHA1_DIGEST_LENGTH;i++)
+		[key appendFormat:@"%02x", digest[i]];
+
+	mPath = [[[[self class] directory] stringByAppendingPathComponent:[key stringByAppendingPathExtension:SEEKINDEX_FILE_EXTENSION]] retain];
+	mLengthFrames = lengthFrames;
+	mIntervalFrames = (UInt64)(kAudioFileSeekIndexIntervalSeconds * sampleRate);
+	mNbPoints = (UInt32)(lengthFrames / mIntervalFrames) + 1;
+	mIsModified = NO;
+
+	mPoints = calloc(mNbPoints, 2*sizeof(UInt64));
+	if (mPoints == NULL) {
+		[self release];
+		return nil;
+	}
+
+	//Points saved by a previous decoding of the same file
+	savedIndex = [NSData dataWithContentsOfFile:mPath];
+	header = (const AudioFileSeekIndexHeader*)[savedIndex bytes];
+	if (([savedIndex length] == (sizeof(AudioFileSeekIndexHeader) + mNbPoints*2*sizeof(UInt64)))
+		&& (header->magic == SEEKINDEX_MAGIC) && (header->version == SEEKINDEX_VERSION)
+		&& (header->lengthFrames == mLengthFrames) && (header->intervalFrames == mIntervalFrames)
+		&& (header->nbPoints == mNbPoints))
+		memcpy(mPoints, header + 1, mNbPoints*2*sizeof(UInt64));
+
+	return [super init];
+}
+
+- (void)dealloc
+{
+	if (mPoints) free(mPoints);
+	[mPath release];
+	[super dealloc];
+}
+
+- (void)addPoint:(UInt64)sample offset:(UInt64)byteOffset
+{
+	UInt64 interval = sample / mIntervalFrames;
+
+	if ((interval >= mNbPoints) || (byteOffset == 0)) return;
+
+	//Points are set only once, except for an earlier frame in the interval: no lock needed to skip the known ones
+	if ((mPoints[2*interval+1] != 0) && (mPoints[2*interval] <= sample)) return;
+
+	@synchronized(self) {
+		if ((mPoints[2*interval+1] == 0) || (mPoints[2*interval] > sample)) {
+			mPoints[2*interval] = sample;
+			mPoints[2*interval+1] = byteOffset;
+			mIsModified = YES;
+		}
+	}
+}
+
+- (bool)getPointBefore:(UInt64)sample pointSample:(UInt64*)pointSample offset:(UInt64*)byteOffset
+{
+	UInt64 interval = sample / mIntervalFrames;
+	int i;
+
+	if (interval >= mNbPoints) return false;
+
+	//The target interval point can start after the target: the previous interval one is then used
+	@synchronized(self) {
+		for (i=0;(i<2) && (interval >= (UInt64)i);i++) {
+			if ((mPoints[2*(interval-i)+1] != 0) && (mPoints[2*(interval-i)] <= sample)) {
+				*pointSample = mPoints[2*(interval-i)];
+				*byteOffset = mPoints[2*(interval-i)+1];
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+- (void)save
+{
+	NSMutableData *savedIndex;
+	AudioFileSeekIndexHeader header;
+	NSString *path = mPath;
+
+	@synchronized(self) {
+		if (!mIsModified) return;
+
+		header.magic = SEEKINDEX_MAGIC;
+		header.version = SEEKINDEX_VERSION;
+		header.lengthFrames = mLengthFrames;
+		header.intervalFrames = mIntervalFrames;
+		header.nbPoints = mNbPoints;
+
+		savedIndex = [[NSMutableData alloc] initWithBytes:&header length:sizeof(header)];
+		[savedIndex appendBytes:mPoints length:mNbPoints*2*sizeof(UInt64)];
+		mIsModified = NO;
+	}
+
+	[path retain];
+	dispatch_async([[self class] saveQueue], ^{
+		NSFileManager *fileMgr = [[NSFileManager alloc] init];
+
+		[fileMgr createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+		[savedIndex writeToFile:path atomically:YES];
+		[fileMgr release];
+		[savedIndex release];
+		[path release];
+	});
+}
+
+@end
@@ -20,6 +20,7 @@
  */
 
 #import "AudioFileLoader.h"
+#import "AudioFileBlockReader.h"
 
 #include <sndfile/sndfile.h>
 #include <samplerate/samplerate.h>
@@ -27,6 +28,7 @@
 @interface AudioFileSndFileLoader : AudioFileLoader {
 	SNDFILE *mSndFileRef;
 	SF_INFO mSF_Info;
+	AudioFileBlockReader *mSndFileReader; //File reads of libSndFile, NULL if opened by its own stdio
 
 	//For libSampleRate
 	SRC_STATE *mLibSrcState;
@@ -37,6 +39,8 @@
 	AudioConverterRef mCoreAudioConverterRef;
 
 	Float64 *mTmpSndFileSourceData; //Used for Integer mode
+	SInt32 *mTmpSndFileIntData; //Used for Integer mode of PCM files, NULL if read as 64bit float
+	void *mTmpChannelsData; //Frames read with the file channels, when they differ from the decoded ones
 }
 
 @end
\ No newline at end of file
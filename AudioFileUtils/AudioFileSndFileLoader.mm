@@ -28,6 +28,11 @@
 
 #include <dispatch/dispatch.h>
 #include </usr/include/mach/vm_map.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #import "AppController.h"
 #import "AudioFileSndFileLoader.h"
@@ -36,15 +41,224 @@
 
 #define TMP_SRC_BUFFER_SIZE 4096
 #define LIBSRC_OUTPUTBUF_SECONDS 5
+#define MAPPED_READAHEAD_SECONDS 10
 
 @interface AudioFileSndFileLoader (metadata)
 - (bool)getAiffMetadata:(NSURL*)fileURL;
 - (bool)getWavMetadata:(NSURL*)fileURL;
 - (long)readSRCdata:(float**)data;
 - (UInt32)readSRCdata:(Float64 **)data forFrames:(UInt32)nbFramesToRead; //For CoreAudio SRC
+- (sf_count_t)readIntegerFrames:(void*)outData maxFrames:(sf_count_t)nbFrames;
+- (int)loadMappedDataChunk:(void**)outBufferData
+		  AllocatedBufSize:(UInt64*)outBufferDataSize
+			 MaxBufferSize:(UInt64)maxBufSize
+			NumTotalFrames:(SInt64*)numTotalFrames
+		   NumLoadedFrames:(SInt64*)numLoadedFrames
+					Status:(UInt32*)status
+		 NextInputPosition:(SInt64*)nextInputPosition
+				 ForBuffer:(int)bufIdx;
 @end
 
 
+#pragma mark Channels remapping
+
+static inline sf_count_t sfReadFrames(SNDFILE *sndFile, float *frames, sf_count_t nbFrames)
+{
+	return sf_readf_float(sndFile, frames, nbFrames);
+}
+
+static inline sf_count_t sfReadFrames(SNDFILE *sndFile, double *frames, sf_count_t nbFrames)
+{
+	return sf_readf_double(sndFile, frames, nbFrames);
+}
+
+/* PCM samples scaled to 32bit, aligned high */
+static inline sf_count_t sfReadFrames(SNDFILE *sndFile, int *frames, sf_count_t nbFrames)
+{
+	return sf_readf_int(sndFile, frames, nbFrames);
+}
+
+/* libSndFile reads frames having the file channels: when the decoded stream has a different number of channels,
+ read through the temporary buffer, dropping the extra channels or completing with silent ones */
+template <typename T>
+static sf_count_t readFramesToChannels(SNDFILE *sndFile, int fileChannels, T *frames, int channels,
+									   sf_count_t nbFrames, void *tmpFrames)
+{
+	T *src = (T*)tmpFrames;
+	sf_count_t framesRead = 0, readStep = 0, i;
+	int channel;
+
+	if (fileChannels == channels) return sfReadFrames(sndFile, frames, nbFrames);
+
+	while (framesRead < nbFrames) {
+		readStep = nbFrames - framesRead;
+		if (readStep > TMP_SRC_BUFFER_SIZE) readStep = TMP_SRC_BUFFER_SIZE;
+		readStep = sfReadFrames(sndFile, src, readStep);
+		if (readStep <= 0) break;
+
+		for (i=0;i<readStep;i++)
+			for (channel=0;channel<channels;channel++)
+				frames[(framesRead+i)*channels+channel] = (channel < fileChannels) ? src[i*fileChannels+channel] : 0;
+		framesRead += readStep;
+	}
+	return (framesRead > 0) ? framesRead : readStep;
+}
+
+
+#pragma mark libSndFile virtual I/O
+
+/* libSndFile reads the file through the block reader instead of stdio */
+
+static sf_count_t blockReaderGetFileLength(void *user_data)
+{
+	return AudioFileBlockReaderLength((AudioFileBlockReader*)user_data);
+}
+
+static sf_count_t blockReaderSeek(sf_count_t offset, int whence, void *user_data)
+{
+	return AudioFileBlockReaderSeek((AudioFileBlockReader*)user_data, offset, whence);
+}
+
+static sf_count_t blockReaderRead(void *ptr, sf_count_t count, void *user_data)
+{
+	SInt64 bytesRead = AudioFileBlockReaderRead((AudioFileBlockReader*)user_data, ptr, count);
+	return (bytesRead < 0) ? 0 : bytesRead;
+}
+
+static sf_count_t blockReaderWrite(const void *ptr, sf_count_t count, void *user_data)
+{
+	return 0;
+}
+
+static sf_count_t blockReaderTell(void *user_data)
+{
+	return AudioFileBlockReaderTell((AudioFileBlockReader*)user_data);
+}
+
+static SF_VIRTUAL_IO blockReaderVirtualIO = {
+	blockReaderGetFileLength,
+	blockReaderSeek,
+	blockReaderRead,
+	blockReaderWrite,
+	blockReaderTell
+};
+
+
+#pragma mark Native format mapping
+
+/* Locates the samples of an uncompressed WAV (little endian) or AIFF (big endian) file
+ Returns the samples offset in the file, -1 if the chunk is not found */
+static off_t findPCMDataChunk(int fd, bool *isBigEndian, UInt64 *dataSize)
+{
+	UInt8 header[12];
+	off_t offset;
+	UInt64 chunkSize;
+	bool isAiff;
+
+	if (pread(fd, header, 12, 0) != 12) return -1;
+	if ((memcmp(header, "RIFF", 4) == 0) && (memcmp(header + 8, "WAVE", 4) == 0)) isAiff = false;
+	else if ((memcmp(header, "FORM", 4) == 0) && (memcmp(header + 8, "AIFF", 4) == 0)) isAiff = true;
+	else return -1;
+
+	for (offset = 12; pread(fd, header, 8, offset) == 8; offset += 8 + chunkSize + (chunkSize & 1)) { //Chunks are padded to an even size
+		chunkSize = isAiff ? OSReadBigInt32(header, 4) : OSReadLittleInt32(header, 4);
+
+		if (!isAiff && (memcmp(header, "data", 4) == 0)) {
+			*isBigEndian = false;
+			*dataSize = chunkSize;
+			return offset + 8;
+		}
+		else if (isAiff && (memcmp(header, "SSND", 4) == 0)) {
+			UInt32 samplesOffset;
+
+			//SSND chunk: samples offset and block size precede the samples
+			if ((chunkSize < 8) || (pread(fd, header, 4, offset + 8) != 4)) return -1;
+			samplesOffset = OSReadBigInt32(header, 0);
+			if (samplesOffset > chunkSize - 8) return -1;
+			*isBigEndian = true;
+			*dataSize = chunkSize - 8 - samplesOffset;
+			return offset + 16 + samplesOffset;
+		}
+	}
+	return -1;
+}
+
+
+#pragma mark Metadata helpers
+
+/* Fills a metadata dictionary from the strings libSndFile reads in the file header */
+static void addSndFileStrings(NSMutableDictionary *fileMetadata, SNDFILE *sndFile)
+{
+	static const int stringTypes[3] = { SF_STR_TITLE, SF_STR_ARTIST, SF_STR_ALBUM };
+	const char *metadataKeys[3] = { kAFInfoDictionary_Title, kAFInfoDictionary_Artist, kAFInfoDictionary_Album };
+	const char *str;
+	NSString *strValue;
+	int i;
+
+	for (i=0;i<3;i++) {
+		str = sf_get_string(sndFile, stringTypes[i]);
+		if (str) {
+			strValue = [NSString stringWithCString:str encoding:NSUTF8StringEncoding];
+			if (!strValue)
+				strValue = [NSString stringWithCString:str encoding:NSMacOSRomanStringEncoding];
+
+			if (strValue)
+				[fileMetadata setObject:strValue
+								 forKey:[NSString stringWithUTF8String: metadataKeys[i]]];
+		}
+	}
+}
+
+/* Fills a metadata dictionary from the ID3v2 tag of AIFF and WAV files
+ The cover art is read only if requested */
+static void addID3v2Tags(NSMutableDictionary *fileMetadata, TagLib::ID3v2::Tag *tag, bool withCoverArt)
+{
+	TagLib::String str;
+	TagLib::uint trackNumber;
+
+	str = tag->title();
+	if (!str.isNull())
+		[fileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
+	str = tag->artist();
+	if (!str.isNull())
+		[fileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
+	str = tag->album();
+	if (!str.isNull())
+		[fileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
+
+	trackNumber = tag->track();
+	if (trackNumber != 0)
+		[fileMetadata setObject:[NSNumber numberWithInt:trackNumber]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
+
+	if (!tag->frameListMap().isEmpty() && tag->frameListMap().contains("TCOM")) {
+		TagLib::ID3v2::FrameList composerList = tag->frameListMap()["TCOM"];
+		if (!composerList.isEmpty())
+			[fileMetadata setObject:[NSString stringWithUTF8String:composerList.front()->toString().toCString(true)]
+							 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
+	}
+
+	if (withCoverArt && !tag->frameListMap().isEmpty() && tag->frameListMap().contains("APIC")) {
+		TagLib::ID3v2::FrameList coverartList = tag->frameListMap()["APIC"];
+		if (!coverartList.isEmpty()) {
+			AudioFileCoverArt *albumArt = nil;
+			for(TagLib::ID3v2::FrameList::Iterator coverartIter = coverartList.begin(); coverartIter != coverartList.end(); coverartIter++) {
+				TagLib::ID3v2::AttachedPictureFrame *coverart =  dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*coverartIter);
+				if (coverart && (!albumArt || (coverart->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover)))
+					albumArt = [[AudioFileCoverArtCache sharedCache] coverArtWithBytes:coverart->picture().data()
+																				length:coverart->picture().size()];
+			}
+			if (albumArt)
+				[fileMetadata setObject:albumArt
+								 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
+		}
+	}
+}
+
+
 #pragma mark SRC callbacks
 
 static long sampleRateCallBack(void *cb_data, float **data)
@@ -62,8 +276,8 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	AudioFileSndFileLoader *sndFileLoader = (AudioFileSndFileLoader*) inUserData;
 
 	*ioNumberDataPackets = (UInt32)[sndFileLoader readSRCdata:(Float64**)&ioData->mBuffers[0].mData forFrames:*ioNumberDataPackets];
-	ioData->mBuffers[0].mDataByteSize = (UInt32)(*ioNumberDataPackets*2*sizeof(Float64));
-	ioData->mBuffers[0].mNumberChannels = 2;
+	ioData->mBuffers[0].mNumberChannels = [sndFileLoader outputChannels];
+	ioData->mBuffers[0].mDataByteSize = (UInt32)(*ioNumberDataPackets*ioData->mBuffers[0].mNumberChannels*sizeof(Float64));
 
 	return noErr;
 }
@@ -107,10 +321,50 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	return false;
 }
 
++ (NSDictionary*)probeMetadata:(NSURL*)fileURL
+{
+	NSMutableDictionary *fileMetadata;
+	NSString *fileExtension;
+	SNDFILE *sndFile = NULL;
+	SF_INFO sfInfo;
+	const char *filePathStr = [[fileURL path] fileSystemRepresentation];
+
+	if (filePathStr == NULL) return nil;
+
+	//Only the file header is parsed: frames count, sample rate and strings chunks
+	sfInfo.format = 0;
+	sndFile = sf_open(filePathStr, SFM_READ, &sfInfo);
+	if (sndFile == NULL) return nil;
+
+	fileMetadata = [NSMutableDictionary dictionaryWithCapacity:6];
+
+	if (sfInfo.samplerate > 0) {
+		[fileMetadata setObject:[NSNumber numberWithFloat:((float)sfInfo.frames)/((float)sfInfo.samplerate)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_ApproximateDurationInSeconds]];
+		[fileMetadata setObject:[NSNumber numberWithDouble:sfInfo.samplerate]
+						 forKey:[NSString stringWithUTF8String: kAudioFileLoaderInfo_NativeSampleRate]];
+	}
+	addSndFileStrings(fileMetadata, sndFile);
+	sf_close(sndFile);
+
+	fileExtension = [[fileURL pathExtension] lowercaseString];
+	if (([fileExtension isEqualToString:@"aif"]) || ([fileExtension isEqualToString:@"aiff"])) {
+		TagLib::RIFF::AIFF::File aifffile(filePathStr, false);
+		if (aifffile.isValid() && aifffile.tag())
+			addID3v2Tags(fileMetadata, aifffile.tag(), false);
+	}
+	else if ([fileExtension isEqualToString:@"wav"]) {
+		TagLib::RIFF::WAV::File wavfile(filePathStr, false);
+		if (wavfile.isValid() && wavfile.tag())
+			addID3v2Tags(fileMetadata, wavfile.tag(), false);
+	}
+
+	return fileMetadata;
+}
+
 - (id)initWithURL:(NSURL*)urlToOpen
 {
 	NSString *fileExtension;
-    NSString *strValue;
 	const char *str = [[urlToOpen path] cStringUsingEncoding:NSUTF8StringEncoding];
 
 	fileExtension = [[urlToOpen pathExtension] lowercaseString];
@@ -119,7 +373,17 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 
 	mSF_Info.format = 0; //As requested by libSndFile
 
-	if (str) mSndFileRef = sf_open(str, SFM_READ, &mSF_Info);
+	mSndFileReader = AudioFileBlockReaderOpen([[urlToOpen path] fileSystemRepresentation], kAudioFileBlockReaderAllowMapping);
+	if (mSndFileReader) {
+		mSndFileRef = sf_open_virtual(&blockReaderVirtualIO, SFM_READ, &mSF_Info, mSndFileReader);
+		if (mSndFileRef == NULL) {
+			//Formats needing the file path (e.g. resource fork): libSndFile own I/O
+			AudioFileBlockReaderClose(mSndFileReader);
+			mSndFileReader = NULL;
+			mSF_Info.format = 0;
+		}
+	}
+	if (str && (mSndFileRef == NULL)) mSndFileRef = sf_open(str, SFM_READ, &mSF_Info);
 
 	if (mSndFileRef == NULL) {
 		[self release];
@@ -128,7 +392,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 
 	mNativeSampleRate = mSF_Info.samplerate;
 	mLengthFrames = mSF_Info.frames;
-	mChannels = 2;
+	mChannels = mSF_Info.channels;
 
 	switch (mSF_Info.format & SF_FORMAT_SUBMASK) {
 		case SF_FORMAT_PCM_S8:
@@ -164,39 +428,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	//Get metadata
 
 	mFileMetadata = [[NSMutableDictionary alloc] initWithCapacity:3];
-
-	str = sf_get_string(mSndFileRef, SF_STR_TITLE);
-	if (str) {
-        strValue = [NSString stringWithCString:str encoding:NSUTF8StringEncoding];
-        if (!strValue)
-            strValue = [NSString stringWithCString:str encoding:NSMacOSRomanStringEncoding];
-
-        if (strValue)
-            [mFileMetadata setObject:strValue
-                              forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
-    }
-
-	str = sf_get_string(mSndFileRef, SF_STR_ARTIST);
-	if (str) {
-        strValue = [NSString stringWithCString:str encoding:NSUTF8StringEncoding];
-        if (!strValue)
-            strValue = [NSString stringWithCString:str encoding:NSMacOSRomanStringEncoding];
-
-        if (strValue)
-            [mFileMetadata setObject:strValue
-                              forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
-    }
-
-	str = sf_get_string(mSndFileRef, SF_STR_ALBUM);
-	if (str) {
-        strValue = [NSString stringWithCString:str encoding:NSUTF8StringEncoding];
-        if (!strValue)
-            strValue = [NSString stringWithCString:str encoding:NSMacOSRomanStringEncoding];
-
-        if (strValue)
-            [mFileMetadata setObject:strValue
-                              forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
-    }
+	addSndFileStrings(mFileMetadata, mSndFileRef);
 
 	//Get additional metadata from the ID3v2 tags
 	if (([fileExtension caseInsensitiveCompare:@"aif"] == NSOrderedSame)
@@ -210,17 +442,22 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	mTmpSRCdata = NULL;
 	mTmplibSampleRateOutBuf = NULL;
 	mTmpSndFileSourceData = NULL;
+	mTmpSndFileIntData = NULL;
+	mTmpChannelsData = NULL;
 
 	return [super initWithURL:urlToOpen];
 }
 
 -(void)close
 {
-	sf_close(mSndFileRef);
+	if (mSndFileRef) { sf_close(mSndFileRef); mSndFileRef = NULL; }
+	if (mSndFileReader) { AudioFileBlockReaderClose(mSndFileReader); mSndFileReader = NULL; }
 	if (mLibSrcState) { src_delete(mLibSrcState); mLibSrcState = NULL; }
 	if (mTmpSRCdata) { free(mTmpSRCdata); mTmpSRCdata = NULL; }
 	if (mTmplibSampleRateOutBuf) { free(mTmplibSampleRateOutBuf); mTmplibSampleRateOutBuf = NULL; }
 	if (mTmpSndFileSourceData) { free(mTmpSndFileSourceData); mTmpSndFileSourceData = NULL; }
+	if (mTmpSndFileIntData) { free(mTmpSndFileIntData); mTmpSndFileIntData = NULL; }
+	if (mTmpChannelsData) { free(mTmpChannelsData); mTmpChannelsData = NULL; }
 	if (mCoreAudioConverterRef) { AudioConverterDispose(mCoreAudioConverterRef); mCoreAudioConverterRef = NULL; }
 
 	[super close];
@@ -235,15 +472,32 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 	   NextInputPosition:(SInt64*)nextInputPosition
 			   ForBuffer:(int)bufIdx
 {
+	//Samples already in the device format: the file data chunk is the buffer, nothing to decode nor copy
+	if ([self loadMappedDataChunk:outBufferData
+				 AllocatedBufSize:outBufferDataSize
+					MaxBufferSize:maxBufSize
+				   NumTotalFrames:numTotalFrames
+				  NumLoadedFrames:numLoadedFrames
+						   Status:status
+				NextInputPosition:nextInputPosition
+						ForBuffer:bufIdx] == 0)
+		return 0;
+
+	if (mSF_Info.channels != mOutputChannels) {
+		mTmpChannelsData = malloc(TMP_SRC_BUFFER_SIZE*mSF_Info.channels*sizeof(Float64));
+		if (mTmpChannelsData == NULL) return -1;
+	}
+
 	//Perform SRC initialization
 	if (mIsUsingSRC) {
 		switch (mSRCModel) {
+			case kAUDSRCModelPolyphaseFIR:
 			case kAUDSRCModelSRClibSampleRate:
 			{
 				int srcError;
-				mLibSrcState = src_callback_new(&sampleRateCallBack, mSRCQuality, 2, &srcError, self);
-				if (mLibSrcState == NULL) return srcError;
-				mTmpSRCdata = (Float32*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float32)*2);
+				srcError = [self newFloatSRC:&sampleRateCallBack channels:mOutputChannels libSrcState:&mLibSrcState];
+				if (srcError != 0) return srcError;
+				mTmpSRCdata = (Float32*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float32)*mOutputChannels);
 
 				if (mIsIntegerModeOn) {
 					AudioStreamBasicDescription inStreamFormat;
@@ -254,7 +508,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 					inStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 					inStreamFormat.mBitsPerChannel = 32;
 					inStreamFormat.mSampleRate = mTargetSampleRate;
-					inStreamFormat.mChannelsPerFrame = 2;
+					inStreamFormat.mChannelsPerFrame = mOutputChannels;
 					inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 					inStreamFormat.mFramesPerPacket = 1;
 					inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
@@ -262,7 +516,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 					err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
 					if (err != noErr) return -1;
 
-					mTmplibSampleRateOutBuf = (Float32*)malloc((size_t)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate * sizeof(Float32) * 2)); //Output of libSampleRate is Float32
+					mTmplibSampleRateOutBuf = (Float32*)malloc((size_t)([self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)] * sizeof(Float32) * mOutputChannels)); //Output of libSampleRate is Float32
 				}
 			}
 				break;
@@ -278,7 +532,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 				inStreamFormat.mBitsPerChannel = 64;
 				inStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 				inStreamFormat.mSampleRate = mNativeSampleRate;
-				inStreamFormat.mChannelsPerFrame = 2; //TODO : implement optional multi-channel
+				inStreamFormat.mChannelsPerFrame = mOutputChannels;
 				inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 				inStreamFormat.mFramesPerPacket = 1;
 				inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
@@ -292,7 +546,7 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 				tmpInt = mSRCQuality;
 				AudioConverterSetProperty(mCoreAudioConverterRef, kAudioConverterSampleRateConverterQuality, sizeof(tmpInt), &tmpInt);
 
-				mTmpSndFileSourceData = (Float64*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float64)*2);
+				mTmpSndFileSourceData = (Float64*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float64)*mOutputChannels);
 			}
 				break;
 		}
@@ -301,20 +555,38 @@ static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
 		AudioStreamBasicDescription inStreamFormat;
 		OSErr err;
 
+		//Integer PCM fitting the device format: no float round trip, the samples being written as they are
+		switch (mSF_Info.format & SF_FORMAT_SUBMASK) {
+			case SF_FORMAT_PCM_S8:
+			case SF_FORMAT_PCM_U8:
+			case SF_FORMAT_PCM_16:
+			case SF_FORMAT_PCM_24:
+			case SF_FORMAT_PCM_32:
+				if (mIsUsingIntegerWriter && (mBitDepth <= (int)mOutputStreamFormat.mBitsPerChannel)) {
+					mTmpSndFileIntData = (SInt32*)malloc((size_t)([self decodingBlockFrames:(UInt32)(5 * mTargetSampleRate)] * sizeof(SInt32) * mOutputChannels));
+					if (mTmpSndFileIntData == NULL) return -1;
+				}
+				break;
+			default:
+				break;
+		}
+
 		//libSndFile can output 64bit float
 		inStreamFormat.mFormatID = kAudioFormatLinearPCM;
 		inStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 		inStreamFormat.mBitsPerChannel = 64;
 		inStreamFormat.mSampleRate = mTargetSampleRate;
-		inStreamFormat.mChannelsPerFrame = 2;
+		inStreamFormat.mChannelsPerFrame = mOutputChannels;
 		inStreamFormat.mBytesPerPacket = inStreamFormat.mChannelsPerFrame * (inStreamFormat.mBitsPerChannel / 8);
 		inStreamFormat.mFramesPerPacket = 1;
 		inStreamFormat.mBytesPerFrame = inStreamFormat.mBytesPerPacket;
 
-		err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
-		if (err != noErr) return -1;
+		if (mTmpSndFileIntData == NULL) {
+			err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
+			if (err != noErr) return -1;
 
-		mTmpSndFileSourceData = (Float64*)malloc((size_t)(5 * mTargetSampleRate * sizeof(Float64) * 2)); //Native libSndFile 64bit float format
+			mTmpSndFileSourceData = (Float64*)malloc((size_t)([self decodingBlockFrames:(UInt32)(5 * mTargetSampleRate)] * sizeof(Float64) * mOutputChannels)); //Native libSndFile 64bit float format
+		}
 	}
 
 	return [self loadChunk:0
@@ -341,8 +613,19 @@ NextInputPosition:(SInt64*)nextInputPosition
 	UInt64 sizeInBytes;
 	__block bool loadWholeFile;
 
+	if (mStreamingRing) {
+		*outBufferData = NULL;
+		*outBufferDataSize = 0;
+		return [self streamChunk:startInputPosition
+				  NumTotalFrames:numTotalFrames
+				 NumLoadedFrames:numLoadedFrames
+						  Status:status
+			   NextInputPosition:nextInputPosition
+					   ForBuffer:bufIdx];
+	}
+
 	//Get uncompressed file size
-	sizeInBytes = mLengthFrames * mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate; //TODO: allow multiple channels
+	sizeInBytes = mLengthFrames * mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate;
     sizeInBytes -= startInputPosition * mOutputStreamFormat.mBytesPerFrame; // inputPosition is expressed in target sample rate
 
 	if (maxBufSize > SF_COUNT_MAX) maxBufSize = INT32_MAX;
@@ -354,10 +637,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 	else
 		loadWholeFile = TRUE;
 
-	kern_return_t theKernelError = vm_allocate(mach_task_self(),
-											   (vm_address_t*)outBufferData,
-											   (vm_size_t)sizeInBytes,
-											   VM_FLAGS_ANYWHERE);
+	kern_return_t theKernelError = [self allocateBuffer:outBufferData size:sizeInBytes];
 	*numLoadedFrames = 0;
 	*numTotalFrames = sizeInBytes / mOutputStreamFormat.mBytesPerFrame;
 
@@ -370,11 +650,8 @@ NextInputPosition:(SInt64*)nextInputPosition
 	*outBufferDataSize = sizeInBytes;
 
 	//Check if need to seek the file read position
-	if (startInputPosition != mNextFrameToLoadPosition) {
-		sf_seek(mSndFileRef, (sf_count_t)(startInputPosition*mNativeSampleRate/mTargetSampleRate), SEEK_SET);
-        if (mIsUsingSRC && mSRCModel == kAUDSRCModelAppleCoreAudio)
-            AudioConverterReset(mCoreAudioConverterRef);
-	}
+	if (startInputPosition != mNextFrameToLoadPosition)
+		[self seekDecoderTo:startInputPosition];
 
 	*status = (loadWholeFile?kAudioFileLoaderStatusEOF:0) | kAudioFileLoaderStatusLoading;
 	mIsMakingBackgroundTask	|= kAudioFileLoaderLoadingBuffer;
@@ -390,31 +667,33 @@ NextInputPosition:(SInt64*)nextInputPosition
 				if ((*numLoadedFrames + readStep) > *numTotalFrames)
 					readStep = *numTotalFrames - *numLoadedFrames;
 
-				if (mIsIntegerModeOn) {
+				if (mTmpSndFileIntData) {
+					readStep = [self readIntegerFrames:((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)
+											 maxFrames:readStep];
+					readError = sf_error(mSndFileRef);
+				}
+				else if (mIsIntegerModeOn) {
 					OSErr err=noErr;
-					UInt32 bytesConverted;
 
-					readStep = sf_readf_double(mSndFileRef, mTmpSndFileSourceData, readStep);
+					readStep = readFramesToChannels(mSndFileRef, mSF_Info.channels, mTmpSndFileSourceData, mOutputChannels,
+													readStep, mTmpChannelsData);
 					readError = sf_error(mSndFileRef);
 
 					if ((readError == noErr) && (readStep > 0)) {
-						bytesConverted = (UInt32)(readStep*mOutputStreamFormat.mBytesPerFrame);
-						err = AudioConverterConvertBuffer(mCoreAudioConverterRef,
-														  (UInt32)(readStep*sizeof(Float64)*2),
-														  mTmpSndFileSourceData,
-														  &bytesConverted,
-														  ((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame));
-						readStep = bytesConverted / mOutputStreamFormat.mBytesPerFrame;
-
-						if ((err == noErr) && (mIntModeAlignedLowZeroBits > 0))
-							[self alignAudioBufferFromHighToLow:(UInt32*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame))
-												framesToConvert:readStep];
+						if (mBitDepth > (int)mOutputStreamFormat.mBitsPerChannel)
+							AudioDitherRequantizeFloat64(&mDither, mTmpSndFileSourceData, (UInt32)readStep, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+						err = [self writeIntegerFrames:(UInt32)readStep from:mTmpSndFileSourceData sourceFormat:kAudioIntegerWriterSourceFloat64
+													to:((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)
+											 converter:mCoreAudioConverterRef];
+						if (err != noErr) readStep = 0;
 
 						readError |= err;
 					}
 				}
 				else {
-					readStep = sf_readf_float(mSndFileRef, (float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)), readStep);
+					readStep = readFramesToChannels(mSndFileRef, mSF_Info.channels,
+													(float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)),
+													mOutputChannels, readStep, mTmpChannelsData);
 					readError = sf_error(mSndFileRef);
 				}
 
@@ -454,6 +733,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 	} else {
 		//Use sample rate converter
 		switch (mSRCModel) {
+			case kAUDSRCModelPolyphaseFIR:
 			case kAUDSRCModelSRClibSampleRate:
 			{
 				dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
@@ -468,25 +748,18 @@ NextInputPosition:(SInt64*)nextInputPosition
 							readStep = (long)(*numTotalFrames - *numLoadedFrames);
 
 						if (mIsIntegerModeOn) {
-							UInt32 bytesConverted;
-
-							framesRead = src_callback_read(mLibSrcState, mTargetSampleRate / mNativeSampleRate,
-														   readStep , mTmplibSampleRateOutBuf);
+							framesRead = [self readFloatSRC:mLibSrcState frames:readStep to:mTmplibSampleRateOutBuf];
 
 							if (framesRead > 0) {
-								bytesConverted = (UInt32)(framesRead*mOutputStreamFormat.mBytesPerFrame);
-								err = AudioConverterConvertBuffer(mCoreAudioConverterRef, (UInt32)(framesRead * sizeof(Float32) * 2),
-															mTmplibSampleRateOutBuf, &bytesConverted,
-															((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame));
-								framesRead = bytesConverted / mOutputStreamFormat.mBytesPerFrame;
-
-								if ((err == noErr) && (mIntModeAlignedLowZeroBits > 0))
-									[self alignAudioBufferFromHighToLow:(UInt32*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame))
-														framesToConvert:readStep];
+								AudioDitherRequantizeFloat32(&mDither, mTmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+								err = [self writeIntegerFrames:(UInt32)framesRead from:mTmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+															to:((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)
+													 converter:mCoreAudioConverterRef];
+								if (err != noErr) framesRead = 0;
 							}
 						}
-						else framesRead = src_callback_read(mLibSrcState, mTargetSampleRate / mNativeSampleRate,
-													   readStep ,(float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)));
+						else framesRead = [self readFloatSRC:mLibSrcState frames:readStep
+													   to:(float*)(((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame))];
 						if (framesRead <=0) break;
 						*numLoadedFrames += framesRead;
 						dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
@@ -531,7 +804,7 @@ NextInputPosition:(SInt64*)nextInputPosition
 					OSStatus readErr = noErr;
 
 					outData.mNumberBuffers = 1;
-					outData.mBuffers[0].mNumberChannels = 2;
+					outData.mBuffers[0].mNumberChannels = mOutputChannels;
 					outData.mBuffers[0].mData = *outBufferData;
 					outData.mBuffers[0].mDataByteSize = (UInt32)sizeInBytes;
 
@@ -589,17 +862,212 @@ NextInputPosition:(SInt64*)nextInputPosition
 	return 0;
 }
 
+- (void)seekDecoderTo:(UInt64)startInputPosition
+{
+	sf_seek(mSndFileRef, (sf_count_t)(startInputPosition*mNativeSampleRate/mTargetSampleRate), SEEK_SET);
+	AudioDitherReset(&mDither);
+	if (mIsUsingSRC && mSRCModel == kAUDSRCModelAppleCoreAudio)
+		AudioConverterReset(mCoreAudioConverterRef);
+	else if (mPolyphaseResampler)
+		AudioPolyphaseResamplerReset(mPolyphaseResampler);
+}
+
+- (SInt64)decodeFrames:(void*)outData maxFrames:(UInt32)maxFrames
+{
+	if (!mIsUsingSRC) {
+		sf_count_t framesRead;
+
+		if (mTmpSndFileIntData) {
+			if (maxFrames > [self decodingBlockFrames:(UInt32)(5 * mTargetSampleRate)])
+				maxFrames = [self decodingBlockFrames:(UInt32)(5 * mTargetSampleRate)];
+
+			framesRead = [self readIntegerFrames:outData maxFrames:maxFrames];
+			if (sf_error(mSndFileRef) != SF_ERR_NO_ERROR) return -1;
+		}
+		else if (mIsIntegerModeOn) {
+			OSStatus err;
+
+			if (maxFrames > [self decodingBlockFrames:(UInt32)(5 * mTargetSampleRate)])
+				maxFrames = [self decodingBlockFrames:(UInt32)(5 * mTargetSampleRate)];
+
+			framesRead = readFramesToChannels(mSndFileRef, mSF_Info.channels, mTmpSndFileSourceData, mOutputChannels,
+											  maxFrames, mTmpChannelsData);
+			if (sf_error(mSndFileRef) != SF_ERR_NO_ERROR) return -1;
+			if (framesRead <= 0) return framesRead;
+
+			if (mBitDepth > (int)mOutputStreamFormat.mBitsPerChannel)
+				AudioDitherRequantizeFloat64(&mDither, mTmpSndFileSourceData, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+			err = [self writeIntegerFrames:(UInt32)framesRead from:mTmpSndFileSourceData sourceFormat:kAudioIntegerWriterSourceFloat64
+										to:outData converter:mCoreAudioConverterRef];
+			if (err != noErr) return -1;
+		}
+		else {
+			framesRead = readFramesToChannels(mSndFileRef, mSF_Info.channels, (float*)outData, mOutputChannels,
+											  maxFrames, mTmpChannelsData);
+			if (sf_error(mSndFileRef) != SF_ERR_NO_ERROR) return -1;
+		}
+		return framesRead;
+	}
+
+	switch (mSRCModel) {
+		case kAUDSRCModelPolyphaseFIR:
+		case kAUDSRCModelSRClibSampleRate:
+		{
+			long framesRead;
+
+			if (mIsIntegerModeOn) {
+				OSStatus err;
+
+				if (maxFrames > [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)])
+					maxFrames = [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)];
+
+				framesRead = [self readFloatSRC:mLibSrcState frames:maxFrames to:mTmplibSampleRateOutBuf];
+				if (framesRead <= 0) return framesRead;
+
+				AudioDitherRequantizeFloat32(&mDither, mTmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+				err = [self writeIntegerFrames:(UInt32)framesRead from:mTmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+											to:outData converter:mCoreAudioConverterRef];
+				if (err != noErr) return -1;
+			}
+			else framesRead = [self readFloatSRC:mLibSrcState frames:maxFrames to:(float*)outData];
+			return framesRead;
+		}
+
+		case kAUDSRCModelAppleCoreAudio:
+		default:
+		{
+			UInt32 readStep = maxFrames;
+			AudioBufferList outBufList;
+			OSStatus err;
+
+			outBufList.mNumberBuffers = 1;
+			outBufList.mBuffers[0].mNumberChannels = mOutputChannels;
+			outBufList.mBuffers[0].mData = outData;
+			outBufList.mBuffers[0].mDataByteSize = maxFrames*mOutputStreamFormat.mBytesPerFrame;
+
+			err = AudioConverterFillComplexBuffer(mCoreAudioConverterRef, CoreAudioEncoderDataProc, self, &readStep, &outBufList, NULL);
+			if (err != noErr) return -1;
+
+			if (mIntModeAlignedLowZeroBits > 0)
+				[self alignAudioBufferFromHighToLow:(UInt32*)outData framesToConvert:readStep];
+
+			return readStep;
+		}
+	}
+}
+
+- (sf_count_t)readIntegerFrames:(void*)outData maxFrames:(sf_count_t)nbFrames
+{
+	sf_count_t framesRead = readFramesToChannels(mSndFileRef, mSF_Info.channels, (int*)mTmpSndFileIntData, mOutputChannels,
+												 nbFrames, mTmpChannelsData);
+
+	if (framesRead > 0)
+		AudioIntegerWriterWrite(&mIntegerWriter, kAudioIntegerWriterSourceInt32, outData, mTmpSndFileIntData,
+								(UInt64)framesRead*mOutputChannels);
+	return framesRead;
+}
+
+- (int)loadMappedDataChunk:(void**)outBufferData
+		  AllocatedBufSize:(UInt64*)outBufferDataSize
+			 MaxBufferSize:(UInt64)maxBufSize
+			NumTotalFrames:(SInt64*)numTotalFrames
+		   NumLoadedFrames:(SInt64*)numLoadedFrames
+					Status:(UInt32*)status
+		 NextInputPosition:(SInt64*)nextInputPosition
+				 ForBuffer:(int)bufIdx
+{
+	struct stat fileStat;
+	struct statfs volumeStat;
+	UInt64 bufSize, chunkSize, mapSize, readAheadSize;
+	off_t dataOffset, mapOffset;
+	UInt8 *mappedData;
+	UInt32 bytesPerSample;
+	bool isBigEndian;
+	int fd;
+
+	//Buffer engine, Integer Mode only, the file frames being the device ones
+	if (mStreamingRing || !mIsIntegerModeOn || mIsUsingSRC || (mSF_Info.channels != mOutputChannels)
+		|| (mIntModeAlignedLowZeroBits != 0) || (mLengthFrames <= 0))
+		return -1;
+
+	switch (mSF_Info.format & SF_FORMAT_SUBMASK) {
+		case SF_FORMAT_PCM_16:
+			bytesPerSample = 2;
+			break;
+		case SF_FORMAT_PCM_24:
+			bytesPerSample = 3;
+			break;
+		case SF_FORMAT_PCM_32:
+			bytesPerSample = 4;
+			break;
+		default:
+			return -1;
+	}
+
+	if ((mOutputStreamFormat.mFormatFlags & (kAudioFormatFlagIsFloat | kAudioFormatFlagIsNonInterleaved))
+		|| !(mOutputStreamFormat.mFormatFlags & kAudioFormatFlagIsSignedInteger)
+		|| (mOutputStreamFormat.mBitsPerChannel != bytesPerSample*8)
+		|| (mOutputStreamFormat.mBytesPerFrame != bytesPerSample*mOutputChannels))
+		return -1;
+
+	bufSize = (UInt64)mLengthFrames * mOutputStreamFormat.mBytesPerFrame;
+	if (bufSize > maxBufSize) return -1;
+
+	fd = open([[mInputFileURL path] fileSystemRepresentation], O_RDONLY);
+	if (fd < 0) return -1;
+
+	//Local volumes only: a page fault on a network one could stall the playback
+	if ((fstat(fd, &fileStat) != 0) || (fstatfs(fd, &volumeStat) != 0) || !(volumeStat.f_flags & MNT_LOCAL)) {
+		close(fd);
+		return -1;
+	}
+
+	dataOffset = findPCMDataChunk(fd, &isBigEndian, &chunkSize);
+	if ((dataOffset < 0) || (chunkSize < bufSize) || ((UInt64)fileStat.st_size < (UInt64)dataOffset + bufSize)
+		|| (isBigEndian != ((mOutputStreamFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) != 0))) {
+		close(fd);
+		return -1;
+	}
+
+	//Private writable mapping as for the PCM cache entries, starting at the page holding the first sample
+	mapOffset = dataOffset & ~((off_t)getpagesize() - 1);
+	mapSize = bufSize + (UInt64)(dataOffset - mapOffset);
+	mappedData = (UInt8*)mmap(NULL, (size_t)mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, mapOffset);
+	close(fd);
+	if (mappedData == MAP_FAILED) return -1;
+
+	//Read ahead the track start, the rest being prefaulted ahead of the play head by the player (not by the IO proc)
+	readAheadSize = (UInt64)(dataOffset - mapOffset)
+		+ (UInt64)(MAPPED_READAHEAD_SECONDS * mNativeSampleRate) * mOutputStreamFormat.mBytesPerFrame;
+	if (readAheadSize > mapSize) readAheadSize = mapSize;
+	madvise(mappedData, (size_t)mapSize, MADV_SEQUENTIAL);
+	madvise(mappedData, (size_t)readAheadSize, MADV_WILLNEED);
+
+	[self loadMappedBuffer:mappedData + (dataOffset - mapOffset)
+			   sizeInBytes:bufSize
+			 OutBufferData:outBufferData
+		  AllocatedBufSize:outBufferDataSize
+			NumTotalFrames:numTotalFrames
+		   NumLoadedFrames:numLoadedFrames
+					Status:status
+		 NextInputPosition:nextInputPosition
+				 ForBuffer:bufIdx];
+	return 0;
+}
+
 - (long)readSRCdata:(float**)data
 {
 	*data = mTmpSRCdata;
-	return (long)sf_readf_float(mSndFileRef, mTmpSRCdata, TMP_SRC_BUFFER_SIZE);
+	return (long)readFramesToChannels(mSndFileRef, mSF_Info.channels, mTmpSRCdata, mOutputChannels,
+									  TMP_SRC_BUFFER_SIZE, mTmpChannelsData);
 }
 
 - (UInt32)readSRCdata:(Float64 **)data forFrames:(UInt32)nbFramesToRead
 {
 	if (nbFramesToRead > TMP_SRC_BUFFER_SIZE) nbFramesToRead = TMP_SRC_BUFFER_SIZE;
 	*data = mTmpSndFileSourceData;
-	return (UInt32)sf_readf_double(mSndFileRef, mTmpSndFileSourceData, nbFramesToRead);
+	return (UInt32)readFramesToChannels(mSndFileRef, mSF_Info.channels, mTmpSndFileSourceData, mOutputChannels,
+										nbFramesToRead, mTmpChannelsData);
 }
 
 
@@ -612,55 +1080,8 @@ NextInputPosition:(SInt64*)nextInputPosition
 
 	TagLib::RIFF::AIFF::File aifffile(filePathStr, false);
 
-	if (aifffile.isValid() && aifffile.tag() ) {
-		TagLib::ID3v2::Tag *tag = aifffile.tag();
-		TagLib::String str;
-		TagLib::uint trackNumber;
-
-		str = tag->title();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
-		str = tag->artist();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
-		str = tag->album();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
-
-		trackNumber = tag->track();
-		if (trackNumber != 0)
-			[mFileMetadata setObject:[NSNumber numberWithInt:trackNumber]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
-
-		if (!tag->frameListMap().isEmpty() && tag->frameListMap().contains("TCOM")) {
-			TagLib::ID3v2::FrameList composerList = tag->frameListMap()["TCOM"];
-			if (!composerList.isEmpty())
-				[mFileMetadata setObject:[NSString stringWithUTF8String:composerList.front()->toString().toCString(true)]
-								  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
-		}
-
-		if (!tag->frameListMap().isEmpty() && tag->frameListMap().contains("APIC")) {
-			TagLib::ID3v2::FrameList coverartList = tag->frameListMap()["APIC"];
-			if (!coverartList.isEmpty()) {
-				NSImage	*albumArt = nil;
-				for(TagLib::ID3v2::FrameList::Iterator coverartIter = coverartList.begin(); coverartIter != coverartList.end(); coverartIter++) {
-					TagLib::ID3v2::AttachedPictureFrame *coverart =  dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*coverartIter);
-					if (coverart && (!albumArt || (coverart->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover))) {
-						if (albumArt) [albumArt release];
-						albumArt = [[NSImage alloc] initWithData:[NSData dataWithBytes:coverart->picture().data() length:coverart->picture().size()]];
-					}
-				}
-				if (albumArt) {
-					[mFileMetadata setObject:albumArt
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
-					[albumArt release];
-				}
-			}
-		}
-	}
+	if (aifffile.isValid() && aifffile.tag() )
+		addID3v2Tags(mFileMetadata, aifffile.tag(), true);
 
 	return true;
 }
@@ -672,55 +1093,8 @@ NextInputPosition:(SInt64*)nextInputPosition
 
 	TagLib::RIFF::WAV::File wavfile(filePathStr, false);
 
-	if (wavfile.isValid() && wavfile.tag() ) {
-		TagLib::ID3v2::Tag *tag = wavfile.tag();
-		TagLib::String str;
-		TagLib::uint trackNumber;
-
-		str = tag->title();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
-		str = tag->artist();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
-		str = tag->album();
-		if (!str.isNull())
-			[mFileMetadata setObject:[NSString stringWithUTF8String:str.toCString(true)]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
-
-		trackNumber = tag->track();
-		if (trackNumber != 0)
-			[mFileMetadata setObject:[NSNumber numberWithInt:trackNumber]
-							  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
-
-		if (!tag->frameListMap().isEmpty() && tag->frameListMap().contains("TCOM")) {
-			TagLib::ID3v2::FrameList composerList = tag->frameListMap()["TCOM"];
-			if (!composerList.isEmpty())
-				[mFileMetadata setObject:[NSString stringWithUTF8String:composerList.front()->toString().toCString(true)]
-								  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
-		}
-
-		if (!tag->frameListMap().isEmpty() && tag->frameListMap().contains("APIC")) {
-			TagLib::ID3v2::FrameList coverartList = tag->frameListMap()["APIC"];
-			if (!coverartList.isEmpty()) {
-				NSImage	*albumArt = nil;
-				for(TagLib::ID3v2::FrameList::Iterator coverartIter = coverartList.begin(); coverartIter != coverartList.end(); coverartIter++) {
-					TagLib::ID3v2::AttachedPictureFrame *coverart =  dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*coverartIter);
-					if (coverart && (!albumArt || (coverart->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover))) {
-						if (albumArt) [albumArt release];
-						albumArt = [[NSImage alloc] initWithData:[NSData dataWithBytes:coverart->picture().data() length:coverart->picture().size()]];
-					}
-				}
-				if (albumArt) {
-					[mFileMetadata setObject:albumArt
-									  forKey:[NSString stringWithUTF8String: kAFInfoDictionary_CoverImage]];
-					[albumArt release];
-				}
-			}
-		}
-	}
+	if (wavfile.isValid() && wavfile.tag() )
+		addID3v2Tags(mFileMetadata, wavfile.tag(), true);
 
 	return true;
 }
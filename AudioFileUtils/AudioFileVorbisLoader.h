@@ -0,0 +1,50 @@
+/*
+ AudioFileVorbisLoader.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOFILEVORBISLOADER_H__
+#define __AUDIOFILEVORBISLOADER_H__
+
+#import "AudioFileLoader.h"
+#import "AudioSampleConvert.h"
+#import "AudioFileBlockReader.h"
+#import "AudioVorbisDecoder.h"
+#include <samplerate/samplerate.h>
+
+@interface AudioFileVorbisLoader : AudioFileLoader
+{
+	OggVorbis_File mVorbisFile;
+	bool mIsVorbisFileOpen;
+	AudioFileBlockReader *mVorbisReader; //File reads of the decoder
+	int mVorbisChannels;
+	AudioVorbisDecoder mVorbisDecoder; //Planar decoded samples to interleaved frames
+	//For libSampleRate
+	SRC_STATE *mLibSrcState;
+	Float32 *mTmpSRCdata;
+	Float32 *mTmplibSampleRateOutBuf; //Used for Integer Mode with libSampleRate
+
+	//For CoreAudio SRC, and Integer mode format conversion
+	AudioConverterRef mCoreAudioConverterRef;
+	Float32 *mTmpVorbisSourceData; //Decoded frames to convert
+}
+@end
+
+#endif
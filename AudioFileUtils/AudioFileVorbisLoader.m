@@ -0,0 +1,530 @@
+/*
+ AudioFileVorbisLoader.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#import <AudioToolbox/AudioToolbox.h>
+#include <dispatch/dispatch.h>
+#include </usr/include/mach/vm_map.h>
+
+#import "AudioFileVorbisLoader.h"
+#import "AppController.h"
+#import "PreferenceController.h"
+
+#define TMP_SRC_BUFFER_SIZE 4096
+#define LIBSRC_OUTPUTBUF_SECONDS 5
+#define DECODING_BLOCK_SECONDS 5
+
+@interface AudioFileVorbisLoader (PrivateMethods)
+- (long)readFrames:(Float32*)outFrames maxFrames:(long)nbFrames;
+- (long)readSRCdata:(float**)data;
+- (UInt32)readSRCdata:(Float32**)data forFrames:(UInt32)nbFramesToRead; //For CoreAudio SRC
+@end
+
+#pragma mark Vorbis decoder I/O callbacks
+
+/* The decoder reads the file through the block reader instead of stdio */
+
+static size_t blockReaderRead(void *ptr, size_t size, size_t nmemb, void *datasource)
+{
+	SInt64 bytesRead = AudioFileBlockReaderRead((AudioFileBlockReader*)datasource, ptr, (SInt64)(size*nmemb));
+	return (bytesRead > 0) ? (size_t)bytesRead / size : 0;
+}
+
+static int blockReaderSeek(void *datasource, ogg_int64_t offset, int whence)
+{
+	return (AudioFileBlockReaderSeek((AudioFileBlockReader*)datasource, offset, whence) < 0) ? -1 : 0;
+}
+
+static long blockReaderTell(void *datasource)
+{
+	return (long)AudioFileBlockReaderTell((AudioFileBlockReader*)datasource);
+}
+
+static ov_callbacks blockReaderCallbacks = {
+	blockReaderRead,
+	blockReaderSeek,
+	NULL, //The reader is closed by the loader
+	blockReaderTell
+};
+
+#pragma mark Metadata helpers
+
+static bool isCommentField(const char *comment, size_t nameLength, const char *fieldName)
+{
+	return (strlen(fieldName) == nameLength) && (strncasecmp(comment, fieldName, nameLength) == 0);
+}
+
+/* Fills a metadata dictionary from the "NAME=value" Vorbis comments */
+static void addVorbisComments(NSMutableDictionary *fileMetadata, const vorbis_comment *comments)
+{
+	const char *separator;
+	size_t nameLength;
+	NSString *fieldKey;
+	int i;
+
+	if (comments == NULL) return;
+
+	for (i=0;i<comments->comments;i++) {
+		separator = strchr(comments->user_comments[i], '=');
+		if (separator == NULL) continue;
+		nameLength = separator - comments->user_comments[i];
+
+		if (isCommentField(comments->user_comments[i], nameLength, "TITLE"))
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Title];
+		else if (isCommentField(comments->user_comments[i], nameLength, "ARTIST"))
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Artist];
+		else if (isCommentField(comments->user_comments[i], nameLength, "ALBUM"))
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Album];
+		else if (isCommentField(comments->user_comments[i], nameLength, "COMPOSER"))
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_Composer];
+		else if (isCommentField(comments->user_comments[i], nameLength, "TRACKNUMBER"))
+			fieldKey = [NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber];
+		else fieldKey = nil;
+
+		if (fieldKey) {
+			NSString *fieldValue = [NSString stringWithUTF8String:separator + 1];
+			if (fieldValue) [fileMetadata setObject:fieldValue forKey:fieldKey];
+		}
+	}
+}
+
+#pragma mark Converters callbacks
+
+/* Decoded samples format, as converted by the AudioConverters */
+static void setFloat32StreamFormat(AudioStreamBasicDescription *streamFormat, Float64 sampleRate, UInt32 channels)
+{
+	streamFormat->mFormatID = kAudioFormatLinearPCM;
+	streamFormat->mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
+	streamFormat->mBitsPerChannel = 32;
+	streamFormat->mSampleRate = sampleRate;
+	streamFormat->mChannelsPerFrame = channels;
+	streamFormat->mBytesPerPacket = streamFormat->mChannelsPerFrame * (streamFormat->mBitsPerChannel / 8);
+	streamFormat->mFramesPerPacket = 1;
+	streamFormat->mBytesPerFrame = streamFormat->mBytesPerPacket;
+}
+
+static long sampleRateCallBack(void *cb_data, float **data)
+{
+	AudioFileVorbisLoader *vorbisLoader = (AudioFileVorbisLoader*) cb_data;
+	return [vorbisLoader readSRCdata:data];
+}
+
+static OSStatus CoreAudioEncoderDataProc(AudioConverterRef inAudioConverter,
+										 UInt32* ioNumberDataPackets,
+										 AudioBufferList* ioData,
+										 AudioStreamPacketDescription** outDataPacketDescription,
+										 void* inUserData)
+{
+	AudioFileVorbisLoader *vorbisLoader = (AudioFileVorbisLoader*) inUserData;
+
+	*ioNumberDataPackets = [vorbisLoader readSRCdata:(Float32**)&ioData->mBuffers[0].mData forFrames:*ioNumberDataPackets];
+	ioData->mBuffers[0].mNumberChannels = [vorbisLoader outputChannels];
+	ioData->mBuffers[0].mDataByteSize = (UInt32)(*ioNumberDataPackets*ioData->mBuffers[0].mNumberChannels*sizeof(Float32));
+
+	return noErr;
+}
+
+
+#pragma mark AudioFileVorbisLoader implementation
+
+@implementation AudioFileVorbisLoader
+
++ (NSArray*)supportedFileExtensions
+{
+	return [NSArray arrayWithObjects:@"ogg",nil];
+}
+
++ (bool)isFormatSupported:(NSURL*)fileURL
+{
+	return [[[fileURL pathExtension] lowercaseString] isEqualToString:@"ogg"];
+}
+
++ (NSDictionary*)probeMetadata:(NSURL*)fileURL
+{
+	OggVorbis_File vorbisFile;
+	vorbis_info *info;
+	ogg_int64_t totalFrames;
+	NSMutableDictionary *fileMetadata;
+	const char *str = [[fileURL path] fileSystemRepresentation];
+
+	//Only the headers and the stream end are read, the decoder being initialized at the first read
+	if ((str == NULL) || (ov_fopen((char*)str, &vorbisFile) != 0))
+		return nil;
+
+	fileMetadata = [NSMutableDictionary dictionaryWithCapacity:6];
+
+	info = ov_info(&vorbisFile, -1);
+	totalFrames = ov_pcm_total(&vorbisFile, -1);
+	if (info && (info->rate > 0) && (totalFrames > 0))
+		[fileMetadata setObject:[NSNumber numberWithFloat:((float)totalFrames) / ((float)info->rate)]
+						 forKey:[NSString stringWithUTF8String: kAFInfoDictionary_ApproximateDurationInSeconds]];
+	if (info && (info->rate > 0))
+		[fileMetadata setObject:[NSNumber numberWithDouble:info->rate]
+						 forKey:[NSString stringWithUTF8String: kAudioFileLoaderInfo_NativeSampleRate]];
+
+	addVorbisComments(fileMetadata, ov_comment(&vorbisFile, -1));
+	ov_clear(&vorbisFile);
+
+	return fileMetadata;
+}
+
+- (id)initWithURL:(NSURL*)urlToOpen
+{
+	vorbis_info *info;
+
+	mIsVorbisFileOpen = NO;
+	mVorbisReader = AudioFileBlockReaderOpen([[urlToOpen path] fileSystemRepresentation], kAudioFileBlockReaderAllowMapping);
+	if (mVorbisReader == NULL) {
+		[self release];
+		return nil;
+	}
+
+	if (ov_open_callbacks(mVorbisReader, &mVorbisFile, NULL, 0, blockReaderCallbacks) != 0) {
+		NSLog(@"Error opening the Ogg Vorbis file for decoding: file=%@", [urlToOpen path]);
+		AudioFileBlockReaderClose(mVorbisReader);
+		mVorbisReader = NULL;
+		[self release];
+		return nil;
+	}
+	mIsVorbisFileOpen = YES;
+
+	info = ov_info(&mVorbisFile, -1);
+	mNativeSampleRate = info->rate;
+	mVorbisChannels = info->channels;
+	mChannels = mVorbisChannels;
+	mBitDepth = 16; //Assume 16bit as for the other lossy formats
+	mLengthFrames = ov_pcm_total(&mVorbisFile, -1);
+	if (mLengthFrames < 0) mLengthFrames = 0;
+
+	mFileMetadata = [[NSMutableDictionary alloc] initWithCapacity:5];
+	addVorbisComments(mFileMetadata, ov_comment(&mVorbisFile, -1));
+
+	mLibSrcState = NULL;
+	mTmpSRCdata = NULL;
+	mTmplibSampleRateOutBuf = NULL;
+	mCoreAudioConverterRef = NULL;
+	mTmpVorbisSourceData = NULL;
+
+	return [super initWithURL:urlToOpen];
+}
+
+-(void)close
+{
+	if (mIsVorbisFileOpen) { ov_clear(&mVorbisFile); mIsVorbisFileOpen = NO; }
+	if (mVorbisReader) { AudioFileBlockReaderClose(mVorbisReader); mVorbisReader = NULL; }
+	if (mLibSrcState) { src_delete(mLibSrcState); mLibSrcState = NULL; }
+	if (mTmpSRCdata) { free(mTmpSRCdata); mTmpSRCdata = NULL; }
+	if (mTmplibSampleRateOutBuf) { free(mTmplibSampleRateOutBuf); mTmplibSampleRateOutBuf = NULL; }
+	if (mTmpVorbisSourceData) { free(mTmpVorbisSourceData); mTmpVorbisSourceData = NULL; }
+	if (mCoreAudioConverterRef) { AudioConverterDispose(mCoreAudioConverterRef); mCoreAudioConverterRef = NULL; }
+
+	[super close];
+}
+
+- (int)loadInitialBuffer:(void**)outBufferData
+		AllocatedBufSize:(UInt64*)outBufferDataSize
+		   MaxBufferSize:(UInt64)maxBufSize
+		  NumTotalFrames:(SInt64*)numTotalFrames
+		 NumLoadedFrames:(SInt64*)numLoadedFrames
+				  Status:(UInt32*)status
+	   NextInputPosition:(SInt64*)nextInputPosition
+			   ForBuffer:(int)bufIdx
+{
+	AudioStreamBasicDescription inStreamFormat;
+	OSErr err;
+
+	if (AudioVorbisDecoderInit(&mVorbisDecoder, &mVorbisFile, ov_read_float, ov_info, mOutputChannels,
+							   [[NSUserDefaults standardUserDefaults] boolForKey:AUDDuplicateMonoToStereo] ? kAudioSampleConvertDuplicateMono : 0) != 0)
+		return -1;
+
+	//Perform SRC initialization
+	if (mIsUsingSRC) {
+		switch (mSRCModel) {
+			case kAUDSRCModelPolyphaseFIR:
+			case kAUDSRCModelSRClibSampleRate:
+			{
+				int srcError;
+				srcError = [self newFloatSRC:&sampleRateCallBack channels:mOutputChannels libSrcState:&mLibSrcState];
+				if (srcError != 0) return srcError;
+				mTmpSRCdata = (Float32*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float32)*mOutputChannels);
+				if (mTmpSRCdata == NULL) return -1;
+
+				if (mIsIntegerModeOn) {
+					//LibSampleRate outputs 32bit float
+					setFloat32StreamFormat(&inStreamFormat, mTargetSampleRate, mOutputChannels);
+					err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
+					if (err != noErr) return -1;
+
+					mTmplibSampleRateOutBuf = (Float32*)malloc((size_t)([self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)] * sizeof(Float32) * mOutputChannels));
+					if (mTmplibSampleRateOutBuf == NULL) return -1;
+				}
+			}
+				break;
+			case kAUDSRCModelAppleCoreAudio:
+			default:
+			{
+				UInt32 tmpInt;
+
+				setFloat32StreamFormat(&inStreamFormat, mNativeSampleRate, mOutputChannels);
+				err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
+				if (err != noErr) return -1;
+
+				tmpInt = mSRCComplexity;
+				AudioConverterSetProperty(mCoreAudioConverterRef, kAudioConverterSampleRateConverterComplexity, sizeof(tmpInt), &tmpInt);
+				tmpInt = mSRCQuality;
+				AudioConverterSetProperty(mCoreAudioConverterRef, kAudioConverterSampleRateConverterQuality, sizeof(tmpInt), &tmpInt);
+
+				mTmpVorbisSourceData = (Float32*)malloc(TMP_SRC_BUFFER_SIZE*sizeof(Float32)*mOutputChannels);
+				if (mTmpVorbisSourceData == NULL) return -1;
+			}
+				break;
+		}
+	}
+	else if (mIsIntegerModeOn) {
+		setFloat32StreamFormat(&inStreamFormat, mTargetSampleRate, mOutputChannels);
+		err = AudioConverterNew(&inStreamFormat, &mOutputStreamFormat, &mCoreAudioConverterRef);
+		if (err != noErr) return -1;
+
+		mTmpVorbisSourceData = (Float32*)malloc((size_t)([self decodingBlockFrames:(UInt32)(DECODING_BLOCK_SECONDS * mTargetSampleRate)] * sizeof(Float32) * mOutputChannels));
+		if (mTmpVorbisSourceData == NULL) return -1;
+	}
+
+	return [self loadChunk:0
+			 OutBufferData:outBufferData
+		  AllocatedBufSize:outBufferDataSize
+			 MaxBufferSize:maxBufSize
+			NumTotalFrames:numTotalFrames
+		   NumLoadedFrames:numLoadedFrames
+					Status:status
+		 NextInputPosition:nextInputPosition
+				 ForBuffer:bufIdx];
+}
+
+- (int)loadChunk:(UInt64)startInputPosition
+   OutBufferData:(void**)outBufferData
+AllocatedBufSize:(UInt64*)outBufferDataSize
+   MaxBufferSize:(UInt64)maxBufSize
+  NumTotalFrames:(SInt64*)numTotalFrames
+ NumLoadedFrames:(SInt64*)numLoadedFrames
+		  Status:(UInt32*)status
+NextInputPosition:(SInt64*)nextInputPosition
+	   ForBuffer:(int)bufIdx
+{
+	UInt64 sizeInBytes;
+	__block bool loadWholeFile;
+
+	if (mStreamingRing) {
+		*outBufferData = NULL;
+		*outBufferDataSize = 0;
+		return [self streamChunk:startInputPosition
+				  NumTotalFrames:numTotalFrames
+				 NumLoadedFrames:numLoadedFrames
+						  Status:status
+			   NextInputPosition:nextInputPosition
+					   ForBuffer:bufIdx];
+	}
+
+	//Get uncompressed file size
+	sizeInBytes = mLengthFrames * mOutputStreamFormat.mBytesPerFrame * mTargetSampleRate / mNativeSampleRate;
+	sizeInBytes -= startInputPosition * mOutputStreamFormat.mBytesPerFrame; // inputPosition is expressed in target sample rate
+
+	if (sizeInBytes > maxBufSize) {
+		loadWholeFile = FALSE;
+		sizeInBytes = maxBufSize;
+	}
+	else
+		loadWholeFile = TRUE;
+
+	kern_return_t theKernelError = [self allocateBuffer:outBufferData size:sizeInBytes];
+	*numLoadedFrames = 0;
+	*numTotalFrames = sizeInBytes / mOutputStreamFormat.mBytesPerFrame;
+
+	if (theKernelError != KERN_SUCCESS) {
+		*status = 0;
+		*outBufferData = NULL;
+		*outBufferDataSize = 0;
+		return -1;
+	}
+	*outBufferDataSize = sizeInBytes;
+
+	//Check if need to seek the file read position
+	if (startInputPosition != mNextFrameToLoadPosition)
+		[self seekDecoderTo:startInputPosition];
+
+	*status = (loadWholeFile?kAudioFileLoaderStatusEOF:0) | kAudioFileLoaderStatusLoading;
+	mIsMakingBackgroundTask	|= kAudioFileLoaderLoadingBuffer;
+
+	//The decoding steps are the streaming engine ones, writing to the buffer instead of the ring
+	dispatch_group_async(mBackgroundLoadGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		SInt64 readStep = 0;
+
+		while (((mIsMakingBackgroundTask & kAudioFileLoaderLoadingBuffer) != 0)
+			   && (loadWholeFile || (((UInt64)*numLoadedFrames * mOutputStreamFormat.mBytesPerFrame) < sizeInBytes))) {
+			readStep = (SInt64)(DECODING_BLOCK_SECONDS * mTargetSampleRate);
+			if ((*numLoadedFrames + readStep) > *numTotalFrames)
+				readStep = *numTotalFrames - *numLoadedFrames;
+
+			readStep = [self decodeFrames:((UInt8*)*outBufferData) + (*numLoadedFrames*mOutputStreamFormat.mBytesPerFrame)
+								maxFrames:(UInt32)readStep];
+			if (readStep <= 0) break;
+
+			*numLoadedFrames += readStep;
+			dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																					  to:*numLoadedFrames
+																					upTo:*numTotalFrames
+																			   forBuffer:bufIdx
+																			   completed:NO
+																				   reset:NO];});
+		}
+
+		if (readStep == 0) {
+			loadWholeFile = YES;
+			*status |= kAudioFileLoaderStatusEOF;
+		}
+
+		if (loadWholeFile && (readStep >= 0)) {
+			//Actual length is known after reading up to the file end
+			*numTotalFrames = *numLoadedFrames;
+			dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateCurrentTrackTotalLength:startInputPosition+*numTotalFrames
+																							 duration:(startInputPosition+*numTotalFrames)/mTargetSampleRate
+																							forBuffer:bufIdx];});
+		}
+
+		*status &= ~kAudioFileLoaderStatusLoading;
+		*nextInputPosition = startInputPosition + *numLoadedFrames;
+		mNextFrameToLoadPosition = *nextInputPosition;
+
+		dispatch_async(dispatch_get_main_queue(), ^{[mAppController updateLoadStatus:startInputPosition
+																				  to:*numLoadedFrames
+																				upTo:*numTotalFrames
+																		   forBuffer:bufIdx
+																		   completed:YES
+																			   reset:NO];});
+	});
+
+	return 0;
+}
+
+- (void)seekDecoderTo:(UInt64)startInputPosition
+{
+	ov_pcm_seek(&mVorbisFile, (ogg_int64_t)(startInputPosition*mNativeSampleRate/mTargetSampleRate));
+	AudioDitherReset(&mDither);
+	if (mIsUsingSRC && mSRCModel == kAUDSRCModelAppleCoreAudio)
+		AudioConverterReset(mCoreAudioConverterRef);
+	else if (mPolyphaseResampler)
+		AudioPolyphaseResamplerReset(mPolyphaseResampler);
+}
+
+- (SInt64)decodeFrames:(void*)outData maxFrames:(UInt32)maxFrames
+{
+	if (!mIsUsingSRC) {
+		long framesRead;
+		OSStatus err;
+
+		//Decoded samples interleaved straight to the buffer frames
+		if (!mIsIntegerModeOn)
+			return [self readFrames:(Float32*)outData maxFrames:maxFrames];
+
+		if (maxFrames > [self decodingBlockFrames:(UInt32)(DECODING_BLOCK_SECONDS * mTargetSampleRate)])
+			maxFrames = [self decodingBlockFrames:(UInt32)(DECODING_BLOCK_SECONDS * mTargetSampleRate)];
+
+		framesRead = [self readFrames:mTmpVorbisSourceData maxFrames:maxFrames];
+		if (framesRead <= 0) return framesRead;
+
+		AudioDitherRequantizeFloat32(&mDither, mTmpVorbisSourceData, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+		err = [self writeIntegerFrames:(UInt32)framesRead from:mTmpVorbisSourceData sourceFormat:kAudioIntegerWriterSourceFloat32
+									to:outData converter:mCoreAudioConverterRef];
+		if (err != noErr) return -1;
+		return framesRead;
+	}
+
+	switch (mSRCModel) {
+		case kAUDSRCModelPolyphaseFIR:
+		case kAUDSRCModelSRClibSampleRate:
+		{
+			long framesRead;
+
+			if (mIsIntegerModeOn) {
+				OSStatus err;
+
+				if (maxFrames > [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)])
+					maxFrames = [self decodingBlockFrames:(UInt32)(LIBSRC_OUTPUTBUF_SECONDS * mTargetSampleRate)];
+
+				framesRead = [self readFloatSRC:mLibSrcState frames:maxFrames to:mTmplibSampleRateOutBuf];
+				if (framesRead <= 0) return framesRead;
+
+				AudioDitherRequantizeFloat32(&mDither, mTmplibSampleRateOutBuf, (UInt32)framesRead, mOutputChannels, mOutputStreamFormat.mBitsPerChannel);
+				err = [self writeIntegerFrames:(UInt32)framesRead from:mTmplibSampleRateOutBuf sourceFormat:kAudioIntegerWriterSourceFloat32
+											to:outData converter:mCoreAudioConverterRef];
+				if (err != noErr) return -1;
+			}
+			else framesRead = [self readFloatSRC:mLibSrcState frames:maxFrames to:(float*)outData];
+			return framesRead;
+		}
+
+		case kAUDSRCModelAppleCoreAudio:
+		default:
+		{
+			UInt32 readStep = maxFrames;
+			AudioBufferList outBufList;
+			OSStatus err;
+
+			outBufList.mNumberBuffers = 1;
+			outBufList.mBuffers[0].mNumberChannels = mOutputChannels;
+			outBufList.mBuffers[0].mData = outData;
+			outBufList.mBuffers[0].mDataByteSize = maxFrames*mOutputStreamFormat.mBytesPerFrame;
+
+			err = AudioConverterFillComplexBuffer(mCoreAudioConverterRef, CoreAudioEncoderDataProc, self, &readStep, &outBufList, NULL);
+			if (err != noErr) return -1;
+
+			if (mIntModeAlignedLowZeroBits > 0)
+				[self alignAudioBufferFromHighToLow:(UInt32*)outData framesToConvert:readStep];
+
+			return readStep;
+		}
+	}
+}
+
+- (long)readFrames:(Float32*)outFrames maxFrames:(long)nbFrames
+{
+	return AudioVorbisDecoderRead(&mVorbisDecoder, outFrames, nbFrames);
+}
+
+- (long)readSRCdata:(float**)data
+{
+	long framesRead = [self readFrames:mTmpSRCdata maxFrames:TMP_SRC_BUFFER_SIZE];
+
+	*data = mTmpSRCdata;
+	return (framesRead < 0) ? 0 : framesRead;
+}
+
+- (UInt32)readSRCdata:(Float32**)data forFrames:(UInt32)nbFramesToRead
+{
+	long framesRead;
+
+	if (nbFramesToRead > TMP_SRC_BUFFER_SIZE) nbFramesToRead = TMP_SRC_BUFFER_SIZE;
+	framesRead = [self readFrames:mTmpVorbisSourceData maxFrames:nbFramesToRead];
+
+	*data = mTmpVorbisSourceData;
+	return (framesRead < 0) ? 0 : (UInt32)framesRead;
+}
+
+@end
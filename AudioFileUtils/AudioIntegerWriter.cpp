@@ -0,0 +1,213 @@
+/*
+ AudioIntegerWriter.cpp
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "AudioIntegerWriter.h"
+
+/* Each writer converts a source sample to a 32bit value aligned high (the bits below the device ones being zero),
+ then stores it in the device container. Source type, container and endianness are template parameters,
+ so that the inner loops are branch free and can be vectorized by the compiler */
+
+#pragma mark Containers
+
+enum
+{
+	kContainer16 = 0, //16bit
+	kContainer24Packed = 1, //24bit in 3 bytes
+	kContainer32High = 2, //32bit, or less significant bits aligned high
+	kContainer32Low = 3 //less than 32 significant bits aligned low
+};
+
+#if defined(__BIG_ENDIAN__) || (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__))
+#define kHostIsBigEndian true
+#else
+#define kHostIsBigEndian false
+#endif
+
+static inline UInt16 swapInt16(UInt16 value)
+{
+	return (UInt16)((value << 8) | (value >> 8));
+}
+
+static inline UInt32 swapInt32(UInt32 value)
+{
+	return (value << 24) | ((value << 8) & 0x00FF0000u) | ((value >> 8) & 0x0000FF00u) | (value >> 24);
+}
+
+#pragma mark Source samples
+
+template <typename Source> static inline SInt32 toAlignedHigh(Source value, UInt32 bitsPerSample);
+
+template <> inline SInt32 toAlignedHigh<SInt32>(SInt32 value, UInt32 bitsPerSample)
+{
+	return value & (SInt32)(0xFFFFFFFFu << (32 - bitsPerSample));
+}
+
+template <> inline SInt32 toAlignedHigh<Float64>(Float64 value, UInt32 bitsPerSample)
+{
+	const Float64 maxValue = (Float64)(1LL << (bitsPerSample - 1));
+	Float64 scaled = nearbyint(value * maxValue);
+
+	if (scaled > maxValue - 1.0) scaled = maxValue - 1.0;
+	else if (scaled < -maxValue) scaled = -maxValue;
+	return (SInt32)((UInt32)(SInt32)scaled << (32 - bitsPerSample));
+}
+
+template <> inline SInt32 toAlignedHigh<Float32>(Float32 value, UInt32 bitsPerSample)
+{
+	return toAlignedHigh<Float64>((Float64)value, bitsPerSample);
+}
+
+#pragma mark Kernels
+
+template <typename Source, int kContainer, bool kBigEndian>
+static void writeSamples(void *dst, const void *src, UInt64 nbSamples, UInt32 bitsPerSample)
+{
+	const Source *in = (const Source*)src;
+	const bool isSwapped = (kBigEndian != kHostIsBigEndian);
+	UInt64 i;
+
+	switch (kContainer) {
+		case kContainer16:
+		{
+			UInt16 *out = (UInt16*)dst;
+			for (i=0;i<nbSamples;i++) {
+				UInt16 sample = (UInt16)((UInt32)toAlignedHigh<Source>(in[i], bitsPerSample) >> 16);
+				out[i] = isSwapped ? swapInt16(sample) : sample;
+			}
+		}
+			break;
+
+		case kContainer24Packed:
+		{
+			UInt8 *out = (UInt8*)dst;
+			for (i=0;i<nbSamples;i++,out+=3) {
+				UInt32 sample = (UInt32)toAlignedHigh<Source>(in[i], bitsPerSample) >> 8;
+				out[kBigEndian ? 2 : 0] = (UInt8)sample;
+				out[1] = (UInt8)(sample >> 8);
+				out[kBigEndian ? 0 : 2] = (UInt8)(sample >> 16);
+			}
+		}
+			break;
+
+		case kContainer32High:
+		case kContainer32Low:
+		{
+			UInt32 *out = (UInt32*)dst;
+			//Aligned low samples are logically shifted: the bits above the significant ones are zero
+			const UInt32 lowShift = (kContainer == kContainer32Low) ? (32 - bitsPerSample) : 0;
+			for (i=0;i<nbSamples;i++) {
+				UInt32 sample = (UInt32)toAlignedHigh<Source>(in[i], bitsPerSample) >> lowShift;
+				out[i] = isSwapped ? swapInt32(sample) : sample;
+			}
+		}
+			break;
+	}
+}
+
+#ifdef __SSE2__
+/* Sample rate converters output to native 32bit: rounding and saturation of 4 samples per step */
+template <int kContainer>
+static void writeFloat32SSE2(void *dst, const void *src, UInt64 nbSamples, UInt32 bitsPerSample)
+{
+	const Float32 *in = (const Float32*)src;
+	SInt32 *out = (SInt32*)dst;
+	//Largest float below 2^31 for the 32bit format, whose maximum value is not a float
+	const __m128 scale = _mm_set1_ps((Float32)(1LL << (bitsPerSample - 1)));
+	const __m128 maxValue = _mm_set1_ps((bitsPerSample < 32) ? (Float32)((1LL << (bitsPerSample - 1)) - 1) : 2147483520.0f);
+	const __m128 minValue = _mm_set1_ps(-(Float32)(1LL << (bitsPerSample - 1)));
+	const __m128i highShift = _mm_cvtsi32_si128((kContainer == kContainer32High) ? (int)(32 - bitsPerSample) : 0);
+	//Aligned low samples keep their significant bits only, as the scalar kernel logical shift
+	const __m128i lowMask = _mm_set1_epi32((kContainer == kContainer32Low) ? (int)(0xFFFFFFFFu >> (32 - bitsPerSample)) : -1);
+	UInt64 i;
+
+	for (i=0;(i+4)<=nbSamples;i+=4) {
+		__m128 scaled = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+		scaled = _mm_max_ps(_mm_min_ps(scaled, maxValue), minValue);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(_mm_sll_epi32(_mm_cvtps_epi32(scaled), highShift), lowMask));
+	}
+	if (i < nbSamples)
+		writeSamples<Float32, kContainer, kHostIsBigEndian>(out + i, in + i, nbSamples - i, bitsPerSample);
+}
+#endif
+
+#pragma mark Writer selection
+
+template <int kContainer, bool kBigEndian>
+static void setKernels(AudioIntegerWriter *writer)
+{
+	writer->kernels[kAudioIntegerWriterSourceInt32] = writeSamples<SInt32, kContainer, kBigEndian>;
+	writer->kernels[kAudioIntegerWriterSourceFloat32] = writeSamples<Float32, kContainer, kBigEndian>;
+	writer->kernels[kAudioIntegerWriterSourceFloat64] = writeSamples<Float64, kContainer, kBigEndian>;
+#ifdef __SSE2__
+	//Default rounding mode of the SSE2 conversion is the nearest one, as the scalar kernel
+	if (((kContainer == kContainer32High) || (kContainer == kContainer32Low)) && (kBigEndian == kHostIsBigEndian))
+		writer->kernels[kAudioIntegerWriterSourceFloat32] = writeFloat32SSE2<kContainer>;
+#endif
+}
+
+template <bool kBigEndian>
+static bool selectContainer(AudioIntegerWriter *writer, UInt32 bytesPerSample, UInt32 bitsPerSample, bool isAlignedLow)
+{
+	switch (bytesPerSample) {
+		case 2:
+			setKernels<kContainer16, kBigEndian>(writer);
+			writer->name = kBigEndian ? "int16 big endian" : "int16";
+			return true;
+		case 3:
+			setKernels<kContainer24Packed, kBigEndian>(writer);
+			writer->name = kBigEndian ? "int24 packed big endian" : "int24 packed";
+			return true;
+		case 4:
+			if (isAlignedLow && (bitsPerSample < 32)) {
+				setKernels<kContainer32Low, kBigEndian>(writer);
+				writer->name = kBigEndian ? "int32 aligned low big endian" : "int32 aligned low";
+			}
+			else {
+				setKernels<kContainer32High, kBigEndian>(writer);
+				writer->name = kBigEndian ? "int32 aligned high big endian" : "int32 aligned high";
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool AudioIntegerWriterSelect(AudioIntegerWriter *writer, const AudioIntegerWriterFormat *format)
+{
+	memset(writer, 0, sizeof(AudioIntegerWriter));
+
+	if ((format->bitsPerSample == 0) || (format->bitsPerSample > 8*format->bytesPerSample))
+		return false;
+
+	writer->bitsPerSample = format->bitsPerSample;
+
+	if (format->isBigEndian)
+		return selectContainer<true>(writer, format->bytesPerSample, format->bitsPerSample, format->isAlignedLow);
+	else
+		return selectContainer<false>(writer, format->bytesPerSample, format->bitsPerSample, format->isAlignedLow);
+}
@@ -0,0 +1,99 @@
+/*
+ AudioIntegerWriter.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#ifndef __AUDIOINTEGERWRITER_H__
+#define __AUDIOINTEGERWRITER_H__
+
+#include <stdbool.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Formats of the decoded samples the writers convert from
+ */
+enum
+{
+	kAudioIntegerWriterSourceInt32 = 0, //32bit signed integer aligned high (FLAC samples shifted to the MSB)
+	kAudioIntegerWriterSourceFloat32 = 1, //32bit float in the [-1.0,1.0[ range (sample rate converters output)
+	kAudioIntegerWriterSourceFloat64 = 2, //64bit float in the [-1.0,1.0[ range (libsndfile output)
+	kAudioIntegerWriterSourceCount = 3
+};
+
+/*
+ AudioIntegerWriterKernel
+ Writes interleaved samples in the integer mode device format, in one pass
+ @param dst the device format destination samples
+ @param src the source samples, in the writer source format
+ @param nbSamples number of samples (frames x channels) to write
+ @param bitsPerSample significant bits of the device format
+ @comment Float samples are rounded to the nearest integer and saturated. Samples already requantized
+ (AudioDitherRequantizeXXX) to the device bit depth are written exactly
+ */
+typedef void (*AudioIntegerWriterKernel)(void *dst, const void *src, UInt64 nbSamples, UInt32 bitsPerSample);
+
+/*
+ AudioIntegerWriterFormat
+ Integer mode device format of the written samples, interleaved signed integers
+ */
+typedef struct {
+	UInt32 bytesPerSample; //Container of the samples: 2, 3 (packed) or 4 bytes
+	UInt32 bitsPerSample; //Significant bits, at most the container ones
+	bool isBigEndian;
+	bool isAlignedLow; //Significant bits narrower than the container aligned low, the upper bits being zero
+} AudioIntegerWriterFormat;
+
+/*
+ AudioIntegerWriter
+ Writers of one integer mode device format, one per source format
+ */
+typedef struct {
+	AudioIntegerWriterKernel kernels[kAudioIntegerWriterSourceCount];
+	UInt32 bitsPerSample;
+	const char *name; //Debug info
+} AudioIntegerWriter;
+
+/** AudioIntegerWriterSelect
+ Selects the writers of an integer device format: 16bit, 24bit packed, 24 or 20bit in 32 aligned high or low,
+ 32bit, either endianness
+ @param writer On output: the writers of the format
+ @param format the integer mode device format
+ @return false if the format has no writer, the AudioConverter being then used
+ */
+bool AudioIntegerWriterSelect(AudioIntegerWriter *writer, const AudioIntegerWriterFormat *format);
+
+/** AudioIntegerWriterWrite
+ Converts interleaved frames to the device format
+ @param sourceFormat kAudioIntegerWriterSourceXXX format of the source samples
+ */
+static inline void AudioIntegerWriterWrite(const AudioIntegerWriter *writer, UInt32 sourceFormat,
+										   void *dst, const void *src, UInt64 nbSamples)
+{
+	writer->kernels[sourceFormat](dst, src, nbSamples, writer->bitsPerSample);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
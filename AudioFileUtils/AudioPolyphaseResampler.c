@@ -0,0 +1,444 @@
+/*
+ AudioPolyphaseResampler.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "AudioPolyphaseResampler.h"
+
+#define kHistoryInputFrames 4096 //Input frames read ahead, beyond the ones of the requested outputs
+
+typedef void (*PolyphaseFilterKernel)(Float32 *out, const Float32 *coefs, Float32 * const history[],
+									  UInt32 offset, UInt32 taps, UInt32 channels);
+
+struct AudioPolyphaseResampler {
+	AudioPolyphaseInputCallback callback;
+	void *cbData;
+	PolyphaseFilterKernel kernel;
+	AudioPolyphaseApplyProc applyProc;
+	UInt32 channels;
+	UInt32 upFactor;
+	UInt32 downFactor;
+	UInt32 taps; //Per phase, multiple of 8
+	Float32 *coefs; //upFactor phases of taps coefficients, in input frames order
+	Float32 **history; //Planar input frames, one array per channel
+	UInt32 historyCapacity;
+	UInt32 historyFrames;
+	SInt64 historyStart; //Input position of the first history frame
+	SInt64 inputFrames; //Frames supplied by the callback
+	SInt64 outputFrames; //Frames output: output n is at input time n*downFactor/upFactor
+	float *pendingData; //Callback frames not yet copied to the history
+	long pendingFrames;
+	bool isInputAtEnd;
+};
+
+#pragma mark Filter design
+
+static UInt32 gcd(UInt32 a, UInt32 b)
+{
+	UInt32 t;
+
+	while (b != 0) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static bool ratioFactors(Float64 inSampleRate, Float64 outSampleRate, UInt32 *upFactor, UInt32 *downFactor)
+{
+	UInt32 inRate = (UInt32)inSampleRate;
+	UInt32 outRate = (UInt32)outSampleRate;
+	UInt32 divisor;
+
+	if ((inRate == 0) || (outRate == 0)
+		|| ((Float64)inRate != inSampleRate) || ((Float64)outRate != outSampleRate))
+		return false;
+
+	divisor = gcd(inRate, outRate);
+	*upFactor = outRate / divisor;
+	*downFactor = inRate / divisor;
+	return (*upFactor <= kAudioPolyphaseMaxPhases) && (*downFactor <= kAudioPolyphaseMaxPhases);
+}
+
+/* Modified Bessel function of the first kind, order 0 */
+static Float64 besselI0(Float64 x)
+{
+	Float64 sum = 1.0, term = 1.0, halfX = x / 2.0;
+	int k;
+
+	for (k=1;k<64;k++) {
+		term *= (halfX / k) * (halfX / k);
+		sum += term;
+		if (term < sum * 1e-17) break;
+	}
+	return sum;
+}
+
+static Float64 kaiserBeta(Float64 attenuation)
+{
+	if (attenuation > 50.0) return 0.1102 * (attenuation - 8.7);
+	if (attenuation > 21.0) return 0.5842 * pow(attenuation - 21.0, 0.4) + 0.07886 * (attenuation - 21.0);
+	return 0.0;
+}
+
+/*
+ Phase p of the filter holds the coefficients of the taps input frames ending at the input position following
+ the output time, the delay of the filter being compensated: output n uses the input frames
+ floor(n*M/L) - taps/2 + 1 to floor(n*M/L) + taps/2, with p = (n*M) mod L
+ Each phase is normalized to a unity DC gain.
+ The cutoff is at the lowest of the two Nyquist frequencies, centered in the transition band: the content folded
+ back is in its upper half, above the audio band
+ */
+static void designFilter(Float32 *coefs, UInt32 upFactor, UInt32 downFactor, UInt32 taps, Float64 attenuation)
+{
+	const Float64 cutoff = (upFactor >= downFactor) ? 0.5 : 0.5 * upFactor / downFactor; //In cycles per input frame
+	const Float64 beta = kaiserBeta(attenuation);
+	const Float64 i0Beta = besselI0(beta);
+	const Float64 halfLength = taps / 2.0;
+	Float64 x, r, h, sum;
+	UInt32 phase, tap;
+
+	for (phase=0;phase<upFactor;phase++) {
+		Float64 phaseCoefs[taps];
+
+		sum = 0.0;
+		for (tap=0;tap<taps;tap++) {
+			//Distance in input frames between this tap input frame and the output time
+			x = (Float64)(taps - 1 - tap) - halfLength + (Float64)phase / upFactor;
+			r = x / halfLength;
+			h = (x == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+			h *= (r*r < 1.0) ? besselI0(beta * sqrt(1.0 - r*r)) / i0Beta : 0.0;
+			phaseCoefs[tap] = h;
+			sum += h;
+		}
+		for (tap=0;tap<taps;tap++)
+			coefs[phase*taps + tap] = (Float32)(phaseCoefs[tap] / sum);
+	}
+}
+
+#pragma mark Scalar kernels
+
+static void filterFrame(Float32 *out, const Float32 *coefs, Float32 * const history[],
+						UInt32 offset, UInt32 taps, UInt32 channels)
+{
+	UInt32 channel,tap;
+	Float32 acc;
+
+	for (channel=0;channel<channels;channel++) {
+		const Float32 *in = history[channel] + offset;
+
+		acc = 0.0f;
+		for (tap=0;tap<taps;tap++)
+			acc += coefs[tap] * in[tap];
+		*out++ = acc;
+	}
+}
+
+#pragma mark SSE2 kernels
+
+#ifdef __SSE2__
+static inline Float32 horizontalSum(__m128 v)
+{
+	v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+static void filterFrameSSE2(Float32 *out, const Float32 *coefs, Float32 * const history[],
+							UInt32 offset, UInt32 taps, UInt32 channels)
+{
+	UInt32 channel,tap;
+	__m128 acc0,acc1;
+
+	for (channel=0;channel<channels;channel++) {
+		const Float32 *in = history[channel] + offset;
+
+		acc0 = _mm_setzero_ps();
+		acc1 = _mm_setzero_ps();
+		for (tap=0;tap<taps;tap+=8) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(coefs + tap), _mm_loadu_ps(in + tap)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(coefs + tap + 4), _mm_loadu_ps(in + tap + 4)));
+		}
+		*out++ = horizontalSum(_mm_add_ps(acc0, acc1));
+	}
+}
+
+/* Both channels in one pass over the coefficients */
+static void filterStereoFrameSSE2(Float32 *out, const Float32 *coefs, Float32 * const history[],
+								  UInt32 offset, UInt32 taps, UInt32 channels)
+{
+	const Float32 *left = history[0] + offset;
+	const Float32 *right = history[1] + offset;
+	__m128 accLeft0,accLeft1,accRight0,accRight1,c0,c1;
+	UInt32 tap;
+
+	(void)channels;
+	accLeft0 = accLeft1 = accRight0 = accRight1 = _mm_setzero_ps();
+	for (tap=0;tap<taps;tap+=8) {
+		c0 = _mm_load_ps(coefs + tap);
+		c1 = _mm_load_ps(coefs + tap + 4);
+		accLeft0 = _mm_add_ps(accLeft0, _mm_mul_ps(c0, _mm_loadu_ps(left + tap)));
+		accLeft1 = _mm_add_ps(accLeft1, _mm_mul_ps(c1, _mm_loadu_ps(left + tap + 4)));
+		accRight0 = _mm_add_ps(accRight0, _mm_mul_ps(c0, _mm_loadu_ps(right + tap)));
+		accRight1 = _mm_add_ps(accRight1, _mm_mul_ps(c1, _mm_loadu_ps(right + tap + 4)));
+	}
+	out[0] = horizontalSum(_mm_add_ps(accLeft0, accLeft1));
+	out[1] = horizontalSum(_mm_add_ps(accRight0, accRight1));
+}
+#endif
+
+#pragma mark Resampler
+
+bool AudioPolyphaseResamplerIsRatioSupported(Float64 inSampleRate, Float64 outSampleRate)
+{
+	UInt32 upFactor,downFactor;
+
+	return ratioFactors(inSampleRate, outSampleRate, &upFactor, &downFactor);
+}
+
+AudioPolyphaseResampler* AudioPolyphaseResamplerNew(AudioPolyphaseInputCallback callback, void *cbData,
+													Float64 inSampleRate, Float64 outSampleRate,
+													UInt32 tapsPerPhase, Float64 stopbandAttenuation, UInt32 channels,
+													AudioPolyphaseApplyProc applyProc)
+{
+	AudioPolyphaseResampler *resampler;
+	UInt32 upFactor,downFactor,taps,channel;
+
+	if ((channels == 0) || (channels > kAudioPolyphaseMaxChannels)
+		|| !ratioFactors(inSampleRate, outSampleRate, &upFactor, &downFactor))
+		return NULL;
+
+	//Same filter length in output frames when downsampling, rounded up to the SSE2 kernels step
+	taps = (downFactor > upFactor) ? (UInt32)(((UInt64)tapsPerPhase * downFactor + upFactor - 1) / upFactor) : tapsPerPhase;
+	taps = (taps < 8) ? 8 : (taps + 7) & ~7;
+
+	resampler = (AudioPolyphaseResampler*)calloc(1, sizeof(AudioPolyphaseResampler));
+	if (resampler == NULL) return NULL;
+
+	resampler->callback = callback;
+	resampler->cbData = cbData;
+	resampler->applyProc = applyProc;
+	resampler->channels = channels;
+	resampler->upFactor = upFactor;
+	resampler->downFactor = downFactor;
+	resampler->taps = taps;
+	resampler->historyCapacity = taps + kHistoryInputFrames;
+	resampler->kernel = filterFrame;
+#ifdef __SSE2__
+	resampler->kernel = (channels == 2) ? filterStereoFrameSSE2 : filterFrameSSE2;
+#endif
+
+	//malloc blocks are 16 bytes aligned, and so are the phases: aligned coefficients loads
+	resampler->coefs = (Float32*)malloc(upFactor * taps * sizeof(Float32));
+	resampler->history = (Float32**)calloc(channels, sizeof(Float32*));
+	if ((resampler->coefs == NULL) || (resampler->history == NULL)) {
+		AudioPolyphaseResamplerDelete(resampler);
+		return NULL;
+	}
+	for (channel=0;channel<channels;channel++) {
+		resampler->history[channel] = (Float32*)malloc(resampler->historyCapacity * sizeof(Float32));
+		if (resampler->history[channel] == NULL) {
+			AudioPolyphaseResamplerDelete(resampler);
+			return NULL;
+		}
+	}
+
+	designFilter(resampler->coefs, upFactor, downFactor, taps, stopbandAttenuation);
+	AudioPolyphaseResamplerReset(resampler);
+
+	return resampler;
+}
+
+void AudioPolyphaseResamplerDelete(AudioPolyphaseResampler *resampler)
+{
+	UInt32 channel;
+
+	if (resampler == NULL) return;
+
+	if (resampler->history) {
+		for (channel=0;channel<resampler->channels;channel++)
+			free(resampler->history[channel]);
+		free(resampler->history);
+	}
+	free(resampler->coefs);
+	free(resampler);
+}
+
+void AudioPolyphaseResamplerReset(AudioPolyphaseResampler *resampler)
+{
+	UInt32 channel;
+
+	//Silence before the first input frame, for the first outputs
+	resampler->historyFrames = resampler->taps / 2 - 1;
+	resampler->historyStart = -(SInt64)resampler->historyFrames;
+	for (channel=0;channel<resampler->channels;channel++)
+		memset(resampler->history[channel], 0, resampler->historyFrames * sizeof(Float32));
+
+	resampler->inputFrames = 0;
+	resampler->outputFrames = 0;
+	resampler->pendingData = NULL;
+	resampler->pendingFrames = 0;
+	resampler->isInputAtEnd = false;
+}
+
+/* Makes room in the history for the input frames firstNeeded to lastNeeded */
+static bool reserveHistory(AudioPolyphaseResampler *resampler, SInt64 firstNeeded, SInt64 lastNeeded)
+{
+	const UInt32 capacity = (UInt32)(lastNeeded - firstNeeded + 1) + kHistoryInputFrames;
+	Float32 *channelHistory;
+	UInt32 channel;
+
+	if ((lastNeeded - firstNeeded + 1) <= resampler->historyCapacity) return true;
+
+	for (channel=0;channel<resampler->channels;channel++) {
+		channelHistory = (Float32*)realloc(resampler->history[channel], capacity * sizeof(Float32));
+		if (channelHistory == NULL) return false;
+		resampler->history[channel] = channelHistory;
+	}
+	resampler->historyCapacity = capacity;
+	return true;
+}
+
+/* Drops the history frames before firstNeeded, and appends the next input frames (silence after the end of the input) */
+static void refillHistory(AudioPolyphaseResampler *resampler, SInt64 firstNeeded)
+{
+	UInt32 dropped,added,channel,frame;
+
+	if (firstNeeded > resampler->historyStart) {
+		dropped = (UInt32)(firstNeeded - resampler->historyStart);
+		if (dropped > resampler->historyFrames) dropped = resampler->historyFrames;
+		for (channel=0;channel<resampler->channels;channel++)
+			memmove(resampler->history[channel], resampler->history[channel] + dropped,
+					(resampler->historyFrames - dropped) * sizeof(Float32));
+		resampler->historyFrames -= dropped;
+		resampler->historyStart += dropped;
+	}
+
+	if ((resampler->pendingFrames == 0) && !resampler->isInputAtEnd) {
+		resampler->pendingFrames = resampler->callback(resampler->cbData, &resampler->pendingData);
+		if (resampler->pendingFrames <= 0) {
+			resampler->pendingFrames = 0;
+			resampler->isInputAtEnd = true;
+		}
+	}
+
+	added = resampler->historyCapacity - resampler->historyFrames;
+	if (resampler->pendingFrames > 0) {
+		if ((long)added > resampler->pendingFrames) added = (UInt32)resampler->pendingFrames;
+		for (channel=0;channel<resampler->channels;channel++) {
+			Float32 *dst = resampler->history[channel] + resampler->historyFrames;
+			const float *src = resampler->pendingData + channel;
+
+			for (frame=0;frame<added;frame++,src+=resampler->channels)
+				dst[frame] = *src;
+		}
+		resampler->pendingData += added * resampler->channels;
+		resampler->pendingFrames -= added;
+		resampler->inputFrames += added;
+	}
+	else {
+		for (channel=0;channel<resampler->channels;channel++)
+			memset(resampler->history[channel] + resampler->historyFrames, 0, added * sizeof(Float32));
+	}
+	resampler->historyFrames += added;
+}
+
+typedef struct {
+	AudioPolyphaseResampler *resampler;
+	Float32 *data;
+	SInt64 firstOutput;
+	SInt64 lastOutput;
+} FilterBlocksContext;
+
+/* Outputs of one kAudioPolyphaseBlockFrames block: the filter phase and input position being derived from the output
+ index, the blocks are independent and give the same samples whatever the thread computing them */
+static void filterBlock(void *context, size_t block)
+{
+	const FilterBlocksContext *blocks = (const FilterBlocksContext*)context;
+	const AudioPolyphaseResampler *resampler = blocks->resampler;
+	const UInt32 taps = resampler->taps;
+	const UInt32 upFactor = resampler->upFactor;
+	const UInt32 downFactor = resampler->downFactor;
+	SInt64 output = blocks->firstOutput + (SInt64)block * kAudioPolyphaseBlockFrames;
+	SInt64 lastOutput = output + kAudioPolyphaseBlockFrames - 1;
+	SInt64 inputPosition = (output * downFactor) / upFactor;
+	UInt32 phase = (UInt32)((output * downFactor) % upFactor);
+	Float32 *out = blocks->data + (output - blocks->firstOutput) * resampler->channels;
+
+	if (lastOutput > blocks->lastOutput) lastOutput = blocks->lastOutput;
+
+	for (;output<=lastOutput;output++) {
+		resampler->kernel(out, resampler->coefs + phase * taps, resampler->history,
+						  (UInt32)(inputPosition - taps / 2 + 1 - resampler->historyStart), taps, resampler->channels);
+		out += resampler->channels;
+
+		phase += downFactor;
+		inputPosition += phase / upFactor;
+		phase %= upFactor;
+	}
+}
+
+long AudioPolyphaseResamplerRead(AudioPolyphaseResampler *resampler, long frames, Float32 *data)
+{
+	const UInt32 taps = resampler->taps;
+	const UInt32 upFactor = resampler->upFactor;
+	const UInt32 downFactor = resampler->downFactor;
+	FilterBlocksContext blocks;
+	SInt64 firstNeeded,lastNeeded,endOfStream;
+	size_t nbBlocks,block;
+
+	if (frames <= 0) return 0;
+
+	//History holding all the input frames of the requested outputs
+	blocks.resampler = resampler;
+	blocks.data = data;
+	blocks.firstOutput = resampler->outputFrames;
+	blocks.lastOutput = resampler->outputFrames + frames - 1;
+	firstNeeded = (blocks.firstOutput * downFactor) / upFactor - taps / 2 + 1;
+	lastNeeded = (blocks.lastOutput * downFactor) / upFactor + taps / 2;
+	if (!reserveHistory(resampler, firstNeeded, lastNeeded)) return -1;
+	while ((resampler->historyStart + resampler->historyFrames - 1) < lastNeeded)
+		refillHistory(resampler, firstNeeded);
+
+	//Output time past the last input frame: end of the stream
+	if (resampler->isInputAtEnd) {
+		endOfStream = (resampler->inputFrames * upFactor + downFactor - 1) / downFactor;
+		if (blocks.lastOutput >= endOfStream) blocks.lastOutput = endOfStream - 1;
+		if (blocks.lastOutput < blocks.firstOutput) return 0;
+	}
+
+	nbBlocks = (size_t)((blocks.lastOutput - blocks.firstOutput) / kAudioPolyphaseBlockFrames + 1);
+	if ((nbBlocks > 1) && resampler->applyProc)
+		resampler->applyProc(nbBlocks, &blocks, filterBlock);
+	else for (block=0;block<nbBlocks;block++)
+		filterBlock(&blocks, block);
+
+	resampler->outputFrames = blocks.lastOutput + 1;
+	return (long)(blocks.lastOutput - blocks.firstOutput + 1);
+}
@@ -0,0 +1,109 @@
+/*
+ AudioPolyphaseResampler.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#ifndef __AUDIOPOLYPHASERESAMPLER_H__
+#define __AUDIOPOLYPHASERESAMPLER_H__
+
+#include <stdbool.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioPolyphaseMaxPhases 640 //Up to the 44.1kHz to 192kHz ratio (640/147)
+#define kAudioPolyphaseMaxChannels 255
+#define kAudioPolyphaseBlockFrames 16384 //Output frames converted by one worker thread
+
+/*
+ AudioPolyphaseInputCallback
+ Supplies the interleaved Float32 frames to resample, same prototype as the libsamplerate src_callback_t
+ @param cbData the pointer given to AudioPolyphaseResamplerNew
+ @param data set to the frames, to stay valid until the next call
+ @return the number of frames supplied, 0 at the end of the stream
+ */
+typedef long (*AudioPolyphaseInputCallback)(void *cbData, float **data);
+
+/*
+ AudioPolyphaseApplyProc
+ Runs the output blocks of a read, same prototype as dispatch_apply_f without the queue
+ @param iterations number of calls to work, with iteration from 0 to iterations-1, in any order and on any threads
+ @param context passed to work
+ @param work the block conversion, to have completed all the iterations on return
+ */
+typedef void (*AudioPolyphaseApplyProc)(size_t iterations, void *context, void (*work)(void *context, size_t iteration));
+
+/*
+ AudioPolyphaseResampler
+ Polyphase FIR sample rate converter for the ratios between integer sample rates: the integer oversampling
+ factors (2x, 4x, 8x) and the 44.1kHz/48kHz families rational ones (147/160, 160/147, ...).
+ Kaiser windowed sinc filter, each output sample being a single SIMD dot product of one of its phases
+ with the input frames, without the coefficients interpolation of the general purpose converters.
+ One resampler has a single consumer thread, the reads of several blocks being split by the apply proc
+ */
+typedef struct AudioPolyphaseResampler AudioPolyphaseResampler;
+
+/** AudioPolyphaseResamplerIsRatioSupported
+ @return true if the conversion ratio fits in kAudioPolyphaseMaxPhases filter phases
+ */
+bool AudioPolyphaseResamplerIsRatioSupported(Float64 inSampleRate, Float64 outSampleRate);
+
+/** AudioPolyphaseResamplerNew
+ @param callback the input frames supplier
+ @param cbData the pointer passed to the callback
+ @param inSampleRate sample rate of the input frames
+ @param outSampleRate sample rate of the output frames
+ @param tapsPerPhase filter length, in input frames. Scaled up by the decimation ratio when downsampling
+ @param stopbandAttenuation Kaiser window design attenuation, in dB
+ @param channels number of interleaved channels, up to kAudioPolyphaseMaxChannels
+ @param applyProc runs the blocks of the reads in parallel, NULL to run them on the reading thread
+ @return the resampler, NULL if the ratio is not supported or on allocation failure
+ @comment The filter delay is compensated: output frame n is aligned on input time n*inSampleRate/outSampleRate
+ */
+AudioPolyphaseResampler* AudioPolyphaseResamplerNew(AudioPolyphaseInputCallback callback, void *cbData,
+													Float64 inSampleRate, Float64 outSampleRate,
+													UInt32 tapsPerPhase, Float64 stopbandAttenuation, UInt32 channels,
+													AudioPolyphaseApplyProc applyProc);
+
+void AudioPolyphaseResamplerDelete(AudioPolyphaseResampler *resampler);
+
+/** AudioPolyphaseResamplerReset
+ Clears the filter history, to be called when the input restarts at another position
+ */
+void AudioPolyphaseResamplerReset(AudioPolyphaseResampler *resampler);
+
+/** AudioPolyphaseResamplerRead
+ @param frames number of frames to output
+ @param data the interleaved Float32 output frames
+ @return the number of frames output, less than frames only at the end of the input stream. -1 on allocation failure
+ @comment The input frames of the whole read are pulled from the callback on the calling thread, then the output
+ frames are converted by blocks of kAudioPolyphaseBlockFrames frames by the apply proc. Each output frame being computed
+ from its own index only, the frames are the same as the ones of smaller reads on a single thread
+ */
+long AudioPolyphaseResamplerRead(AudioPolyphaseResampler *resampler, long frames, Float32 *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
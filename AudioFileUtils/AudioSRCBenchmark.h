@@ -0,0 +1,48 @@
+/*
+ AudioSRCBenchmark.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#ifndef __AUDIOSRCBENCHMARK_H__
+#define __AUDIOSRCBENCHMARK_H__
+
+#import <Cocoa/Cocoa.h>
+
+/**
+ class AudioSRCBenchmark
+ Throughput and accuracy of the sample rate converters: every kAUDSRCModelXXX model at every kAUDSRCQualityXXX
+ quality, over the common sample rate pairs, measured by AudioSRCMeasure with the settings of the loaders
+ */
+@interface AudioSRCBenchmark : NSObject
+{
+}
+
+/** writeReport
+ Runs the whole benchmark, and writes one CSV line per model, quality and sample rate pair
+ @param path the CSV file to write
+ @return true if success
+ @comment Takes minutes: not to be run on the main thread
+ */
++ (bool)writeReport:(NSString*)path;
+
+@end
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ AudioSRCBenchmark.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <samplerate/samplerate.h>
+
+#import "AudioSRCBenchmark.h"
+#import "AudioSRCMeasure.h"
+#import "AudioPolyphaseResampler.h"
+#import "AudioFileLoader.h"
+#import "PreferenceController.h"
+
+/* Converter of one benchmark line, and the signal it converts */
+typedef struct {
+	int model;
+	int SRCQuality;
+	int SRCComplexity;
+	Float64 inSampleRate;
+	Float64 outSampleRate;
+	const Float32 *inData;
+	long inFrames;
+	bool isInputSupplied;
+} AudioSRCBenchmarkConverter;
+
+static const Float64 kBenchmarkSampleRatePairs[][2] = {
+	{ 44100.0, 88200.0 }, { 44100.0, 176400.0 }, { 44100.0, 192000.0 },
+	{ 48000.0, 96000.0 }, { 48000.0, 192000.0 }, { 96000.0, 44100.0 }
+};
+
+static const char * const kBenchmarkModelNames[] = { "CoreAudio", "libSampleRate", "PolyphaseFIR" };
+static const char * const kBenchmarkQualityNames[] = { "Lowest", "Low", "Medium", "High", "Max" };
+
+#pragma mark Converters
+
+static long convertlibSampleRate(void *userData, const Float32 *in, long inFrames, Float32 *out, long maxOutFrames)
+{
+	AudioSRCBenchmarkConverter *converter = (AudioSRCBenchmarkConverter*)userData;
+	SRC_DATA srcData;
+
+	srcData.data_in = in;
+	srcData.input_frames = inFrames;
+	srcData.data_out = out;
+	srcData.output_frames = maxOutFrames;
+	srcData.src_ratio = converter->outSampleRate / converter->inSampleRate;
+	if (src_simple(&srcData, converter->SRCQuality, 1) != 0) return -1;
+
+	return srcData.output_frames_gen;
+}
+
+static long polyphaseInputCallback(void *cbData, float **data)
+{
+	AudioSRCBenchmarkConverter *converter = (AudioSRCBenchmarkConverter*)cbData;
+
+	if (converter->isInputSupplied) return 0;
+	converter->isInputSupplied = true;
+	*data = (float*)converter->inData;
+	return converter->inFrames;
+}
+
+static long convertPolyphaseFIR(void *userData, const Float32 *in, long inFrames, Float32 *out, long maxOutFrames)
+{
+	AudioSRCBenchmarkConverter *converter = (AudioSRCBenchmarkConverter*)userData;
+	AudioPolyphaseResampler *resampler;
+	long framesRead;
+
+	converter->inData = in;
+	converter->inFrames = inFrames;
+	converter->isInputSupplied = false;
+	resampler = AudioPolyphaseResamplerNew(polyphaseInputCallback, converter, converter->inSampleRate, converter->outSampleRate,
+										   (UInt32)converter->SRCQuality, (Float64)converter->SRCComplexity, 1,
+										   AudioFileLoaderApplyConcurrently);
+	if (resampler == NULL) return -1;
+
+	framesRead = AudioPolyphaseResamplerRead(resampler, maxOutFrames, out);
+	AudioPolyphaseResamplerDelete(resampler);
+	return framesRead;
+}
+
+static OSStatus CoreAudioInputDataProc(AudioConverterRef inAudioConverter,
+									   UInt32* ioNumberDataPackets,
+									   AudioBufferList* ioData,
+									   AudioStreamPacketDescription** outDataPacketDescription,
+									   void* inUserData)
+{
+	AudioSRCBenchmarkConverter *converter = (AudioSRCBenchmarkConverter*)inUserData;
+
+	if (converter->isInputSupplied) {
+		*ioNumberDataPackets = 0;
+		return noErr;
+	}
+	converter->isInputSupplied = true;
+	*ioNumberDataPackets = (UInt32)converter->inFrames;
+	ioData->mBuffers[0].mNumberChannels = 1;
+	ioData->mBuffers[0].mData = (void*)converter->inData;
+	ioData->mBuffers[0].mDataByteSize = (UInt32)(converter->inFrames * sizeof(Float32));
+	return noErr;
+}
+
+static long convertCoreAudio(void *userData, const Float32 *in, long inFrames, Float32 *out, long maxOutFrames)
+{
+	AudioSRCBenchmarkConverter *converter = (AudioSRCBenchmarkConverter*)userData;
+	AudioStreamBasicDescription inStreamFormat,outStreamFormat;
+	AudioConverterRef audioConverter;
+	AudioBufferList outBufList;
+	UInt32 framesRead = (UInt32)maxOutFrames;
+	UInt32 tmpInt;
+	OSStatus err;
+
+	inStreamFormat.mFormatID = kAudioFormatLinearPCM;
+	inStreamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
+	inStreamFormat.mBitsPerChannel = 32;
+	inStreamFormat.mSampleRate = converter->inSampleRate;
+	inStreamFormat.mChannelsPerFrame = 1;
+	inStreamFormat.mBytesPerPacket = sizeof(Float32);
+	inStreamFormat.mFramesPerPacket = 1;
+	inStreamFormat.mBytesPerFrame = sizeof(Float32);
+	inStreamFormat.mReserved = 0;
+	outStreamFormat = inStreamFormat;
+	outStreamFormat.mSampleRate = converter->outSampleRate;
+
+	if (AudioConverterNew(&inStreamFormat, &outStreamFormat, &audioConverter) != noErr) return -1;
+	tmpInt = converter->SRCComplexity;
+	AudioConverterSetProperty(audioConverter, kAudioConverterSampleRateConverterComplexity, sizeof(tmpInt), &tmpInt);
+	tmpInt = converter->SRCQuality;
+	AudioConverterSetProperty(audioConverter, kAudioConverterSampleRateConverterQuality, sizeof(tmpInt), &tmpInt);
+
+	converter->inData = in;
+	converter->inFrames = inFrames;
+	converter->isInputSupplied = false;
+	outBufList.mNumberBuffers = 1;
+	outBufList.mBuffers[0].mNumberChannels = 1;
+	outBufList.mBuffers[0].mData = out;
+	outBufList.mBuffers[0].mDataByteSize = (UInt32)(maxOutFrames * sizeof(Float32));
+
+	err = AudioConverterFillComplexBuffer(audioConverter, CoreAudioInputDataProc, converter, &framesRead, &outBufList, NULL);
+	AudioConverterDispose(audioConverter);
+
+	return (err == noErr) ? framesRead : -1;
+}
+
+@implementation AudioSRCBenchmark
+
++ (bool)writeReport:(NSString*)path
+{
+	const AudioSRCMeasureConvertProc convertProcs[] = { convertCoreAudio, convertlibSampleRate, convertPolyphaseFIR };
+	AudioSRCBenchmarkConverter converter;
+	AudioSRCMeasureResults results;
+	AudioSRCMeasureResults libSampleRateResults[kAUDSRCQualityMax+1][sizeof(kBenchmarkSampleRatePairs)/sizeof(kBenchmarkSampleRatePairs[0])];
+	bool isLibSampleRateMeasured[kAUDSRCQualityMax+1][sizeof(kBenchmarkSampleRatePairs)/sizeof(kBenchmarkSampleRatePairs[0])];
+	FILE *csvFile;
+	int model,quality;
+	size_t pair;
+
+	csvFile = fopen([path fileSystemRepresentation], "w");
+	if (csvFile == NULL) return false;
+
+	memset(isLibSampleRateMeasured, 0, sizeof(isLibSampleRateMeasured));
+	AudioSRCMeasureWriteCSVHeader(csvFile);
+	for (model=kAUDSRCModelAppleCoreAudio;model<=kAUDSRCModelPolyphaseFIR;model++) {
+		for (quality=kAUDSRCQualityLowest;quality<=kAUDSRCQualityMax;quality++) {
+			memset(&converter, 0, sizeof(converter));
+			converter.model = model;
+			[AudioFileLoader getSRCSettingsForModel:model quality:quality
+										 SRCQuality:&converter.SRCQuality complexity:&converter.SRCComplexity];
+
+			for (pair=0;pair<sizeof(kBenchmarkSampleRatePairs)/sizeof(kBenchmarkSampleRatePairs[0]);pair++) {
+				converter.inSampleRate = kBenchmarkSampleRatePairs[pair][0];
+				converter.outSampleRate = kBenchmarkSampleRatePairs[pair][1];
+
+				if (AudioSRCMeasure(convertProcs[model], &converter, converter.inSampleRate, converter.outSampleRate, &results) != 0) {
+					NSLog(@"SRC benchmark: %s %s %.0f to %.0f failed", kBenchmarkModelNames[model], kBenchmarkQualityNames[quality],
+						  converter.inSampleRate, converter.outSampleRate);
+					continue;
+				}
+				AudioSRCMeasureWriteCSVLine(csvFile, kBenchmarkModelNames[model], kBenchmarkQualityNames[quality],
+											converter.inSampleRate, converter.outSampleRate, &results);
+				fflush(csvFile);
+
+				//Accuracy check of the polyphase converter against libSampleRate at the same quality
+				if (model == kAUDSRCModelSRClibSampleRate) {
+					libSampleRateResults[quality][pair] = results;
+					isLibSampleRateMeasured[quality][pair] = true;
+				}
+				else if ((model == kAUDSRCModelPolyphaseFIR) && isLibSampleRateMeasured[quality][pair]
+						 && !AudioSRCMeasureIsAsAccurate(&results, &libSampleRateResults[quality][pair]))
+					NSLog(@"SRC benchmark: %s %s %.0f to %.0f less accurate than %s", kBenchmarkModelNames[model],
+						  kBenchmarkQualityNames[quality], converter.inSampleRate, converter.outSampleRate,
+						  kBenchmarkModelNames[kAUDSRCModelSRClibSampleRate]);
+			}
+		}
+	}
+
+	fclose(csvFile);
+	return true;
+}
+
+@end
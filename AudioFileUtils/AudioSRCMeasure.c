@@ -0,0 +1,302 @@
+/*
+ AudioSRCMeasure.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "AudioSRCMeasure.h"
+
+#define kTransientFrames 32768 //Output frames skipped at both ends: filter settling
+#define kRippleTones 16
+#define kToneAmplitude 0.5
+#define kMainLobeBins 8 //Half width of the window main lobe
+#define kNoExcludedBin (kAudioSRCMeasureFFTSize + 2*kMainLobeBins)
+
+/* 7 terms Blackman-Harris window: sidelobes below -180dB, under the converters floor */
+static const Float64 kWindowCoefs[7] = { 0.27105140069342, -0.43329793923448, 0.21812299954311, -0.06592544638803,
+	0.01081174209837, -0.00077658482522, 0.00001388721735 };
+
+typedef struct {
+	Float64 *window;
+	Float64 *re;
+	Float64 *im;
+	Float64 *power; //Power spectrum, normalized to the power of a full scale bin centered sine
+	Float64 windowGain; //Coherent gain
+	Float64 windowPowerGain; //Noise power gain
+} Analyzer;
+
+#pragma mark FFT
+
+static void fft(Float64 *re, Float64 *im, UInt32 size)
+{
+	UInt32 i,j,k,len,half;
+	Float64 tr,ti,wr,wi,angle,ur,ui,t;
+
+	//Bit reversal
+	for (i=1,j=0;i<size;i++) {
+		k = size >> 1;
+		for (;j&k;k>>=1) j ^= k;
+		j |= k;
+		if (i < j) {
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (len=2;len<=size;len<<=1) {
+		half = len >> 1;
+		angle = -2.0 * M_PI / len;
+		for (k=0;k<half;k++) {
+			wr = cos(angle * k);
+			wi = sin(angle * k);
+			for (i=k;i<size;i+=len) {
+				ur = re[i + half];
+				ui = im[i + half];
+				tr = ur*wr - ui*wi;
+				ti = ur*wi + ui*wr;
+				re[i + half] = re[i] - tr;
+				im[i + half] = im[i] - ti;
+				re[i] += tr;
+				im[i] += ti;
+			}
+		}
+	}
+}
+
+static int analyzerInit(Analyzer *analyzer)
+{
+	UInt32 i,k;
+	Float64 w;
+
+	analyzer->window = (Float64*)malloc(kAudioSRCMeasureFFTSize * sizeof(Float64));
+	analyzer->re = (Float64*)malloc(kAudioSRCMeasureFFTSize * sizeof(Float64));
+	analyzer->im = (Float64*)malloc(kAudioSRCMeasureFFTSize * sizeof(Float64));
+	analyzer->power = (Float64*)malloc((kAudioSRCMeasureFFTSize / 2 + 1) * sizeof(Float64));
+	if (!analyzer->window || !analyzer->re || !analyzer->im || !analyzer->power) return -1;
+
+	analyzer->windowGain = 0.0;
+	analyzer->windowPowerGain = 0.0;
+	for (i=0;i<kAudioSRCMeasureFFTSize;i++) {
+		for (k=0,w=0.0;k<7;k++)
+			w += kWindowCoefs[k] * cos(2.0 * M_PI * k * i / kAudioSRCMeasureFFTSize);
+		analyzer->window[i] = w;
+		analyzer->windowGain += w;
+		analyzer->windowPowerGain += w*w;
+	}
+	return 0;
+}
+
+static void analyzerFree(Analyzer *analyzer)
+{
+	free(analyzer->window);
+	free(analyzer->re);
+	free(analyzer->im);
+	free(analyzer->power);
+}
+
+/* Power spectrum of the FFT size frames in the middle of the signal */
+static void analyze(Analyzer *analyzer, const Float32 *signal, long frames)
+{
+	const Float32 *start = signal + (frames - kAudioSRCMeasureFFTSize) / 2;
+	const Float64 norm = 2.0 / analyzer->windowGain;
+	UInt32 i;
+
+	for (i=0;i<kAudioSRCMeasureFFTSize;i++) {
+		analyzer->re[i] = start[i] * analyzer->window[i];
+		analyzer->im[i] = 0.0;
+	}
+	fft(analyzer->re, analyzer->im, kAudioSRCMeasureFFTSize);
+	for (i=0;i<=kAudioSRCMeasureFFTSize/2;i++)
+		analyzer->power[i] = (analyzer->re[i]*analyzer->re[i] + analyzer->im[i]*analyzer->im[i]) * norm * norm;
+}
+
+/* Power of the bins firstBin to lastBin, excluding the main lobe of the window around excludedBin */
+static Float64 bandPower(const Analyzer *analyzer, UInt32 firstBin, UInt32 lastBin, UInt32 excludedBin)
+{
+	Float64 power = 0.0;
+
+	if (lastBin > kAudioSRCMeasureFFTSize / 2) lastBin = kAudioSRCMeasureFFTSize / 2;
+	for (;firstBin<=lastBin;firstBin++)
+		if ((firstBin + kMainLobeBins < excludedBin) || (firstBin > excludedBin + kMainLobeBins))
+			power += analyzer->power[firstBin];
+	return power * analyzer->windowGain * analyzer->windowGain / (analyzer->windowPowerGain * kAudioSRCMeasureFFTSize);
+}
+
+/* Power of a bin centered tone: the bins of the window main lobe */
+static Float64 tonePower(const Analyzer *analyzer, UInt32 bin)
+{
+	UInt32 first = (bin > kMainLobeBins) ? bin - kMainLobeBins : 0;
+	Float64 power = 0.0;
+
+	for (;(first<=bin+kMainLobeBins) && (first<=kAudioSRCMeasureFFTSize/2);first++) power += analyzer->power[first];
+	return power * analyzer->windowGain * analyzer->windowGain / (analyzer->windowPowerGain * kAudioSRCMeasureFFTSize);
+}
+
+#pragma mark Measures
+
+static Float64 wallClock(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+/* Output FFT bin nearest to a frequency */
+static UInt32 frequencyBin(Float64 frequency, Float64 outSampleRate)
+{
+	return (UInt32)floor(frequency * kAudioSRCMeasureFFTSize / outSampleRate + 0.5);
+}
+
+static void generateTones(Float32 *in, long inFrames, const Float64 *frequencies, UInt32 nbTones,
+						  Float64 amplitude, Float64 inSampleRate)
+{
+	long frame;
+	UInt32 tone;
+	Float64 sample;
+
+	for (frame=0;frame<inFrames;frame++) {
+		for (tone=0,sample=0.0;tone<nbTones;tone++)
+			sample += amplitude * sin(2.0 * M_PI * frequencies[tone] * frame / inSampleRate);
+		in[frame] = (Float32)sample;
+	}
+}
+
+int AudioSRCMeasure(AudioSRCMeasureConvertProc convert, void *userData, Float64 inSampleRate, Float64 outSampleRate,
+					AudioSRCMeasureResults *results)
+{
+	const Float64 binWidth = outSampleRate / kAudioSRCMeasureFFTSize;
+	const Float64 lowestNyquist = ((inSampleRate < outSampleRate) ? inSampleRate : outSampleRate) / 2.0;
+	const Float64 bandEdge = (lowestNyquist * 0.9 < 20000.0) ? lowestNyquist * 0.9 : 20000.0;
+	const long maxOutFrames = kAudioSRCMeasureFFTSize + 2 * kTransientFrames;
+	const long inFrames = (long)((Float64)maxOutFrames * inSampleRate / outSampleRate) + 1;
+	Float64 frequencies[kRippleTones];
+	Float64 startTime,convertTime,gain,minGain,maxGain,signal,noise;
+	Float32 *in,*out;
+	long outFrames;
+	UInt32 tone,bin;
+	Analyzer analyzer;
+	struct rusage usage;
+	int err = -1;
+
+	in = (Float32*)malloc(inFrames * sizeof(Float32));
+	out = (Float32*)malloc((maxOutFrames + 1024) * sizeof(Float32));
+	memset(&analyzer, 0, sizeof(analyzer));
+	if (!in || !out || (analyzerInit(&analyzer) != 0)) goto cleanup;
+
+	//THD+N and throughput: 1kHz tone
+	frequencies[0] = frequencyBin(1000.0, outSampleRate) * binWidth;
+	generateTones(in, inFrames, frequencies, 1, kToneAmplitude, inSampleRate);
+	startTime = wallClock();
+	outFrames = convert(userData, in, inFrames, out, maxOutFrames + 1024);
+	convertTime = wallClock() - startTime;
+	if (outFrames < kAudioSRCMeasureFFTSize + kTransientFrames) goto cleanup;
+	results->framesPerSecond = (convertTime > 0.0) ? outFrames / convertTime : 0.0;
+
+	analyze(&analyzer, out, outFrames);
+	bin = frequencyBin(frequencies[0], outSampleRate);
+	signal = tonePower(&analyzer, bin);
+	noise = bandPower(&analyzer, frequencyBin(20.0, outSampleRate), frequencyBin(bandEdge, outSampleRate), bin);
+	results->thdPlusNoise = 10.0 * log10((noise > 1e-30 ? noise : 1e-30) / signal);
+
+	//Passband ripple: tones evenly spaced up to the band edge
+	for (tone=0;tone<kRippleTones;tone++)
+		frequencies[tone] = frequencyBin(bandEdge * (tone + 1) / kRippleTones, outSampleRate) * binWidth;
+	generateTones(in, inFrames, frequencies, kRippleTones, kToneAmplitude / kRippleTones, inSampleRate);
+	outFrames = convert(userData, in, inFrames, out, maxOutFrames + 1024);
+	if (outFrames < kAudioSRCMeasureFFTSize + kTransientFrames) goto cleanup;
+
+	analyze(&analyzer, out, outFrames);
+	minGain = 1e30;
+	maxGain = 0.0;
+	for (tone=0;tone<kRippleTones;tone++) {
+		gain = tonePower(&analyzer, frequencyBin(frequencies[tone], outSampleRate))
+			/ ((kToneAmplitude / kRippleTones) * (kToneAmplitude / kRippleTones));
+		if (gain < minGain) minGain = gain;
+		if (gain > maxGain) maxGain = gain;
+	}
+	results->passbandRipple = 10.0 * log10(maxGain / minGain);
+
+	//Alias rejection
+	if (outSampleRate > inSampleRate) {
+		//Upsampling: tone below the input Nyquist frequency, images above it
+		frequencies[0] = frequencyBin(0.45 * inSampleRate, outSampleRate) * binWidth;
+		generateTones(in, inFrames, frequencies, 1, kToneAmplitude, inSampleRate);
+		outFrames = convert(userData, in, inFrames, out, maxOutFrames + 1024);
+		if (outFrames < kAudioSRCMeasureFFTSize + kTransientFrames) goto cleanup;
+
+		analyze(&analyzer, out, outFrames);
+		signal = tonePower(&analyzer, frequencyBin(frequencies[0], outSampleRate));
+		noise = bandPower(&analyzer, frequencyBin(inSampleRate / 2.0, outSampleRate) + kMainLobeBins, kAudioSRCMeasureFFTSize / 2, kNoExcludedBin);
+	}
+	else {
+		//Downsampling: tone between the two Nyquist frequencies, folded back in the output band
+		frequencies[0] = (outSampleRate + inSampleRate) / 4.0;
+		generateTones(in, inFrames, frequencies, 1, kToneAmplitude, inSampleRate);
+		outFrames = convert(userData, in, inFrames, out, maxOutFrames + 1024);
+		if (outFrames < kAudioSRCMeasureFFTSize + kTransientFrames) goto cleanup;
+
+		analyze(&analyzer, out, outFrames);
+		signal = kToneAmplitude * kToneAmplitude;
+		noise = bandPower(&analyzer, 0, kAudioSRCMeasureFFTSize / 2, kNoExcludedBin);
+	}
+	results->aliasRejection = 10.0 * log10(signal / (noise > 1e-30 ? noise : 1e-30));
+
+	//ru_maxrss is in bytes on Mac OS X, in kilobytes on Linux
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	results->peakMemoryKB = (UInt64)usage.ru_maxrss / 1024;
+#else
+	results->peakMemoryKB = (UInt64)usage.ru_maxrss;
+#endif
+	err = 0;
+
+cleanup:
+	analyzerFree(&analyzer);
+	free(in);
+	free(out);
+	return err;
+}
+
+bool AudioSRCMeasureIsAsAccurate(const AudioSRCMeasureResults *results, const AudioSRCMeasureResults *reference)
+{
+	return (results->thdPlusNoise <= reference->thdPlusNoise + kAudioSRCMeasureToleranceDB)
+		&& (results->aliasRejection >= reference->aliasRejection - kAudioSRCMeasureToleranceDB)
+		&& (results->passbandRipple <= reference->passbandRipple + kAudioSRCMeasureRippleToleranceDB);
+}
+
+void AudioSRCMeasureWriteCSVHeader(FILE *csvFile)
+{
+	fprintf(csvFile, "model,quality,input_rate,output_rate,frames_per_second,peak_memory_kb,thd_n_db,passband_ripple_db,alias_rejection_db\n");
+}
+
+void AudioSRCMeasureWriteCSVLine(FILE *csvFile, const char *model, const char *quality,
+								 Float64 inSampleRate, Float64 outSampleRate, const AudioSRCMeasureResults *results)
+{
+	fprintf(csvFile, "%s,%s,%.0f,%.0f,%.0f,%llu,%.2f,%.4f,%.2f\n", model, quality, inSampleRate, outSampleRate,
+			results->framesPerSecond, (unsigned long long)results->peakMemoryKB,
+			results->thdPlusNoise, results->passbandRipple, results->aliasRejection);
+}
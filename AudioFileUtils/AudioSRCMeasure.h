@@ -0,0 +1,99 @@
+/*
+ AudioSRCMeasure.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#ifndef __AUDIOSRCMEASURE_H__
+#define __AUDIOSRCMEASURE_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioSRCMeasureFFTSize 65536 //Analysis length, in output frames
+#define kAudioSRCMeasureToleranceDB 3.0 //Measures differences within the analysis noise
+#define kAudioSRCMeasureRippleToleranceDB 0.01
+
+/*
+ AudioSRCMeasureConvertProc
+ Converts a whole mono signal with the measured converter
+ @param userData the pointer given to AudioSRCMeasure
+ @param in the input frames
+ @param inFrames number of input frames
+ @param out the output frames
+ @param maxOutFrames size of the output buffer, in frames
+ @return the number of frames output, -1 on error
+ */
+typedef long (*AudioSRCMeasureConvertProc)(void *userData, const Float32 *in, long inFrames, Float32 *out, long maxOutFrames);
+
+/*
+ AudioSRCMeasureResults
+ */
+typedef struct {
+	Float64 framesPerSecond; //Output frames per second of wall clock time
+	UInt64 peakMemoryKB; //Process peak resident size after the conversions
+	Float64 thdPlusNoise; //1kHz tone, distortion and noise from 20Hz to the audio band edge, in dB relative to the tone
+	Float64 passbandRipple; //Peak to peak gain of 16 tones evenly spaced up to the audio band edge, in dB
+	Float64 aliasRejection; //Images (upsampling) or aliases (downsampling) of a tone, in dB below the tone
+} AudioSRCMeasureResults;
+
+/** AudioSRCMeasure
+ Measures a converter on synthetic tones: the steady state part of the outputs is analyzed with a 7 terms
+ Blackman-Harris windowed FFT, the test frequencies falling on its bins
+ @param convert the conversion of the measured converter
+ @param userData the pointer passed to convert
+ @param inSampleRate sample rate of the input frames
+ @param outSampleRate sample rate of the output frames
+ @param results the measures
+ @return 0 if success, -1 if a conversion or an allocation failed
+ @comment The audio band edge is 20kHz, or 90% of the lowest Nyquist frequency below it
+ */
+int AudioSRCMeasure(AudioSRCMeasureConvertProc convert, void *userData, Float64 inSampleRate, Float64 outSampleRate,
+					AudioSRCMeasureResults *results);
+
+/** AudioSRCMeasureIsAsAccurate
+ Compares the accuracy measures of two converters on the same sample rates
+ @return true if results are not worse than reference, within kAudioSRCMeasureToleranceDB on THD+N and alias rejection,
+ and kAudioSRCMeasureRippleToleranceDB on passband ripple. The throughput and memory are not compared
+ */
+bool AudioSRCMeasureIsAsAccurate(const AudioSRCMeasureResults *results, const AudioSRCMeasureResults *reference);
+
+/** AudioSRCMeasureWriteCSVHeader
+ Writes the column names of the AudioSRCMeasureWriteCSVLine lines
+ */
+void AudioSRCMeasureWriteCSVHeader(FILE *csvFile);
+
+/** AudioSRCMeasureWriteCSVLine
+ @param model the converter model name
+ @param quality the converter quality name
+ */
+void AudioSRCMeasureWriteCSVLine(FILE *csvFile, const char *model, const char *quality,
+								 Float64 inSampleRate, Float64 outSampleRate, const AudioSRCMeasureResults *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ AudioSampleConvert.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "AudioSampleConvert.h"
+
+/* Full scale of the float conversion: the FLAC bits per sample rounded up to whole bytes, as the integer formats */
+static inline Float32 float32Scale(UInt32 bitsPerSample)
+{
+	return 1.0f / (Float32)(1L << (((bitsPerSample + 7) / 8) * 8 - 1));
+}
+
+#pragma mark Scalar kernels
+
+static void planarToFloat32(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+							UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	Float32 *out = (Float32*)dst;
+	const Float32 scale = float32Scale(bitsPerSample);
+	UInt32 frame,channel;
+
+	for (frame=0;frame<nbFrames;frame++) {
+		for (channel=0;channel<srcChannels;channel++)
+			*out++ = (Float32)src[channel][frame] * scale;
+		for (;channel<dstChannels;channel++)
+			*out++ = 0.0f;
+	}
+}
+
+static void planarToInt32(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+						  UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	SInt32 *out = (SInt32*)dst;
+	const UInt32 shift = 32 - bitsPerSample;
+	UInt32 frame,channel;
+
+	for (frame=0;frame<nbFrames;frame++) {
+		for (channel=0;channel<srcChannels;channel++)
+			*out++ = src[channel][frame] << shift;
+		for (;channel<dstChannels;channel++)
+			*out++ = 0;
+	}
+}
+
+static void planarFloat32(Float32 *dst, const Float32 * const src[], UInt32 nbFrames,
+						  UInt32 srcChannels, UInt32 dstChannels)
+{
+	UInt32 frame,channel;
+
+	for (frame=0;frame<nbFrames;frame++) {
+		for (channel=0;channel<srcChannels;channel++)
+			*dst++ = src[channel][frame];
+		for (;channel<dstChannels;channel++)
+			*dst++ = 0.0f;
+	}
+}
+
+/* Mono source duplicated to the first two destination channels, the other ones being silent */
+
+static void monoDuplicateToFloat32(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+								   UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	Float32 *out = (Float32*)dst;
+	const Float32 scale = float32Scale(bitsPerSample);
+	Float32 sample;
+	UInt32 frame,channel;
+
+	(void)srcChannels;
+	for (frame=0;frame<nbFrames;frame++) {
+		sample = (Float32)src[0][frame] * scale;
+		*out++ = sample;
+		*out++ = sample;
+		for (channel=2;channel<dstChannels;channel++)
+			*out++ = 0.0f;
+	}
+}
+
+static void monoDuplicateToInt32(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+								 UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	SInt32 *out = (SInt32*)dst;
+	const UInt32 shift = 32 - bitsPerSample;
+	SInt32 sample;
+	UInt32 frame,channel;
+
+	(void)srcChannels;
+	for (frame=0;frame<nbFrames;frame++) {
+		sample = src[0][frame] << shift;
+		*out++ = sample;
+		*out++ = sample;
+		for (channel=2;channel<dstChannels;channel++)
+			*out++ = 0;
+	}
+}
+
+static void monoDuplicateFloat32(Float32 *dst, const Float32 * const src[], UInt32 nbFrames,
+								 UInt32 srcChannels, UInt32 dstChannels)
+{
+	UInt32 frame,channel;
+
+	(void)srcChannels;
+	for (frame=0;frame<nbFrames;frame++) {
+		*dst++ = src[0][frame];
+		*dst++ = src[0][frame];
+		for (channel=2;channel<dstChannels;channel++)
+			*dst++ = 0.0f;
+	}
+}
+
+#pragma mark SSE2 kernels
+
+#ifdef __SSE2__
+/* Stereo and mono (right channel silent) sources to stereo frames, 4 frames per step */
+
+static void stereoToFloat32SSE2(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+								UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	Float32 *out = (Float32*)dst;
+	const SInt32 *left = src[0];
+	const SInt32 *right = src[1];
+	const __m128 scale = _mm_set1_ps(float32Scale(bitsPerSample));
+	__m128 l,r;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,out+=8) {
+		l = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(left + frame))), scale);
+		r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(right + frame))), scale);
+		_mm_storeu_ps(out, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(out + 4, _mm_unpackhi_ps(l, r));
+	}
+	for (;frame<nbFrames;frame++) {
+		*out++ = (Float32)left[frame] * _mm_cvtss_f32(scale);
+		*out++ = (Float32)right[frame] * _mm_cvtss_f32(scale);
+	}
+}
+
+static void monoToFloat32SSE2(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+							  UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	Float32 *out = (Float32*)dst;
+	const SInt32 *left = src[0];
+	const __m128 scale = _mm_set1_ps(float32Scale(bitsPerSample));
+	const __m128 silence = _mm_setzero_ps();
+	__m128 l;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,out+=8) {
+		l = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(left + frame))), scale);
+		_mm_storeu_ps(out, _mm_unpacklo_ps(l, silence));
+		_mm_storeu_ps(out + 4, _mm_unpackhi_ps(l, silence));
+	}
+	for (;frame<nbFrames;frame++) {
+		*out++ = (Float32)left[frame] * _mm_cvtss_f32(scale);
+		*out++ = 0.0f;
+	}
+}
+
+static void stereoToInt32SSE2(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+							  UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	SInt32 *out = (SInt32*)dst;
+	const SInt32 *left = src[0];
+	const SInt32 *right = src[1];
+	const UInt32 shift = 32 - bitsPerSample;
+	const __m128i shiftCount = _mm_cvtsi32_si128((int)shift);
+	__m128i l,r;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,out+=8) {
+		l = _mm_sll_epi32(_mm_loadu_si128((const __m128i*)(left + frame)), shiftCount);
+		r = _mm_sll_epi32(_mm_loadu_si128((const __m128i*)(right + frame)), shiftCount);
+		_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi32(l, r));
+		_mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi32(l, r));
+	}
+	for (;frame<nbFrames;frame++) {
+		*out++ = left[frame] << shift;
+		*out++ = right[frame] << shift;
+	}
+}
+
+static void monoToInt32SSE2(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+							UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	SInt32 *out = (SInt32*)dst;
+	const SInt32 *left = src[0];
+	const UInt32 shift = 32 - bitsPerSample;
+	const __m128i shiftCount = _mm_cvtsi32_si128((int)shift);
+	const __m128i silence = _mm_setzero_si128();
+	__m128i l;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,out+=8) {
+		l = _mm_sll_epi32(_mm_loadu_si128((const __m128i*)(left + frame)), shiftCount);
+		_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi32(l, silence));
+		_mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi32(l, silence));
+	}
+	for (;frame<nbFrames;frame++) {
+		*out++ = left[frame] << shift;
+		*out++ = 0;
+	}
+}
+
+static void stereoFloat32SSE2(Float32 *dst, const Float32 * const src[], UInt32 nbFrames,
+							  UInt32 srcChannels, UInt32 dstChannels)
+{
+	const Float32 *left = src[0];
+	const Float32 *right = src[1];
+	__m128 l,r;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,dst+=8) {
+		l = _mm_loadu_ps(left + frame);
+		r = _mm_loadu_ps(right + frame);
+		_mm_storeu_ps(dst, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(dst + 4, _mm_unpackhi_ps(l, r));
+	}
+	for (;frame<nbFrames;frame++) {
+		*dst++ = left[frame];
+		*dst++ = right[frame];
+	}
+}
+
+static void monoFloat32SSE2(Float32 *dst, const Float32 * const src[], UInt32 nbFrames,
+							UInt32 srcChannels, UInt32 dstChannels)
+{
+	const Float32 *left = src[0];
+	const __m128 silence = _mm_setzero_ps();
+	__m128 l;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,dst+=8) {
+		l = _mm_loadu_ps(left + frame);
+		_mm_storeu_ps(dst, _mm_unpacklo_ps(l, silence));
+		_mm_storeu_ps(dst + 4, _mm_unpackhi_ps(l, silence));
+	}
+	for (;frame<nbFrames;frame++) {
+		*dst++ = left[frame];
+		*dst++ = 0.0f;
+	}
+}
+
+/* Mono source duplicated to stereo frames, 4 frames per step */
+
+static void monoDuplicateToFloat32SSE2(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+									   UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	Float32 *out = (Float32*)dst;
+	const SInt32 *left = src[0];
+	const __m128 scale = _mm_set1_ps(float32Scale(bitsPerSample));
+	__m128 l;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,out+=8) {
+		l = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(left + frame))), scale);
+		_mm_storeu_ps(out, _mm_unpacklo_ps(l, l));
+		_mm_storeu_ps(out + 4, _mm_unpackhi_ps(l, l));
+	}
+	for (;frame<nbFrames;frame++) {
+		*out++ = (Float32)left[frame] * _mm_cvtss_f32(scale);
+		*out++ = (Float32)left[frame] * _mm_cvtss_f32(scale);
+	}
+}
+
+static void monoDuplicateToInt32SSE2(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+									 UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample)
+{
+	SInt32 *out = (SInt32*)dst;
+	const SInt32 *left = src[0];
+	const UInt32 shift = 32 - bitsPerSample;
+	const __m128i shiftCount = _mm_cvtsi32_si128((int)shift);
+	__m128i l;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,out+=8) {
+		l = _mm_sll_epi32(_mm_loadu_si128((const __m128i*)(left + frame)), shiftCount);
+		_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi32(l, l));
+		_mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi32(l, l));
+	}
+	for (;frame<nbFrames;frame++) {
+		*out++ = left[frame] << shift;
+		*out++ = left[frame] << shift;
+	}
+}
+
+static void monoDuplicateFloat32SSE2(Float32 *dst, const Float32 * const src[], UInt32 nbFrames,
+									 UInt32 srcChannels, UInt32 dstChannels)
+{
+	const Float32 *left = src[0];
+	__m128 l;
+	UInt32 frame;
+
+	(void)srcChannels; (void)dstChannels;
+	for (frame=0;(frame+4)<=nbFrames;frame+=4,dst+=8) {
+		l = _mm_loadu_ps(left + frame);
+		_mm_storeu_ps(dst, _mm_unpacklo_ps(l, l));
+		_mm_storeu_ps(dst + 4, _mm_unpackhi_ps(l, l));
+	}
+	for (;frame<nbFrames;frame++) {
+		*dst++ = left[frame];
+		*dst++ = left[frame];
+	}
+}
+#endif
+
+#pragma mark Kernels selection
+
+AudioSampleConvertKernel AudioSampleSelectPlanarToFloat32Kernel(UInt32 srcChannels, UInt32 dstChannels, UInt32 options, const char **kernelName)
+{
+	if ((options & kAudioSampleConvertDuplicateMono) && (srcChannels == 1) && (dstChannels >= 2)) {
+#ifdef __SSE2__
+		if (dstChannels == 2) {
+			if (kernelName) *kernelName = "monoDuplicateToFloat32SSE2";
+			return monoDuplicateToFloat32SSE2;
+		}
+#endif
+		if (kernelName) *kernelName = "monoDuplicateToFloat32";
+		return monoDuplicateToFloat32;
+	}
+
+#ifdef __SSE2__
+	if ((srcChannels == 2) && (dstChannels == 2)) {
+		if (kernelName) *kernelName = "stereoToFloat32SSE2";
+		return stereoToFloat32SSE2;
+	}
+	if ((srcChannels == 1) && (dstChannels == 2)) {
+		if (kernelName) *kernelName = "monoToFloat32SSE2";
+		return monoToFloat32SSE2;
+	}
+#endif
+	if (kernelName) *kernelName = "planarToFloat32";
+	return planarToFloat32;
+}
+
+AudioSampleConvertKernel AudioSampleSelectPlanarToInt32Kernel(UInt32 srcChannels, UInt32 dstChannels, UInt32 options, const char **kernelName)
+{
+	if ((options & kAudioSampleConvertDuplicateMono) && (srcChannels == 1) && (dstChannels >= 2)) {
+#ifdef __SSE2__
+		if (dstChannels == 2) {
+			if (kernelName) *kernelName = "monoDuplicateToInt32SSE2";
+			return monoDuplicateToInt32SSE2;
+		}
+#endif
+		if (kernelName) *kernelName = "monoDuplicateToInt32";
+		return monoDuplicateToInt32;
+	}
+
+#ifdef __SSE2__
+	if ((srcChannels == 2) && (dstChannels == 2)) {
+		if (kernelName) *kernelName = "stereoToInt32SSE2";
+		return stereoToInt32SSE2;
+	}
+	if ((srcChannels == 1) && (dstChannels == 2)) {
+		if (kernelName) *kernelName = "monoToInt32SSE2";
+		return monoToInt32SSE2;
+	}
+#endif
+	if (kernelName) *kernelName = "planarToInt32";
+	return planarToInt32;
+}
+
+AudioSampleFloatConvertKernel AudioSampleSelectPlanarFloat32Kernel(UInt32 srcChannels, UInt32 dstChannels, UInt32 options, const char **kernelName)
+{
+	if ((options & kAudioSampleConvertDuplicateMono) && (srcChannels == 1) && (dstChannels >= 2)) {
+#ifdef __SSE2__
+		if (dstChannels == 2) {
+			if (kernelName) *kernelName = "monoDuplicateFloat32SSE2";
+			return monoDuplicateFloat32SSE2;
+		}
+#endif
+		if (kernelName) *kernelName = "monoDuplicateFloat32";
+		return monoDuplicateFloat32;
+	}
+
+#ifdef __SSE2__
+	if ((srcChannels == 2) && (dstChannels == 2)) {
+		if (kernelName) *kernelName = "stereoFloat32SSE2";
+		return stereoFloat32SSE2;
+	}
+	if ((srcChannels == 1) && (dstChannels == 2)) {
+		if (kernelName) *kernelName = "monoFloat32SSE2";
+		return monoFloat32SSE2;
+	}
+#endif
+	if (kernelName) *kernelName = "planarFloat32";
+	return planarFloat32;
+}
@@ -0,0 +1,99 @@
+/*
+ AudioSampleConvert.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#ifndef __AUDIOSAMPLECONVERT_H__
+#define __AUDIOSAMPLECONVERT_H__
+
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Kernels selection options */
+enum {
+	kAudioSampleConvertDuplicateMono = 1 //Mono sources copied to the first two destination channels, instead of the left one only
+};
+
+/*
+ AudioSampleConvertKernel
+ Converts planar decoder samples (FLAC library output: one signed 32bit integer array per channel, low aligned)
+ to interleaved frames of the buffers
+ @param dst the interleaved destination frames, dstChannels samples per frame
+ @param src the planar samples, one array per source channel
+ @param nbFrames number of frames to convert
+ @param srcChannels number of source channels, the destination channels beyond them being silent
+ @param dstChannels number of channels of the destination frames
+ @param bitsPerSample significant bits of the source samples
+ */
+typedef void (*AudioSampleConvertKernel)(void *dst, const SInt32 * const src[], UInt32 nbFrames,
+										 UInt32 srcChannels, UInt32 dstChannels, UInt32 bitsPerSample);
+
+/** AudioSampleSelectPlanarToFloat32Kernel
+ Selects the kernel converting to 32bit float samples in the [-1.0,1.0[ range, the full scale being the one
+ of the smallest whole number of bytes holding the source samples
+ @param srcChannels number of source channels
+ @param dstChannels number of channels of the destination frames
+ @param options kAudioSampleConvertXXX flags
+ @param kernelName (optional) returns the name of the selected kernel, for debug info
+ @return the conversion kernel, to be selected once per decoded stream
+ */
+AudioSampleConvertKernel AudioSampleSelectPlanarToFloat32Kernel(UInt32 srcChannels, UInt32 dstChannels, UInt32 options, const char **kernelName);
+
+/** AudioSampleSelectPlanarToInt32Kernel
+ Selects the kernel converting to 32bit signed integer samples aligned high (shifted to the MSB)
+ @param srcChannels number of source channels
+ @param dstChannels number of channels of the destination frames
+ @param options kAudioSampleConvertXXX flags
+ @param kernelName (optional) returns the name of the selected kernel, for debug info
+ @return the conversion kernel, to be selected once per decoded stream
+ */
+AudioSampleConvertKernel AudioSampleSelectPlanarToInt32Kernel(UInt32 srcChannels, UInt32 dstChannels, UInt32 options, const char **kernelName);
+
+/*
+ AudioSampleFloatConvertKernel
+ Interleaves planar 32bit float decoder samples (Vorbis library output) to the buffers frames
+ @param dst the interleaved destination frames, dstChannels samples per frame
+ @param src the planar samples, one array per source channel
+ @param nbFrames number of frames to convert
+ @param srcChannels number of source channels, the destination channels beyond them being silent
+ @param dstChannels number of channels of the destination frames
+ */
+typedef void (*AudioSampleFloatConvertKernel)(Float32 *dst, const Float32 * const src[], UInt32 nbFrames,
+											  UInt32 srcChannels, UInt32 dstChannels);
+
+/** AudioSampleSelectPlanarFloat32Kernel
+ Selects the kernel interleaving 32bit float samples
+ @param srcChannels number of source channels
+ @param dstChannels number of channels of the destination frames
+ @param options kAudioSampleConvertXXX flags
+ @param kernelName (optional) returns the name of the selected kernel, for debug info
+ @return the interleaving kernel, to be selected once per decoded stream
+ */
+AudioSampleFloatConvertKernel AudioSampleSelectPlanarFloat32Kernel(UInt32 srcChannels, UInt32 dstChannels, UInt32 options, const char **kernelName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
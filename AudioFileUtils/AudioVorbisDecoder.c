@@ -0,0 +1,85 @@
+/*
+ AudioVorbisDecoder.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+#include "AudioVorbisDecoder.h"
+
+/* Vorbis channels order to the WAV one (FLAC and CoreAudio order), for 1 to 8 channels */
+static const int vorbisChannelOrder[8][8] = {
+	{0},
+	{0,1},
+	{0,2,1},
+	{0,1,2,3},
+	{0,2,1,3,4},
+	{0,2,1,5,3,4},
+	{0,2,1,6,5,3,4},
+	{0,2,1,7,5,6,3,4}
+};
+
+int AudioVorbisDecoderInit(AudioVorbisDecoder *decoder, OggVorbis_File *vorbisFile, AudioVorbisReadFloatProc readFloat,
+						   AudioVorbisInfoProc info, UInt32 outputChannels, UInt32 options)
+{
+	vorbis_info *streamInfo = info(vorbisFile, -1);
+
+	if ((streamInfo == NULL) || (streamInfo->channels <= 0) || (streamInfo->channels > kAudioVorbisMaxChannels)
+		|| (outputChannels == 0))
+		return -1;
+
+	decoder->vorbisFile = vorbisFile;
+	decoder->readFloat = readFloat;
+	decoder->info = info;
+	decoder->channels = (UInt32)streamInfo->channels;
+	decoder->outputChannels = outputChannels;
+	decoder->channelOrder = (decoder->channels <= 8) ? vorbisChannelOrder[decoder->channels-1] : NULL;
+	decoder->convertKernel = AudioSampleSelectPlanarFloat32Kernel((decoder->channels < outputChannels) ? decoder->channels : outputChannels,
+																  outputChannels, options, NULL);
+	return 0;
+}
+
+long AudioVorbisDecoderRead(AudioVorbisDecoder *decoder, Float32 *outFrames, long maxFrames)
+{
+	const UInt32 convertedChannels = (decoder->channels < decoder->outputChannels) ? decoder->channels : decoder->outputChannels;
+	const Float32 *channelSamples[kAudioVorbisMaxChannels];
+	float **pcm;
+	long framesRead = 0, readStep;
+	UInt32 channel;
+	int section;
+
+	while (framesRead < maxFrames) {
+		readStep = decoder->readFloat(decoder->vorbisFile, &pcm, (int)(maxFrames - framesRead), &section);
+		if (readStep == OV_HOLE) continue; //Gap in the stream (e.g. a corrupted page): decoding resumes after it
+		if (readStep < 0) return (framesRead > 0) ? framesRead : -1;
+		if (readStep == 0) break;
+
+		//Chained streams changing the channels count are not supported: the track ends there
+		if ((UInt32)decoder->info(decoder->vorbisFile, section)->channels != decoder->channels) break;
+
+		for (channel=0;channel<convertedChannels;channel++)
+			channelSamples[channel] = pcm[decoder->channelOrder ? (UInt32)decoder->channelOrder[channel] : channel];
+
+		decoder->convertKernel(outFrames + framesRead*decoder->outputChannels, channelSamples, (UInt32)readStep,
+							   convertedChannels, decoder->outputChannels);
+		framesRead += readStep;
+	}
+	return framesRead;
+}
@@ -0,0 +1,96 @@
+/*
+ AudioVorbisDecoder.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+#ifndef __AUDIOVORBISDECODER_H__
+#define __AUDIOVORBISDECODER_H__
+
+#include <MacTypes.h>
+#ifndef OV_EXCLUDE_STATIC_CALLBACKS
+#define OV_EXCLUDE_STATIC_CALLBACKS //The files are read through the loaders own callbacks
+#endif
+#include <vorbis/vorbisfile.h>
+
+#include "AudioSampleConvert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioVorbisMaxChannels 255
+
+/*
+ AudioVorbisReadFloatProc
+ Decodes the next samples, same prototype as ov_read_float
+ @return the number of frames decoded, 0 at the end of the stream, OV_HOLE on a gap in the stream, < 0 on error
+ */
+typedef long (*AudioVorbisReadFloatProc)(OggVorbis_File *vorbisFile, float ***pcm, int samples, int *section);
+
+/*
+ AudioVorbisInfoProc
+ Returns the stream info of a chained stream section (-1 for the current one), same prototype as ov_info
+ */
+typedef vorbis_info* (*AudioVorbisInfoProc)(OggVorbis_File *vorbisFile, int section);
+
+/*
+ AudioVorbisDecoder
+ Decodes an opened Vorbis file to the interleaved Float32 frames of the buffers, in the WAV channels order.
+ The file decoding and stream info are read through the procs, ov_read_float and ov_info in the loaders
+ */
+typedef struct {
+	OggVorbis_File *vorbisFile;
+	AudioVorbisReadFloatProc readFloat;
+	AudioVorbisInfoProc info;
+	UInt32 channels; //Of the stream first section
+	UInt32 outputChannels;
+	const int *channelOrder; //Vorbis order index of each WAV order channel, NULL beyond 8 channels
+	AudioSampleFloatConvertKernel convertKernel; //Selected once per stream
+} AudioVorbisDecoder;
+
+/** AudioVorbisDecoderInit
+ @param vorbisFile the opened file
+ @param readFloat ov_read_float
+ @param info ov_info
+ @param outputChannels number of channels of the output frames, the stream channels beyond them being dropped
+ and the output channels beyond the stream ones being silent
+ @param options kAudioSampleConvertXXX flags
+ @return 0 if success, -1 if the stream channels count is not supported
+ */
+int AudioVorbisDecoderInit(AudioVorbisDecoder *decoder, OggVorbis_File *vorbisFile, AudioVorbisReadFloatProc readFloat,
+						   AudioVorbisInfoProc info, UInt32 outputChannels, UInt32 options);
+
+/** AudioVorbisDecoderRead
+ @param outFrames the interleaved output frames
+ @param maxFrames number of frames to decode
+ @return the number of frames decoded, less than maxFrames at the end of the stream, -1 on a decoding error
+ before any frame
+ @comment The gaps in the stream (e.g. a corrupted page) are skipped. A chained stream section changing the
+ channels count ends the stream, as it is not supported
+ */
+long AudioVorbisDecoderRead(AudioVorbisDecoder *decoder, Float32 *outFrames, long maxFrames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,6 +23,16 @@
 #include <CoreAudio/CoreAudio.h>
 #include <AudioToolbox/AudioToolbox.h>
 
+#import "AudioRingBuffer.h"
+#import "AudioOutputEventQueue.h"
+#import "AudioOutputIOStats.h"
+#import "AudioOutputSink.h"
+#import "AudioDither.h"
+#import "AudioOutputVerifier.h"
+#import "AudioBufferPool.h"
+#import "AudioSampleRatePolicy.h"
+#import "AudioOutputCopyKernels.h"
+
 @interface AudioStreamDescription : NSObject
 {
 	AudioStreamRangedDescription *mPhysicalFormats;
@@ -47,16 +57,6 @@
 @end
 
 
-/*Lookup structure for audio channel mapping
- taking into account the multiple streams devices
- e.g. multiple mono streams */
-typedef struct {
-	AudioStreamID streamID;
-	UInt32 stream;
-	UInt32 channel;
-} AudioChannelMapping;
-
-
 /* This object is not thread safe and should be accessed only from the main thread */
 @interface AudioDeviceDescription : NSObject
 {
@@ -69,6 +69,7 @@ typedef struct {
 	UInt32 mPreferredChannelStereo[2];
 	UInt32 mCountAvailableSampleRates;
 	UInt32 availableVolumeControls;
+	Float64 mSampleRateSwitchDuration; //Measured duration of the nominal sample rate switches, 0 until one is measured
 }
 @property AudioDeviceID audioDevID;
 @property (copy) NSString *name;
@@ -82,9 +83,14 @@ typedef struct {
 - (Float64)maxSampleRate;
 - (Float64)maxSampleRateNotLimited;
 - (BOOL)isSampleRateHandled:(Float64)splRate withLimit:(BOOL)isLimitEnforced;
+/** recordSampleRateSwitchDuration
+ @param duration the time (in s) from the nominal sample rate change request to the device notifying it is done
+ */
+- (void)recordSampleRateSwitchDuration:(Float64)duration;
+- (Float64)sampleRateSwitchDuration;
 - (void)setPreferredChannelsStereo:(UInt32)leftChannel right:(UInt32)rightChannel;
 - (UInt32)getPreferredChannel:(UInt32)channel;
-- (void)getChannelMapping:(AudioChannelMapping*)channelMapping forChannel:(UInt32)channel;
+- (BOOL)getChannelMapping:(AudioChannelMapping*)channelMapping forChannel:(UInt32)channel;
 @end
 
 @class AppController;
@@ -104,7 +110,9 @@ typedef struct {
 	AudioFileLoader *inputFileLoader;
 	UInt32 inputFileLoadStatus;
 	UInt32 bytesPerFrame;
+	UInt32 channels;
 	UInt32 currentPlayingTimeInSeconds;
+	SInt32 verifySerial; //Bit-perfect verification track serial, 0 if the track is not verified
 } AudioBufferItem;
 
 
@@ -120,13 +128,24 @@ struct _AudioOutputBufferData {
 	AudioBufferItem buffers[2];
 	AppController *appController;
 	AudioOutput	*audioOut;
-	AudioChannelMapping channelMap[2]; //stereo
+	AudioChannelMapping channelMap[kAudioOutputMaxChannels]; //stereo pair first, then the multichannel tracks additional channels
+	AudioOutputCopyKernel copyKernels[kAudioOutputMaxChannels+1]; //Indexed by the buffer channels count
+	const char *copyKernelNames[kAudioOutputMaxChannels+1];
 	AudioStreamBasicDescription integerModeStreamFormat;
 	AudioStreamBasicDescription integerModeStreamFormatToBe;
     AudioStreamBasicDescription buffersStreamFormat;
+	AudioRingBuffer ring; //Streaming engine: decoded frames of the playing and next tracks
+	AudioOutputEventQueue eventQueue; //Notifications from the IO proc and HAL listener to the main thread
+	CFRunLoopSourceRef eventsSource; //Signaled by the HAL listener for its events to be processed at once by the main thread
+	AudioOutputIOStats ioStats;
+	AudioOutputVerifier verifier; //Bit-perfect verification, allocated when enabled in the preferences
+	AudioDeviceIOProc renderProc; //Playback engine IO proc, called by the timing IO proc
+	AudioBufferList *sinkBufferList; //Output sink: device streams layout the IO proc writes to
 	SInt32 playingAudioBuffer;
 	SInt32 bufferIndexForNextChunkToLoad; //Split loading: next chunk load is enqueued, will be launch at end of current chunk load
-	UInt32 ditheringMode;
+	UInt32 ditheringMode; //kAudioDitheringXXX mode of the integer mode requantization, read from the preferences at each track load
+	UInt32 mappedChannels; //Number of valid channelMap entries, 2 for stereo only devices
+	UInt32 ringChannels; //Streaming engine: channels of the ring frames, tracks with less channels being padded with silence
 	AudioDeviceID selectedAudioDeviceID;
 
 	UInt32 isIOPaused;
@@ -136,6 +155,8 @@ struct _AudioOutputBufferData {
 	bool isHoggingDevice;
 	bool willChangePlayingBuffer;
 	bool isSimpleStereoDevice;
+	bool isStreamingEngineOn; //Buffers data is streamed through the ring, buffers only hold the tracks control info
+	bool isInUnderrun;
 };
 
 typedef struct _AudioOutputBufferData AudioOutputBufferData;
@@ -145,12 +166,22 @@ typedef struct _AudioOutputBufferData AudioOutputBufferData;
 	AudioOutputBufferData mBufferData;
 	AudioDeviceIOProcID audioOutIOProcID;
 	NSMutableArray *audioDevicesList;
+	NSTimer *mIOEventsTimer; //IO proc events processing, scheduled only while playing
+	AudioOutputSink *mOutputSink; //Headless output backend replacing the device IO proc, NULL when playing to the device
 
 	Float64 audioDeviceCurrentNominalSampleRate;
 	UInt32 audioDeviceCurrentPhysicalBitDepth;
 	UInt32 audioDeviceInitialIOBufferFrameSize;
 
 	SInt32 selectedAudioDeviceIndex;
+	UInt32 mUnderrunsCount;
+
+	UInt64 mSampleRateSwitchStartTime; //Host time of the device sample rate change request, 0 when no switch is measured
+	NSMutableDictionary *mNativeSampleRates; //Sample rate switch policy lookahead: native sample rates of the upcoming files, probed in the background
+	AudioBufferPool mBufferPool; //Recycled regions of the buffers the loaders decode to
+	dispatch_queue_t mBufferWiringQueue; //Wiring ahead of the play head, source hashing and buffers releases, off the main thread
+	volatile bool mIsBufferWiringPending; //Position ticks coalesced while a wiring is in progress
+	volatile bool mIsSourceHashingPending;
 
 	bool isPlaying;
 }
@@ -223,6 +254,11 @@ typedef struct _AudioOutputBufferData AudioOutputBufferData;
 
 - (UInt32)deviceInitializationStatus;
 
+/** ioStatistics
+ @return the IO proc counters and histograms of the current (or last) playback, as a property list dictionary
+ */
+- (NSDictionary*)ioStatistics;
+
 - (bool)pause:(bool)isPaused;
 - (bool)isPaused;
 
@@ -235,7 +271,8 @@ typedef struct _AudioOutputBufferData AudioOutputBufferData;
 enum {
 	kAudioIOProcPause = 1,
 	kAudioIOProcSampleRateChanging = 2,
-	kAudioIOProcAudioBufferSizeChanging = 4
+	kAudioIOProcAudioBufferSizeChanging = 4,
+	kAudioIOProcStreamingReset = 8
 };
 
 /*
@@ -257,17 +294,4 @@ enum
 {
 	kAudioVolumePhysicalControl = 1,
 	kAudioVolumeVirtualControl = 2
-};
-
-/*
- Dithering modes
- */
-enum
-{
-	kAudioNoDithering = 0,
-	kAudioDitheringLinear = 1,
-	kAudioDitheringTriangle = 2,
-	kAudioDitheringNoiseShaping = 3,
-
-	kAudioDither16bit = 0x100
 };
\ No newline at end of file
@@ -23,12 +23,34 @@
 #include <libkern/OSAtomic.h>
 #include <dispatch/dispatch.h>
 #include </usr/include/mach/vm_map.h>
+#include <mach/mach_time.h>
+#include <sys/resource.h>
 
 #import "AudioOutput.h"
+#import "AudioOutputCopyKernels.h"
 #import "AppController.h"
 #import "PreferenceController.h"
 #import "AudioFileLoader.h"
 
+#define kAudioOutputStreamingRingSeconds 4 //Streaming engine ring size, at the device max sample rate
+#define kAudioOutputStreamingRingMaxBytes (16*1024*1024) //Ring size limit, for multichannel rings at high sample rates
+#define kAudioOutputEventsPollInterval 0.02 //Period of the IO proc events processing in the main thread while playing, in seconds
+#define kAudioOutputWiredSecondsAhead 10 //Buffer pages kept wired ahead of the play head
+#define kAudioOutputSourceHashBytesPerPass (16*1024*1024) //Loaded frames hashed per position tick, for the bit-perfect verification
+
+/* Loaded frames of the two buffers to hash, captured on the main thread */
+typedef struct {
+	struct {
+		SInt32 serial;
+		const void *data;
+		SInt64 firstFrame;
+		SInt64 frames;
+		UInt32 bytesPerFrame;
+		bool isLoadComplete;
+		UInt32 md5Status;
+	} buffers[2];
+} AudioOutputSourceHashPass;
+
 
 #pragma mark Simple structures implementation
 
@@ -347,6 +369,7 @@
 	name = nil;
 	UID = nil;
 	streams = nil;
+	mSampleRateSwitchDuration = 0;
 	return [super init];
 }
 
@@ -441,6 +464,18 @@
 	return maxSampleRate;
 }
 
+- (void)recordSampleRateSwitchDuration:(Float64)duration
+{
+	//Smoothed over the switches, as some devices take longer to lock on some rates
+	if (mSampleRateSwitchDuration == 0) mSampleRateSwitchDuration = duration;
+	else mSampleRateSwitchDuration = 0.75*mSampleRateSwitchDuration + 0.25*duration;
+}
+
+- (Float64)sampleRateSwitchDuration
+{
+	return (mSampleRateSwitchDuration > 0) ? mSampleRateSwitchDuration : kAudioSampleRatePolicyDefaultSwitchDuration;
+}
+
 - (BOOL)isSampleRateHandled:(Float64)splRate withLimit:(BOOL)isLimitEnforced
 {
 	BOOL isHandled = FALSE;
@@ -500,7 +535,7 @@
 	}
 }
 
-- (void)getChannelMapping:(AudioChannelMapping*)channelMapping forChannel:(UInt32)channel
+- (BOOL)getChannelMapping:(AudioChannelMapping*)channelMapping forChannel:(UInt32)channel
 {
 	UInt32 i;
 	AudioStreamDescription *streamDesc;
@@ -512,9 +547,10 @@
 			channelMapping->stream = i;
 			channelMapping->channel = channel - [streamDesc startingChannel];
 			channelMapping->streamID = [streamDesc streamID];
-			break;
+			return YES;
 		}
 	}
+	return NO;
 }
 
 - (NSString*)description
@@ -563,12 +599,49 @@
 - (void)completeDeviceStop;
 - (void)samplerateSwitchIsComplete;
 - (void)samplerateSwitchUnPause;
+- (NSTimeInterval)samplerateSwitchSettlingDelay;
+- (Float64)nativeSampleRateOfFile:(NSURL*)fileURL;
+- (void)prefetchNativeSampleRates;
+- (void)applySampleRateSwitchPolicy:(int)bufferToFill;
+- (void)startStreamingBuffer:(int)bufferIndex at:(SInt64)startingPosition;
+- (void)processIOEvents:(NSTimer*)timer;
+- (void)wireFramesAheadOfPlayHead;
+- (void)releaseBufferData:(int)bufIdx;
+- (void)hashLoadedFrames;
+- (void)storeLoadedTracksInPCMCache;
+- (bool)createOutputSink:(int)sinkType;
+- (void)disposeOutputSink;
+- (OSStatus)setMappedStreamsPhysicalFormat:(AudioStreamBasicDescription*)streamFormat;
 @end
 
 
 
 #pragma mark Core Audio callback
 
+/* Bit-perfect verification: captures the samples a copy kernel just wrote to the device streams,
+ reading them back from the streams through the same channels mapping */
+static inline void captureRenderedFrames(AudioOutputBufferData *bufferData, AudioBufferList *outOutputData,
+										 SInt32 serial, SInt64 trackPosition, UInt32 dstFrameOffset, UInt32 frames,
+										 UInt32 channels, UInt32 bytesPerSample)
+{
+	const UInt8 *channelData[kAudioOutputMaxChannels];
+	UInt32 channelStrides[kAudioOutputMaxChannels];
+	UInt32 channel;
+
+	if (serial == 0) return;
+
+	for (channel=0;channel<channels;channel++) {
+		AudioBuffer *stream = &outOutputData->mBuffers[bufferData->channelMap[channel].stream];
+
+		channelStrides[channel] = stream->mNumberChannels*bytesPerSample;
+		channelData[channel] = (const UInt8*)stream->mData + dstFrameOffset*channelStrides[channel]
+			+ bufferData->channelMap[channel].channel*bytesPerSample;
+	}
+
+	AudioOutputVerifierCaptureRendered(&bufferData->verifier, serial, trackPosition, frames, channels, bytesPerSample,
+									   channelData, channelStrides);
+}
+
 /*CoreAudio HAL input callack */
 OSStatus coreAudioOutputIOProc(AudioDeviceID  inDevice,
                   const AudioTimeStamp*   inNow,
@@ -584,17 +657,22 @@ OSStatus coreAudioOutputIOProc(AudioDeviceID  inDevice,
 
 	AudioOutputBufferData *bufferData = (AudioOutputBufferData *)inClientData;
 
-	if (bufferData->isIOPaused) return kAudioHardwareNoError;
+	if (bufferData->isIOPaused) {
+		AudioOutputIOStatsRecordPause(&bufferData->ioStats, bufferData->isIOPaused);
+		return kAudioHardwareNoError;
+	}
 
 	playingBuffer = bufferData->playingAudioBuffer; //For thread safety, make a local copy in this thread
 
 	if ((playingBuffer > 1)
-		|| (bufferData->buffers[playingBuffer].loadedFrames <= 0)) //Pause (no Sound) if no buffer ready
+		|| (bufferData->buffers[playingBuffer].loadedFrames <= 0)) { //Pause (no Sound) if no buffer ready
+		bufferData->ioStats.starvedNoData++;
 		return kAudioHardwareNoError;
+	}
 
 	//check end of buffer
-	framesToCopy = outOutputData->mBuffers[bufferData->channelMap[0].stream].mDataByteSize*2/outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels
-		/bufferData->buffers[playingBuffer].bytesPerFrame;
+	framesToCopy = outOutputData->mBuffers[bufferData->channelMap[0].stream].mDataByteSize*bufferData->buffers[playingBuffer].channels
+		/outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels/bufferData->buffers[playingBuffer].bytesPerFrame;
 
 	if ((SInt64)(bufferData->buffers[playingBuffer].currentPlayingFrame + framesToCopy) > bufferData->buffers[playingBuffer].loadedFrames) {
 		framesToCopy = (UInt32)(bufferData->buffers[playingBuffer].loadedFrames - bufferData->buffers[playingBuffer].currentPlayingFrame);
@@ -604,93 +682,25 @@ OSStatus coreAudioOutputIOProc(AudioDeviceID  inDevice,
 			bufferSwap = YES;
 			framesCopied = framesToCopy;
 		}
-	}
-
-	if (!bufferData->isSimpleStereoDevice)
-	{	 //change if more than stereo supported
-
-		if (bufferData->isIntegerModeOn && bufferData->integerModeStreamFormat.mChannelsPerFrame == 1 && bufferData->integerModeStreamFormat.mBytesPerFrame == 4) {
-			// handle mono output stream, integer mode case
-			SInt32	dstOffset	  = bufferData->channelMap[0].channel;
-			SInt32* dstBufferBase = (SInt32*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData + dstOffset;
-			SInt32  dstStride	  = outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels;
-
-			SInt32	dstOffset1	  = bufferData->channelMap[1].channel;
-			SInt32* dstBufferBase1 = (SInt32*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData + dstOffset1;
-			SInt32  dstStride1	  = outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels;
-
-			SInt64	srcOffset	  = bufferData->buffers[playingBuffer].currentPlayingFrame * bufferData->buffers[playingBuffer].bytesPerFrame/4;
-			SInt32* srcBufferBase = (SInt32*)bufferData->buffers[playingBuffer].data + srcOffset;
-			SInt32* srcBufferBase1 = (SInt32*)bufferData->buffers[playingBuffer].data + srcOffset + 1;
-			const SInt32  srcStride	  = 2;
-
-			for (unsigned int i=0;i<framesToCopy;i++){
-				*(dstBufferBase + dstStride*i) = *(srcBufferBase+srcStride*i);
-				*(dstBufferBase1 + dstStride1*i) = *(srcBufferBase1+srcStride*i);
-			}
-		} else if (!bufferData->isIntegerModeOn || (bufferData->integerModeStreamFormat.mBytesPerFrame == 8)) {
-			for (unsigned int i=0;i<framesToCopy;i++){
-				*((SInt32*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-				  +outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*i+bufferData->channelMap[0].channel)
-				=*((SInt32*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-															*bufferData->buffers[playingBuffer].bytesPerFrame/4
-															+2*i+0));
-				*((SInt32*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-				  +outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*i+bufferData->channelMap[1].channel)
-				=*((SInt32*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-															*bufferData->buffers[playingBuffer].bytesPerFrame/4
-															+2*i+1));
-			}
-		}
-		else if (bufferData->integerModeStreamFormat.mBytesPerFrame == 6) {
-			//Copy 24bit data as 16bit + 8 bit
-			for (UInt32 i=0;i<framesToCopy;i++){
-				*(UInt16*)((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-						   +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*i
-							 +bufferData->channelMap[0].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2)
-				=*(UInt16*)((UInt8*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																			 +i)*bufferData->buffers[playingBuffer].bytesPerFrame);
-				*((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-				  +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*i
-					+bufferData->channelMap[0].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2 +2)
-				=*((UInt8*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																	+i)*bufferData->buffers[playingBuffer].bytesPerFrame +2);
-
-				*(UInt16*)((UInt8*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-						   +(outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*i
-							 +bufferData->channelMap[1].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2)
-				=*(UInt16*)((UInt8*)bufferData->buffers[playingBuffer].data+(2*bufferData->buffers[playingBuffer].currentPlayingFrame
-																			 +2*i+1)*bufferData->buffers[playingBuffer].bytesPerFrame/2);
-				*((UInt8*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-				  +(outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*i
-					+bufferData->channelMap[1].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2 +2)
-				=*((UInt8*)bufferData->buffers[playingBuffer].data+(2*bufferData->buffers[playingBuffer].currentPlayingFrame
-																	+2*i+1)*bufferData->buffers[playingBuffer].bytesPerFrame/2 +2);
-			}
-		}
 		else {
-			for (UInt32 i=0;i<framesToCopy;i++){
-				bcopy(((UInt8*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																		+i)*bufferData->buffers[playingBuffer].bytesPerFrame),
-					  ((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-					   +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*i
-						 +bufferData->channelMap[0].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2),
-					  bufferData->integerModeStreamFormat.mBitsPerChannel/8);
-
-				bcopy(((UInt8*)bufferData->buffers[playingBuffer].data+(2*bufferData->buffers[playingBuffer].currentPlayingFrame
-																		+2*i+1)*bufferData->buffers[playingBuffer].bytesPerFrame/2),
-					  ((UInt8*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-					   +(outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*i
-						 +bufferData->channelMap[1].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2),
-					  bufferData->integerModeStreamFormat.mBitsPerChannel/8);
+			bufferData->ioStats.starvedLoading++;
+			if (!bufferData->isInUnderrun) {
+				bufferData->isInUnderrun = YES;
+				AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventUnderrun, playingBuffer);
 			}
 		}
-
 	}
-		// Simple stereo device
-	else bcopy((char*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-															   *bufferData->buffers[playingBuffer].bytesPerFrame),
-		  outOutputData->mBuffers[0].mData,framesToCopy * bufferData->buffers[playingBuffer].bytesPerFrame);
+	else bufferData->isInUnderrun = NO;
+
+	//Copy to the device stream(s) using the copy kernel selected for the current streams layout and track channels
+	bufferData->copyKernels[bufferData->buffers[playingBuffer].channels]((UInt8*)bufferData->buffers[playingBuffer].data
+						   +bufferData->buffers[playingBuffer].currentPlayingFrame*bufferData->buffers[playingBuffer].bytesPerFrame,
+						   outOutputData, bufferData->channelMap, 0, framesToCopy,
+						   bufferData->buffers[playingBuffer].bytesPerFrame/bufferData->buffers[playingBuffer].channels);
+	captureRenderedFrames(bufferData, outOutputData, bufferData->buffers[playingBuffer].verifySerial,
+						  bufferData->buffers[playingBuffer].firstFrameOffset + bufferData->buffers[playingBuffer].currentPlayingFrame,
+						  0, framesToCopy, bufferData->buffers[playingBuffer].channels,
+						  bufferData->buffers[playingBuffer].bytesPerFrame/bufferData->buffers[playingBuffer].channels);
 
 	/* Update displayed current time */
 #ifndef __ppc__
@@ -702,11 +712,9 @@ OSStatus coreAudioOutputIOProc(AudioDeviceID  inDevice,
 	newCurrentSeconds = (UInt32)(bufferData->buffers[playingBuffer].currentPlayingFrame / bufferData->buffers[playingBuffer].sampleRate);
 	if (newCurrentSeconds != bufferData->buffers[playingBuffer].currentPlayingTimeInSeconds) {
 		bufferData->buffers[playingBuffer].currentPlayingTimeInSeconds = newCurrentSeconds;
-		//Only send a call with no argument, as the arguments when calling performSelectorOnMainThread
-		//Must be passed in an object, and this means creating a new NSNumber object each time here
-		//Thus making a malloc that could potentially take too much time (e.g. OS performing page swap at this time)
-		[bufferData->appController performSelectorOnMainThread:@selector(updateCurrentPlayingTime)
-														  withObject:nil waitUntilDone:FALSE];
+		//Posted in the preallocated events queue: no malloc nor lock in this real-time thread
+		//that could potentially take too much time (e.g. OS performing page swap at this time)
+		AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventPositionTick, playingBuffer);
 	}
 
 	//Gapless playback : changing buffer
@@ -718,90 +726,19 @@ OSStatus coreAudioOutputIOProc(AudioDeviceID  inDevice,
 
 		//Continue to fill buffer if no need to change sampling rate
 		if (bufferData->buffers[0].sampleRate == bufferData->buffers[1].sampleRate) {
-			framesToCopy = (UInt32)(outOutputData->mBuffers[bufferData->channelMap[0].stream].mDataByteSize*2
+			framesToCopy = (UInt32)(outOutputData->mBuffers[bufferData->channelMap[0].stream].mDataByteSize*bufferData->buffers[playingBuffer].channels
 									/outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels/bufferData->buffers[playingBuffer].bytesPerFrame
 									- framesCopied);
 			if (framesToCopy > bufferData->buffers[playingBuffer].loadedFrames)
 				framesToCopy = (UInt32)bufferData->buffers[playingBuffer].loadedFrames;
 
-			if (bufferData->isIntegerModeOn && bufferData->integerModeStreamFormat.mChannelsPerFrame == 1 && bufferData->integerModeStreamFormat.mBytesPerFrame == 4) {
-				// handle mono output stream, integer mode case
-				SInt32	dstOffset	  = bufferData->channelMap[0].channel;
-				SInt32* dstBufferBase = (SInt32*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData + dstOffset;
-				SInt32  dstStride	  = outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels;
-
-				SInt32	dstOffset1	  = bufferData->channelMap[1].channel;
-				SInt32* dstBufferBase1 = (SInt32*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData + dstOffset1;
-				SInt32  dstStride1	  = outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels;
-
-				SInt64	srcOffset	  = bufferData->buffers[playingBuffer].currentPlayingFrame * bufferData->buffers[playingBuffer].bytesPerFrame/4;
-				SInt32* srcBufferBase = (SInt32*)bufferData->buffers[playingBuffer].data + srcOffset;
-				SInt32* srcBufferBase1 = (SInt32*)bufferData->buffers[playingBuffer].data + srcOffset + 1;
-				const SInt32  srcStride	  = 2;
-
-				for (unsigned int i=0;i<framesToCopy;i++){
-					*(dstBufferBase + dstStride*(i+framesCopied)) = *(srcBufferBase+srcStride*i);
-					*(dstBufferBase1 + dstStride1*(i+framesCopied)) = *(srcBufferBase1+srcStride*i);
-				}
-
-			} else if (!bufferData->isIntegerModeOn || (bufferData->integerModeStreamFormat.mBytesPerFrame == 8)) {
-				for (UInt32 i=0;i<framesToCopy;i++){
-					*((SInt32*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-					  +outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*(i+framesCopied)+bufferData->channelMap[0].channel)
-					=*((SInt32*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																*bufferData->buffers[playingBuffer].bytesPerFrame/4
-																+2*i+0));
-					*((SInt32*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-					  +outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*(i+framesCopied)+bufferData->channelMap[1].channel)
-					=*((SInt32*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																*bufferData->buffers[playingBuffer].bytesPerFrame/4
-																+2*i+1));
-				}
-			}
-			else if (bufferData->integerModeStreamFormat.mBytesPerFrame == 6) {
-				//Copy 24bit data as 16bit + 8 bit
-				for (UInt32 i=0;i<framesToCopy;i++){
-					*(UInt16*)((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-							  +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*(i+framesCopied)
-								+bufferData->channelMap[0].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2)
-					=*(UInt16*)((UInt8*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																+i)*bufferData->buffers[playingBuffer].bytesPerFrame);
-					*((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-							   +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*(i+framesCopied)
-								 +bufferData->channelMap[0].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2 +2)
-					=*((UInt8*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																				 +i)*bufferData->buffers[playingBuffer].bytesPerFrame +2);
-
-
-					*(UInt16*)((UInt8*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-					  +(outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*(i+framesCopied)
-						+bufferData->channelMap[1].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2)
-					=*(UInt16*)((UInt8*)bufferData->buffers[playingBuffer].data+(2*bufferData->buffers[playingBuffer].currentPlayingFrame
-																+2*i+1)*bufferData->buffers[playingBuffer].bytesPerFrame/2);
-					*((UInt8*)outOutputData->mBuffers[bufferData->channelMap[1].stream].mData
-					  +(outOutputData->mBuffers[bufferData->channelMap[1].stream].mNumberChannels*(i+framesCopied)
-						+bufferData->channelMap[1].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2 +2)
-					=*((UInt8*)bufferData->buffers[playingBuffer].data+(2*bufferData->buffers[playingBuffer].currentPlayingFrame
-																				 +2*i+1)*bufferData->buffers[playingBuffer].bytesPerFrame/2 +2);
-				}
-			}
-			else {
-				for (UInt32 i=0;i<framesToCopy;i++){
-					bcopy(((UInt8*)bufferData->buffers[playingBuffer].data+(bufferData->buffers[playingBuffer].currentPlayingFrame
-																			+i)*bufferData->buffers[playingBuffer].bytesPerFrame),
-						  ((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-						   +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*(i+framesCopied)
-							 +bufferData->channelMap[0].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2),
-						  bufferData->integerModeStreamFormat.mBitsPerChannel/8);
-
-					bcopy(((UInt8*)bufferData->buffers[playingBuffer].data+(2*bufferData->buffers[playingBuffer].currentPlayingFrame
-																			+2*i+1)*bufferData->buffers[playingBuffer].bytesPerFrame/2),
-						  ((UInt8*)outOutputData->mBuffers[bufferData->channelMap[0].stream].mData
-						   +(outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels*(i+framesCopied)
-							 +bufferData->channelMap[1].channel)*bufferData->buffers[playingBuffer].bytesPerFrame/2),
-						  bufferData->integerModeStreamFormat.mBitsPerChannel/8);
-				}
-			}
+			bufferData->copyKernels[bufferData->buffers[playingBuffer].channels](bufferData->buffers[playingBuffer].data,
+								   outOutputData, bufferData->channelMap, framesCopied, framesToCopy,
+								   bufferData->buffers[playingBuffer].bytesPerFrame/bufferData->buffers[playingBuffer].channels);
+			captureRenderedFrames(bufferData, outOutputData, bufferData->buffers[playingBuffer].verifySerial,
+								  bufferData->buffers[playingBuffer].firstFrameOffset, framesCopied, framesToCopy,
+								  bufferData->buffers[playingBuffer].channels,
+								  bufferData->buffers[playingBuffer].bytesPerFrame/bufferData->buffers[playingBuffer].channels);
 
 			OSAtomicAdd64(framesToCopy, &bufferData->buffers[playingBuffer].currentPlayingFrame);
 
@@ -817,13 +754,163 @@ OSStatus coreAudioOutputIOProc(AudioDeviceID  inDevice,
 			bufferData->willChangePlayingBuffer = YES;
 			bufferData->playingAudioBuffer = playingBuffer;
 			//Notify buffer swapped
-			dispatch_async(dispatch_get_main_queue(), ^{[bufferData->appController notifyBufferPlayed:bufferPlayed];});
+			AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventBufferPlayed, bufferPlayed);
 		}
 	}
 
 	return kAudioHardwareNoError;
 }
 
+/*CoreAudio HAL output callback for the streaming engine
+ Frames are read from the ring, track changes being signaled by the markers written in-band by the decoders */
+OSStatus coreAudioStreamingOutputIOProc(AudioDeviceID  inDevice,
+										const AudioTimeStamp*   inNow,
+										const AudioBufferList*  inInputData,
+										const AudioTimeStamp*   inInputTime,
+										AudioBufferList*        outOutputData,
+										const AudioTimeStamp*   inOutputTime,
+										void*                   inClientData)
+{
+	UInt32 newCurrentSeconds,playingBuffer;
+	UInt32 framesToCopy,framesCopied,framesAvailable;
+	AudioRingBufferMarker marker;
+	void *ringRegion;
+
+	AudioOutputBufferData *bufferData = (AudioOutputBufferData *)inClientData;
+
+	if (bufferData->isIOPaused) {
+		AudioOutputIOStatsRecordPause(&bufferData->ioStats, bufferData->isIOPaused);
+		return kAudioHardwareNoError;
+	}
+
+	playingBuffer = bufferData->playingAudioBuffer; //For thread safety, make a local copy in this thread
+
+	if (playingBuffer > 1) {
+		bufferData->ioStats.starvedNoData++;
+		return kAudioHardwareNoError;
+	}
+
+	framesToCopy = outOutputData->mBuffers[bufferData->channelMap[0].stream].mDataByteSize*bufferData->ringChannels
+		/outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels/bufferData->ring.bytesPerFrame;
+	framesCopied = 0;
+
+	while ((framesCopied < framesToCopy) && !bufferData->isIOPaused) {
+		framesAvailable = AudioRingBufferGetReadRegion(&bufferData->ring, &ringRegion);
+
+		if (framesAvailable == 0) {
+			UInt32 bufferPlayed = playingBuffer;
+
+			if (AudioRingBufferGetNextMarker(&bufferData->ring, &marker)
+				&& (marker.framePosition == bufferData->ring.readPosition)) {
+				AudioRingBufferPopMarker(&bufferData->ring);
+				//Start of the playing track (playback start or seek)
+				if (marker.bufferIndex == (SInt32)playingBuffer) continue;
+			}
+			else if ((bufferData->buffers[playingBuffer].lengthFrames == 0)
+					 || (bufferData->buffers[playingBuffer].currentPlayingFrame < bufferData->buffers[playingBuffer].lengthFrames)) {
+				//Decoder late: pause (no sound) until more frames are available
+				bufferData->ioStats.starvedLoading++;
+				if (!bufferData->isInUnderrun) {
+					bufferData->isInUnderrun = YES;
+					AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventUnderrun, playingBuffer);
+				}
+				break;
+			}
+
+			//Gapless playback : changing buffer, either at the next track marker
+			//or at the end of the playing track when the next one is not yet decoded
+			playingBuffer ^= 0x1;
+
+			//Request to change sampling rate if needed
+			if (bufferData->buffers[0].sampleRate != bufferData->buffers[1].sampleRate)
+				bufferData->isIOPaused |= kAudioIOProcSampleRateChanging;
+
+			if ((bufferData->isIOPaused & kAudioIOProcPause) == 0) {
+				//Same race condition prevention as for the buffers based playback
+				bufferData->willChangePlayingBuffer = YES;
+				bufferData->playingAudioBuffer = playingBuffer;
+				//Notify buffer swapped
+				AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventBufferPlayed, bufferPlayed);
+			}
+			continue;
+		}
+
+		if (framesAvailable > (framesToCopy - framesCopied))
+			framesAvailable = framesToCopy - framesCopied;
+
+		//All the ring frames have the same channels count, whatever the track
+		bufferData->copyKernels[bufferData->ringChannels](ringRegion, outOutputData, bufferData->channelMap, framesCopied, framesAvailable,
+														  bufferData->ring.bytesPerFrame/bufferData->ringChannels);
+		captureRenderedFrames(bufferData, outOutputData, bufferData->buffers[playingBuffer].verifySerial,
+							  bufferData->buffers[playingBuffer].currentPlayingFrame, framesCopied, framesAvailable,
+							  bufferData->ringChannels, bufferData->ring.bytesPerFrame/bufferData->ringChannels);
+
+		AudioRingBufferCommitRead(&bufferData->ring, framesAvailable);
+		OSAtomicAdd64(framesAvailable, &bufferData->buffers[playingBuffer].currentPlayingFrame);
+		framesCopied += framesAvailable;
+		bufferData->isInUnderrun = NO;
+	}
+
+	/* Update displayed current time */
+	newCurrentSeconds = (UInt32)(bufferData->buffers[playingBuffer].currentPlayingFrame / bufferData->buffers[playingBuffer].sampleRate);
+	if (newCurrentSeconds != bufferData->buffers[playingBuffer].currentPlayingTimeInSeconds) {
+		bufferData->buffers[playingBuffer].currentPlayingTimeInSeconds = newCurrentSeconds;
+		AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventPositionTick, playingBuffer);
+	}
+
+	return kAudioHardwareNoError;
+}
+
+/*CoreAudio HAL output callback actually registered: times the playback engine IO proc */
+OSStatus coreAudioTimedOutputIOProc(AudioDeviceID  inDevice,
+									const AudioTimeStamp*   inNow,
+									const AudioBufferList*  inInputData,
+									const AudioTimeStamp*   inInputTime,
+									AudioBufferList*        outOutputData,
+									const AudioTimeStamp*   inOutputTime,
+									void*                   inClientData)
+{
+	AudioOutputBufferData *bufferData = (AudioOutputBufferData *)inClientData;
+	UInt64 startHostTime = mach_absolute_time();
+	OSStatus err;
+
+	err = bufferData->renderProc(inDevice, inNow, inInputData, inInputTime, outOutputData, inOutputTime, inClientData);
+
+	AudioOutputIOStatsRecordCallback(&bufferData->ioStats, startHostTime, mach_absolute_time(),
+									 outOutputData->mBuffers[bufferData->channelMap[0].stream].mDataByteSize*2
+									 /outOutputData->mBuffers[bufferData->channelMap[0].stream].mNumberChannels
+									 /bufferData->buffersStreamFormat.mBytesPerFrame);
+	return err;
+}
+
+/*Output sink render callback: runs the IO proc on buffers having the device streams layout,
+ then packs the mapped channels, stereo pair first, as the sink frames */
+static void outputSinkRenderProc(void *renderContext, void *frames, uint32_t framesCount)
+{
+	AudioOutputBufferData *bufferData = (AudioOutputBufferData *)renderContext;
+	AudioBufferList *outputData = bufferData->sinkBufferList;
+	UInt32 bytesPerSample = bufferData->buffersStreamFormat.mBytesPerFrame/2;
+	UInt32 sinkChannels = bufferData->mappedChannels;
+	UInt32 i,channel;
+
+	//The HAL provides zeroed buffers
+	for (i=0;i<outputData->mNumberBuffers;i++) {
+		outputData->mBuffers[i].mDataByteSize = framesCount*outputData->mBuffers[i].mNumberChannels*bytesPerSample;
+		memset(outputData->mBuffers[i].mData, 0, outputData->mBuffers[i].mDataByteSize);
+	}
+
+	coreAudioTimedOutputIOProc(bufferData->selectedAudioDeviceID, NULL, NULL, NULL, outputData, NULL, bufferData);
+
+	for (i=0;i<framesCount;i++) {
+		for (channel=0;channel<sinkChannels;channel++) {
+			AudioBuffer *stream = &outputData->mBuffers[bufferData->channelMap[channel].stream];
+			memcpy((UInt8*)frames + (sinkChannels*i+channel)*bytesPerSample,
+				   (UInt8*)stream->mData + (i*stream->mNumberChannels + bufferData->channelMap[channel].channel)*bytesPerSample,
+				   bytesPerSample);
+		}
+	}
+}
+
 #pragma mark Audio HAL listener functions
 
 OSStatus HALlistenerProc(AudioObjectID inObjectID,
@@ -843,12 +930,12 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 			switch (inAddresses[addressIndex].mSelector) {
 				case kAudioDevicePropertyNominalSampleRate: {
 						//Tell the I/O proc the sampling rate change is completed and playback can be resumed
-                    [bufferData->audioOut performSelectorOnMainThread:@selector(samplerateSwitchIsComplete) withObject:nil waitUntilDone:NO];
+                    AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventSampleRateSwitchComplete, 0);
                 }
 					break;
 				case kAudioDeviceProcessorOverload:
 					//Notify user of this CPU load issue
-					[bufferData->appController performSelectorOnMainThread:@selector(notifyProcessorOverload) withObject:nil waitUntilDone:NO];
+					AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventProcessorOverload, 0);
 					break;
 				case kAudioDevicePropertyDeviceIsAlive:
 					//Check if device is still alive, if not, then stop playback
@@ -859,15 +946,15 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 					err = AudioObjectGetPropertyData(inObjectID, &propertyAddress, 0, NULL, &propSize, &tmpInt);
 
 					if ((err == kAudioHardwareNoError) && (tmpInt == NO))
-						[bufferData->appController performSelectorOnMainThread:@selector(notifyDeviceRemoved) withObject:nil waitUntilDone:NO];
+						AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventDeviceRemoved, 0);
 					break;
                 case kAudioDevicePropertyMute:
 				case kAudioDevicePropertyVolumeScalar:
 				case kAudioHardwareServiceDeviceProperty_VirtualMasterVolume:
-					[bufferData->appController performSelectorOnMainThread:@selector(notifyDeviceVolumeChanged) withObject:nil waitUntilDone:NO];
+					AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventDeviceVolumeChanged, 0);
 					break;
                 case kAudioDevicePropertyDataSource: //Build-in output volume selections are different for datasources (e.g. speakers, headphones)
-					[bufferData->appController performSelectorOnMainThread:@selector(notifyDeviceDataSourceChanged) withObject:nil waitUntilDone:NO];
+					AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventDeviceDataSourceChanged, 0);
        			break;
 				case kAudioDevicePropertyBufferFrameSize:
 					//Tell the I/O proc the buffer size change is completed and playback can be resumed
@@ -886,7 +973,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 						&& ((pid_t)tmpInt == getpid())) {
 						bufferData->playbackStartPhase = kAudioPlaybackStartDeviceHogged;
 						bufferData->isHoggingDevice = YES;
-						[bufferData->audioOut performSelectorOnMainThread:@selector(initiatePlaybackAfterHoggingDevice) withObject:nil waitUntilDone:NO];
+						AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventDeviceHogged, 0);
 					}
 					break;
 
@@ -899,7 +986,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 			switch (inAddresses[addressIndex].mSelector) {
 				case kAudioHardwarePropertyDevices:
 					//Notify audio devices list has changed
-					[bufferData->appController performSelectorOnMainThread:@selector(notifyDevicesListUpdated) withObject:nil waitUntilDone:NO];
+					AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventDevicesListUpdated, 0);
 					break;
 				default:
 					break;
@@ -925,11 +1012,11 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
                         && (bufferData->integerModeStreamFormat.mBitsPerChannel == bufferData->integerModeStreamFormatToBe.mBitsPerChannel)
                         && (bufferData->integerModeStreamFormat.mBytesPerFrame == bufferData->integerModeStreamFormatToBe.mBytesPerFrame)) {
 							bufferData->playbackStartPhase = kAudioPlaybackStartFinishingDeviceInitialization;
-							[bufferData->audioOut performSelectorOnMainThread:@selector(initiatePlaybackCompletingInit) withObject:nil waitUntilDone:NO];
+							AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventIntegerModeFormatSet, 0);
 					}
 					else if (bufferData->playbackStartPhase == kAudioPlaybackSwitchingBackToFloatMode) {
 						bufferData->playbackStartPhase = kAudioPlaybackNotInStartingPhase;
-						[bufferData->audioOut performSelectorOnMainThread:@selector(completeDeviceStop) withObject:nil waitUntilDone:NO];
+						AudioOutputEventQueuePush(&bufferData->eventQueue, kAudioOutputEventFloatModeFormatRestored, 0);
 					}
 				}
 					break;
@@ -938,9 +1025,19 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 			}
 		}
 	}
+
+	//The HAL events are rare, and not sent from the IO thread: wake up the main thread at once
+	CFRunLoopSourceSignal(bufferData->eventsSource);
+	CFRunLoopWakeUp(CFRunLoopGetMain());
 	return err;
 }
 
+/* Run loop source callback, info is the AudioOutput, not retained by the source */
+static void processEventsSourcePerform(void *info)
+{
+	[(AudioOutput*)info processIOEvents:nil];
+}
+
 
 
 #pragma mark -
@@ -962,8 +1059,38 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	mBufferData.selectedAudioDeviceID = 0;
 	mBufferData.isSimpleStereoDevice = NO;
 	mBufferData.isHoggingDevice = NO;
+	memset(mBufferData.copyKernels, 0, sizeof(mBufferData.copyKernels));
+	memset(mBufferData.copyKernelNames, 0, sizeof(mBufferData.copyKernelNames));
+	mBufferData.mappedChannels = 2;
+	mBufferData.isStreamingEngineOn = NO;
+	mBufferData.ringChannels = 2;
+	mBufferData.ring.data = NULL;
+	mBufferData.ring.dataSizeInBytes = 0;
+	mBufferData.ring.capacityFrames = 0;
 	mBufferData.playbackStartPhase = kAudioPlaybackNotInStartingPhase;
+	mBufferData.isInUnderrun = NO;
+	mBufferData.renderProc = coreAudioOutputIOProc;
+	mBufferData.sinkBufferList = NULL;
+	mOutputSink = NULL;
+	AudioOutputIOStatsReset(&mBufferData.ioStats, 0);
+	memset(&mBufferData.verifier, 0, sizeof(AudioOutputVerifier));
 	selectedAudioDeviceIndex = -1;
+	mUnderrunsCount = 0;
+	mSampleRateSwitchStartTime = 0;
+	mNativeSampleRates = [[NSMutableDictionary alloc] init];
+	AudioBufferPoolInit(&mBufferPool, 0, 0);
+	mBufferWiringQueue = dispatch_queue_create("fr.dplisson.audirvana.bufferwiring", NULL);
+	mIsBufferWiringPending = false;
+	mIsSourceHashingPending = false;
+
+	//IO proc and HAL listener events are processed in the main thread, also during modal loops and menu tracking
+	//HAL listener events signal a run loop source, IO proc ones are polled by a timer only while playing,
+	//the IO proc not being allowed to call the run loop functions
+	AudioOutputEventQueueInit(&mBufferData.eventQueue);
+	CFRunLoopSourceContext eventsSourceContext = {0, self, NULL, NULL, NULL, NULL, NULL, NULL, NULL, processEventsSourcePerform};
+	mBufferData.eventsSource = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &eventsSourceContext);
+	CFRunLoopAddSource(CFRunLoopGetMain(), mBufferData.eventsSource, kCFRunLoopCommonModes);
+	mIOEventsTimer = nil;
 
 	audioDevicesList = [[NSMutableArray alloc] init];
 	[self rebuildDevicesList];
@@ -998,6 +1125,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 		mBufferData.buffers[i].lengthFrames = 0;
 		mBufferData.buffers[i].loadedFrames = 0;
 		mBufferData.buffers[i].data = NULL;
+		mBufferData.buffers[i].verifySerial = 0;
 	}
 
 	return [super init];
@@ -1009,6 +1137,21 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 
 	if (isPlaying) [self stop];
 	[self closeBuffers];
+	dispatch_sync(mBufferWiringQueue, ^{}); //Wiring in progress and buffers releases completed
+	dispatch_release(mBufferWiringQueue);
+	AudioBufferPoolDispose(&mBufferPool);
+	AudioOutputVerifierDeallocate(&mBufferData.verifier);
+
+	[mIOEventsTimer invalidate];
+	mIOEventsTimer = nil;
+
+	//Now that the timer does not retain self any more, dealloc is actually called: the listeners must not outlive it
+	propertyAddress.mSelector = kAudioHardwarePropertyDevices;
+	propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
+	propertyAddress.mElement = kAudioObjectPropertyElementMaster;
+	AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &propertyAddress, &HALlistenerProc, &mBufferData);
+	CFRunLoopSourceInvalidate(mBufferData.eventsSource);
+	CFRelease(mBufferData.eventsSource);
 
 	if (mBufferData.selectedAudioDeviceID) {
 		//Remove previous listeners
@@ -1067,6 +1210,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 
 	if (audioDevicesList) [audioDevicesList release];
+	[mNativeSampleRates release];
 
 	[super dealloc];
 }
@@ -1416,6 +1560,22 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] getChannelMapping:&mBufferData.channelMap[1]
 																	  forChannel:[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] getPreferredChannel:1]];
 
+	//Multichannel tracks: the additional channels follow the stereo pair on the next device channels,
+	//as long as they are on streams having the same layout, so that the same stream format applies to all of them
+	mBufferData.mappedChannels = 2;
+	if ([[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] getPreferredChannel:1]
+		== ([[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] getPreferredChannel:0] + 1)) {
+		NSArray *streams = [[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams];
+		UInt32 streamChannels = [[streams objectAtIndex:mBufferData.channelMap[0].stream] numChannels];
+
+		while ((mBufferData.mappedChannels < kAudioOutputMaxChannels)
+			   && [[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] getChannelMapping:&mBufferData.channelMap[mBufferData.mappedChannels]
+																				   forChannel:[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] getPreferredChannel:0]
+																							  + mBufferData.mappedChannels]
+			   && ([[streams objectAtIndex:mBufferData.channelMap[mBufferData.mappedChannels].stream] numChannels] == streamChannels))
+			mBufferData.mappedChannels++;
+	}
+
 	//Check in memcopy optimization is possible for simple stereo interleaved devices
 	if ((mBufferData.channelMap[0].stream == 0) && (mBufferData.channelMap[1].stream == 0)
 		&& ([[[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams] objectAtIndex:mBufferData.channelMap[0].stream] numChannels] == 2)
@@ -1545,6 +1705,25 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	if (mBufferData.isIntegerModeOn)
 		[mBufferData.buffers[bufferToFill].inputFileLoader setIntegerMode:YES
 															 streamFormat:&mBufferData.buffersStreamFormat];
+
+	//Buffers recycled across tracks and seeks, keeping up to a maximum size buffer of free regions
+	AudioBufferPoolSetOptions(&mBufferPool,
+							  [[NSUserDefaults standardUserDefaults] boolForKey:AUDBufferPoolHugePages] ? kAudioBufferPoolHugePages : 0,
+							  [[NSUserDefaults standardUserDefaults] integerForKey:AUDMaxAudioBufferSize]*1024*1024);
+	[mBufferData.buffers[bufferToFill].inputFileLoader setBufferPool:&mBufferPool];
+
+	//Dithering of the float samples requantized to the integer mode format
+	mBufferData.ditheringMode = (UInt32)[[NSUserDefaults standardUserDefaults] integerForKey:AUDDitheringMode];
+	[mBufferData.buffers[bufferToFill].inputFileLoader setDitheringMode:mBufferData.ditheringMode];
+
+	//Multichannel tracks, up to the channels mapped on the device
+	//Streaming engine: up to the ring frames channels, set at playback init whatever the preference is now
+	if (mBufferData.isStreamingEngineOn)
+		[mBufferData.buffers[bufferToFill].inputFileLoader setOutputChannels:mBufferData.ringChannels];
+	else if ([[NSUserDefaults standardUserDefaults] boolForKey:AUDMultichannelPlayback])
+		[mBufferData.buffers[bufferToFill].inputFileLoader setOutputChannels:mBufferData.mappedChannels];
+	mBufferData.buffers[bufferToFill].channels = [mBufferData.buffers[bufferToFill].inputFileLoader outputChannels];
+	mBufferData.buffers[bufferToFill].bytesPerFrame = (mBufferData.buffersStreamFormat.mBytesPerFrame/2) * mBufferData.buffers[bufferToFill].channels;
 	//Sample rate handling
 	mBufferData.buffers[bufferToFill].sampleRate = [mBufferData.buffers[bufferToFill].inputFileLoader nativeSampleRate];
 
@@ -1584,26 +1763,63 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 		[mBufferData.buffers[bufferToFill].inputFileLoader setSampleRateConversion:mBufferData.buffers[bufferToFill].sampleRate];
 	}
 
+	//Gapless transition to another sample rate: switch the device, or convert the track to the playing rate
+	//Not done with forced upsampling, as the rates of the upcoming tracks are then not the native ones
+	if ((mBufferData.playingAudioBuffer == (bufferToFill==0?1:0))
+		&& (mBufferData.buffers[mBufferData.playingAudioBuffer].inputFileLoader != nil)
+		&& (mBufferData.buffers[bufferToFill].sampleRate != mBufferData.buffers[mBufferData.playingAudioBuffer].sampleRate)
+		&& ([[NSUserDefaults standardUserDefaults] integerForKey:AUDForceUpsamlingType] == kAUDSRCNoForcedUpsampling))
+		[self applySampleRateSwitchPolicy:bufferToFill];
+	[self prefetchNativeSampleRates];
+
 	mBufferData.buffers[bufferToFill].firstFrameOffset = 0;
 
+	//Bit-perfect verification: the decoded frames are hashed as they are loaded, the rendered ones by the IO proc
+	mBufferData.buffers[bufferToFill].verifySerial = 0;
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:AUDBitPerfectVerification]
+		&& (AudioOutputVerifierIsAllocated(&mBufferData.verifier)
+			|| (AudioOutputVerifierAllocate(&mBufferData.verifier) == 0)))
+		mBufferData.buffers[bufferToFill].verifySerial = AudioOutputVerifierStartTrack(&mBufferData.verifier,
+																					   [[fileURL lastPathComponent] UTF8String]);
+	[mBufferData.buffers[bufferToFill].inputFileLoader setVerifier:&mBufferData.verifier
+															 serial:mBufferData.buffers[bufferToFill].verifySerial];
+
+	//Decoded PCM cache, keyed by the loader settings done above
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:AUDPCMCacheEnabled])
+		[mBufferData.buffers[bufferToFill].inputFileLoader setPCMCache:[AudioFilePCMCache sharedCache]];
+
 	mBufferData.bufferIndexForNextChunkToLoad = -1;
 	[mBufferData.appController resetLoadStatus:NO];
 
-	if ([mBufferData.buffers[bufferToFill].inputFileLoader loadInitialBuffer:&mBufferData.buffers[bufferToFill].data
+	if (mBufferData.isStreamingEngineOn) {
+		[mBufferData.buffers[bufferToFill].inputFileLoader setStreamingRing:&mBufferData.ring];
+		//No previous track to wait for if the other buffer is empty
+		if (mBufferData.buffers[bufferToFill==0?1:0].inputFileLoader == nil)
+			AudioRingBufferSetNextProducer(&mBufferData.ring, bufferToFill);
+	}
+
+	//Track already decoded: its cache entry is mapped as the buffer
+	if (([mBufferData.buffers[bufferToFill].inputFileLoader loadCachedBuffer:&mBufferData.buffers[bufferToFill].data
+															AllocatedBufSize:&mBufferData.buffers[bufferToFill].dataSizeInBytes
+															   MaxBufferSize:[[NSUserDefaults standardUserDefaults] integerForKey:AUDMaxAudioBufferSize]*1024*1024
+															  NumTotalFrames:&mBufferData.buffers[bufferToFill].lengthFrames
+															 NumLoadedFrames:&mBufferData.buffers[bufferToFill].loadedFrames
+																	  Status:&mBufferData.buffers[bufferToFill].inputFileLoadStatus
+														   NextInputPosition:&mBufferData.buffers[bufferToFill].inputFileNextPosition
+																   ForBuffer:bufferToFill] != 0)
+		&& ([mBufferData.buffers[bufferToFill].inputFileLoader loadInitialBuffer:&mBufferData.buffers[bufferToFill].data
 															AllocatedBufSize:&mBufferData.buffers[bufferToFill].dataSizeInBytes
 															MaxBufferSize:[[NSUserDefaults standardUserDefaults] integerForKey:AUDMaxAudioBufferSize]*1024*1024
 															  NumTotalFrames:&mBufferData.buffers[bufferToFill].lengthFrames
 															NumLoadedFrames:&mBufferData.buffers[bufferToFill].loadedFrames
 																   Status:&mBufferData.buffers[bufferToFill].inputFileLoadStatus
 														NextInputPosition:&mBufferData.buffers[bufferToFill].inputFileNextPosition
-																   ForBuffer:bufferToFill] != 0) {
+																   ForBuffer:bufferToFill] != 0)) {
 		[mBufferData.buffers[bufferToFill].inputFileLoader release];
 		mBufferData.buffers[bufferToFill].inputFileLoader = nil;
 		return FALSE;
 	}
 
-    mBufferData.buffers[bufferToFill].bytesPerFrame = mBufferData.buffersStreamFormat.mBytesPerFrame;
-
 	mBufferData.buffers[bufferToFill].currentPlayingFrame = 0;
 
 	return TRUE;
@@ -1632,6 +1848,8 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 
 	mBufferData.buffers[bufferToFill].sampleRate = mBufferData.buffers[previousBuffer].sampleRate;
 	mBufferData.buffers[bufferToFill].bytesPerFrame = mBufferData.buffers[previousBuffer].bytesPerFrame;
+	mBufferData.buffers[bufferToFill].channels = mBufferData.buffers[previousBuffer].channels;
+	mBufferData.buffers[bufferToFill].verifySerial = mBufferData.buffers[previousBuffer].verifySerial;
 	mBufferData.buffers[bufferToFill].loadedFrames = 0;
 	mBufferData.buffers[bufferToFill].lengthFrames = 0;
 
@@ -1669,10 +1887,11 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	//Ensure both buffers are cleared
 	bool result = [self closeBuffer:0];
 
-	if ([self closeBuffer:1])
-		return result;
-	else
-		return false;
+	if (![self closeBuffer:1]) result = false;
+
+	//Not playing anymore: the recycled regions are returned to the system
+	AudioBufferPoolTrim(&mBufferPool);
+	return result;
 }
 
 - (bool)closeBuffer:(int)bufferToClose
@@ -1684,18 +1903,25 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 
     if (mBufferData.buffers[bufferToClose].inputFileLoader) {
 		[mBufferData.buffers[bufferToClose].inputFileLoader abortLoading];
+
+		//Streaming engine: remove the not yet played track from the ring, and let the next one take its place
+		if (mBufferData.isStreamingEngineOn
+			&& AudioRingBufferIsTrackPending(&mBufferData.ring, bufferToClose)) {
+			mBufferData.isIOPaused |= kAudioIOProcStreamingReset;
+			usleep(50000); //Wait to be sure the I/O proc is not reading the ring
+			AudioRingBufferDiscardTrack(&mBufferData.ring, bufferToClose);
+			AudioRingBufferSetNextProducer(&mBufferData.ring, bufferToClose);
+			mBufferData.isIOPaused &= ~kAudioIOProcStreamingReset;
+		}
+
 		[mBufferData.buffers[bufferToClose].inputFileLoader release];
 		mBufferData.buffers[bufferToClose].inputFileLoader = nil;
+		mBufferData.buffers[bufferToClose].verifySerial = 0;
 		result = true;
 	}
 
-	if (mBufferData.buffers[bufferToClose].data) {
-		vm_deallocate(mach_task_self(),
-					  (vm_address_t)mBufferData.buffers[bufferToClose].data,
-					  (vm_size_t)mBufferData.buffers[bufferToClose].dataSizeInBytes);
-		mBufferData.buffers[bufferToClose].dataSizeInBytes = 0;
-		mBufferData.buffers[bufferToClose].data = NULL;
-	}
+	//Also unmaps the buffers mapped from the decoded PCM cache or from native format files
+	[self releaseBufferData:bufferToClose];
 	return result;
 }
 
@@ -1757,6 +1983,9 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 
 - (void)unswapPlayingBuffer
 {
+	//Nothing to unswap when streaming: the frames are in the ring
+	if (mBufferData.buffers[mBufferData.playingAudioBuffer].data == NULL) return;
+
 	[mBufferData.buffers[mBufferData.playingAudioBuffer].inputFileLoader unswapBuffer:mBufferData.buffers[mBufferData.playingAudioBuffer].data
 														  bufferSize:mBufferData.buffers[mBufferData.playingAudioBuffer].lengthFrames
 																from:mBufferData.buffers[mBufferData.playingAudioBuffer].currentPlayingFrame];
@@ -1781,7 +2010,12 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 
 			err = AudioObjectSetPropertyData(mBufferData.selectedAudioDeviceID, &propertyAddress, 0, NULL, sizeof(Float64), &newSamplingRate);
 
-			if (err == kAudioHardwareNoError) audioDeviceCurrentNominalSampleRate = newSamplingRate;
+			if (err == kAudioHardwareNoError) {
+				mSampleRateSwitchStartTime = mach_absolute_time();
+				audioDeviceCurrentNominalSampleRate = newSamplingRate;
+				AudioOutputIOStatsSetSampleRate(&mBufferData.ioStats, newSamplingRate);
+				if (mOutputSink) AudioOutputSinkSetSampleRate(mOutputSink, newSamplingRate);
+			}
 			else mBufferData.isIOPaused &= ~kAudioIOProcSampleRateChanging;
 		}
 	}
@@ -1795,6 +2029,21 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 }
 
 - (void)samplerateSwitchIsComplete
+{
+	//Measure the device switch duration, for the sample rate switch policy
+	if ((mSampleRateSwitchStartTime != 0) && (selectedAudioDeviceIndex >= 0)) {
+		mach_timebase_info_data_t timebase;
+
+		mach_timebase_info(&timebase);
+		[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex]
+		 recordSampleRateSwitchDuration:(mach_absolute_time() - mSampleRateSwitchStartTime) * (Float64)timebase.numer / timebase.denom / 1.0e9];
+	}
+	mSampleRateSwitchStartTime = 0;
+
+    [self performSelector:@selector(samplerateSwitchUnPause) withObject:nil afterDelay:[self samplerateSwitchSettlingDelay]];
+}
+
+- (NSTimeInterval)samplerateSwitchSettlingDelay
 {
     NSTimeInterval notificationLatency = 0.0;
 
@@ -1827,7 +2076,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
             break;
     }
 
-    [self performSelector:@selector(samplerateSwitchUnPause) withObject:nil afterDelay:notificationLatency];
+    return notificationLatency;
 }
 
 - (void)samplerateSwitchUnPause
@@ -1835,6 +2084,94 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
     mBufferData.isIOPaused &= ~kAudioIOProcSampleRateChanging;
 }
 
+- (Float64)nativeSampleRateOfFile:(NSURL*)fileURL
+{
+	//0 if not yet probed, -1 while probed: the track is then left out of the lookahead
+	return [[mNativeSampleRates objectForKey:fileURL] doubleValue];
+}
+
+- (void)prefetchNativeSampleRates
+{
+	NSUInteger lookahead = [[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateSwitchLookahead];
+	NSMutableArray *filesToProbe;
+
+	if (([[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateSwitchPolicy] != kAudioSampleRatePolicyAdaptive)
+		|| ([[NSUserDefaults standardUserDefaults] integerForKey:AUDForceUpsamlingType] != kAUDSRCNoForcedUpsampling))
+		return;
+
+	//The next track and its own lookahead, for the next transition
+	if (lookahead > kAudioSampleRatePolicyMaxLookahead) lookahead = kAudioSampleRatePolicyMaxLookahead;
+	filesToProbe = [NSMutableArray arrayWithCapacity:lookahead+1];
+	for (NSURL *upcomingFile in [mBufferData.appController upcomingFiles:lookahead+1]) {
+		if ([mNativeSampleRates objectForKey:upcomingFile]) continue;
+		if ([mNativeSampleRates count] >= 1024) [mNativeSampleRates removeAllObjects];
+		[mNativeSampleRates setObject:[NSNumber numberWithDouble:-1.0] forKey:upcomingFile];
+		[filesToProbe addObject:upcomingFile];
+	}
+	if ([filesToProbe count] == 0) return;
+
+	//Only the file headers are read, off the main thread: the lookahead windows of the successive transitions overlap
+	[filesToProbe retain];
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSMutableArray *sampleRates = [[NSMutableArray alloc] initWithCapacity:[filesToProbe count]];
+
+		for (NSURL *fileURL in filesToProbe) {
+			NSNumber *sampleRate = [[AudioFileLoader probeMetadata:fileURL]
+									objectForKey:[NSString stringWithUTF8String: kAudioFileLoaderInfo_NativeSampleRate]];
+			//Unreadable files are skipped by the player
+			[sampleRates addObject:sampleRate ? sampleRate : [NSNumber numberWithDouble:0.0]];
+		}
+		[pool drain];
+
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[mNativeSampleRates addEntriesFromDictionary:[NSDictionary dictionaryWithObjects:sampleRates forKeys:filesToProbe]];
+			[sampleRates release];
+			[filesToProbe release];
+		});
+	});
+}
+
+- (void)applySampleRateSwitchPolicy:(int)bufferToFill
+{
+	AudioSampleRatePolicyTransition transition;
+	AudioSampleRatePolicyDecision decision;
+	AudioFileLoader *fileLoader = mBufferData.buffers[bufferToFill].inputFileLoader;
+	NSUInteger lookahead = [[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateSwitchLookahead];
+
+	transition.mode = (UInt32)[[NSUserDefaults standardUserDefaults] integerForKey:AUDSampleRateSwitchPolicy];
+	transition.playingRate = mBufferData.buffers[mBufferData.playingAudioBuffer].sampleRate;
+	transition.playingNativeRate = [mBufferData.buffers[mBufferData.playingAudioBuffer].inputFileLoader nativeSampleRate];
+	transition.nextRate = mBufferData.buffers[bufferToFill].sampleRate;
+	transition.nextNativeRate = [fileLoader nativeSampleRate];
+	transition.switchDuration = [[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] sampleRateSwitchDuration]
+		+ [self samplerateSwitchSettlingDelay];
+	transition.upcomingCount = 0;
+
+	//Rates of the tracks after this one, only weighted by the adaptive policy
+	if (transition.mode == kAudioSampleRatePolicyAdaptive) {
+		if (lookahead > kAudioSampleRatePolicyMaxLookahead) lookahead = kAudioSampleRatePolicyMaxLookahead;
+		for (NSURL *upcomingFile in [mBufferData.appController upcomingFiles:lookahead]) {
+			transition.upcomingNativeRates[transition.upcomingCount] = [self nativeSampleRateOfFile:upcomingFile];
+			//Unreadable files are skipped by the player, the ones not yet probed are left out
+			if (transition.upcomingNativeRates[transition.upcomingCount] > 0) transition.upcomingCount++;
+		}
+	}
+
+	AudioSampleRatePolicyDecide(&transition, &decision);
+
+	NSLog(@"Sample rate switch %@: %.0fHz -> %.0fHz, %@ (%u track(s) at this rate, switch gap %.2fs x%u, conversion cost %.2fs: %s)",
+		  [[fileLoader inputFileURL] lastPathComponent], transition.playingRate, transition.nextRate,
+		  (decision.action == kAudioSampleRatePolicyResample) ? @"track converted" : @"device re-clocked",
+		  decision.runLength, transition.switchDuration, decision.switchesAvoided, decision.conversionCost, decision.reason);
+
+	//Converted in the background by the loader, played without pausing the IO proc
+	if (decision.action == kAudioSampleRatePolicyResample) {
+		mBufferData.buffers[bufferToFill].sampleRate = transition.playingRate;
+		[fileLoader setSampleRateConversion:transition.playingRate];
+	}
+}
+
 - (bool)isIntegerModeOn
 {
 	return mBufferData.isIntegerModeOn;
@@ -2091,15 +2428,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 			return true;
 		}
 		else {
-			propertyAddress.mSelector = kAudioStreamPropertyPhysicalFormat;
-			propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
-			propertyAddress.mElement = kAudioObjectPropertyElementMaster;
-			propertySize = sizeof(AudioStreamBasicDescription);
-			err = AudioObjectSetPropertyData([[[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams] objectAtIndex:mBufferData.channelMap[0].stream] streamID],
-											 &propertyAddress, 0, NULL, propertySize, &mBufferData.integerModeStreamFormatToBe);
-			if ((err == kAudioHardwareNoError) && (mBufferData.channelMap[0].stream != mBufferData.channelMap[1].stream))
-				err = AudioObjectSetPropertyData([[[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams] objectAtIndex:mBufferData.channelMap[1].stream] streamID],
-												 &propertyAddress, 0, NULL, propertySize, &mBufferData.integerModeStreamFormatToBe);
+			err = [self setMappedStreamsPhysicalFormat:&mBufferData.integerModeStreamFormatToBe];
 
 			mBufferData.isIntegerModeOn = TRUE;
 			audioDeviceCurrentPhysicalBitDepth = mBufferData.integerModeStreamFormatToBe.mBitsPerChannel;
@@ -2160,13 +2489,31 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	[[self class] cancelPreviousPerformRequestsWithTarget:self
 												 selector:@selector(initiatePlaybackTimedOut) object:nil];
 
-	//Force the decoded audio stream to be stereo (can be set to more for multichannel devices)
+	//Reference stereo format of the decoded audio stream, multichannel tracks buffers having the same sample format
     memcpy(&mBufferData.buffersStreamFormat, &mBufferData.integerModeStreamFormat, sizeof(AudioStreamBasicDescription));
 	mBufferData.buffersStreamFormat.mBytesPerFrame = (mBufferData.buffersStreamFormat.mBytesPerFrame * 2) / mBufferData.buffersStreamFormat.mChannelsPerFrame;
 	mBufferData.buffersStreamFormat.mBytesPerPacket = mBufferData.buffersStreamFormat.mBytesPerFrame;
    	mBufferData.buffersStreamFormat.mChannelsPerFrame = 2;
 	mBufferData.buffersStreamFormat.mFramesPerPacket = 1;
 
+	//Select the IO proc copy kernels for this sample size and streams layout, one per track channels count
+	{
+		UInt32 dstChannels[kAudioOutputMaxChannels];
+		NSArray *streams = [[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams];
+
+		for (tmpInt=0;tmpInt<mBufferData.mappedChannels;tmpInt++)
+			dstChannels[tmpInt] = [[streams objectAtIndex:mBufferData.channelMap[tmpInt].stream] numChannels];
+
+		memset(mBufferData.copyKernels, 0, sizeof(mBufferData.copyKernels));
+		memset(mBufferData.copyKernelNames, 0, sizeof(mBufferData.copyKernelNames));
+		mBufferData.copyKernels[2] = AudioOutputSelectCopyKernel(mBufferData.buffersStreamFormat.mBytesPerFrame/2, dstChannels,
+																 mBufferData.channelMap, &mBufferData.copyKernelNames[2]);
+		for (tmpInt=3;tmpInt<=mBufferData.mappedChannels;tmpInt++)
+			mBufferData.copyKernels[tmpInt] = AudioOutputSelectMultichannelCopyKernel(mBufferData.buffersStreamFormat.mBytesPerFrame/2, tmpInt,
+																					  dstChannels, mBufferData.channelMap,
+																					  &mBufferData.copyKernelNames[tmpInt]);
+	}
+
 	//Enable only the used output streams, optimization needed only on multi-channel devices
 	tmpInt = (UInt32)[[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams] count];
     if (tmpInt > 2) {
@@ -2177,8 +2524,8 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
         for (tmpInt=0;tmpInt<streamsUsage->mNumberStreams;tmpInt++)
             streamsUsage->mStreamIsOn[tmpInt] = false;
 
-        streamsUsage->mStreamIsOn[mBufferData.channelMap[0].stream] = true;
-        streamsUsage->mStreamIsOn[mBufferData.channelMap[1].stream] = true;
+        for (tmpInt=0;tmpInt<mBufferData.mappedChannels;tmpInt++)
+            streamsUsage->mStreamIsOn[mBufferData.channelMap[tmpInt].stream] = true;
 
         propertyAddress.mSelector = kAudioDevicePropertyIOProcStreamUsage;
         propertyAddress.mScope = kAudioDevicePropertyScopeOutput;
@@ -2229,8 +2576,33 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	propertyAddress.mElement=kAudioObjectPropertyElementMaster;
 	AudioObjectGetPropertyData(mBufferData.selectedAudioDeviceID, &propertyAddress, 0, NULL, &propertySize, &audioDeviceCurrentNominalSampleRate);
 
+	//Streaming engine: decoded frames go through a ring of a few seconds instead of whole track buffers
+	//The ring frames have all the mapped channels for multichannel playback, stereo tracks being padded with silence
+	mBufferData.isStreamingEngineOn = NO;
+	AudioRingBufferDeallocate(&mBufferData.ring);
+	mBufferData.ringChannels = [[NSUserDefaults standardUserDefaults] boolForKey:AUDMultichannelPlayback]?mBufferData.mappedChannels:2;
+	if (mBufferData.copyKernels[mBufferData.ringChannels] == NULL)
+		mBufferData.ringChannels = 2;
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:AUDStreamingEngine]) {
+		UInt32 ringBytesPerFrame = (mBufferData.buffersStreamFormat.mBytesPerFrame/2) * mBufferData.ringChannels;
+		UInt32 ringFrames = (UInt32)(kAudioOutputStreamingRingSeconds*[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] maxSampleRateNotLimited]);
+
+		if (ringFrames > (kAudioOutputStreamingRingMaxBytes / ringBytesPerFrame))
+			ringFrames = kAudioOutputStreamingRingMaxBytes / ringBytesPerFrame;
+		if (AudioRingBufferAllocate(&mBufferData.ring, ringFrames, ringBytesPerFrame) == 0)
+			mBufferData.isStreamingEngineOn = YES;
+	}
+
 	//Set up callback connection
-	err = AudioDeviceCreateIOProcID(mBufferData.selectedAudioDeviceID, coreAudioOutputIOProc, &mBufferData, &audioOutIOProcID);
+	AudioOutputIOStatsReset(&mBufferData.ioStats, audioDeviceCurrentNominalSampleRate);
+	AudioOutputVerifierReset(&mBufferData.verifier);
+	mBufferData.renderProc = mBufferData.isStreamingEngineOn?coreAudioStreamingOutputIOProc:coreAudioOutputIOProc;
+	if ([[NSUserDefaults standardUserDefaults] integerForKey:AUDOutputSinkType] != kAudioOutputSinkDevice) {
+		//Headless output: the IO proc is called by the sink thread instead of the HAL
+		audioOutIOProcID = 0;
+		err = [self createOutputSink:(int)[[NSUserDefaults standardUserDefaults] integerForKey:AUDOutputSinkType]]?kAudioHardwareNoError:kAudioHardwareUnspecifiedError;
+	}
+	else err = AudioDeviceCreateIOProcID(mBufferData.selectedAudioDeviceID, coreAudioTimedOutputIOProc, &mBufferData, &audioOutIOProcID);
 
 	if (err == kAudioHardwareNoError) {
 		[mBufferData.appController startPlayingPhase2];
@@ -2269,6 +2641,90 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	}
 }
 
+- (bool)createOutputSink:(int)sinkType
+{
+	AudioObjectPropertyAddress propertyAddress;
+	NSArray *streams = [[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams];
+	UInt32 framesPerBuffer = 512;
+	UInt32 propertySize = sizeof(UInt32);
+	UInt32 bytesPerSample = mBufferData.buffersStreamFormat.mBytesPerFrame/2;
+	AudioOutputSinkFormat sinkFormat;
+	UInt32 i;
+
+	//Render the same buffer size as the device
+	propertyAddress.mSelector = kAudioDevicePropertyBufferFrameSize;
+	propertyAddress.mScope = kAudioDevicePropertyScopeOutput;
+	propertyAddress.mElement = kAudioObjectPropertyElementMaster;
+	AudioObjectGetPropertyData(mBufferData.selectedAudioDeviceID, &propertyAddress, 0, NULL, &propertySize, &framesPerBuffer);
+
+	//Buffers with the device streams layout, for the channel mapping and copy kernel to be the ones used with the device
+	mBufferData.sinkBufferList = (AudioBufferList*)malloc(offsetof(AudioBufferList, mBuffers) + [streams count]*sizeof(AudioBuffer));
+	if (!mBufferData.sinkBufferList) return false;
+	mBufferData.sinkBufferList->mNumberBuffers = (UInt32)[streams count];
+	for (i=0;i<[streams count];i++) {
+		mBufferData.sinkBufferList->mBuffers[i].mNumberChannels = [[streams objectAtIndex:i] numChannels];
+		mBufferData.sinkBufferList->mBuffers[i].mDataByteSize = framesPerBuffer*mBufferData.sinkBufferList->mBuffers[i].mNumberChannels*bytesPerSample;
+		mBufferData.sinkBufferList->mBuffers[i].mData = malloc(mBufferData.sinkBufferList->mBuffers[i].mDataByteSize);
+	}
+
+	//The sink frames have the device stream samples format and the mapped channels, the WAV file being labeled from them
+	sinkFormat.channels = mBufferData.mappedChannels;
+	sinkFormat.bytesPerSample = bytesPerSample;
+	sinkFormat.validBitsPerSample = mBufferData.buffersStreamFormat.mBitsPerChannel;
+	sinkFormat.isFloat = (mBufferData.buffersStreamFormat.mFormatFlags & kAudioFormatFlagIsFloat) != 0;
+	sinkFormat.isBigEndian = (mBufferData.buffersStreamFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) != 0;
+	sinkFormat.isAlignedHigh = (mBufferData.buffersStreamFormat.mFormatFlags & kAudioFormatFlagIsAlignedHigh) != 0;
+
+	mOutputSink = AudioOutputSinkCreate(sinkType,
+										[[[[NSUserDefaults standardUserDefaults] stringForKey:AUDOutputSinkFilePath] stringByExpandingTildeInPath] fileSystemRepresentation],
+										&sinkFormat, framesPerBuffer, [[NSUserDefaults standardUserDefaults] doubleForKey:AUDOutputSinkSpeedFactor],
+										outputSinkRenderProc, &mBufferData);
+	if (!mOutputSink) {
+		[self disposeOutputSink];
+		return false;
+	}
+	return true;
+}
+
+- (void)disposeOutputSink
+{
+	UInt32 i;
+
+	//Stops the sink thread before freeing its buffers
+	AudioOutputSinkDispose(mOutputSink);
+	mOutputSink = NULL;
+
+	if (mBufferData.sinkBufferList) {
+		for (i=0;i<mBufferData.sinkBufferList->mNumberBuffers;i++)
+			free(mBufferData.sinkBufferList->mBuffers[i].mData);
+		free(mBufferData.sinkBufferList);
+		mBufferData.sinkBufferList = NULL;
+	}
+}
+
+/*Sets the physical format of all the streams the channels are mapped to
+ Each stream is set once, even when several channels are mapped to it */
+- (OSStatus)setMappedStreamsPhysicalFormat:(AudioStreamBasicDescription*)streamFormat
+{
+	AudioObjectPropertyAddress propertyAddress;
+	OSStatus err = kAudioHardwareNoError;
+	UInt32 i,j;
+
+	propertyAddress.mSelector = kAudioStreamPropertyPhysicalFormat;
+	propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
+	propertyAddress.mElement = kAudioObjectPropertyElementMaster;
+
+	for (i=0;(i<mBufferData.mappedChannels) && (err == kAudioHardwareNoError);i++) {
+		for (j=0;j<i;j++)
+			if (mBufferData.channelMap[j].stream == mBufferData.channelMap[i].stream) break;
+		if (j<i) continue; //Stream already set
+
+		err = AudioObjectSetPropertyData([[[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams] objectAtIndex:mBufferData.channelMap[i].stream] streamID],
+										 &propertyAddress, 0, NULL, sizeof(AudioStreamBasicDescription), streamFormat);
+	}
+	return err;
+}
+
 - (UInt32)deviceInitializationStatus
 {
 	return mBufferData.playbackStartPhase;
@@ -2285,9 +2741,20 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
     mBufferData.isIOPaused |= kAudioIOProcPause;
 
 	//Start device I/O
-	err = AudioDeviceStart(mBufferData.selectedAudioDeviceID, audioOutIOProcID);
-
-	if (err == noErr) isPlaying = true;
+	if (mOutputSink)
+		err = (AudioOutputSinkStart(mOutputSink, audioDeviceCurrentNominalSampleRate) == 0)?noErr:kAudioHardwareUnspecifiedError;
+	else
+		err = AudioDeviceStart(mBufferData.selectedAudioDeviceID, audioOutIOProcID);
+
+	if (err == noErr) {
+		isPlaying = true;
+		//The timer retains self only until the playback stop
+		if (mIOEventsTimer == nil) {
+			mIOEventsTimer = [NSTimer timerWithTimeInterval:kAudioOutputEventsPollInterval target:self
+												   selector:@selector(processIOEvents:) userInfo:nil repeats:YES];
+			[[NSRunLoop mainRunLoop] addTimer:mIOEventsTimer forMode:NSRunLoopCommonModes];
+		}
+	}
 	else
 		if (outError) {
 			NSDictionary *errDict=[NSDictionary dictionaryWithObject:NSLocalizedString(@"Error starting device playback",@"Generic error message for device start")
@@ -2323,7 +2790,13 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	if (!isPlaying) return false;
 
 	//Stop device I/O
-	err = AudioDeviceStop(mBufferData.selectedAudioDeviceID, audioOutIOProcID);
+	if (mOutputSink) [self disposeOutputSink];
+	else err = AudioDeviceStop(mBufferData.selectedAudioDeviceID, audioOutIOProcID);
+
+	//No more IO proc events: the last ones are processed by the next run loop pass
+	[mIOEventsTimer invalidate];
+	mIOEventsTimer = nil;
+	CFRunLoopSourceSignal(mBufferData.eventsSource);
 
 	//Tell the user audio device is stopping
 	deviceMaxSplRate = [[audioDevicesList objectAtIndex:selectedAudioDeviceIndex]	maxSampleRate];
@@ -2335,8 +2808,18 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 								   playingSampleRate:deviceMaxSplRate];
 
 	//Disconnect I/O callback
-	err = AudioDeviceDestroyIOProcID(mBufferData.selectedAudioDeviceID, audioOutIOProcID);
-	audioOutIOProcID = 0;
+	if (audioOutIOProcID) {
+		err = AudioDeviceDestroyIOProcID(mBufferData.selectedAudioDeviceID, audioOutIOProcID);
+		audioOutIOProcID = 0;
+	}
+
+	//Stop decoding to the ring before releasing it
+	if (mBufferData.isStreamingEngineOn) {
+		[mBufferData.buffers[0].inputFileLoader abortLoading];
+		[mBufferData.buffers[1].inputFileLoader abortLoading];
+		mBufferData.isStreamingEngineOn = NO;
+		AudioRingBufferDeallocate(&mBufferData.ring);
+	}
 
 	//TODO: Switch back device sampling rate to previous one (if needed)
 
@@ -2352,12 +2835,7 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 
 		mBufferData.playbackStartPhase = kAudioPlaybackSwitchingBackToFloatMode;
 
-		propertyAddress.mSelector = kAudioStreamPropertyPhysicalFormat;
-		propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
-		propertyAddress.mElement = kAudioObjectPropertyElementMaster;
-		propertySize = sizeof(originalStreamFormat);
-		err = AudioObjectSetPropertyData([[[[audioDevicesList objectAtIndex:selectedAudioDeviceIndex] streams] objectAtIndex:mBufferData.channelMap[0].stream] streamID],
-										 &propertyAddress, 0, NULL, propertySize, &originalStreamFormat);
+		err = [self setMappedStreamsPhysicalFormat:&originalStreamFormat];
 		mBufferData.isIntegerModeOn = NO;
 
 		//perform device complete stop anyway
@@ -2436,6 +2914,29 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	 of a buffer swap requested by the playing thread is prevented */
 	SInt32 playingBuffer = mBufferData.playingAudioBuffer;
 
+	if (mBufferData.isStreamingEngineOn) {
+		int otherBuffer = playingBuffer==0?1:0;
+
+		if ((mBufferData.buffers[playingBuffer].lengthFrames > 0)
+			&& ((SInt64)seekPosition > mBufferData.buffers[playingBuffer].lengthFrames))
+			seekPosition = mBufferData.buffers[playingBuffer].lengthFrames;
+
+		//Frames already in the ring are discarded: restart decoding of the playing track from the seek position,
+		//then of the next one from its start
+		mBufferData.isIOPaused |= kAudioIOProcStreamingReset;
+		usleep(50000); //Wait to be sure the I/O proc is not reading the ring
+		[mBufferData.buffers[playingBuffer].inputFileLoader abortLoading];
+		[mBufferData.buffers[otherBuffer].inputFileLoader abortLoading];
+		AudioRingBufferReset(&mBufferData.ring);
+		AudioRingBufferSetNextProducer(&mBufferData.ring, playingBuffer);
+
+		[self startStreamingBuffer:playingBuffer at:seekPosition];
+		[self startStreamingBuffer:otherBuffer at:0];
+		mBufferData.isIOPaused &= ~kAudioIOProcStreamingReset;
+
+		return true;
+	}
+
 	/* First check if current is "split loaded" : either current buffer load is incomplete
 	 or it doesn't start at 0 (check needed in case of last load)*/
 	if (((mBufferData.buffers[playingBuffer].inputFileLoadStatus & kAudioFileLoaderStatusEOF) == 0)
@@ -2463,16 +2964,11 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 				if (mBufferData.buffers[playingBuffer].inputFileLoader) {
 					[mBufferData.buffers[playingBuffer].inputFileLoader release];
 					mBufferData.buffers[playingBuffer].inputFileLoader = nil;
+					mBufferData.buffers[playingBuffer].verifySerial = 0;
 					mBufferData.buffers[playingBuffer].lengthFrames = 0;
 					mBufferData.buffers[playingBuffer].loadedFrames = 0;
 				}
-				if (mBufferData.buffers[playingBuffer].data) {
-					vm_deallocate(mach_task_self(),
-								  (vm_address_t)mBufferData.buffers[playingBuffer].data,
-								  (vm_size_t)mBufferData.buffers[playingBuffer].dataSizeInBytes);
-					mBufferData.buffers[playingBuffer].dataSizeInBytes = 0;
-					mBufferData.buffers[playingBuffer].data = NULL;
-				}
+				[self releaseBufferData:playingBuffer];
 
 				if (![mBufferData.appController fillBufferWithNext:playingBuffer]) {
                     //Also remove this buffer from the loading progress bar if no other track after
@@ -2487,6 +2983,14 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 				[self closeBuffer:otherBuffer];
 				[mBufferData.appController resetLoadStatus:NO];
 				[self loadNextChunk:otherBuffer at:seekPosition];
+				{
+					//After the hashing in progress of the frames loaded before the seek
+					AudioOutputVerifier *verifier = &mBufferData.verifier;
+					SInt32 serial = mBufferData.buffers[otherBuffer].verifySerial;
+					dispatch_async(mBufferWiringQueue, ^{
+						AudioOutputVerifierRestartSource(verifier, serial, seekPosition);
+					});
+				}
 				mBufferData.playingAudioBuffer = otherBuffer;
 
 				//And load next chunk for the old playing buffer
@@ -2495,16 +2999,11 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 				if (mBufferData.buffers[playingBuffer].inputFileLoader) {
 					[mBufferData.buffers[playingBuffer].inputFileLoader release];
 					mBufferData.buffers[playingBuffer].inputFileLoader = nil;
+					mBufferData.buffers[playingBuffer].verifySerial = 0;
 					mBufferData.buffers[playingBuffer].lengthFrames = 0;
 					mBufferData.buffers[playingBuffer].loadedFrames = 0;
 				}
-				if (mBufferData.buffers[playingBuffer].data) {
-					vm_deallocate(mach_task_self(),
-								  (vm_address_t)mBufferData.buffers[playingBuffer].data,
-								  (vm_size_t)mBufferData.buffers[playingBuffer].dataSizeInBytes);
-					mBufferData.buffers[playingBuffer].dataSizeInBytes = 0;
-					mBufferData.buffers[playingBuffer].data = NULL;
-				}
+				[self releaseBufferData:playingBuffer];
 
 				[mBufferData.appController fillBufferWithNext:playingBuffer];
 				[self pause:NO];
@@ -2524,6 +3023,236 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	return true;
 }
 
+- (void)startStreamingBuffer:(int)bufferIndex at:(SInt64)startingPosition
+{
+	if (mBufferData.buffers[bufferIndex].inputFileLoader == nil) return;
+
+	mBufferData.buffers[bufferIndex].firstFrameOffset = 0;
+	mBufferData.buffers[bufferIndex].currentPlayingFrame = startingPosition;
+
+	[mBufferData.buffers[bufferIndex].inputFileLoader loadChunk:startingPosition
+												  OutBufferData:&mBufferData.buffers[bufferIndex].data
+											   AllocatedBufSize:&mBufferData.buffers[bufferIndex].dataSizeInBytes
+												  MaxBufferSize:[[NSUserDefaults standardUserDefaults] integerForKey:AUDMaxAudioBufferSize]*1024*1024
+												 NumTotalFrames:&mBufferData.buffers[bufferIndex].lengthFrames
+												NumLoadedFrames:&mBufferData.buffers[bufferIndex].loadedFrames
+														 Status:&mBufferData.buffers[bufferIndex].inputFileLoadStatus
+											  NextInputPosition:&mBufferData.buffers[bufferIndex].inputFileNextPosition
+													  ForBuffer:bufferIndex];
+}
+
+- (void)processIOEvents:(NSTimer*)timer
+{
+	AudioOutputEvent event;
+	bool isPositionUpdated = NO;
+
+	while (AudioOutputEventQueuePop(&mBufferData.eventQueue, &event)) {
+		switch (event.type) {
+			case kAudioOutputEventPositionTick:
+				isPositionUpdated = YES;
+				break;
+			case kAudioOutputEventBufferPlayed:
+				[mBufferData.appController notifyBufferPlayed:event.bufferIndex];
+				break;
+			case kAudioOutputEventUnderrun:
+				mUnderrunsCount++;
+				break;
+			case kAudioOutputEventSampleRateSwitchComplete:
+				[self samplerateSwitchIsComplete];
+				break;
+			case kAudioOutputEventProcessorOverload:
+				[mBufferData.appController notifyProcessorOverload];
+				break;
+			case kAudioOutputEventDeviceRemoved:
+				[mBufferData.appController notifyDeviceRemoved];
+				break;
+			case kAudioOutputEventDeviceVolumeChanged:
+				[mBufferData.appController notifyDeviceVolumeChanged];
+				break;
+			case kAudioOutputEventDeviceDataSourceChanged:
+				[mBufferData.appController notifyDeviceDataSourceChanged];
+				break;
+			case kAudioOutputEventDevicesListUpdated:
+				[mBufferData.appController notifyDevicesListUpdated];
+				break;
+			case kAudioOutputEventDeviceHogged:
+				[self initiatePlaybackAfterHoggingDevice];
+				break;
+			case kAudioOutputEventIntegerModeFormatSet:
+				[self initiatePlaybackCompletingInit];
+				break;
+			case kAudioOutputEventFloatModeFormatRestored:
+				[self completeDeviceStop];
+				break;
+			default:
+				break;
+		}
+	}
+
+	//Position ticks are coalesced: only the latest position is displayed
+	if (isPositionUpdated) {
+		[mBufferData.appController updateCurrentPlayingTime];
+		[self wireFramesAheadOfPlayHead];
+	}
+
+	[self hashLoadedFrames];
+	[self storeLoadedTracksInPCMCache];
+}
+
+- (void)wireFramesAheadOfPlayHead
+{
+	SInt32 playingBuffer = mBufferData.playingAudioBuffer;
+	void *data;
+	UInt64 size, offset, length;
+
+	if ((playingBuffer < 0) || (playingBuffer > 1) || (mBufferData.buffers[playingBuffer].data == NULL)
+		|| mIsBufferWiringPending) return;
+
+	data = mBufferData.buffers[playingBuffer].data;
+	size = mBufferData.buffers[playingBuffer].dataSizeInBytes;
+	offset = mBufferData.buffers[playingBuffer].currentPlayingFrame * mBufferData.buffers[playingBuffer].bytesPerFrame;
+	length = (UInt64)(kAudioOutputWiredSecondsAhead * mBufferData.buffers[playingBuffer].sampleRate)
+		* mBufferData.buffers[playingBuffer].bytesPerFrame;
+
+	//Faulting in seconds of pages takes time: not on the main thread. The buffers mapped from files or from
+	//the PCM cache are prefaulted from the file, the pool regions released meanwhile are skipped (checked under the pool lock)
+	mIsBufferWiringPending = true;
+	dispatch_async(mBufferWiringQueue, ^{
+		AudioBufferPoolLockWindow(&mBufferPool, data, size, offset, length);
+		mIsBufferWiringPending = false;
+	});
+}
+
+- (void)releaseBufferData:(int)bufIdx
+{
+	AudioBufferPool *pool = &mBufferPool; //Not self: also called from dealloc
+	void *data = mBufferData.buffers[bufIdx].data;
+	UInt64 size = mBufferData.buffers[bufIdx].dataSizeInBytes;
+
+	mBufferData.buffers[bufIdx].dataSizeInBytes = 0;
+	mBufferData.buffers[bufIdx].data = NULL;
+	if (data == NULL) return;
+
+	//Unmapped or put back after the wiring in progress, the prefault reads being stopped at the next page:
+	//the main thread neither waits for the disk nor for an mlock
+	AudioBufferPoolCancelPrefault(pool);
+	dispatch_async(mBufferWiringQueue, ^{
+		AudioBufferPoolRelease(pool, data, size);
+	});
+}
+
+- (void)hashLoadedFrames
+{
+	AudioOutputVerifier *verifier = &mBufferData.verifier;
+	AudioOutputSourceHashPass pass;
+	AudioBufferItem *buffer;
+	int i;
+
+	//Streaming engine: the frames are hashed by the loaders as they are written to the ring
+	if (!AudioOutputVerifierIsAllocated(verifier) || mBufferData.isStreamingEngineOn || mIsSourceHashingPending) return;
+
+	for (i=0;i<2;i++) {
+		buffer = &mBufferData.buffers[i];
+		pass.buffers[i].serial = ((buffer->verifySerial == 0) || (buffer->data == NULL)) ? 0 : buffer->verifySerial;
+		pass.buffers[i].data = buffer->data;
+		pass.buffers[i].firstFrame = buffer->firstFrameOffset;
+		pass.buffers[i].frames = buffer->loadedFrames;
+		pass.buffers[i].bytesPerFrame = buffer->bytesPerFrame;
+		pass.buffers[i].isLoadComplete = ((buffer->inputFileLoadStatus & (kAudioFileLoaderStatusEOF | kAudioFileLoaderStatusLoading))
+										  == kAudioFileLoaderStatusEOF) && (buffer->loadedFrames >= buffer->lengthFrames);
+		pass.buffers[i].md5Status = pass.buffers[i].serial ? [buffer->inputFileLoader sourceMD5Status] : kAudioOutputVerifierMD5Unavailable;
+	}
+
+	//Tracks arriving fully loaded (PCM cache, mapped files, parallel decoding) are hashed over several ticks, off the
+	//main thread. On the wiring queue, the buffers are released only after being hashed
+	mIsSourceHashingPending = true;
+	dispatch_async(mBufferWiringQueue, ^{
+		SInt64 nextFrame, frames;
+		int buf;
+
+		//Chunks of a split loaded track are hashed in track order, a chunk loaded ahead waiting for the previous one
+		for (buf=0;buf<2;buf++) {
+			if (pass.buffers[buf].serial == 0) continue;
+
+			frames = pass.buffers[buf].frames;
+			nextFrame = AudioOutputVerifierSourcePosition(verifier, pass.buffers[buf].serial);
+			if ((nextFrame >= pass.buffers[buf].firstFrame)
+				&& (frames - (nextFrame - pass.buffers[buf].firstFrame)) * pass.buffers[buf].bytesPerFrame > kAudioOutputSourceHashBytesPerPass)
+				frames = (nextFrame - pass.buffers[buf].firstFrame) + kAudioOutputSourceHashBytesPerPass / pass.buffers[buf].bytesPerFrame;
+
+			AudioOutputVerifierHashSource(verifier, pass.buffers[buf].serial, pass.buffers[buf].data,
+										  pass.buffers[buf].firstFrame, frames, pass.buffers[buf].bytesPerFrame);
+			AudioOutputVerifierPostSource(verifier, pass.buffers[buf].serial, pass.buffers[buf].firstFrame + pass.buffers[buf].frames,
+										  pass.buffers[buf].isLoadComplete, pass.buffers[buf].md5Status);
+		}
+		mIsSourceHashingPending = false;
+	});
+}
+
+- (void)storeLoadedTracksInPCMCache
+{
+	AudioBufferItem *buffer;
+	int i;
+
+	//Streaming engine: the loaders write the cache entries as they decode
+	if (mBufferData.isStreamingEngineOn) return;
+
+	//Only whole tracks are cached, the loader storing each one once
+	for (i=0;i<2;i++) {
+		buffer = &mBufferData.buffers[i];
+		if ((buffer->inputFileLoader == nil) || (buffer->data == NULL) || (buffer->firstFrameOffset != 0)
+			|| ((buffer->inputFileLoadStatus & (kAudioFileLoaderStatusEOF | kAudioFileLoaderStatusLoading)) != kAudioFileLoaderStatusEOF)
+			|| (buffer->loadedFrames < buffer->lengthFrames))
+			continue;
+
+		[buffer->inputFileLoader storeBufferInPCMCache:buffer->data frames:buffer->loadedFrames];
+	}
+}
+
+- (NSDictionary*)ioStatistics
+{
+	AudioOutputIOStats stats;
+	NSMutableArray *durationHistogram = [NSMutableArray arrayWithCapacity:kAudioOutputIOStatsDurationBuckets];
+	NSMutableArray *loadHistogram = [NSMutableArray arrayWithCapacity:kAudioOutputIOStatsLoadBuckets];
+	struct rusage usage;
+	UInt32 i;
+
+	//Snapshot, as the IO proc may be updating the values
+	memcpy(&stats, &mBufferData.ioStats, sizeof(AudioOutputIOStats));
+
+	//Page faults of the process, most of them from filling the audio buffers when they are not recycled
+	getrusage(RUSAGE_SELF, &usage);
+
+	for (i=0;i<kAudioOutputIOStatsDurationBuckets;i++)
+		[durationHistogram addObject:[NSNumber numberWithUnsignedLongLong:stats.durationHistogram[i]]];
+	for (i=0;i<kAudioOutputIOStatsLoadBuckets;i++)
+		[loadHistogram addObject:[NSNumber numberWithUnsignedLongLong:stats.loadHistogram[i]]];
+
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedLongLong:stats.callbacks], @"Callbacks",
+			[NSNumber numberWithUnsignedLongLong:stats.framesRequested], @"FramesRequested",
+			[NSNumber numberWithUnsignedInt:(stats.callbacks > 0)?stats.minFramesPerCallback:0], @"MinFramesPerCallback",
+			[NSNumber numberWithUnsignedInt:stats.maxFramesPerCallback], @"MaxFramesPerCallback",
+			[NSNumber numberWithUnsignedLongLong:stats.maxDurationNanos], @"MaxDurationNanoseconds",
+			[NSNumber numberWithUnsignedInt:stats.maxLoadPercent], @"MaxLoadPercent",
+			durationHistogram, @"DurationLog2MicrosecondsHistogram",
+			loadHistogram, @"LoadDecilesHistogram",
+			[NSNumber numberWithUnsignedLongLong:stats.loadHistogram[kAudioOutputIOStatsLoadBuckets-1]], @"DeadlineMisses",
+			[NSNumber numberWithUnsignedLongLong:stats.starvedNoData], @"StarvedNoData",
+			[NSNumber numberWithUnsignedLongLong:stats.starvedLoading], @"StarvedLoading",
+			[NSNumber numberWithUnsignedLongLong:stats.pausedCallbacks[kAudioOutputIOStatsPauseUser]], @"PausedUser",
+			[NSNumber numberWithUnsignedLongLong:stats.pausedCallbacks[kAudioOutputIOStatsPauseSampleRateChanging]], @"PausedSampleRateChanging",
+			[NSNumber numberWithUnsignedLongLong:stats.pausedCallbacks[kAudioOutputIOStatsPauseAudioBufferSizeChanging]], @"PausedAudioBufferSizeChanging",
+			[NSNumber numberWithUnsignedLongLong:stats.pausedCallbacks[kAudioOutputIOStatsPauseStreamingReset]], @"PausedStreamingReset",
+			[NSNumber numberWithUnsignedInt:mUnderrunsCount], @"Underruns",
+			[NSNumber numberWithBool:[[NSUserDefaults standardUserDefaults] boolForKey:AUDForceMaxIOBufferSize]], @"ForceMaxIOBufferSize",
+			[NSNumber numberWithUnsignedLongLong:mBufferPool.allocations], @"BufferPoolAllocations",
+			[NSNumber numberWithUnsignedLongLong:mBufferPool.hugePagesAllocations], @"BufferPoolHugePagesAllocations",
+			[NSNumber numberWithUnsignedLongLong:mBufferPool.recycles], @"BufferPoolRecycles",
+			[NSNumber numberWithLong:usage.ru_minflt], @"MinorPageFaults",
+			nil];
+}
+
 - (UInt64)currentPlayingPosition
 {
 	/*Potentially not coherent value due to race condition
@@ -2560,6 +3289,44 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 		}
 		[debugStr appendFormat:@", %i bytes per frame @%.1fkHz\n",mBufferData.buffersStreamFormat.mBytesPerFrame,
 		 mBufferData.buffersStreamFormat.mSampleRate/1000.0f];
+		if (mBufferData.copyKernelNames[2])
+			[debugStr appendFormat:@"Output copy kernel: %s\n",mBufferData.copyKernelNames[2]];
+		for (i=3;i<=mBufferData.mappedChannels;i++)
+			if (mBufferData.copyKernelNames[i])
+				[debugStr appendFormat:@"%i channels tracks copy kernel: %s\n",i,mBufferData.copyKernelNames[i]];
+		[debugStr appendFormat:@"Output underruns: %u, dropped events: %i\n",mUnderrunsCount,mBufferData.eventQueue.droppedEvents];
+		[debugStr appendFormat:@"IO proc: %llu callbacks of %u to %u frames, max duration %.1fus (%u%% of IO buffer), %llu deadlines missed\n",
+		 mBufferData.ioStats.callbacks,(mBufferData.ioStats.callbacks > 0)?mBufferData.ioStats.minFramesPerCallback:0,
+		 mBufferData.ioStats.maxFramesPerCallback,mBufferData.ioStats.maxDurationNanos/1000.0,mBufferData.ioStats.maxLoadPercent,
+		 mBufferData.ioStats.loadHistogram[kAudioOutputIOStatsLoadBuckets-1]];
+		[debugStr appendFormat:@"IO proc silence: %llu no data, %llu load late, paused %llu user %llu sample rate %llu buffer size %llu streaming reset\n",
+		 mBufferData.ioStats.starvedNoData,mBufferData.ioStats.starvedLoading,
+		 mBufferData.ioStats.pausedCallbacks[kAudioOutputIOStatsPauseUser],
+		 mBufferData.ioStats.pausedCallbacks[kAudioOutputIOStatsPauseSampleRateChanging],
+		 mBufferData.ioStats.pausedCallbacks[kAudioOutputIOStatsPauseAudioBufferSizeChanging],
+		 mBufferData.ioStats.pausedCallbacks[kAudioOutputIOStatsPauseStreamingReset]];
+		if (mBufferData.isStreamingEngineOn)
+			[debugStr appendFormat:@"Streaming engine: ring of %u %u channels frames (%.1fs), %u frames buffered\n",
+			 mBufferData.ring.capacityFrames,mBufferData.ringChannels,mBufferData.ring.capacityFrames/audioDeviceCurrentNominalSampleRate,
+			 AudioRingBufferFillFrames(&mBufferData.ring)];
+	}
+
+	//Bit-perfect verification results of the last played tracks
+	if (AudioOutputVerifierIsAllocated(&mBufferData.verifier)) {
+		AudioOutputVerifierTrack tracks[kAudioOutputVerifierHistory];
+		UInt32 tracksCount = AudioOutputVerifierCopyTracks(&mBufferData.verifier, tracks, kAudioOutputVerifierHistory);
+		NSString *verdicts[] = {@"pending",@"bit-perfect",@"MISMATCH",@"not verifiable"};
+		NSString *md5Statuses[] = {@"n/a",@"match",@"MISMATCH"};
+
+		[debugStr appendFormat:@"\nBit-perfect verification of the %u last tracks:\n",tracksCount];
+		for (i=0;i<tracksCount;i++) {
+			[debugStr appendFormat:@"%s: %@, decoded CRC32C 0x%08x (%llu bytes), rendered CRC32C 0x%08x (%llu bytes), decoder MD5 %@%@%@\n",
+			 tracks[i].name,verdicts[AudioOutputVerifierTrackVerdict(&tracks[i])],
+			 tracks[i].source.crc,tracks[i].source.bytes,tracks[i].rendered.crc,tracks[i].rendered.bytes,
+			 md5Statuses[tracks[i].md5Status],
+			 (tracks[i].flags & (kAudioOutputVerifierSourcePartial | kAudioOutputVerifierRenderDiscontinuity))?@", seeked":@"",
+			 (tracks[i].flags & kAudioOutputVerifierRenderOverrun)?@", rendered frames lost":@""];
+		}
 	}
 
 	[debugStr appendFormat:@"\nHog Mode is %@\nDevices found : %i\n\nList of devices:\n",mBufferData.isHoggingDevice?@"on":@"off",[audioDevicesList count]];
@@ -2578,8 +3345,11 @@ OSStatus HALlistenerProc(AudioObjectID inObjectID,
 	[debugStr appendString:[deviceDesc description]];
 
 	[debugStr appendFormat:@"\nSimple stereo device: %@",mBufferData.isSimpleStereoDevice?@"yes":@"no"];
-	[debugStr appendFormat:@"\nChannel mapping: L:Stream %i channel %i R:Stream %i channel %i\n\n%i output streams:",mBufferData.channelMap[0].stream,mBufferData.channelMap[0].channel,
-	 mBufferData.channelMap[1].stream,mBufferData.channelMap[1].channel,[[deviceDesc streams] count]];
+	[debugStr appendFormat:@"\nChannel mapping: L:Stream %i channel %i R:Stream %i channel %i",mBufferData.channelMap[0].stream,mBufferData.channelMap[0].channel,
+	 mBufferData.channelMap[1].stream,mBufferData.channelMap[1].channel];
+	for (i=2;i<mBufferData.mappedChannels;i++)
+		[debugStr appendFormat:@" %i:Stream %i channel %i",i+1,mBufferData.channelMap[i].stream,mBufferData.channelMap[i].channel];
+	[debugStr appendFormat:@"\n\n%i output streams:",[[deviceDesc streams] count]];
 
 	//Streams information
 	for (i=0;i<[[deviceDesc streams] count];i++) {
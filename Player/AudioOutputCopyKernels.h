@@ -0,0 +1,78 @@
+/*
+ AudioOutputCopyKernels.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#ifndef __AUDIOOUTPUTCOPYKERNELS_H__
+#define __AUDIOOUTPUTCOPYKERNELS_H__
+
+#include <CoreAudio/CoreAudioTypes.h>
+#include <CoreAudio/AudioHardware.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*Lookup structure for audio channel mapping
+ taking into account the multiple streams devices
+ e.g. multiple mono streams */
+#define kAudioOutputMaxChannels 8 //Up to 7.1 multichannel tracks
+
+typedef struct {
+	AudioStreamID streamID;
+	UInt32 stream;
+	UInt32 channel;
+} AudioChannelMapping;
+
+/*Output copy kernel
+ Copies interleaved frames from an audio buffer to the device output stream(s)
+ One kernel is selected at playback init for each buffer channels count, for the buffer sample size and device streams layout,
+ so that the IO proc does not have to test the layout on each callback */
+typedef void (*AudioOutputCopyKernel)(const void *srcFrames, AudioBufferList *outOutputData,
+									  const AudioChannelMapping *channelMap,
+									  UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 bytesPerSample);
+
+/** AudioOutputSelectCopyKernel
+ Selects the output copy kernel specialized for the buffers sample size and the device streams layout
+ @param bytesPerSample size of one sample in the audio buffers (and in the device stream)
+ @param dstChannels number of channels of the device streams the left and right channels are mapped to
+ @param channelMap left and right channels mapping
+ @param kernelName (optional) returns the name of the selected kernel, for debug info
+ @return the copy kernel to be called from the IO proc
+ */
+AudioOutputCopyKernel AudioOutputSelectCopyKernel(UInt32 bytesPerSample, const UInt32 dstChannels[2],
+												  const AudioChannelMapping *channelMap, const char **kernelName);
+
+/** AudioOutputSelectMultichannelCopyKernel
+ Selects the output copy kernel routing the frames of multichannel buffers to the device streams
+ @param bytesPerSample size of one sample in the audio buffers (and in the device stream)
+ @param channels number of channels of the buffer frames, from 3 to kAudioOutputMaxChannels
+ @param dstChannels number of channels of the device stream each buffer channel is mapped to
+ @param channelMap the mapping of each buffer channel
+ @param kernelName (optional) returns the name of the selected kernel, for debug info
+ @return the copy kernel to be called from the IO proc, NULL if the channels count is not handled
+ */
+AudioOutputCopyKernel AudioOutputSelectMultichannelCopyKernel(UInt32 bytesPerSample, UInt32 channels, const UInt32 *dstChannels,
+															  const AudioChannelMapping *channelMap, const char **kernelName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,446 @@
+/*
+ AudioOutputCopyKernels.mm
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "AudioOutputCopyKernels.h"
+
+/* All kernels copy interleaved stereo frames (L,R) from the audio buffer
+ to the device output streams, starting at output frame dstFrameOffset
+ Sample size and destination stride are template parameters, so that the inner loops
+ have no run-time dependant size or index computation
+ The multichannel kernels do the same for 3 to kAudioOutputMaxChannels channels frames,
+ the channels count being a template parameter too */
+
+#pragma mark Kernels
+
+//Opaque sample of kSampleBytes bytes, copied with the widest moves the compiler can use
+template <size_t kSampleBytes> struct AudioSample {
+	UInt8 bytes[kSampleBytes];
+};
+
+/* Interleaved stereo stream, left and right on channels 0 and 1 : straight memory copy */
+template <size_t kSampleBytes>
+static void copyInterleavedStereo(const void *srcFrames, AudioBufferList *outOutputData,
+								  const AudioChannelMapping *channelMap,
+								  UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 bytesPerSample)
+{
+	const size_t frameBytes = (kSampleBytes != 0) ? 2*kSampleBytes : 2*bytesPerSample;
+
+	memcpy((UInt8*)outOutputData->mBuffers[channelMap[0].stream].mData + dstFrameOffset*frameBytes,
+		   srcFrames, framesToCopy*frameBytes);
+}
+
+/* Left and right channels are adjacent in the same stream : one store per frame */
+template <size_t kSampleBytes>
+static void copyAdjacentPair(const void *srcFrames, AudioBufferList *outOutputData,
+							 const AudioChannelMapping *channelMap,
+							 UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	typedef AudioSample<2*kSampleBytes> Frame;
+	const UInt32 dstStride = outOutputData->mBuffers[channelMap[0].stream].mNumberChannels;
+	const Frame *src = (const Frame*)srcFrames;
+	UInt8 *dst = (UInt8*)outOutputData->mBuffers[channelMap[0].stream].mData
+		+ (dstFrameOffset*dstStride + channelMap[0].channel)*kSampleBytes;
+
+	for (UInt32 i=0;i<framesToCopy;i++) {
+		*(Frame*)dst = src[i];
+		dst += dstStride*kSampleBytes;
+	}
+}
+
+/* General case : left and right channels each on its own position
+ kDstStride is the number of channels of the destination streams, 0 when only known at run time */
+template <size_t kSampleBytes, UInt32 kDstStride>
+static void copyStrided(const void *srcFrames, AudioBufferList *outOutputData,
+						const AudioChannelMapping *channelMap,
+						UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	typedef AudioSample<kSampleBytes> Sample;
+	const UInt32 dstStrideL = (kDstStride != 0) ? kDstStride : outOutputData->mBuffers[channelMap[0].stream].mNumberChannels;
+	const UInt32 dstStrideR = (kDstStride != 0) ? kDstStride : outOutputData->mBuffers[channelMap[1].stream].mNumberChannels;
+	const Sample *src = (const Sample*)srcFrames;
+	Sample *dstL = (Sample*)outOutputData->mBuffers[channelMap[0].stream].mData + dstFrameOffset*dstStrideL + channelMap[0].channel;
+	Sample *dstR = (Sample*)outOutputData->mBuffers[channelMap[1].stream].mData + dstFrameOffset*dstStrideR + channelMap[1].channel;
+
+	for (UInt32 i=0;i<framesToCopy;i++) {
+		*dstL = src[0];
+		*dstR = src[1];
+		src += 2;
+		dstL += dstStrideL;
+		dstR += dstStrideR;
+	}
+}
+
+#ifdef __SSE2__
+/* 32bit samples to two mono streams : SSE2 de-interleave, 4 frames per iteration */
+template <>
+void copyStrided<4,1>(const void *srcFrames, AudioBufferList *outOutputData,
+					  const AudioChannelMapping *channelMap,
+					  UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	const SInt32 *src = (const SInt32*)srcFrames;
+	SInt32 *dstL = (SInt32*)outOutputData->mBuffers[channelMap[0].stream].mData + dstFrameOffset + channelMap[0].channel;
+	SInt32 *dstR = (SInt32*)outOutputData->mBuffers[channelMap[1].stream].mData + dstFrameOffset + channelMap[1].channel;
+	UInt32 i;
+
+	for (i=0;i+4<=framesToCopy;i+=4) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)(src + 2*i));		//L0 R0 L1 R1
+		__m128i hi = _mm_loadu_si128((const __m128i*)(src + 2*i + 4));	//L2 R2 L3 R3
+		lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3,1,2,0));				//L0 L1 R0 R1
+		hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3,1,2,0));				//L2 L3 R2 R3
+		_mm_storeu_si128((__m128i*)(dstL + i), _mm_unpacklo_epi64(lo, hi));
+		_mm_storeu_si128((__m128i*)(dstR + i), _mm_unpackhi_epi64(lo, hi));
+	}
+	for (;i<framesToCopy;i++) {
+		dstL[i] = src[2*i];
+		dstR[i] = src[2*i+1];
+	}
+}
+
+/* 32bit samples, adjacent channels in a wider stream : two frames per load, 64bit stores */
+template <>
+void copyAdjacentPair<4>(const void *srcFrames, AudioBufferList *outOutputData,
+						 const AudioChannelMapping *channelMap,
+						 UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	const UInt32 dstStride = outOutputData->mBuffers[channelMap[0].stream].mNumberChannels;
+	const SInt32 *src = (const SInt32*)srcFrames;
+	SInt32 *dst = (SInt32*)outOutputData->mBuffers[channelMap[0].stream].mData
+		+ dstFrameOffset*dstStride + channelMap[0].channel;
+	UInt32 i;
+
+	for (i=0;i+2<=framesToCopy;i+=2) {
+		__m128i frames = _mm_loadu_si128((const __m128i*)(src + 2*i));
+		_mm_storel_epi64((__m128i*)dst, frames);
+		_mm_storel_epi64((__m128i*)(dst + dstStride), _mm_srli_si128(frames, 8));
+		dst += 2*dstStride;
+	}
+	if (i<framesToCopy) {
+		dst[0] = src[2*i];
+		dst[1] = src[2*i+1];
+	}
+}
+#endif
+
+/* Any other sample size : run time sized copy */
+static void copyGenericSampleSize(const void *srcFrames, AudioBufferList *outOutputData,
+								  const AudioChannelMapping *channelMap,
+								  UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 bytesPerSample)
+{
+	const UInt32 dstStrideL = outOutputData->mBuffers[channelMap[0].stream].mNumberChannels*bytesPerSample;
+	const UInt32 dstStrideR = outOutputData->mBuffers[channelMap[1].stream].mNumberChannels*bytesPerSample;
+	const UInt8 *src = (const UInt8*)srcFrames;
+	UInt8 *dstL = (UInt8*)outOutputData->mBuffers[channelMap[0].stream].mData + dstFrameOffset*dstStrideL + channelMap[0].channel*bytesPerSample;
+	UInt8 *dstR = (UInt8*)outOutputData->mBuffers[channelMap[1].stream].mData + dstFrameOffset*dstStrideR + channelMap[1].channel*bytesPerSample;
+
+	for (UInt32 i=0;i<framesToCopy;i++) {
+		memcpy(dstL, src, bytesPerSample);
+		memcpy(dstR, src+bytesPerSample, bytesPerSample);
+		src += 2*bytesPerSample;
+		dstL += dstStrideL;
+		dstR += dstStrideR;
+	}
+}
+
+
+#pragma mark Multichannel kernels
+
+/* All channels in the same order and interleaved in a stream of the same channels count : straight memory copy */
+template <size_t kSampleBytes, UInt32 kChannels>
+static void copyInterleavedFrames(const void *srcFrames, AudioBufferList *outOutputData,
+								  const AudioChannelMapping *channelMap,
+								  UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 bytesPerSample)
+{
+	const size_t frameBytes = (kSampleBytes != 0) ? kChannels*kSampleBytes : kChannels*bytesPerSample;
+
+	memcpy((UInt8*)outOutputData->mBuffers[channelMap[0].stream].mData + dstFrameOffset*frameBytes,
+		   srcFrames, framesToCopy*frameBytes);
+}
+
+/* All channels adjacent in a wider stream : one store per frame */
+template <size_t kSampleBytes, UInt32 kChannels>
+static void copyAdjacentFrames(const void *srcFrames, AudioBufferList *outOutputData,
+							   const AudioChannelMapping *channelMap,
+							   UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	typedef AudioSample<kChannels*kSampleBytes> Frame;
+	const UInt32 dstStride = outOutputData->mBuffers[channelMap[0].stream].mNumberChannels;
+	const Frame *src = (const Frame*)srcFrames;
+	UInt8 *dst = (UInt8*)outOutputData->mBuffers[channelMap[0].stream].mData
+		+ (dstFrameOffset*dstStride + channelMap[0].channel)*kSampleBytes;
+
+	for (UInt32 i=0;i<framesToCopy;i++) {
+		*(Frame*)dst = src[i];
+		dst += dstStride*kSampleBytes;
+	}
+}
+
+/* General case : each channel scattered to its own stream position
+ The channel loop has a constant count, and is unrolled by the compiler */
+template <size_t kSampleBytes, UInt32 kChannels>
+static void scatterStrided(const void *srcFrames, AudioBufferList *outOutputData,
+						   const AudioChannelMapping *channelMap,
+						   UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	typedef AudioSample<kSampleBytes> Sample;
+	const Sample *src = (const Sample*)srcFrames;
+	Sample *dst[kChannels];
+	UInt32 dstStride[kChannels];
+	UInt32 channel;
+
+	for (channel=0;channel<kChannels;channel++) {
+		dstStride[channel] = outOutputData->mBuffers[channelMap[channel].stream].mNumberChannels;
+		dst[channel] = (Sample*)outOutputData->mBuffers[channelMap[channel].stream].mData
+			+ dstFrameOffset*dstStride[channel] + channelMap[channel].channel;
+	}
+
+	for (UInt32 i=0;i<framesToCopy;i++) {
+		for (channel=0;channel<kChannels;channel++) {
+			*dst[channel] = src[channel];
+			dst[channel] += dstStride[channel];
+		}
+		src += kChannels;
+	}
+}
+
+#ifdef __SSE2__
+/* 32bit samples to mono streams : SSE2 4x4 transposes, 4 frames and 4 channels per iteration */
+template <UInt32 kChannels>
+static void scatterToMonoStreams32(const void *srcFrames, AudioBufferList *outOutputData,
+								   const AudioChannelMapping *channelMap,
+								   UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 /*bytesPerSample*/)
+{
+	const SInt32 *src = (const SInt32*)srcFrames;
+	SInt32 *dst[kChannels];
+	UInt32 i,channel,k;
+
+	for (channel=0;channel<kChannels;channel++)
+		dst[channel] = (SInt32*)outOutputData->mBuffers[channelMap[channel].stream].mData + dstFrameOffset + channelMap[channel].channel;
+
+	for (i=0;i+4<=framesToCopy;i+=4) {
+		const SInt32 *frames = src + i*kChannels;
+
+		for (channel=0;channel+4<=kChannels;channel+=4) {
+			__m128i f0 = _mm_loadu_si128((const __m128i*)(frames + channel));				//A0 B0 C0 D0
+			__m128i f1 = _mm_loadu_si128((const __m128i*)(frames + kChannels + channel));	//A1 B1 C1 D1
+			__m128i f2 = _mm_loadu_si128((const __m128i*)(frames + 2*kChannels + channel));	//A2 B2 C2 D2
+			__m128i f3 = _mm_loadu_si128((const __m128i*)(frames + 3*kChannels + channel));	//A3 B3 C3 D3
+			__m128i ab01 = _mm_unpacklo_epi32(f0, f1);	//A0 A1 B0 B1
+			__m128i ab23 = _mm_unpacklo_epi32(f2, f3);	//A2 A3 B2 B3
+			__m128i cd01 = _mm_unpackhi_epi32(f0, f1);	//C0 C1 D0 D1
+			__m128i cd23 = _mm_unpackhi_epi32(f2, f3);	//C2 C3 D2 D3
+			_mm_storeu_si128((__m128i*)(dst[channel] + i), _mm_unpacklo_epi64(ab01, ab23));
+			_mm_storeu_si128((__m128i*)(dst[channel+1] + i), _mm_unpackhi_epi64(ab01, ab23));
+			_mm_storeu_si128((__m128i*)(dst[channel+2] + i), _mm_unpacklo_epi64(cd01, cd23));
+			_mm_storeu_si128((__m128i*)(dst[channel+3] + i), _mm_unpackhi_epi64(cd01, cd23));
+		}
+		//Remaining channels (e.g. 5.1 surround pair)
+		for (;channel<kChannels;channel++)
+			for (k=0;k<4;k++)
+				dst[channel][i+k] = frames[k*kChannels + channel];
+	}
+	for (;i<framesToCopy;i++)
+		for (channel=0;channel<kChannels;channel++)
+			dst[channel][i] = src[i*kChannels + channel];
+}
+#endif
+
+/* Any other sample size : run time sized copy */
+template <UInt32 kChannels>
+static void scatterGenericSampleSize(const void *srcFrames, AudioBufferList *outOutputData,
+									 const AudioChannelMapping *channelMap,
+									 UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 bytesPerSample)
+{
+	const UInt8 *src = (const UInt8*)srcFrames;
+	UInt8 *dst[kChannels];
+	UInt32 dstStride[kChannels];
+	UInt32 channel;
+
+	for (channel=0;channel<kChannels;channel++) {
+		dstStride[channel] = outOutputData->mBuffers[channelMap[channel].stream].mNumberChannels*bytesPerSample;
+		dst[channel] = (UInt8*)outOutputData->mBuffers[channelMap[channel].stream].mData
+			+ dstFrameOffset*dstStride[channel] + channelMap[channel].channel*bytesPerSample;
+	}
+
+	for (UInt32 i=0;i<framesToCopy;i++) {
+		for (channel=0;channel<kChannels;channel++) {
+			memcpy(dst[channel], src, bytesPerSample);
+			src += bytesPerSample;
+			dst[channel] += dstStride[channel];
+		}
+	}
+}
+
+
+#pragma mark Kernel selection
+
+template <size_t kSampleBytes>
+static AudioOutputCopyKernel selectKernelForSampleSize(const UInt32 dstChannels[2], const AudioChannelMapping *channelMap,
+													   const char **kernelName)
+{
+	if ((channelMap[0].stream == channelMap[1].stream) && (channelMap[1].channel == channelMap[0].channel+1)) {
+		if ((dstChannels[0] == 2) && (channelMap[0].channel == 0)) {
+			*kernelName = "interleaved stereo copy";
+			return copyInterleavedStereo<kSampleBytes>;
+		}
+		*kernelName = "adjacent channels copy";
+		return copyAdjacentPair<kSampleBytes>;
+	}
+
+	if (dstChannels[0] == dstChannels[1]) {
+		switch (dstChannels[0]) {
+			case 1:
+				*kernelName = "mono streams copy";
+				return copyStrided<kSampleBytes,1>;
+			case 2:
+				*kernelName = "stereo streams copy";
+				return copyStrided<kSampleBytes,2>;
+			default:
+				break;
+		}
+	}
+	*kernelName = "strided copy";
+	return copyStrided<kSampleBytes,0>;
+}
+
+AudioOutputCopyKernel AudioOutputSelectCopyKernel(UInt32 bytesPerSample, const UInt32 dstChannels[2],
+												  const AudioChannelMapping *channelMap, const char **kernelName)
+{
+	const char *name;
+	AudioOutputCopyKernel kernel;
+
+	switch (bytesPerSample) {
+		case 4: //32bit integer and Float32
+			kernel = selectKernelForSampleSize<4>(dstChannels, channelMap, &name);
+			break;
+		case 3: //24bit packed
+			kernel = selectKernelForSampleSize<3>(dstChannels, channelMap, &name);
+			break;
+		case 2:
+			kernel = selectKernelForSampleSize<2>(dstChannels, channelMap, &name);
+			break;
+		default:
+			if ((channelMap[0].stream == channelMap[1].stream) && (dstChannels[0] == 2)
+				&& (channelMap[0].channel == 0) && (channelMap[1].channel == 1)) {
+				name = "interleaved stereo copy";
+				kernel = copyInterleavedStereo<0>;
+			}
+			else {
+				name = "generic sample size copy";
+				kernel = copyGenericSampleSize;
+			}
+			break;
+	}
+
+	if (kernelName) *kernelName = name;
+	return kernel;
+}
+
+//kSampleBytes is 0 for the run time sized samples
+template <size_t kSampleBytes, UInt32 kChannels>
+static AudioOutputCopyKernel selectMultichannelKernel(const UInt32 *dstChannels, const AudioChannelMapping *channelMap,
+													  const char **kernelName)
+{
+	bool isAdjacent = true, isMonoStreams = true;
+	UInt32 channel;
+
+	for (channel=0;channel<kChannels;channel++) {
+		if ((channelMap[channel].stream != channelMap[0].stream)
+			|| (channelMap[channel].channel != channelMap[0].channel + channel))
+			isAdjacent = false;
+		if (dstChannels[channel] != 1)
+			isMonoStreams = false;
+	}
+
+	if (isAdjacent && (dstChannels[0] == kChannels)) {
+		*kernelName = "multichannel interleaved copy";
+		return copyInterleavedFrames<kSampleBytes,kChannels>;
+	}
+	if (kSampleBytes == 0) {
+		*kernelName = "multichannel generic sample size copy";
+		return scatterGenericSampleSize<kChannels>;
+	}
+	if (isAdjacent) {
+		*kernelName = "multichannel adjacent channels copy";
+		return copyAdjacentFrames<(kSampleBytes != 0) ? kSampleBytes : 1,kChannels>;
+	}
+#ifdef __SSE2__
+	if (isMonoStreams && (kSampleBytes == 4)) {
+		*kernelName = "multichannel mono streams copy";
+		return scatterToMonoStreams32<kChannels>;
+	}
+#endif
+	*kernelName = "multichannel strided copy";
+	return scatterStrided<(kSampleBytes != 0) ? kSampleBytes : 1,kChannels>;
+}
+
+template <size_t kSampleBytes>
+static AudioOutputCopyKernel selectMultichannelKernelForSampleSize(UInt32 channels, const UInt32 *dstChannels,
+																   const AudioChannelMapping *channelMap,
+																   const char **kernelName)
+{
+	switch (channels) {
+		case 3:
+			return selectMultichannelKernel<kSampleBytes,3>(dstChannels, channelMap, kernelName);
+		case 4:
+			return selectMultichannelKernel<kSampleBytes,4>(dstChannels, channelMap, kernelName);
+		case 5:
+			return selectMultichannelKernel<kSampleBytes,5>(dstChannels, channelMap, kernelName);
+		case 6:
+			return selectMultichannelKernel<kSampleBytes,6>(dstChannels, channelMap, kernelName);
+		case 7:
+			return selectMultichannelKernel<kSampleBytes,7>(dstChannels, channelMap, kernelName);
+		case 8:
+			return selectMultichannelKernel<kSampleBytes,8>(dstChannels, channelMap, kernelName);
+		default:
+			*kernelName = NULL;
+			return NULL;
+	}
+}
+
+AudioOutputCopyKernel AudioOutputSelectMultichannelCopyKernel(UInt32 bytesPerSample, UInt32 channels, const UInt32 *dstChannels,
+															  const AudioChannelMapping *channelMap, const char **kernelName)
+{
+	const char *name;
+	AudioOutputCopyKernel kernel;
+
+	switch (bytesPerSample) {
+		case 4: //32bit integer and Float32
+			kernel = selectMultichannelKernelForSampleSize<4>(channels, dstChannels, channelMap, &name);
+			break;
+		case 3: //24bit packed
+			kernel = selectMultichannelKernelForSampleSize<3>(channels, dstChannels, channelMap, &name);
+			break;
+		case 2:
+			kernel = selectMultichannelKernelForSampleSize<2>(channels, dstChannels, channelMap, &name);
+			break;
+		default:
+			kernel = selectMultichannelKernelForSampleSize<0>(channels, dstChannels, channelMap, &name);
+			break;
+	}
+
+	if (kernelName) *kernelName = name;
+	return kernel;
+}
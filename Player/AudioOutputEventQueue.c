@@ -0,0 +1,85 @@
+/*
+ AudioOutputEventQueue.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#include <libkern/OSAtomic.h>
+
+#include "AudioOutputEventQueue.h"
+
+void AudioOutputEventQueueInit(AudioOutputEventQueue *queue)
+{
+	SInt32 i;
+
+	for (i=0;i<kAudioOutputEventQueueSize;i++)
+		queue->cells[i].sequence = i;
+	queue->enqueuePosition = 0;
+	queue->dequeuePosition = 0;
+	queue->droppedEvents = 0;
+	OSMemoryBarrier();
+}
+
+bool AudioOutputEventQueuePush(AudioOutputEventQueue *queue, UInt32 type, UInt32 bufferIndex)
+{
+	SInt32 position,sequence;
+	SInt32 cellIndex;
+
+	//Reserve a cell: retry only if another producer has taken this one in the meantime
+	for (;;) {
+		position = queue->enqueuePosition;
+		cellIndex = position & (kAudioOutputEventQueueSize-1);
+		sequence = queue->cells[cellIndex].sequence;
+
+		if (sequence == position) {
+			if (OSAtomicCompareAndSwap32Barrier(position, position+1, &queue->enqueuePosition))
+				break;
+		}
+		else if ((SInt32)(sequence - position) < 0) {
+			//Queue full: cell not yet consumed
+			OSAtomicIncrement32(&queue->droppedEvents);
+			return false;
+		}
+	}
+
+	queue->cells[cellIndex].event.type = type;
+	queue->cells[cellIndex].event.bufferIndex = bufferIndex;
+
+	//Event must be visible before the cell is marked as filled
+	OSMemoryBarrier();
+	queue->cells[cellIndex].sequence = position+1;
+	return true;
+}
+
+bool AudioOutputEventQueuePop(AudioOutputEventQueue *queue, AudioOutputEvent *event)
+{
+	SInt32 position = queue->dequeuePosition;
+	SInt32 cellIndex = position & (kAudioOutputEventQueueSize-1);
+
+	if ((SInt32)(queue->cells[cellIndex].sequence - (position+1)) < 0)
+		return false; //Empty
+
+	OSMemoryBarrier();
+	*event = queue->cells[cellIndex].event;
+
+	//Release the cell for the producers of the next round
+	OSMemoryBarrier();
+	queue->cells[cellIndex].sequence = position+kAudioOutputEventQueueSize;
+	queue->dequeuePosition = position+1;
+	return true;
+}
@@ -0,0 +1,93 @@
+/*
+ AudioOutputEventQueue.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#ifndef __AUDIOOUTPUTEVENTQUEUE_H__
+#define __AUDIOOUTPUTEVENTQUEUE_H__
+
+#include <stdbool.h>
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioOutputEventQueueSize 64 //Must be a power of 2
+
+/*
+ Events sent by the IO proc and the HAL listener, processed in the main thread
+ */
+enum {
+	kAudioOutputEventPositionTick = 1,
+	kAudioOutputEventBufferPlayed,
+	kAudioOutputEventUnderrun,
+	kAudioOutputEventSampleRateSwitchComplete,
+	kAudioOutputEventProcessorOverload,
+	kAudioOutputEventDeviceRemoved,
+	kAudioOutputEventDeviceVolumeChanged,
+	kAudioOutputEventDeviceDataSourceChanged,
+	kAudioOutputEventDevicesListUpdated,
+	kAudioOutputEventDeviceHogged,
+	kAudioOutputEventIntegerModeFormatSet,
+	kAudioOutputEventFloatModeFormatRestored
+};
+
+typedef struct {
+	UInt32 type;
+	UInt32 bufferIndex; //Buffer played, for kAudioOutputEventBufferPlayed
+} AudioOutputEvent;
+
+/*
+ AudioOutputEventQueue
+ Fixed size lock-free queue of events, with multiple producers (IO proc, HAL listener) and a single consumer (main thread)
+ Pushing an event does not allocate memory nor take any lock, so it is safe from the real-time IO thread.
+ Each cell sequence number tells whether it is free for the producer of a position, or filled for the consumer
+ */
+typedef struct {
+	struct {
+		volatile SInt32 sequence;
+		AudioOutputEvent event;
+	} cells[kAudioOutputEventQueueSize];
+	volatile SInt32 enqueuePosition;
+	SInt32 dequeuePosition; //Accessed only by the consumer
+	volatile SInt32 droppedEvents;
+} AudioOutputEventQueue;
+
+void AudioOutputEventQueueInit(AudioOutputEventQueue *queue);
+
+/** AudioOutputEventQueuePush
+ @param type the event type (see enum)
+ @param bufferIndex the event argument
+ @return false if the queue is full, the event being then dropped
+ */
+bool AudioOutputEventQueuePush(AudioOutputEventQueue *queue, UInt32 type, UInt32 bufferIndex);
+
+/** AudioOutputEventQueuePop
+ @param event On output: the oldest event in the queue
+ @return false if the queue is empty
+ @comment To be called only from the main thread
+ */
+bool AudioOutputEventQueuePop(AudioOutputEventQueue *queue, AudioOutputEvent *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
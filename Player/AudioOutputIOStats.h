@@ -0,0 +1,92 @@
+/*
+ AudioOutputIOStats.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#ifndef __AUDIOOUTPUTIOSTATS_H__
+#define __AUDIOOUTPUTIOSTATS_H__
+
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioOutputIOStatsDurationBuckets 16 //Bucket n: callback duration in [2^(n-1),2^n[ microseconds, bucket 0: less than 1us
+#define kAudioOutputIOStatsLoadBuckets 11 //Bucket n: callback duration in [10n%,10(n+1)%[ of the IO buffer duration, last one: deadline missed
+
+/*
+ IO proc pause reasons, matching the Audio I/O Proc pause conditions flags
+ */
+enum {
+	kAudioOutputIOStatsPauseUser = 0,
+	kAudioOutputIOStatsPauseSampleRateChanging,
+	kAudioOutputIOStatsPauseAudioBufferSizeChanging,
+	kAudioOutputIOStatsPauseStreamingReset,
+	kAudioOutputIOStatsPauseReasons
+};
+
+/*
+ AudioOutputIOStats
+ IO proc counters and histograms
+ Written only by the IO thread, with plain stores (no lock, no atomic operation).
+ The main thread reads them without synchronization: values may be slightly incoherent between them, which is fine for statistics
+ */
+typedef struct {
+	UInt64 callbacks;
+	UInt64 framesRequested;
+	UInt64 durationHistogram[kAudioOutputIOStatsDurationBuckets];
+	UInt64 loadHistogram[kAudioOutputIOStatsLoadBuckets];
+	UInt64 maxDurationNanos;
+	UInt64 starvedNoData; //Silence output as no buffer is ready
+	UInt64 starvedLoading; //Playing position caught up with the background load
+	UInt64 pausedCallbacks[kAudioOutputIOStatsPauseReasons];
+	Float64 nanosPerFrame; //IO buffer duration per frame at the device sample rate
+	Float64 ticksToNanos; //Host time conversion factor
+	UInt32 minFramesPerCallback;
+	UInt32 maxFramesPerCallback;
+	UInt32 maxLoadPercent;
+} AudioOutputIOStats;
+
+/** AudioOutputIOStatsReset
+ Clears all counters
+ @param deviceSampleRate the device nominal sample rate, used to compute the IO deadline
+ @comment To be called when the IO proc is not running
+ */
+void AudioOutputIOStatsReset(AudioOutputIOStats *stats, Float64 deviceSampleRate);
+void AudioOutputIOStatsSetSampleRate(AudioOutputIOStats *stats, Float64 deviceSampleRate);
+
+/** AudioOutputIOStatsRecordCallback
+ Accounts one IO proc callback
+ @param startHostTime,endHostTime the callback start and end times, from mach_absolute_time
+ @param framesRequested the number of frames the device asked for
+ */
+void AudioOutputIOStatsRecordCallback(AudioOutputIOStats *stats, UInt64 startHostTime, UInt64 endHostTime, UInt32 framesRequested);
+
+/** AudioOutputIOStatsRecordPause
+ Accounts a callback returning silence as the IO proc is paused
+ @param isIOPaused the IO proc pause conditions flags
+ */
+void AudioOutputIOStatsRecordPause(AudioOutputIOStats *stats, UInt32 isIOPaused);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
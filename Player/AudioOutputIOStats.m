@@ -0,0 +1,80 @@
+/*
+ AudioOutputIOStats.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#include <string.h>
+#include <mach/mach_time.h>
+
+#include "AudioOutputIOStats.h"
+
+void AudioOutputIOStatsReset(AudioOutputIOStats *stats, Float64 deviceSampleRate)
+{
+	mach_timebase_info_data_t timebase;
+
+	memset(stats, 0, sizeof(AudioOutputIOStats));
+	stats->minFramesPerCallback = 0xFFFFFFFF;
+
+	mach_timebase_info(&timebase);
+	stats->ticksToNanos = (Float64)timebase.numer / timebase.denom;
+	AudioOutputIOStatsSetSampleRate(stats, deviceSampleRate);
+}
+
+void AudioOutputIOStatsSetSampleRate(AudioOutputIOStats *stats, Float64 deviceSampleRate)
+{
+	stats->nanosPerFrame = (deviceSampleRate > 0) ? 1.0e9 / deviceSampleRate : 0;
+}
+
+void AudioOutputIOStatsRecordCallback(AudioOutputIOStats *stats, UInt64 startHostTime, UInt64 endHostTime, UInt32 framesRequested)
+{
+	UInt64 durationNanos = (UInt64)((endHostTime - startHostTime) * stats->ticksToNanos);
+	UInt64 durationMicros = durationNanos / 1000;
+	UInt32 bucket;
+
+	stats->callbacks++;
+	stats->framesRequested += framesRequested;
+	if (framesRequested < stats->minFramesPerCallback) stats->minFramesPerCallback = framesRequested;
+	if (framesRequested > stats->maxFramesPerCallback) stats->maxFramesPerCallback = framesRequested;
+	if (durationNanos > stats->maxDurationNanos) stats->maxDurationNanos = durationNanos;
+
+	//Log2 bucket: index of the highest bit set
+	bucket = (durationMicros == 0) ? 0 : (UInt32)(64 - __builtin_clzll(durationMicros));
+	if (bucket >= kAudioOutputIOStatsDurationBuckets) bucket = kAudioOutputIOStatsDurationBuckets-1;
+	stats->durationHistogram[bucket]++;
+
+	//Part of the IO buffer duration used by the callback
+	if ((framesRequested > 0) && (stats->nanosPerFrame > 0)) {
+		UInt32 loadPercent = (UInt32)(100 * durationNanos / (framesRequested * stats->nanosPerFrame));
+
+		if (loadPercent > stats->maxLoadPercent) stats->maxLoadPercent = loadPercent;
+		bucket = loadPercent / 10;
+		if (bucket >= kAudioOutputIOStatsLoadBuckets) bucket = kAudioOutputIOStatsLoadBuckets-1;
+		stats->loadHistogram[bucket]++;
+	}
+}
+
+void AudioOutputIOStatsRecordPause(AudioOutputIOStats *stats, UInt32 isIOPaused)
+{
+	UInt32 reason;
+
+	for (reason=0;reason<kAudioOutputIOStatsPauseReasons;reason++) {
+		if (isIOPaused & (1 << reason))
+			stats->pausedCallbacks[reason]++;
+	}
+}
@@ -0,0 +1,361 @@
+/*
+ AudioOutputSink.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "AudioOutputSink.h"
+
+#define WAV_HEADER_SIZE 44
+#define WAV_EXTENSIBLE_HEADER_SIZE 68
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_IEEE_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+#define WAV_SPEAKER_FRONT_LEFT_RIGHT 0x3
+
+struct AudioOutputSink {
+	pthread_t thread;
+	void *frames;
+	void *fileFrames; //Frames converted to the WAV samples format, NULL if the rendered ones can be written as is
+	FILE *wavFile;
+	char *wavFilePath;
+	AudioOutputSinkRenderProc renderProc;
+	void *renderContext;
+	AudioOutputSinkFormat format;
+	volatile uint64_t framesRendered;
+	uint64_t bytesWritten;
+	volatile double sampleRate;
+	double wavSampleRate;
+	double speedFactor;
+	uint32_t framesPerBuffer;
+	uint32_t wavSegment; //Index of the WAV file segment being written, from 1
+	int sinkType;
+	volatile bool isRunning;
+	bool isThreadStarted;
+};
+
+#pragma mark WAV file
+
+static void writeLE32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t)value;
+	dst[1] = (uint8_t)(value >> 8);
+	dst[2] = (uint8_t)(value >> 16);
+	dst[3] = (uint8_t)(value >> 24);
+}
+
+static void writeLE16(uint8_t *dst, uint16_t value)
+{
+	dst[0] = (uint8_t)value;
+	dst[1] = (uint8_t)(value >> 8);
+}
+
+static uint32_t validBitsPerSample(const AudioOutputSinkFormat *format)
+{
+	if (format->isFloat || (format->validBitsPerSample == 0) || (format->validBitsPerSample > 8*format->bytesPerSample))
+		return 8*format->bytesPerSample;
+	return format->validBitsPerSample;
+}
+
+/* Integer samples not filling their container need the extensible format to give their significant bits,
+ as do more than 2 channels */
+static bool isWAVExtensible(const AudioOutputSinkFormat *format)
+{
+	return (validBitsPerSample(format) != 8*format->bytesPerSample) || (format->channels > 2);
+}
+
+/* WAV samples are little endian and left justified: samples needing a conversion before being written */
+static bool isWAVConversionNeeded(const AudioOutputSinkFormat *format)
+{
+	return (format->isBigEndian && (format->bytesPerSample > 1))
+		|| ((validBitsPerSample(format) != 8*format->bytesPerSample) && !format->isAlignedHigh);
+}
+
+static void convertToWAVSamples(const AudioOutputSinkFormat *format, uint8_t *dst, const uint8_t *src, uint32_t samples)
+{
+	const uint32_t bytesPerSample = format->bytesPerSample;
+	const uint32_t justifyShift = format->isAlignedHigh ? 0 : (8*bytesPerSample - validBitsPerSample(format));
+	uint32_t i,k,value;
+
+	for (i=0;i<samples;i++) {
+		value = 0;
+		for (k=0;k<bytesPerSample;k++)
+			value |= (uint32_t)src[format->isBigEndian ? k : (bytesPerSample-1-k)] << (8*(bytesPerSample-1-k));
+		//The low aligned sign extension bits are shifted out
+		value <<= justifyShift;
+		for (k=0;k<bytesPerSample;k++)
+			dst[k] = (uint8_t)(value >> (8*k));
+		src += bytesPerSample;
+		dst += bytesPerSample;
+	}
+}
+
+static uint32_t WAVHeaderSize(const AudioOutputSinkFormat *format)
+{
+	return isWAVExtensible(format) ? WAV_EXTENSIBLE_HEADER_SIZE : WAV_HEADER_SIZE;
+}
+
+/* Writes (or rewrites once the data size is known) the canonical 44 bytes header,
+ or the 68 bytes extensible one for samples not filling their container or multichannel frames.
+ The device channels beyond the stereo pair have no speaker position: their channel mask is left empty */
+static int writeWAVHeader(AudioOutputSink *sink)
+{
+	const AudioOutputSinkFormat *format = &sink->format;
+	const uint32_t headerSize = WAVHeaderSize(format);
+	uint8_t header[WAV_EXTENSIBLE_HEADER_SIZE];
+	uint32_t dataSize = (sink->bytesWritten > 0xFFFFFFFFULL - headerSize) ? (uint32_t)(0xFFFFFFFFULL - headerSize) : (uint32_t)sink->bytesWritten;
+	uint32_t blockAlign = format->channels * format->bytesPerSample;
+	uint16_t formatTag = format->isFloat ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM;
+	uint8_t *dataChunk;
+
+	memcpy(header, "RIFF", 4);
+	writeLE32(header+4, dataSize + headerSize - 8);
+	memcpy(header+8, "WAVEfmt ", 8);
+	writeLE32(header+16, headerSize - 28); //fmt chunk size: 16, or 40 for the extensible format
+	writeLE16(header+20, isWAVExtensible(format) ? WAV_FORMAT_EXTENSIBLE : formatTag);
+	writeLE16(header+22, (uint16_t)format->channels);
+	writeLE32(header+24, (uint32_t)sink->wavSampleRate);
+	writeLE32(header+28, (uint32_t)sink->wavSampleRate * blockAlign);
+	writeLE16(header+32, (uint16_t)blockAlign);
+	writeLE16(header+34, (uint16_t)(8*format->bytesPerSample));
+	dataChunk = header+36;
+
+	if (isWAVExtensible(format)) {
+		static const uint8_t subFormatGUIDTail[14] = {0x00,0x00, 0x00,0x00, 0x10,0x00, 0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71};
+
+		writeLE16(header+36, 22);
+		writeLE16(header+38, (uint16_t)validBitsPerSample(format));
+		writeLE32(header+40, (format->channels == 2) ? WAV_SPEAKER_FRONT_LEFT_RIGHT : 0);
+		writeLE16(header+44, formatTag);
+		memcpy(header+46, subFormatGUIDTail, sizeof(subFormatGUIDTail));
+		dataChunk = header+60;
+	}
+	memcpy(dataChunk, "data", 4);
+	writeLE32(dataChunk+4, dataSize);
+
+	if (fseek(sink->wavFile, 0, SEEK_SET) != 0) return -1;
+	if (fwrite(header, headerSize, 1, sink->wavFile) != 1) return -1;
+	return fseek(sink->wavFile, 0, SEEK_END);
+}
+
+/* Segment n>1 of "dir/name.wav" is "dir/name-n.wav" */
+static char* WAVSegmentPath(const char *filePath, uint32_t segment)
+{
+	const char *slash = strrchr(filePath, '/');
+	const char *dot = strrchr(filePath, '.');
+	size_t pathLength = strlen(filePath) + 16;
+	char *path = (char*)malloc(pathLength);
+
+	if (!path) return NULL;
+	if (segment <= 1)
+		snprintf(path, pathLength, "%s", filePath);
+	else if (dot && (!slash || (dot > slash)))
+		snprintf(path, pathLength, "%.*s-%u%s", (int)(dot - filePath), filePath, segment, dot);
+	else
+		snprintf(path, pathLength, "%s-%u", filePath, segment);
+	return path;
+}
+
+/* Ends the WAV file being written, and starts the next segment at the new sample rate */
+static int startWAVSegment(AudioOutputSink *sink)
+{
+	char *path;
+
+	if (sink->wavFile) {
+		writeWAVHeader(sink);
+		fclose(sink->wavFile);
+		sink->wavFile = NULL;
+	}
+
+	sink->wavSampleRate = sink->sampleRate;
+	sink->bytesWritten = 0;
+	sink->wavSegment++;
+	path = WAVSegmentPath(sink->wavFilePath, sink->wavSegment);
+	if (!path) return -1;
+	sink->wavFile = fopen(path, "wb");
+	free(path);
+	if (!sink->wavFile) return -1;
+
+	return writeWAVHeader(sink);
+}
+
+#pragma mark Sink thread
+
+static double currentTimeInSeconds(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+static void* sinkThread(void *arg)
+{
+	AudioOutputSink *sink = (AudioOutputSink*)arg;
+	size_t bufferBytes = (size_t)sink->framesPerBuffer * sink->format.channels * sink->format.bytesPerSample;
+	double clockStart = currentTimeInSeconds();
+	double clockTime = 0.0; //Simulated device time since start
+
+	while (sink->isRunning) {
+		//Sample rate changed since the previous buffer: the WAV file can not hold the frames at the new rate
+		if ((sink->sinkType == kAudioOutputSinkWAVFile) && (sink->sampleRate != sink->wavSampleRate))
+			startWAVSegment(sink);
+
+		//The device sends silence where the IO proc writes nothing
+		memset(sink->frames, 0, bufferBytes);
+		sink->renderProc(sink->renderContext, sink->frames, sink->framesPerBuffer);
+		sink->framesRendered += sink->framesPerBuffer;
+
+		if (sink->wavFile) {
+			const void *fileFrames = sink->frames;
+
+			if (sink->fileFrames) {
+				convertToWAVSamples(&sink->format, (uint8_t*)sink->fileFrames, (const uint8_t*)sink->frames,
+									sink->framesPerBuffer*sink->format.channels);
+				fileFrames = sink->fileFrames;
+			}
+			if (fwrite(fileFrames, bufferBytes, 1, sink->wavFile) == 1)
+				sink->bytesWritten += bufferBytes;
+		}
+
+		//Wait for the simulated device to consume the buffer
+		if (sink->speedFactor > 0) {
+			double delay;
+
+			clockTime += sink->framesPerBuffer / (sink->sampleRate * sink->speedFactor);
+			delay = clockStart + clockTime - currentTimeInSeconds();
+			if (delay > 0) usleep((useconds_t)(delay * 1.0e6));
+		}
+	}
+	return NULL;
+}
+
+#pragma mark Public functions
+
+AudioOutputSink* AudioOutputSinkCreate(int sinkType, const char *filePath, const AudioOutputSinkFormat *format,
+									   uint32_t framesPerBuffer, double speedFactor,
+									   AudioOutputSinkRenderProc renderProc, void *renderContext)
+{
+	AudioOutputSink *sink;
+	size_t bufferBytes;
+
+	if (((sinkType != kAudioOutputSinkNull) && (sinkType != kAudioOutputSinkWAVFile))
+		|| !format || (format->channels == 0) || (format->bytesPerSample == 0) || (format->bytesPerSample > 4)
+		|| (framesPerBuffer == 0) || (renderProc == NULL)
+		|| ((sinkType == kAudioOutputSinkWAVFile) && !filePath))
+		return NULL;
+
+	sink = (AudioOutputSink*)calloc(1, sizeof(AudioOutputSink));
+	if (!sink) return NULL;
+
+	sink->sinkType = sinkType;
+	sink->format = *format;
+	sink->framesPerBuffer = framesPerBuffer;
+	sink->speedFactor = speedFactor;
+	sink->renderProc = renderProc;
+	sink->renderContext = renderContext;
+
+	bufferBytes = (size_t)framesPerBuffer * format->channels * format->bytesPerSample;
+	sink->frames = malloc(bufferBytes);
+	if (!sink->frames) {
+		free(sink);
+		return NULL;
+	}
+
+	//The WAV file is created at start, its header needing the sample rate
+	if (sinkType == kAudioOutputSinkWAVFile) {
+		sink->wavFilePath = strdup(filePath);
+		if (isWAVConversionNeeded(format))
+			sink->fileFrames = malloc(bufferBytes);
+		if (!sink->wavFilePath || (isWAVConversionNeeded(format) && !sink->fileFrames)) {
+			AudioOutputSinkDispose(sink);
+			return NULL;
+		}
+	}
+
+	return sink;
+}
+
+int AudioOutputSinkStart(AudioOutputSink *sink, double sampleRate)
+{
+	if (sink->isThreadStarted || (sampleRate <= 0)) return -1;
+
+	sink->sampleRate = sampleRate;
+	sink->framesRendered = 0;
+
+	if (sink->sinkType == kAudioOutputSinkWAVFile) {
+		//Each start rewrites the files from the first segment
+		if (sink->wavFile) {
+			fclose(sink->wavFile);
+			sink->wavFile = NULL;
+		}
+		sink->wavSegment = 0;
+		if (startWAVSegment(sink) != 0) return -1;
+	}
+
+	sink->isRunning = true;
+	if (pthread_create(&sink->thread, NULL, sinkThread, sink) != 0) {
+		sink->isRunning = false;
+		return -1;
+	}
+	sink->isThreadStarted = true;
+	return 0;
+}
+
+void AudioOutputSinkSetSampleRate(AudioOutputSink *sink, double sampleRate)
+{
+	if (sampleRate > 0) sink->sampleRate = sampleRate;
+}
+
+void AudioOutputSinkStop(AudioOutputSink *sink)
+{
+	if (!sink->isThreadStarted) return;
+
+	sink->isRunning = false;
+	pthread_join(sink->thread, NULL);
+	sink->isThreadStarted = false;
+
+	if (sink->wavFile) {
+		writeWAVHeader(sink);
+		fflush(sink->wavFile);
+	}
+}
+
+void AudioOutputSinkDispose(AudioOutputSink *sink)
+{
+	if (!sink) return;
+
+	AudioOutputSinkStop(sink);
+	if (sink->wavFile) fclose(sink->wavFile);
+	free(sink->wavFilePath);
+	free(sink->fileFrames);
+	free(sink->frames);
+	free(sink);
+}
+
+uint64_t AudioOutputSinkFramesRendered(AudioOutputSink *sink)
+{
+	return sink->framesRendered;
+}
@@ -0,0 +1,102 @@
+/*
+ AudioOutputSink.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#ifndef __AUDIOOUTPUTSINK_H__
+#define __AUDIOOUTPUTSINK_H__
+
+/* Plain C (no CoreAudio nor Cocoa dependency), so that the sinks also build and run on Linux */
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Output backends
+ */
+enum {
+	kAudioOutputSinkDevice = 0, //CoreAudio HAL device IO proc
+	kAudioOutputSinkNull = 1, //Frames rendered and discarded
+	kAudioOutputSinkWAVFile = 2 //Frames rendered and written to a WAV file
+};
+
+/*
+ Frames format, as the device streams would receive it
+ */
+typedef struct {
+	uint32_t channels; //Number of interleaved channels
+	uint32_t bytesPerSample; //Sample container size
+	uint32_t validBitsPerSample; //Significant bits of integer samples, 0 if all the container bits are
+	bool isFloat; //32bit floats, else signed integers
+	bool isBigEndian;
+	bool isAlignedHigh; //Significant bits in the high part of the container, when they do not fill it
+} AudioOutputSinkFormat;
+
+/*
+ Render callback: fills the interleaved frames buffer, exactly as the device would receive it
+ Called from the sink thread
+ */
+typedef void (*AudioOutputSinkRenderProc)(void *renderContext, void *frames, uint32_t framesCount);
+
+typedef struct AudioOutputSink AudioOutputSink;
+
+/** AudioOutputSinkCreate
+ @param sinkType kAudioOutputSinkNull or kAudioOutputSinkWAVFile
+ @param filePath the WAV file to write (WAV sink only)
+ @param format the rendered frames format. The WAV file holds the same samples, little endian
+ and left justified as the WAV format requires, its header giving their significant bits
+ @param framesPerBuffer number of frames rendered per callback (the simulated IO buffer size)
+ @param speedFactor simulated device clock speed: 1.0 for real time, 0 to render as fast as possible
+ @return the sink, NULL on error (e.g. file can't be created)
+ */
+AudioOutputSink* AudioOutputSinkCreate(int sinkType, const char *filePath, const AudioOutputSinkFormat *format,
+									   uint32_t framesPerBuffer, double speedFactor,
+									   AudioOutputSinkRenderProc renderProc, void *renderContext);
+
+/** AudioOutputSinkStart
+ Starts the sink thread, pulling frames at the simulated device clock
+ @param sampleRate the simulated device sample rate
+ @return 0 if success
+ */
+int AudioOutputSinkStart(AudioOutputSink *sink, double sampleRate);
+
+/** AudioOutputSinkSetSampleRate
+ Changes the simulated device clock rate
+ @comment A WAV file has a single sample rate: the frames rendered at a new rate are written
+ to a new segment file, named after the first one with a -2, -3... suffix.
+ The switch is done by the sink thread, at its next buffer.
+ */
+void AudioOutputSinkSetSampleRate(AudioOutputSink *sink, double sampleRate);
+
+/** AudioOutputSinkStop
+ Stops the sink thread, and finalizes the WAV file header. Returns only when the thread is stopped
+ */
+void AudioOutputSinkStop(AudioOutputSink *sink);
+void AudioOutputSinkDispose(AudioOutputSink *sink);
+
+uint64_t AudioOutputSinkFramesRendered(AudioOutputSink *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ AudioOutputVerifier.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOOUTPUTVERIFIER_H__
+#define __AUDIOOUTPUTVERIFIER_H__
+
+#include <stdbool.h>
+#include <MacTypes.h>
+#include <dispatch/dispatch.h>
+#include <libkern/OSAtomic.h>
+
+#include "AudioRingBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioOutputVerifierHistory 8 //Number of tracks results kept
+#define kAudioOutputVerifierRingBytes (12*384*1024) //Multiple of 2, 3 and 4: a sample never wraps around the ring end
+#define kAudioOutputVerifierDrainIntervalMs 50
+#define kAudioOutputVerifierNameSize 64
+
+/*
+ Track verification flags
+ */
+enum {
+	kAudioOutputVerifierSourceComplete = 1, //All the frames of the track are loaded and hashed
+	kAudioOutputVerifierSourcePartial = 2, //Decoding not done in one pass from the track start (seek)
+	kAudioOutputVerifierRenderDiscontinuity = 4, //Rendering not started at the track start, or seeked
+	kAudioOutputVerifierRenderOverrun = 8 //Rendered frames lost: the helper thread could not keep up
+};
+
+/*
+ Decoder checksum status (FLAC STREAMINFO MD5)
+ */
+enum {
+	kAudioOutputVerifierMD5Unavailable = 0,
+	kAudioOutputVerifierMD5Match = 1,
+	kAudioOutputVerifierMD5Mismatch = 2
+};
+
+/*
+ Track verification verdict
+ */
+enum {
+	kAudioOutputVerifierPending = 0, //Track not completely loaded or not yet played to its end
+	kAudioOutputVerifierBitPerfect = 1,
+	kAudioOutputVerifierMismatch = 2,
+	kAudioOutputVerifierNotVerifiable = 3 //Seeked or frames lost: rendered and source frames do not cover the same range
+};
+
+typedef struct {
+	UInt32 crc; //CRC32C of the bytes hashed so far
+	UInt64 bytes;
+} AudioOutputVerifierChecksum;
+
+/* Verification result of a track */
+typedef struct {
+	SInt32 serial;
+	UInt32 flags;
+	UInt32 md5Status;
+	AudioOutputVerifierChecksum source; //PCM written by the loader in the track buffers or in the streaming ring
+	AudioOutputVerifierChecksum rendered; //PCM copied by the IO proc to the device streams, in the same frame layout
+	char name[kAudioOutputVerifierNameSize];
+} AudioOutputVerifierTrack;
+
+/* Source side hashing of a track, done by the thread writing or loading its frames */
+typedef struct {
+	SInt32 serial;
+	UInt32 flags;
+	SInt64 nextFrame; //Track position of the next frame to hash
+	SInt64 postedFrame;
+	AudioOutputVerifierChecksum checksum;
+} AudioOutputVerifierSource;
+
+/*
+ AudioOutputVerifier
+ Bit-perfect verification: compares the checksum of the PCM frames decoded for a track with the one of the frames
+ actually copied to the device.
+ The IO proc only gathers the rendered samples in a ring, track starts being marked in-band.
+ The ring is hashed by a helper thread (dispatch timer on a serial queue), which also owns the results.
+ Tracks are identified by a serial number, 0 meaning the track is not verified.
+ */
+typedef struct {
+	AudioRingBuffer ring; //Rendered samples, one ring frame being one byte
+	dispatch_queue_t queue;
+	dispatch_source_t drainTimer;
+
+	//Helper queue side
+	AudioOutputVerifierTrack tracks[kAudioOutputVerifierHistory];
+	SInt32 drainingTrack; //Index of the track which rendered samples are hashed, -1 if none
+
+	//Decoding side
+	AudioOutputVerifierSource sources[2]; //At most the playing and the next track
+	OSSpinLock sourcesLock; //Sources updated by the loaders, the main thread and the buffer wiring queue
+	SInt32 lastSerial;
+
+	//IO proc side
+	SInt64 renderNextPosition;
+	SInt32 renderSerial;
+	UInt32 renderPendingFlags;
+} AudioOutputVerifier;
+
+/** AudioOutputVerifierCRC32C
+ @param crc the checksum of the previous bytes, 0 for the first ones
+ @return the updated checksum
+ @comment Uses the SSE4.2 crc32 instruction when built for it, otherwise a slicing-by-8 table
+ */
+UInt32 AudioOutputVerifierCRC32C(UInt32 crc, const void *data, size_t length);
+
+/** AudioOutputVerifierAllocate
+ Allocates the rendered samples ring, and starts the helper thread
+ @return 0 if success
+ */
+int AudioOutputVerifierAllocate(AudioOutputVerifier *verifier);
+void AudioOutputVerifierDeallocate(AudioOutputVerifier *verifier);
+bool AudioOutputVerifierIsAllocated(AudioOutputVerifier *verifier);
+
+/** AudioOutputVerifierReset
+ Discards the rendered samples not yet hashed
+ @comment Must be called only when the IO proc is stopped
+ */
+void AudioOutputVerifierReset(AudioOutputVerifier *verifier);
+
+#pragma mark Decoding side
+
+/** AudioOutputVerifierStartTrack
+ Registers a new track to verify
+ @param name the track name displayed with its results
+ @return the track serial number
+ @comment Called from the main thread
+ */
+SInt32 AudioOutputVerifierStartTrack(AudioOutputVerifier *verifier, const char *name);
+
+/** AudioOutputVerifierHashSource
+ Adds loaded frames to the track source checksum. Frames already hashed are skipped, and frames after
+ a not yet hashed range are left for a later call (next chunk of a split loaded track)
+ @param data the frames, starting at the track position firstFrame
+ @param frames number of frames available in data
+ @comment Called by a single thread for a track: the buffer wiring queue for the buffers, the decoding thread for the streaming ring.
+ The checksum is computed out of the sources lock
+ */
+void AudioOutputVerifierHashSource(AudioOutputVerifier *verifier, SInt32 serial, const void *data,
+								   SInt64 firstFrame, SInt64 frames, UInt32 bytesPerFrame);
+
+/** AudioOutputVerifierRestartSource
+ Restarts the source checksum from another track position, after a seek
+ */
+void AudioOutputVerifierRestartSource(AudioOutputVerifier *verifier, SInt32 serial, SInt64 position);
+
+/** AudioOutputVerifierSourcePosition
+ @return the track position of the next frame to hash, -1 for an unknown track
+ */
+SInt64 AudioOutputVerifierSourcePosition(AudioOutputVerifier *verifier, SInt32 serial);
+
+/** AudioOutputVerifierPostSource
+ Sends the source checksum to the helper thread, if it changed since the last call
+ @param trackEnd the track position after the last loaded frame
+ @param isLoadComplete true if the loader reached the end of the track
+ @param md5Status the decoder own checksum status, kAudioOutputVerifierMD5XXX
+ @comment Called by the thread hashing the track source
+ */
+void AudioOutputVerifierPostSource(AudioOutputVerifier *verifier, SInt32 serial, SInt64 trackEnd, bool isLoadComplete, UInt32 md5Status);
+
+#pragma mark IO proc side
+
+/** AudioOutputVerifierCaptureRendered
+ Copies the rendered samples of a track in the ring, in the track frame layout, from the device streams
+ @param trackPosition the track position of the first rendered frame
+ @param channelData address of the first rendered sample of each channel
+ @param channelStrides distance in bytes between two samples of each channel
+ @comment Real-time safe: no lock nor memory allocation. If the ring is full, the samples are dropped
+ and the track marked as not verifiable
+ */
+void AudioOutputVerifierCaptureRendered(AudioOutputVerifier *verifier, SInt32 serial, SInt64 trackPosition,
+										UInt32 frames, UInt32 channels, UInt32 bytesPerSample,
+										const UInt8 * const *channelData, const UInt32 *channelStrides);
+
+#pragma mark Results
+
+/** AudioOutputVerifierCopyTracks
+ Hashes the pending rendered samples, then returns the tracks results, most recent first
+ @param tracks On output: the tracks results
+ @param maxTracks size of the tracks array
+ @return the number of tracks copied
+ */
+UInt32 AudioOutputVerifierCopyTracks(AudioOutputVerifier *verifier, AudioOutputVerifierTrack *tracks, UInt32 maxTracks);
+
+/** AudioOutputVerifierTrackVerdict
+ @return the track verification verdict, kAudioOutputVerifierXXX
+ */
+UInt32 AudioOutputVerifierTrackVerdict(const AudioOutputVerifierTrack *track);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ AudioOutputVerifier.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <string.h>
+#include <libkern/OSAtomic.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include "AudioOutputVerifier.h"
+
+#define kAudioOutputVerifierSerialMask 0x00FFFFFF //Ring markers carry the serial and, in the upper bits, the render flags
+#define kAudioOutputVerifierFlagsShift 24
+
+#pragma mark CRC32C
+
+#ifndef __SSE4_2__
+static UInt32 crc32cTable[8][256];
+static dispatch_once_t crc32cTableOnce;
+
+static void crc32cBuildTable(void *context)
+{
+	UInt32 i,j,crc;
+
+	for (i=0;i<256;i++) {
+		crc = i;
+		for (j=0;j<8;j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+		crc32cTable[0][i] = crc;
+	}
+	for (i=0;i<256;i++)
+		for (j=1;j<8;j++)
+			crc32cTable[j][i] = (crc32cTable[j-1][i] >> 8) ^ crc32cTable[0][crc32cTable[j-1][i] & 0xFF];
+}
+#endif
+
+UInt32 AudioOutputVerifierCRC32C(UInt32 crc, const void *data, size_t length)
+{
+	const UInt8 *bytes = (const UInt8*)data;
+
+	crc = ~crc;
+
+#ifdef __SSE4_2__
+	while (length && ((uintptr_t)bytes & 7)) {
+		crc = _mm_crc32_u8(crc, *bytes++);
+		length--;
+	}
+#ifdef __x86_64__
+	for (;length>=8;length-=8,bytes+=8)
+		crc = (UInt32)_mm_crc32_u64(crc, *(const UInt64*)bytes);
+#else
+	for (;length>=4;length-=4,bytes+=4)
+		crc = _mm_crc32_u32(crc, *(const UInt32*)bytes);
+#endif
+	while (length--)
+		crc = _mm_crc32_u8(crc, *bytes++);
+#else
+	dispatch_once_f(&crc32cTableOnce, NULL, crc32cBuildTable);
+
+	while (length && ((uintptr_t)bytes & 3)) {
+		crc = crc32cTable[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+		length--;
+	}
+#ifdef __LITTLE_ENDIAN__
+	//Slicing-by-8: 8 bytes per iteration
+	for (;length>=8;length-=8,bytes+=8) {
+		UInt32 low = *(const UInt32*)bytes ^ crc;
+		UInt32 high = *(const UInt32*)(bytes+4);
+
+		crc = crc32cTable[7][low & 0xFF] ^ crc32cTable[6][(low >> 8) & 0xFF]
+			^ crc32cTable[5][(low >> 16) & 0xFF] ^ crc32cTable[4][low >> 24]
+			^ crc32cTable[3][high & 0xFF] ^ crc32cTable[2][(high >> 8) & 0xFF]
+			^ crc32cTable[1][(high >> 16) & 0xFF] ^ crc32cTable[0][high >> 24];
+	}
+#endif
+	while (length--)
+		crc = crc32cTable[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+#endif
+
+	return ~crc;
+}
+
+#pragma mark Helper queue
+
+/* Track record of a serial, created if needed in place of the oldest one. To be called on the helper queue */
+static AudioOutputVerifierTrack* trackForSerial(AudioOutputVerifier *verifier, SInt32 serial)
+{
+	SInt32 i,oldest = 0;
+
+	for (i=0;i<kAudioOutputVerifierHistory;i++) {
+		if (verifier->tracks[i].serial == serial) return &verifier->tracks[i];
+		if (verifier->tracks[i].serial < verifier->tracks[oldest].serial) oldest = i;
+	}
+
+	if (verifier->drainingTrack == oldest) verifier->drainingTrack = -1;
+	memset(&verifier->tracks[oldest], 0, sizeof(AudioOutputVerifierTrack));
+	verifier->tracks[oldest].serial = serial;
+	return &verifier->tracks[oldest];
+}
+
+/* Hashes the rendered samples in the ring, up to the write position. To be called on the helper queue */
+static void drainRing(AudioOutputVerifier *verifier)
+{
+	AudioRingBufferMarker marker;
+	AudioOutputVerifierTrack *track;
+	void *region;
+	UInt32 bytesAvailable;
+
+	for (;;) {
+		bytesAvailable = AudioRingBufferGetReadRegion(&verifier->ring, &region);
+
+		if (bytesAvailable > 0) {
+			if (verifier->drainingTrack >= 0) {
+				track = &verifier->tracks[verifier->drainingTrack];
+				track->rendered.crc = AudioOutputVerifierCRC32C(track->rendered.crc, region, bytesAvailable);
+				track->rendered.bytes += bytesAvailable;
+			}
+			AudioRingBufferCommitRead(&verifier->ring, bytesAvailable);
+		}
+		else if (AudioRingBufferGetNextMarker(&verifier->ring, &marker)
+				 && (marker.framePosition == verifier->ring.readPosition)) {
+			//Start of the rendering of a track, or render flags update
+			track = trackForSerial(verifier, marker.bufferIndex & kAudioOutputVerifierSerialMask);
+			track->flags |= (UInt32)marker.bufferIndex >> kAudioOutputVerifierFlagsShift;
+			verifier->drainingTrack = (SInt32)(track - verifier->tracks);
+			AudioRingBufferPopMarker(&verifier->ring);
+		}
+		else break;
+	}
+}
+
+int AudioOutputVerifierAllocate(AudioOutputVerifier *verifier)
+{
+	memset(verifier, 0, sizeof(AudioOutputVerifier));
+	verifier->drainingTrack = -1;
+
+	if (AudioRingBufferAllocate(&verifier->ring, kAudioOutputVerifierRingBytes, 1) != 0)
+		return -1;
+
+	verifier->queue = dispatch_queue_create("AudioOutputVerifier", NULL);
+	verifier->drainTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, verifier->queue);
+	if ((verifier->queue == NULL) || (verifier->drainTimer == NULL)) {
+		AudioOutputVerifierDeallocate(verifier);
+		return -1;
+	}
+
+	dispatch_source_set_timer(verifier->drainTimer, dispatch_time(DISPATCH_TIME_NOW, 0),
+							  kAudioOutputVerifierDrainIntervalMs*NSEC_PER_MSEC, 10*NSEC_PER_MSEC);
+	dispatch_source_set_event_handler(verifier->drainTimer, ^{ drainRing(verifier); });
+	dispatch_resume(verifier->drainTimer);
+	return 0;
+}
+
+void AudioOutputVerifierDeallocate(AudioOutputVerifier *verifier)
+{
+	if (verifier->drainTimer) {
+		dispatch_source_cancel(verifier->drainTimer);
+		dispatch_release(verifier->drainTimer);
+		verifier->drainTimer = NULL;
+	}
+	if (verifier->queue) {
+		//Wait for the last drain to complete before releasing the ring
+		dispatch_sync(verifier->queue, ^{});
+		dispatch_release(verifier->queue);
+		verifier->queue = NULL;
+	}
+	AudioRingBufferDeallocate(&verifier->ring);
+}
+
+bool AudioOutputVerifierIsAllocated(AudioOutputVerifier *verifier)
+{
+	return (verifier->queue != NULL);
+}
+
+void AudioOutputVerifierReset(AudioOutputVerifier *verifier)
+{
+	if (verifier->queue == NULL) return;
+
+	dispatch_sync(verifier->queue, ^{
+		drainRing(verifier);
+		AudioRingBufferReset(&verifier->ring);
+		verifier->drainingTrack = -1;
+	});
+	verifier->renderSerial = 0;
+	verifier->renderPendingFlags = 0;
+	verifier->renderNextPosition = 0;
+}
+
+#pragma mark Decoding side
+
+static AudioOutputVerifierSource* sourceForSerial(AudioOutputVerifier *verifier, SInt32 serial)
+{
+	if (serial == 0) return NULL;
+	if (verifier->sources[0].serial == serial) return &verifier->sources[0];
+	if (verifier->sources[1].serial == serial) return &verifier->sources[1];
+	return NULL;
+}
+
+SInt32 AudioOutputVerifierStartTrack(AudioOutputVerifier *verifier, const char *name)
+{
+	AudioOutputVerifierSource *source;
+	SInt32 serial;
+	char trackName[kAudioOutputVerifierNameSize];
+
+	if (verifier->queue == NULL) return 0;
+
+	serial = ++verifier->lastSerial & kAudioOutputVerifierSerialMask;
+	if (serial == 0) serial = ++verifier->lastSerial & kAudioOutputVerifierSerialMask;
+
+	//Replace the older of the two tracks
+	OSSpinLockLock(&verifier->sourcesLock);
+	source = (verifier->sources[0].serial <= verifier->sources[1].serial) ? &verifier->sources[0] : &verifier->sources[1];
+	memset(source, 0, sizeof(AudioOutputVerifierSource));
+	source->serial = serial;
+	source->postedFrame = -1;
+	OSSpinLockUnlock(&verifier->sourcesLock);
+
+	strlcpy(trackName, name ? name : "", sizeof(trackName));
+	dispatch_async(verifier->queue, ^{
+		strlcpy(trackForSerial(verifier, serial)->name, trackName, kAudioOutputVerifierNameSize);
+	});
+	return serial;
+}
+
+void AudioOutputVerifierHashSource(AudioOutputVerifier *verifier, SInt32 serial, const void *data,
+								   SInt64 firstFrame, SInt64 frames, UInt32 bytesPerFrame)
+{
+	AudioOutputVerifierSource *source;
+	SInt64 endFrame = firstFrame + frames;
+	SInt64 startFrame;
+	UInt64 bytesToHash;
+	UInt32 crc;
+
+	OSSpinLockLock(&verifier->sourcesLock);
+	source = sourceForSerial(verifier, serial);
+	if ((source == NULL) || (source->nextFrame < firstFrame) || (source->nextFrame >= endFrame)) {
+		OSSpinLockUnlock(&verifier->sourcesLock);
+		return;
+	}
+	startFrame = source->nextFrame;
+	crc = source->checksum.crc;
+	OSSpinLockUnlock(&verifier->sourcesLock);
+
+	//Hashed out of the lock, the result being dropped if the track was replaced or restarted meanwhile
+	bytesToHash = (UInt64)(endFrame - startFrame) * bytesPerFrame;
+	crc = AudioOutputVerifierCRC32C(crc, (const UInt8*)data + (startFrame - firstFrame) * bytesPerFrame, (size_t)bytesToHash);
+
+	OSSpinLockLock(&verifier->sourcesLock);
+	if ((source->serial == serial) && (source->nextFrame == startFrame)) {
+		source->checksum.crc = crc;
+		source->checksum.bytes += bytesToHash;
+		source->nextFrame = endFrame;
+	}
+	OSSpinLockUnlock(&verifier->sourcesLock);
+}
+
+void AudioOutputVerifierRestartSource(AudioOutputVerifier *verifier, SInt32 serial, SInt64 position)
+{
+	AudioOutputVerifierSource *source;
+
+	OSSpinLockLock(&verifier->sourcesLock);
+	source = sourceForSerial(verifier, serial);
+	if (source != NULL) {
+		if ((position != 0) || (source->nextFrame != 0))
+			source->flags |= kAudioOutputVerifierSourcePartial;
+		source->flags &= ~kAudioOutputVerifierSourceComplete;
+		source->nextFrame = position;
+		source->postedFrame = -1;
+		source->checksum.crc = 0;
+		source->checksum.bytes = 0;
+	}
+	OSSpinLockUnlock(&verifier->sourcesLock);
+}
+
+SInt64 AudioOutputVerifierSourcePosition(AudioOutputVerifier *verifier, SInt32 serial)
+{
+	AudioOutputVerifierSource *source;
+	SInt64 position;
+
+	OSSpinLockLock(&verifier->sourcesLock);
+	source = sourceForSerial(verifier, serial);
+	position = source ? source->nextFrame : -1;
+	OSSpinLockUnlock(&verifier->sourcesLock);
+	return position;
+}
+
+void AudioOutputVerifierPostSource(AudioOutputVerifier *verifier, SInt32 serial, SInt64 trackEnd, bool isLoadComplete, UInt32 md5Status)
+{
+	AudioOutputVerifierSource *source;
+	AudioOutputVerifierChecksum checksum;
+	UInt32 flags;
+
+	OSSpinLockLock(&verifier->sourcesLock);
+	source = sourceForSerial(verifier, serial);
+	if ((source == NULL) || (source->postedFrame == -2)) { //-2: already posted as complete
+		OSSpinLockUnlock(&verifier->sourcesLock);
+		return;
+	}
+
+	if (isLoadComplete && (source->nextFrame == trackEnd))
+		source->flags |= kAudioOutputVerifierSourceComplete;
+	else if (source->nextFrame == source->postedFrame) {
+		OSSpinLockUnlock(&verifier->sourcesLock);
+		return;
+	}
+
+	checksum = source->checksum;
+	flags = source->flags;
+	source->postedFrame = (flags & kAudioOutputVerifierSourceComplete) ? -2 : source->nextFrame;
+	OSSpinLockUnlock(&verifier->sourcesLock);
+
+	dispatch_async(verifier->queue, ^{
+		AudioOutputVerifierTrack *track = trackForSerial(verifier, serial);
+		track->source = checksum;
+		track->flags = (track->flags & ~(kAudioOutputVerifierSourceComplete|kAudioOutputVerifierSourcePartial)) | flags;
+		track->md5Status = md5Status;
+	});
+}
+
+#pragma mark IO proc side
+
+void AudioOutputVerifierCaptureRendered(AudioOutputVerifier *verifier, SInt32 serial, SInt64 trackPosition,
+										UInt32 frames, UInt32 channels, UInt32 bytesPerSample,
+										const UInt8 * const *channelData, const UInt32 *channelStrides)
+{
+	AudioRingBuffer *ring = &verifier->ring;
+	UInt32 bytesToWrite = frames*channels*bytesPerSample;
+	UInt32 bytesFree,regionBytes,frame,channel;
+	UInt8 *region,*regionEnd;
+
+	if ((serial == 0) || (ring->capacityFrames == 0) || (frames == 0)) return;
+
+	if (serial != verifier->renderSerial) {
+		if (trackPosition != 0) verifier->renderPendingFlags |= kAudioOutputVerifierRenderDiscontinuity;
+	}
+	else if (trackPosition != verifier->renderNextPosition)
+		verifier->renderPendingFlags |= kAudioOutputVerifierRenderDiscontinuity;
+	verifier->renderNextPosition = trackPosition + frames;
+
+	//Track start and flags are sent in-band, for the helper to apply them to the right samples
+	if ((serial != verifier->renderSerial) || verifier->renderPendingFlags) {
+		if (!AudioRingBufferPushMarker(ring, serial | (SInt32)(verifier->renderPendingFlags << kAudioOutputVerifierFlagsShift))) {
+			verifier->renderPendingFlags |= kAudioOutputVerifierRenderOverrun;
+			return;
+		}
+		verifier->renderSerial = serial;
+		verifier->renderPendingFlags = 0;
+	}
+
+	bytesFree = ring->capacityFrames - (UInt32)(ring->writePosition - ring->readPosition);
+	if (bytesToWrite > bytesFree) {
+		verifier->renderPendingFlags |= kAudioOutputVerifierRenderOverrun;
+		return;
+	}
+
+	//Gather the channels samples as interleaved frames. The ring size being a multiple of the sample size,
+	//a region always ends on a sample boundary
+	frame = 0;
+	channel = 0;
+	while (bytesToWrite > 0) {
+		regionBytes = AudioRingBufferGetWriteRegion(ring, (void**)&region);
+		if (regionBytes > bytesToWrite) regionBytes = bytesToWrite;
+
+		for (regionEnd=region+regionBytes;region<regionEnd;region+=bytesPerSample) {
+			memcpy(region, channelData[channel] + frame*channelStrides[channel], bytesPerSample);
+			if (++channel == channels) {
+				channel = 0;
+				frame++;
+			}
+		}
+		AudioRingBufferCommitWrite(ring, regionBytes);
+		bytesToWrite -= regionBytes;
+	}
+}
+
+#pragma mark Results
+
+UInt32 AudioOutputVerifierCopyTracks(AudioOutputVerifier *verifier, AudioOutputVerifierTrack *tracks, UInt32 maxTracks)
+{
+	__block UInt32 count = 0;
+
+	if (verifier->queue == NULL) return 0;
+
+	dispatch_sync(verifier->queue, ^{
+		AudioOutputVerifierTrack sortedTracks[kAudioOutputVerifierHistory];
+		SInt32 i,j;
+
+		drainRing(verifier);
+		//Insertion sort, most recent first
+		for (i=0;i<kAudioOutputVerifierHistory;i++) {
+			if (verifier->tracks[i].serial == 0) continue;
+			for (j=(SInt32)count;(j>0) && (sortedTracks[j-1].serial < verifier->tracks[i].serial);j--)
+				sortedTracks[j] = sortedTracks[j-1];
+			sortedTracks[j] = verifier->tracks[i];
+			count++;
+		}
+		if (count > maxTracks) count = maxTracks;
+		memcpy(tracks, sortedTracks, count*sizeof(AudioOutputVerifierTrack));
+	});
+	return count;
+}
+
+UInt32 AudioOutputVerifierTrackVerdict(const AudioOutputVerifierTrack *track)
+{
+	if (track->flags & (kAudioOutputVerifierSourcePartial | kAudioOutputVerifierRenderDiscontinuity | kAudioOutputVerifierRenderOverrun))
+		return kAudioOutputVerifierNotVerifiable;
+	if (!(track->flags & kAudioOutputVerifierSourceComplete) || (track->rendered.bytes < track->source.bytes))
+		return kAudioOutputVerifierPending;
+	if ((track->rendered.bytes == track->source.bytes) && (track->rendered.crc == track->source.crc))
+		return kAudioOutputVerifierBitPerfect;
+	return kAudioOutputVerifierMismatch;
+}
@@ -0,0 +1,159 @@
+/*
+ AudioRingBuffer.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#ifndef __AUDIORINGBUFFER_H__
+#define __AUDIORINGBUFFER_H__
+
+#include <stdbool.h>
+#include <MacTypes.h>
+#include <mach/semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioRingBufferMaxMarkers 4
+#define kAudioRingBufferWaitTimeoutMs 500 //Producer wait guard, the waits being normally ended by a signal
+
+/* Track boundary marker, carried in-band with the audio frames
+ framePosition is the absolute ring position of the first frame of the track */
+typedef struct {
+	SInt64 framePosition;
+	SInt32 bufferIndex; //Index of the AudioBufferItem controlling the track
+} AudioRingBufferMarker;
+
+/*
+ AudioRingBuffer
+ Single producer (the decoding thread) / single consumer (the IO proc) lock-free ring of PCM frames
+ Read and write positions are absolute frame counts, only incremented, the offset in the ring
+ being the position modulo the capacity.
+ Data and markers are made visible to the consumer by a memory barrier before the position update
+ The producer blocks on semaphores when the ring is full or when waiting for its turn, the consumer
+ signaling it only once enough frames are free, so that neither side polls
+ */
+typedef struct {
+	void *data;
+	UInt64 dataSizeInBytes;
+	volatile SInt64 writePosition;
+	volatile SInt64 readPosition;
+	AudioRingBufferMarker markers[kAudioRingBufferMaxMarkers];
+	volatile SInt32 markersWritten;
+	volatile SInt32 markersRead;
+	volatile SInt32 nextProducerBuffer; //Index of the buffer allowed to stream its track next, for tracks to be written in playing order
+	volatile UInt32 producerWaitFrames; //Free frames the producer is waiting for, 0 if it is not waiting for frames
+	volatile bool isProducerWaitingMarker; //Producer waiting for a free marker
+	semaphore_t producerSpaceSemaphore; //Signaled by the consumer when the producer wait is satisfied
+	semaphore_t producerTurnSemaphore; //Signaled when nextProducerBuffer changes
+	UInt32 capacityFrames;
+	UInt32 bytesPerFrame;
+} AudioRingBuffer;
+
+/** AudioRingBufferAllocate
+ Allocates the ring memory
+ @param ring the ring buffer to initialize
+ @param capacityFrames the ring size in frames
+ @param bytesPerFrame the frame size
+ @return 0 if success
+ */
+int AudioRingBufferAllocate(AudioRingBuffer *ring, UInt32 capacityFrames, UInt32 bytesPerFrame);
+void AudioRingBufferDeallocate(AudioRingBuffer *ring);
+
+/** AudioRingBufferReset
+ Discards all the frames and markers not yet read
+ @comment Must be called only when both the producer and the consumer are stopped
+ */
+void AudioRingBufferReset(AudioRingBuffer *ring);
+
+/** AudioRingBufferDiscardTrack
+ Removes from the ring the not yet read track of a buffer, and all what was written after it
+ @param bufferIndex the buffer which track is to be discarded
+ @return true if the track marker was found in the not yet read part of the ring
+ @comment Must be called only when both the producer and the consumer are stopped
+ */
+bool AudioRingBufferDiscardTrack(AudioRingBuffer *ring, SInt32 bufferIndex);
+
+/** AudioRingBufferIsTrackPending
+ @return true if the track of the buffer has started to be written in the ring and its start is not yet read
+ */
+bool AudioRingBufferIsTrackPending(AudioRingBuffer *ring, SInt32 bufferIndex);
+
+UInt32 AudioRingBufferFillFrames(AudioRingBuffer *ring);
+
+#pragma mark Producer side
+
+/** AudioRingBufferGetWriteRegion
+ @param region On output: the address where to write the frames
+ @return the number of frames that can be written in one piece, up to the ring end
+ */
+UInt32 AudioRingBufferGetWriteRegion(AudioRingBuffer *ring, void **region);
+void AudioRingBufferCommitWrite(AudioRingBuffer *ring, UInt32 framesWritten);
+
+/** AudioRingBufferPushMarker
+ Marks the current write position as the start of the track of a buffer
+ @return false if the markers queue is full
+ */
+bool AudioRingBufferPushMarker(AudioRingBuffer *ring, SInt32 bufferIndex);
+
+/** AudioRingBufferWaitForSpace
+ Blocks the producer until the consumer has freed enough of the ring
+ @param minFrames number of free frames to wait for, clipped to the ring capacity
+ @param needsMarker true to wait for a free marker too
+ @comment Returns early when woken up by AudioRingBufferWakeProducers, the caller has to check again its conditions
+ */
+void AudioRingBufferWaitForSpace(AudioRingBuffer *ring, UInt32 minFrames, bool needsMarker);
+
+/** AudioRingBufferWaitForTurn
+ Blocks the producer until nextProducerBuffer is bufferIndex
+ @comment Returns early when woken up by AudioRingBufferWakeProducers, the caller has to check again its conditions
+ */
+void AudioRingBufferWaitForTurn(AudioRingBuffer *ring, SInt32 bufferIndex);
+
+/** AudioRingBufferSetNextProducer
+ Lets the producer of the buffer write its track, waking it up if it is waiting for its turn
+ */
+void AudioRingBufferSetNextProducer(AudioRingBuffer *ring, SInt32 bufferIndex);
+
+/** AudioRingBufferWakeProducers
+ Wakes up the waiting producers, e.g. for them to see their decoding has been aborted
+ */
+void AudioRingBufferWakeProducers(AudioRingBuffer *ring);
+
+#pragma mark Consumer side
+
+/** AudioRingBufferGetReadRegion
+ @param region On output: the address of the frames to read
+ @return the number of frames that can be read in one piece, up to the ring end or the next track marker
+ */
+UInt32 AudioRingBufferGetReadRegion(AudioRingBuffer *ring, void **region);
+void AudioRingBufferCommitRead(AudioRingBuffer *ring, UInt32 framesRead);
+
+/** AudioRingBufferGetNextMarker
+ @param marker On output: the next track marker not yet passed
+ @return false if no marker is pending
+ */
+bool AudioRingBufferGetNextMarker(AudioRingBuffer *ring, AudioRingBufferMarker *marker);
+void AudioRingBufferPopMarker(AudioRingBuffer *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
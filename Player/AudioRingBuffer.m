@@ -0,0 +1,264 @@
+/*
+ AudioRingBuffer.m
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+#include <libkern/OSAtomic.h>
+#include </usr/include/mach/vm_map.h>
+#include <mach/mach_init.h>
+#include <mach/task.h>
+#include <mach/semaphore.h>
+
+#include "AudioRingBuffer.h"
+
+int AudioRingBufferAllocate(AudioRingBuffer *ring, UInt32 capacityFrames, UInt32 bytesPerFrame)
+{
+	kern_return_t theKernelError;
+
+	ring->capacityFrames = capacityFrames;
+	ring->bytesPerFrame = bytesPerFrame;
+	ring->dataSizeInBytes = (UInt64)capacityFrames * bytesPerFrame;
+	ring->writePosition = 0;
+	ring->readPosition = 0;
+	ring->markersWritten = 0;
+	ring->markersRead = 0;
+	ring->nextProducerBuffer = 0;
+	ring->producerWaitFrames = 0;
+	ring->isProducerWaitingMarker = false;
+
+	theKernelError = vm_allocate(mach_task_self(),
+								 (vm_address_t*)&ring->data,
+								 (vm_size_t)ring->dataSizeInBytes,
+								 VM_FLAGS_ANYWHERE);
+	if (theKernelError != KERN_SUCCESS) {
+		ring->data = NULL;
+		ring->dataSizeInBytes = 0;
+		ring->capacityFrames = 0;
+		return -1;
+	}
+
+	if ((semaphore_create(mach_task_self(), &ring->producerSpaceSemaphore, SYNC_POLICY_FIFO, 0) != KERN_SUCCESS)
+		|| (semaphore_create(mach_task_self(), &ring->producerTurnSemaphore, SYNC_POLICY_FIFO, 0) != KERN_SUCCESS)) {
+		AudioRingBufferDeallocate(ring);
+		return -1;
+	}
+	return 0;
+}
+
+void AudioRingBufferDeallocate(AudioRingBuffer *ring)
+{
+	if (ring->data) {
+		vm_deallocate(mach_task_self(), (vm_address_t)ring->data, (vm_size_t)ring->dataSizeInBytes);
+		ring->data = NULL;
+	}
+	if (ring->producerSpaceSemaphore) {
+		semaphore_destroy(mach_task_self(), ring->producerSpaceSemaphore);
+		ring->producerSpaceSemaphore = 0;
+	}
+	if (ring->producerTurnSemaphore) {
+		semaphore_destroy(mach_task_self(), ring->producerTurnSemaphore);
+		ring->producerTurnSemaphore = 0;
+	}
+	ring->dataSizeInBytes = 0;
+	ring->capacityFrames = 0;
+}
+
+void AudioRingBufferReset(AudioRingBuffer *ring)
+{
+	ring->readPosition = ring->writePosition;
+	ring->markersRead = ring->markersWritten;
+	OSMemoryBarrier();
+}
+
+bool AudioRingBufferDiscardTrack(AudioRingBuffer *ring, SInt32 bufferIndex)
+{
+	SInt32 i;
+
+	for (i=ring->markersRead;i<ring->markersWritten;i++) {
+		if (ring->markers[i % kAudioRingBufferMaxMarkers].bufferIndex == bufferIndex) {
+			ring->writePosition = ring->markers[i % kAudioRingBufferMaxMarkers].framePosition;
+			ring->markersWritten = i;
+			OSMemoryBarrier();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AudioRingBufferIsTrackPending(AudioRingBuffer *ring, SInt32 bufferIndex)
+{
+	SInt32 i;
+
+	for (i=ring->markersRead;i<ring->markersWritten;i++) {
+		if (ring->markers[i % kAudioRingBufferMaxMarkers].bufferIndex == bufferIndex)
+			return true;
+	}
+	return false;
+}
+
+UInt32 AudioRingBufferFillFrames(AudioRingBuffer *ring)
+{
+	return (UInt32)(ring->writePosition - ring->readPosition);
+}
+
+#pragma mark Producer side
+
+UInt32 AudioRingBufferGetWriteRegion(AudioRingBuffer *ring, void **region)
+{
+	SInt64 writePosition = ring->writePosition;
+	UInt32 offset,freeFrames;
+
+	if (ring->capacityFrames == 0) return 0;
+
+	offset = (UInt32)(writePosition % ring->capacityFrames);
+	freeFrames = ring->capacityFrames - (UInt32)(writePosition - ring->readPosition);
+
+	//Contiguous part only, the remaining one will be given at the next call
+	if (freeFrames > (ring->capacityFrames - offset))
+		freeFrames = ring->capacityFrames - offset;
+
+	*region = (UInt8*)ring->data + (UInt64)offset*ring->bytesPerFrame;
+	return freeFrames;
+}
+
+void AudioRingBufferCommitWrite(AudioRingBuffer *ring, UInt32 framesWritten)
+{
+	//Frames data must be visible before the consumer sees the new write position
+	OSAtomicAdd64Barrier(framesWritten, &ring->writePosition);
+}
+
+bool AudioRingBufferPushMarker(AudioRingBuffer *ring, SInt32 bufferIndex)
+{
+	AudioRingBufferMarker *marker;
+
+	if ((ring->markersWritten - ring->markersRead) >= kAudioRingBufferMaxMarkers)
+		return false;
+
+	marker = &ring->markers[ring->markersWritten % kAudioRingBufferMaxMarkers];
+	marker->framePosition = ring->writePosition;
+	marker->bufferIndex = bufferIndex;
+
+	OSAtomicIncrement32Barrier(&ring->markersWritten);
+	return true;
+}
+
+void AudioRingBufferWaitForSpace(AudioRingBuffer *ring, UInt32 minFrames, bool needsMarker)
+{
+	mach_timespec_t timeout = { 0, kAudioRingBufferWaitTimeoutMs*1000000 };
+
+	if (minFrames > ring->capacityFrames) minFrames = ring->capacityFrames;
+	if (minFrames == 0) minFrames = 1;
+
+	if (needsMarker)
+		ring->isProducerWaitingMarker = true;
+	else
+		ring->producerWaitFrames = minFrames;
+	OSMemoryBarrier();
+
+	//The consumer may have read before seeing the wait request: check again before blocking
+	if (needsMarker ? ((ring->markersWritten - ring->markersRead) >= kAudioRingBufferMaxMarkers)
+		: ((ring->capacityFrames - (UInt32)(ring->writePosition - ring->readPosition)) < minFrames))
+		semaphore_timedwait(ring->producerSpaceSemaphore, timeout);
+
+	ring->producerWaitFrames = 0;
+	ring->isProducerWaitingMarker = false;
+}
+
+void AudioRingBufferWaitForTurn(AudioRingBuffer *ring, SInt32 bufferIndex)
+{
+	mach_timespec_t timeout = { 0, kAudioRingBufferWaitTimeoutMs*1000000 };
+
+	//Turn changes are counted by the semaphore, so a change made before the wait is not lost
+	if (ring->nextProducerBuffer != bufferIndex)
+		semaphore_timedwait(ring->producerTurnSemaphore, timeout);
+}
+
+void AudioRingBufferSetNextProducer(AudioRingBuffer *ring, SInt32 bufferIndex)
+{
+	ring->nextProducerBuffer = bufferIndex;
+	OSMemoryBarrier();
+	if (ring->producerTurnSemaphore) semaphore_signal(ring->producerTurnSemaphore);
+}
+
+void AudioRingBufferWakeProducers(AudioRingBuffer *ring)
+{
+	if (ring->producerSpaceSemaphore) semaphore_signal(ring->producerSpaceSemaphore);
+	if (ring->producerTurnSemaphore) semaphore_signal(ring->producerTurnSemaphore);
+}
+
+#pragma mark Consumer side
+
+UInt32 AudioRingBufferGetReadRegion(AudioRingBuffer *ring, void **region)
+{
+	SInt64 readPosition = ring->readPosition;
+	SInt64 readLimit = ring->writePosition;
+	AudioRingBufferMarker marker;
+	UInt32 offset,availableFrames;
+
+	if (ring->capacityFrames == 0) return 0;
+
+	//Never read past the next track start: the IO proc has to process the marker first
+	if (AudioRingBufferGetNextMarker(ring, &marker) && (marker.framePosition < readLimit))
+		readLimit = marker.framePosition;
+
+	OSMemoryBarrier();
+
+	offset = (UInt32)(readPosition % ring->capacityFrames);
+	availableFrames = (UInt32)(readLimit - readPosition);
+	if (availableFrames > (ring->capacityFrames - offset))
+		availableFrames = ring->capacityFrames - offset;
+
+	*region = (UInt8*)ring->data + (UInt64)offset*ring->bytesPerFrame;
+	return availableFrames;
+}
+
+void AudioRingBufferCommitRead(AudioRingBuffer *ring, UInt32 framesRead)
+{
+	UInt32 waitFrames;
+
+	OSAtomicAdd64Barrier(framesRead, &ring->readPosition);
+
+	//Wake up the producer only once enough frames are free, not on each IO cycle
+	//semaphore_signal does not block, and can be called from the IO proc
+	waitFrames = ring->producerWaitFrames;
+	if ((waitFrames != 0)
+		&& ((ring->capacityFrames - (UInt32)(ring->writePosition - ring->readPosition)) >= waitFrames)) {
+		ring->producerWaitFrames = 0;
+		semaphore_signal(ring->producerSpaceSemaphore);
+	}
+}
+
+bool AudioRingBufferGetNextMarker(AudioRingBuffer *ring, AudioRingBufferMarker *marker)
+{
+	if (ring->markersRead == ring->markersWritten) return false;
+
+	OSMemoryBarrier();
+	*marker = ring->markers[ring->markersRead % kAudioRingBufferMaxMarkers];
+	return true;
+}
+
+void AudioRingBufferPopMarker(AudioRingBuffer *ring)
+{
+	OSAtomicIncrement32Barrier(&ring->markersRead);
+
+	if (ring->isProducerWaitingMarker) {
+		ring->isProducerWaitingMarker = false;
+		semaphore_signal(ring->producerSpaceSemaphore);
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ AudioSampleRatePolicy.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#include <stdbool.h>
+#include <math.h>
+
+#include "AudioSampleRatePolicy.h"
+
+Float64 AudioSampleRatePolicyConversionCost(Float64 fromRate, Float64 toRate)
+{
+	Float64 ratio = (fromRate > toRate) ? fromRate / toRate : toRate / fromRate;
+
+	return (ratio == floor(ratio)) ? kAudioSampleRatePolicyIntegerRatioCost : kAudioSampleRatePolicyFractionalRatioCost;
+}
+
+void AudioSampleRatePolicyDecide(const AudioSampleRatePolicyTransition *transition, AudioSampleRatePolicyDecision *decision)
+{
+	UInt32 i;
+	bool returnsToPlayingRate = false;
+
+	decision->action = kAudioSampleRatePolicyReclock;
+	decision->runLength = 1;
+	decision->switchesAvoided = 0;
+	decision->switchCost = 0;
+	decision->conversionCost = 0;
+
+	//Run of tracks at the next rate, and rate after it
+	//Native rates are compared: the track after the run plays at the device rate either natively, or converted as the
+	//playing one is
+	for (i=0;i<transition->upcomingCount;i++) {
+		if (transition->upcomingNativeRates[i] != transition->nextNativeRate) {
+			returnsToPlayingRate = (transition->upcomingNativeRates[i] == transition->playingNativeRate)
+				|| (transition->upcomingNativeRates[i] == transition->playingRate);
+			break;
+		}
+		decision->runLength++;
+	}
+
+	//Converting saves the switch to the next rate, and the switch back if the run is followed by the playing rate
+	decision->switchesAvoided = returnsToPlayingRate ? 2 : 1;
+	decision->switchCost = decision->switchesAvoided * transition->switchDuration;
+	decision->conversionCost = decision->runLength * AudioSampleRatePolicyConversionCost(transition->nextRate, transition->playingRate);
+
+	switch (transition->mode) {
+		case kAudioSampleRatePolicyGapless:
+			decision->action = kAudioSampleRatePolicyResample;
+			decision->reason = "gapless playback preferred";
+			break;
+
+		case kAudioSampleRatePolicyAdaptive:
+			if (transition->nextRate > transition->playingRate)
+				decision->reason = "conversion would downsample";
+			else if (decision->switchCost > decision->conversionCost) {
+				decision->action = kAudioSampleRatePolicyResample;
+				decision->reason = "switch gap exceeds conversion cost";
+			}
+			else decision->reason = "conversion cost exceeds switch gap";
+			break;
+
+		case kAudioSampleRatePolicyBitPerfect:
+		default:
+			decision->reason = "bit-perfect playback preferred";
+			break;
+	}
+}
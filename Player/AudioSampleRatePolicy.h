@@ -0,0 +1,96 @@
+/*
+ AudioSampleRatePolicy.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOSAMPLERATEPOLICY_H__
+#define __AUDIOSAMPLERATEPOLICY_H__
+
+#include <MacTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define kAudioSampleRatePolicyMaxLookahead 16 //Max number of tracks after the next one whose rates are examined
+#define kAudioSampleRatePolicyDefaultSwitchDuration 0.5 //Device rate switch duration (s) assumed until one is measured
+#define kAudioSampleRatePolicyIntegerRatioCost 0.5 //Penalty (s of gap equivalent) of converting one track by an integer ratio
+#define kAudioSampleRatePolicyFractionalRatioCost 1.0 //Same, across rate families (e.g. 44.1kHz <-> 48kHz)
+
+/*
+ Policy modes, for the tracks transitions at another sample rate
+ */
+enum {
+	kAudioSampleRatePolicyBitPerfect = 0, //Always re-clock the device: no conversion, the IO proc pauses during the switch
+	kAudioSampleRatePolicyAdaptive, //Convert the next track when the device switches it avoids cost more than the conversion
+	kAudioSampleRatePolicyGapless //Never re-clock the device between tracks: convert the next track to the playing rate
+};
+
+/*
+ Decisions
+ */
+enum {
+	kAudioSampleRatePolicyReclock = 0,
+	kAudioSampleRatePolicyResample
+};
+
+/*
+ AudioSampleRatePolicyTransition
+ The transition from the playing track to the next one, and the native rates of the following tracks
+ */
+typedef struct {
+	Float64 playingRate; //Device rate the playing track is played at
+	Float64 playingNativeRate; //Differs from playingRate when the playing track is itself converted
+	Float64 nextRate; //Rate the next track would be played at without conversion to the playing rate
+	Float64 nextNativeRate;
+	Float64 upcomingNativeRates[kAudioSampleRatePolicyMaxLookahead]; //Tracks after the next one, in playing order
+	Float64 switchDuration; //Gap of a device rate switch: measured on the device, plus the settling delay set in the preferences
+	UInt32 upcomingCount;
+	UInt32 mode;
+} AudioSampleRatePolicyTransition;
+
+typedef struct {
+	Float64 switchCost; //Gap (s) of the device switches avoided by converting
+	Float64 conversionCost; //Penalty (s of gap equivalent) of converting the tracks until the switch happens anyway
+	UInt32 action; //kAudioSampleRatePolicyReclock or kAudioSampleRatePolicyResample
+	UInt32 runLength; //Number of tracks at the next rate, the next one included
+	UInt32 switchesAvoided;
+	const char *reason;
+} AudioSampleRatePolicyDecision;
+
+/** AudioSampleRatePolicyDecide
+ Decides whether the device is switched to the next track rate, or the next track converted to the playing rate
+ @param transition the playing and next tracks rates, with the lookahead of the following ones
+ @param decision the action, with the costs it is based on
+ @comment The tracks at the next rate are expected to be converted as well while the decision holds, as they then
+ follow a track at the playing rate: the conversion cost accounts for the whole run of tracks at the next rate
+ */
+void AudioSampleRatePolicyDecide(const AudioSampleRatePolicyTransition *transition, AudioSampleRatePolicyDecision *decision);
+
+/** AudioSampleRatePolicyConversionCost
+ @return the penalty of converting one track from a rate to another
+ */
+Float64 AudioSampleRatePolicyConversionCost(Float64 fromRate, Float64 toRate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -91,6 +91,11 @@ typedef enum {
 - (IBAction)cancelAddingTrack:(id)sender;
 
 - (NSURL*)nextFile;
+/** upcomingFiles
+ @param maxCount the maximum number of files returned
+ @return the files that nextFile will return, in order, without changing the loaded track
+ */
+- (NSArray*)upcomingFiles:(NSUInteger)maxCount;
 - (NSURL*)firstFileWhenStartingPlayback;
 - (NSURL*)fileAtIndex:(NSInteger)index;
 - (void)refreshTableDisplay;
@@ -25,6 +25,8 @@
 
 #import "AudioFileLoader.h"
 
+#define PROBE_BATCH_FILES 64 //Files of a folder whose metadata are probed concurrently before their insertion
+
 //Playlist changes notifications
 NSString * const AUDPlaylistItemInsertedAtLoadedPositionNotification = @"AUDPlaylistItemInsertedAtLoadedPositionNotification";
 NSString * const AUDPlaylistItemAppendedtoPlaylistNotification = @"AUDPlaylistItemAppendedtoPlaylistNotification";
@@ -39,6 +41,7 @@ NSString * const AUDTogglePlaylistShuffle = @"AUDTogglePlaylistShuffle";
 
 @interface PlaylistDocument (PrivateMethods)
 - (bool)insertPlaylistItem:(NSURL*)itemURL atRow:(NSUInteger)row;
+- (bool)insertPlaylistItem:(NSURL*)itemURL withMetadata:(NSDictionary*)metadata atRow:(NSUInteger)row;
 @end
 
 
@@ -223,22 +226,45 @@ NSString * const AUDTogglePlaylistShuffle = @"AUDTogglePlaylistShuffle";
                              locale:[NSLocale currentLocale]];
     }];
 	NSUInteger dirSize = [dirFiles count];
+	NSUInteger batchStart,batchSize,i;
+	NSURL *batchFileList[PROBE_BATCH_FILES];
+	NSDictionary *batchMetadataList[PROBE_BATCH_FILES];
+	NSURL **batchFiles = batchFileList; //Arrays can't be captured by blocks
+	NSDictionary **batchMetadata = batchMetadataList;
 
 	if (mAddingTracksInBackground)
 		dispatch_async(dispatch_get_main_queue(),
 				   ^{[addingTracksProgress setMaxValue:[addingTracksProgress maxValue] + dirSize];});
 
-	for (NSURL *filesInDir in dirFiles) {
-		if (mAbortAddingTracks) break;
-		if (![filesInDir getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]
-			|| ![isDirectory boolValue]) {
+	//Metadata probes are mostly waiting for the file system (network mounts): run them concurrently,
+	//the insertions staying serial and in the folder order
+	for (batchStart=0;(batchStart < dirSize) && !mAbortAddingTracks;batchStart+=PROBE_BATCH_FILES) {
+		NSUInteger batchEnd = MIN(batchStart + PROBE_BATCH_FILES, dirSize);
+
+		for (i=batchStart,batchSize=0;i<batchEnd;i++) {
+			NSURL *filesInDir = [dirFiles objectAtIndex:i];
 			//Do not handle sub-directories listed, as enumeration is already deep
-			if ([AudioFileLoader isFormatSupported:filesInDir])
-				if ([self insertPlaylistItem:filesInDir atRow:[playlist count]-insertRevIdx])
-					nbItemsInserted++;
+			if ((![filesInDir getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]
+				 || ![isDirectory boolValue])
+				&& [AudioFileLoader isFormatSupported:filesInDir])
+				batchFiles[batchSize++] = filesInDir;
+		}
+
+		dispatch_apply(batchSize, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t fileIdx) {
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			batchMetadata[fileIdx] = [[AudioFileLoader probeMetadata:batchFiles[fileIdx]] retain];
+			[pool drain];
+		});
+
+		for (i=0;i<batchSize;i++) {
+			if (!mAbortAddingTracks && batchMetadata[i]
+				&& [self insertPlaylistItem:batchFiles[i] withMetadata:batchMetadata[i] atRow:[playlist count]-insertRevIdx])
+				nbItemsInserted++;
+			[batchMetadata[i] release];
 		}
+
 		if (mAddingTracksInBackground)
-			dispatch_async(dispatch_get_main_queue(), ^{[addingTracksProgress incrementBy:1.0f];});
+			dispatch_async(dispatch_get_main_queue(), ^{[addingTracksProgress incrementBy:(double)(batchEnd - batchStart)];});
 	}
 
 
@@ -248,26 +274,35 @@ NSString * const AUDTogglePlaylistShuffle = @"AUDTogglePlaylistShuffle";
 
 /* Insert playlist item, may be called by the background queue */
 - (bool)insertPlaylistItem:(NSURL*)itemURL atRow:(NSUInteger)row
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	bool isInserted = [self insertPlaylistItem:itemURL withMetadata:[AudioFileLoader probeMetadata:itemURL] atRow:row];
+
+	[pool drain];
+	return isInserted;
+}
+
+/* Insert playlist item from its probed metadata, may be called by the background queue */
+- (bool)insertPlaylistItem:(NSURL*)itemURL withMetadata:(NSDictionary*)metadata atRow:(NSUInteger)row
 {
 	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 
-    AudioFileLoader *fileLoader = [[AudioFileLoader createWithURL:itemURL] retain];
-	if (fileLoader) {
+	if (metadata) {
         NSUInteger previousPlaylistSize = [playlist count];
 		PlaylistItem *newItem = [[PlaylistItem alloc]init];
 		[newItem setFileURL:itemURL];
-		NSString *str = [fileLoader title];
+		NSString *str = [metadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_Title]];
 		[newItem setTitle:str?str:[itemURL lastPathComponent]];
-		str = [fileLoader album];
+		str = [metadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_Album]];
 		if (str) [newItem setAlbum:str];
-		str = [fileLoader artist];
+		str = [metadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_Artist]];
 		if (str) [newItem setArtist:str];
-		str = [fileLoader composer];
+		str = [metadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_Composer]];
 		if (str) [newItem setComposer:str];
-		[newItem setDurationInSeconds:[fileLoader durationInSeconds]];
-		[newItem setTrackNumber:[fileLoader trackNumber]];
-		[fileLoader close];
-		[fileLoader release];
+		id obj = [metadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_ApproximateDurationInSeconds]];
+		[newItem setDurationInSeconds:obj?[obj floatValue]:(float)-1.0];
+		obj = [metadata objectForKey:[NSString stringWithUTF8String: kAFInfoDictionary_TrackNumber]];
+		[newItem setTrackNumber:obj?[obj intValue]:0];
 
         //Used to check if not playing: mPlayingTrackIndex changes in the playlist selection cursor event notification handler
         NSInteger currentPlayingTrackIndex = mPlayingTrackIndex;
@@ -699,6 +734,29 @@ NSString * const AUDTogglePlaylistShuffle = @"AUDTogglePlaylistShuffle";
 	return [[playlist objectAtIndex:mLoadedTrackIndex] fileURL];
 }
 
+- (NSArray*)upcomingFiles:(NSUInteger)maxCount
+{
+	NSMutableArray *files = [NSMutableArray arrayWithCapacity:maxCount];
+	NSInteger nonShuffledIndex = mLoadedTrackNonShuffledIndex;
+	NSInteger trackIndex;
+
+	while ([files count] < MIN(maxCount, [playlist count])) {
+		if ([playlist count] <= (UInt32)(nonShuffledIndex+1)) {
+			if (mIsRepeating) nonShuffledIndex = 0;
+			else break; //End of playlist reached
+		}
+		else nonShuffledIndex++;
+
+		if (mIsShuffling)
+			trackIndex = [[mShuffleIndexes objectAtIndex:nonShuffledIndex] longValue];
+		else trackIndex = nonShuffledIndex;
+
+		[files addObject:[[playlist objectAtIndex:trackIndex] fileURL]];
+	}
+
+	return files;
+}
+
 - (NSURL*)firstFileWhenStartingPlayback
 {
     if ((mLoadedTrackIndex <0)|| ((NSUInteger)mLoadedTrackIndex >= [playlist count])) return nil;
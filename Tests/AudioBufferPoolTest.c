@@ -0,0 +1,302 @@
+/*
+ AudioBufferPoolTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+/* Buffer pool test and page faults benchmark
+ Checks the size classes, the regions recycling, the allocations beyond the pool slots being fully returned to the
+ system, the wired window bookkeeping when the wired memory limit is reached, and the prefaulting of the mapped
+ buffers. The benchmark counts the page
+ faults of successive track loads into fresh allocations, as before the pool, and into the pool regions */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <mach/mach.h>
+
+#include "AudioTest.h"
+#include "AudioBufferPool.h"
+
+#define kTestMB (1024*1024)
+#define kBenchTrackSize (96*kTestMB) //A CD quality track of 9 minutes, in float
+#define kBenchTrackLoads 8
+
+static void testSizeClasses(void)
+{
+	static const UInt64 sizes[] = { 1, 4096, kAudioBufferPoolMinClassSize, kAudioBufferPoolMinClassSize + 1,
+		10*kTestMB, 100*kTestMB + 12345, 1000*(UInt64)kTestMB };
+	bool isMonotonic = true, isBounded = true;
+	UInt64 size, sizeClass, previousClass = 0;
+	UInt32 i;
+
+	for (i=0;i<sizeof(sizes)/sizeof(sizes[0]);i++) {
+		sizeClass = AudioBufferPoolSizeClass(sizes[i]);
+		AudioTestCheck(sizeClass >= sizes[i]);
+		AudioTestCheck(sizeClass % kAudioBufferPoolMinClassSize == 0);
+		AudioTestCheck(AudioBufferPoolSizeClass(sizeClass) == sizeClass);
+	}
+
+	for (size=kTestMB;size<2000*(UInt64)kTestMB;size+=kTestMB + 4096) {
+		sizeClass = AudioBufferPoolSizeClass(size);
+		if (sizeClass < previousClass) isMonotonic = false;
+		if ((sizeClass - size >= size/kAudioBufferPoolClassSteps) && (sizeClass - size >= kAudioBufferPoolMinClassSize)) isBounded = false;
+		previousClass = sizeClass;
+	}
+	AudioTestCheck(isMonotonic);
+	AudioTestCheck(isBounded);
+}
+
+static void testRecycling(void)
+{
+	AudioBufferPool pool;
+	void *first, *second, *third;
+
+	AudioBufferPoolInit(&pool, 0, 1024*(UInt64)kTestMB);
+
+	first = AudioBufferPoolAcquire(&pool, 20*kTestMB);
+	AudioTestCheck(first != NULL);
+	((UInt8*)first)[20*kTestMB - 1] = 1;
+	AudioBufferPoolRelease(&pool, first, 20*kTestMB);
+
+	//Same class: recycled, not cleared
+	second = AudioBufferPoolAcquire(&pool, 19*kTestMB);
+	AudioTestCheck(second == first);
+	AudioTestCheck(((UInt8*)second)[20*kTestMB - 1] == 1);
+	AudioTestCheck((pool.allocations == 1) && (pool.recycles == 1));
+
+	//Region in use: a new one
+	third = AudioBufferPoolAcquire(&pool, 19*kTestMB);
+	AudioTestCheck((third != NULL) && (third != second));
+	AudioTestCheck(pool.allocations == 2);
+
+	AudioBufferPoolRelease(&pool, second, 19*kTestMB);
+	AudioBufferPoolRelease(&pool, third, 19*kTestMB);
+
+	//Much smaller requests do not take the big free regions
+	first = AudioBufferPoolAcquire(&pool, kTestMB);
+	AudioTestCheck((first != second) && (first != third));
+	AudioBufferPoolRelease(&pool, first, kTestMB);
+
+	//Free regions limit
+	AudioBufferPoolSetOptions(&pool, 0, 0);
+	AudioTestCheck(pool.regions[0].data == NULL);
+	AudioBufferPoolDispose(&pool);
+}
+
+/* @return the process virtual memory size, 0 if unknown */
+static UInt64 virtualSize(void)
+{
+#ifdef __APPLE__
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+	return info.virtual_size;
+#else
+	FILE *statm = fopen("/proc/self/statm", "r");
+	unsigned long pages = 0;
+
+	if (statm == NULL) return 0;
+	if (fscanf(statm, "%lu", &pages) != 1) pages = 0;
+	fclose(statm);
+	return (UInt64)pages * (UInt64)getpagesize();
+#endif
+}
+
+static void testOverflowAllocations(void)
+{
+	const UInt64 size = 3*kTestMB + 4096; //Class 4MB
+	void *regions[kAudioBufferPoolMaxRegions];
+	AudioBufferPool pool;
+	UInt64 mappedSize;
+	void *overflow;
+	UInt32 i;
+
+	AudioBufferPoolInit(&pool, 0, 1024*(UInt64)kTestMB);
+	for (i=0;i<kAudioBufferPoolMaxRegions;i++)
+		regions[i] = AudioBufferPoolAcquire(&pool, size);
+
+	//All slots in use: deallocated on release with the requested size, nothing left mapped
+	mappedSize = virtualSize();
+	overflow = AudioBufferPoolAcquire(&pool, size);
+	AudioTestCheck(overflow != NULL);
+	AudioTestCheck(pool.allocations == kAudioBufferPoolMaxRegions + 1);
+	memset(overflow, 0xA5, (size_t)size);
+	AudioBufferPoolRelease(&pool, overflow, size);
+	AudioTestCheck(virtualSize() == mappedSize);
+
+	for (i=0;i<kAudioBufferPoolMaxRegions;i++)
+		AudioBufferPoolRelease(&pool, regions[i], size);
+	AudioBufferPoolDispose(&pool);
+}
+
+static void testLockWindow(void)
+{
+	const UInt64 pageSize = (UInt64)getpagesize();
+	AudioBufferPool pool;
+	AudioBufferPoolRegion *region;
+	struct rlimit initialLimit, limit;
+	bool isLimitSet;
+	UInt8 *data;
+
+	AudioBufferPoolInit(&pool, 0, 0);
+	data = (UInt8*)AudioBufferPoolAcquire(&pool, 16*kTestMB);
+	region = &pool.regions[0];
+	AudioTestCheck(region->data == data);
+
+	//Unaligned window rounded to the pages
+	AudioBufferPoolLockWindow(&pool, data, 16*kTestMB, 100, kTestMB);
+	AudioTestCheck(region->lockedOffset == 0);
+	if (region->lockedSize > 0) //Else the wired memory limit is below 1MB
+		AudioTestCheck(region->lockedSize == ((100 + kTestMB + pageSize - 1) & ~(pageSize - 1)));
+
+	//Wired memory limit reached moving forward: the bookkeeping is the pages still wired
+	getrlimit(RLIMIT_MEMLOCK, &initialLimit);
+	limit = initialLimit;
+	limit.rlim_cur = 2*kTestMB;
+	isLimitSet = (setrlimit(RLIMIT_MEMLOCK, &limit) == 0);
+
+	AudioBufferPoolLockWindow(&pool, data, 16*kTestMB, 0, kTestMB);
+	AudioBufferPoolLockWindow(&pool, data, 16*kTestMB, kTestMB/2, 4*kTestMB);
+	AudioTestCheck(region->lockedOffset == kTestMB/2);
+	//Not enforced when privileged
+	AudioTestCheck((region->lockedSize == 4*kTestMB) || (region->lockedSize == kTestMB/2) || !isLimitSet);
+
+	if (isLimitSet) setrlimit(RLIMIT_MEMLOCK, &initialLimit);
+
+	//Window beyond the buffer: clipped
+	AudioBufferPoolLockWindow(&pool, data, 16*kTestMB, 15*kTestMB, 4*kTestMB);
+	AudioTestCheck((region->lockedSize == 0) || (region->lockedOffset + region->lockedSize == region->size));
+
+	AudioBufferPoolRelease(&pool, data, 16*kTestMB);
+	AudioTestCheck(region->lockedSize == 0);
+	AudioBufferPoolDispose(&pool);
+}
+
+static long minorPageFaults(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_minflt;
+}
+
+/* Reads one byte per page, returning the page faults taken */
+static long touchPages(const UInt8 *start, const UInt8 *end)
+{
+	volatile UInt8 sum = 0;
+	long faults = minorPageFaults();
+	for (;start<end;start+=getpagesize()) sum += *start;
+	return minorPageFaults() - faults;
+}
+
+static void testPrefaultMappedWindow(void)
+{
+	const UInt64 fileSize = 8*kTestMB, bufferOffset = 100, bufferSize = 4*kTestMB;
+	AudioBufferPool pool;
+	FILE *file;
+	UInt8 *mapped, *data;
+
+	file = tmpfile();
+	AudioTestCheck(file != NULL);
+	if (file == NULL) return;
+	ftruncate(fileno(file), (off_t)fileSize);
+	mapped = (UInt8*)mmap(NULL, (size_t)fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+	AudioTestCheck(mapped != MAP_FAILED);
+	if (mapped == MAP_FAILED) { fclose(file); return; }
+	data = mapped + bufferOffset; //As a data chunk mapped from its page
+
+	AudioBufferPoolInit(&pool, 0, 0);
+
+	//Not from the pool: the window pages are faulted in, the play head not faulting on them. A cancel stops only
+	//the prefault in progress
+	AudioBufferPoolCancelPrefault(&pool);
+	AudioBufferPoolLockWindow(&pool, data, bufferSize, kTestMB + 10, kTestMB);
+	AudioTestCheck(touchPages(data + kTestMB + 10, data + 2*kTestMB + 10) == 0);
+	AudioTestCheck(pool.regions[0].data == NULL);
+
+	//Window beyond the buffer: clipped, the rest of the mapping untouched
+	AudioBufferPoolLockWindow(&pool, data, bufferSize, bufferSize - kTestMB, 4*kTestMB);
+	AudioTestCheck(touchPages(data + bufferSize - kTestMB, data + bufferSize) == 0);
+	AudioTestCheck(touchPages(mapped + 6*kTestMB, mapped + fileSize) > 0);
+	AudioBufferPoolLockWindow(&pool, data, bufferSize, bufferSize, kTestMB);
+
+	AudioBufferPoolDispose(&pool);
+	munmap(mapped, (size_t)fileSize);
+	fclose(file);
+}
+
+#pragma mark Benchmark
+
+/* Decoding writes all the buffer pages */
+static void loadTrack(UInt8 *buffer)
+{
+	UInt64 i;
+	for (i=0;i<kBenchTrackSize;i+=4096) buffer[i] = (UInt8)i;
+}
+
+static void benchmarkPageFaults(void)
+{
+	AudioBufferPool pool;
+	vm_address_t address;
+	long faults;
+	double start, elapsed;
+	void *data;
+	int i;
+
+	faults = minorPageFaults();
+	start = AudioTestTime();
+	for (i=0;i<kBenchTrackLoads;i++) {
+		if (vm_allocate(mach_task_self(), &address, kBenchTrackSize, VM_FLAGS_ANYWHERE) != KERN_SUCCESS) return;
+		loadTrack((UInt8*)address);
+		vm_deallocate(mach_task_self(), address, kBenchTrackSize);
+	}
+	elapsed = AudioTestTime() - start;
+	printf("%-56s %10.0f page faults/track %8.1f ms/track\n", "track loads in fresh allocations",
+		   (double)(minorPageFaults() - faults)/kBenchTrackLoads, 1000.0*elapsed/kBenchTrackLoads);
+
+	AudioBufferPoolInit(&pool, 0, 2*(UInt64)kBenchTrackSize);
+	faults = minorPageFaults();
+	start = AudioTestTime();
+	for (i=0;i<kBenchTrackLoads;i++) {
+		data = AudioBufferPoolAcquire(&pool, kBenchTrackSize);
+		if (data == NULL) break;
+		loadTrack((UInt8*)data);
+		AudioBufferPoolRelease(&pool, data, kBenchTrackSize);
+	}
+	elapsed = AudioTestTime() - start;
+	printf("%-56s %10.0f page faults/track %8.1f ms/track\n", "track loads in the pool regions",
+		   (double)(minorPageFaults() - faults)/kBenchTrackLoads, 1000.0*elapsed/kBenchTrackLoads);
+	AudioBufferPoolDispose(&pool);
+}
+
+int main(int argc, char *argv[])
+{
+	testSizeClasses();
+	testRecycling();
+	testOverflowAllocations();
+	testLockWindow();
+	testPrefaultMappedWindow();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkPageFaults();
+	return AudioTestResult("AudioBufferPoolTest");
+}
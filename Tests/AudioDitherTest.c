@@ -0,0 +1,271 @@
+/*
+ AudioDitherTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+/* Requantization test and benchmark
+ Checks the outputs are on the target integer grid and within the dither bounds, the TPDF dither
+ error power being independent of the signal, and the noise shaping loop staying stable and
+ moving the error power out of the low frequencies. The benchmark gives the frames/s of each mode */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "AudioTest.h"
+#include "AudioDither.h"
+
+#define kTestChannels 2
+#define kTestFrames 4096
+#define kTestLevels 64 //Input levels between two grid steps
+#define kTestStatFrames 65536
+
+#define countof(array) (sizeof(array)/sizeof((array)[0]))
+
+static const UInt32 kTestModes[] = { kAudioNoDithering, kAudioDitheringLinear, kAudioDitheringTriangle, kAudioDitheringNoiseShaping };
+static const char *kTestModeNames[] = { "no dithering", "RPDF", "TPDF", "noise shaping" };
+
+static bool isOnGrid(Float64 sample, Float64 maxValue)
+{
+	Float64 value = sample * maxValue;
+	return (value == floor(value)) && (value >= -maxValue) && (value <= maxValue - 1.0);
+}
+
+/* Requantization error, in LSB, of a constant input set between two grid steps
+ @return the largest error, the mean and the mean square being returned too */
+static Float64 measureError(UInt32 mode, bool isFloat64, UInt32 targetBits, Float64 inputLSB,
+							Float64 *mean, Float64 *meanSquare, bool *isGridCorrect)
+{
+	const Float64 maxValue = ldexp(1.0, targetBits - 1);
+	AudioDitherState dither;
+	Float64 sum = 0, sumSquare = 0, maxError = 0;
+	UInt32 i;
+
+	AudioDitherInit(&dither, mode);
+	*isGridCorrect = true;
+
+	if (isFloat64) {
+		Float64 *samples = (Float64*)malloc(kTestStatFrames*kTestChannels*sizeof(Float64));
+		for (i=0;i<kTestStatFrames*kTestChannels;i++) samples[i] = inputLSB / maxValue;
+		AudioDitherRequantizeFloat64(&dither, samples, kTestStatFrames, kTestChannels, targetBits);
+		for (i=0;i<kTestStatFrames*kTestChannels;i++) {
+			Float64 error = samples[i]*maxValue - inputLSB;
+			if (!isOnGrid(samples[i], maxValue)) *isGridCorrect = false;
+			sum += error;
+			sumSquare += error*error;
+			if (fabs(error) > maxError) maxError = fabs(error);
+		}
+		free(samples);
+	}
+	else {
+		Float32 *samples = (Float32*)malloc(kTestStatFrames*kTestChannels*sizeof(Float32));
+		const Float32 input = (Float32)(inputLSB / maxValue);
+		for (i=0;i<kTestStatFrames*kTestChannels;i++) samples[i] = input;
+		AudioDitherRequantizeFloat32(&dither, samples, kTestStatFrames, kTestChannels, targetBits);
+		for (i=0;i<kTestStatFrames*kTestChannels;i++) {
+			Float64 error = (Float64)samples[i]*maxValue - (Float64)input*maxValue;
+			if (!isOnGrid(samples[i], maxValue)) *isGridCorrect = false;
+			sum += error;
+			sumSquare += error*error;
+			if (fabs(error) > maxError) maxError = fabs(error);
+		}
+		free(samples);
+	}
+
+	*mean = sum / (kTestStatFrames*kTestChannels);
+	*meanSquare = sumSquare / (kTestStatFrames*kTestChannels);
+	return maxError;
+}
+
+/* RPDF error is within 1 LSB with a zero mean, TPDF one within 1.5 LSB with a signal independent
+ power of 1/4 LSB^2 (1/12 of rounding + 2/12 of dither), for both the SSE2 (float) and scalar (double) kernels */
+static void testDitherBounds(void)
+{
+	static const UInt32 targetBits[] = { 16, 24 };
+	UInt32 b, level, precision;
+	Float64 mean, meanSquare, maxError;
+	bool isGridCorrect;
+
+	for (precision=0;precision<2;precision++)
+		for (b=0;b<countof(targetBits);b++)
+			for (level=0;level<kTestLevels;level++) {
+				Float64 inputLSB = 1000.0 + (Float64)level/kTestLevels;
+
+				maxError = measureError(kAudioDitheringLinear, precision, targetBits[b], inputLSB, &mean, &meanSquare, &isGridCorrect);
+				AudioTestCheck(isGridCorrect);
+				AudioTestCheck(maxError <= 1.0);
+				AudioTestCheck(fabs(mean) < 0.02);
+
+				maxError = measureError(kAudioDitheringTriangle, precision, targetBits[b], inputLSB, &mean, &meanSquare, &isGridCorrect);
+				AudioTestCheck(isGridCorrect);
+				AudioTestCheck(maxError < 1.5);
+				AudioTestCheck(fabs(mean) < 0.02);
+				AudioTestCheck(fabs(meanSquare - 0.25) < 0.02);
+				if (fabs(meanSquare - 0.25) >= 0.02)
+					fprintf(stderr, "  TPDF %u bits at %f LSB: error power %f\n", (unsigned)targetBits[b], inputLSB, meanSquare);
+			}
+}
+
+/* Saturation at the integer format bounds, and the modes and flags that leave the samples untouched */
+static void testClipping(void)
+{
+	UInt32 m, i;
+
+	for (m=1;m<countof(kTestModes);m++) {
+		AudioDitherState dither;
+		Float32 samples[kTestFrames*kTestChannels];
+
+		AudioDitherInit(&dither, kTestModes[m]);
+		for (i=0;i<kTestFrames*kTestChannels;i++) samples[i] = (i & 2) ? 1.0f : -1.0f;
+		AudioDitherRequantizeFloat32(&dither, samples, kTestFrames, kTestChannels, 16);
+		for (i=0;i<kTestFrames*kTestChannels;i++)
+			AudioTestCheck((samples[i] >= -1.0f) && (samples[i] <= 32767.0f/32768.0f));
+	}
+
+	for (m=0;m<countof(kTestModes);m++) {
+		AudioDitherState dither;
+
+		AudioDitherInit(&dither, kTestModes[m]);
+		AudioTestCheck(!AudioDitherIsNeeded(&dither, 32));
+		AudioTestCheck(AudioDitherIsNeeded(&dither, 16) == (kTestModes[m] != kAudioNoDithering));
+		AudioDitherInit(&dither, kTestModes[m] | kAudioDither16bit);
+		AudioTestCheck(!AudioDitherIsNeeded(&dither, 24));
+	}
+}
+
+/* Fraction of the error power below fs/8, from the error smoothed by an 8 taps moving average */
+static Float64 lowBandErrorFraction(const Float64 *errors, UInt32 count)
+{
+	Float64 total = 0, low = 0;
+	UInt32 i, k;
+
+	for (i=8;i<count;i++) {
+		Float64 average = 0;
+		for (k=0;k<8;k++) average += errors[i-k];
+		average /= 8;
+		low += average*average;
+		total += errors[i]*errors[i];
+	}
+	return low / total;
+}
+
+/* The error feedback loop must stay bounded on a full scale sine and on clipped square waves,
+ and its error spectrum must have less low frequency power than the TPDF dither one */
+static void testNoiseShaping(void)
+{
+	const Float64 maxValue = 32768.0;
+	AudioDitherState dither;
+	Float64 *samples = (Float64*)malloc(kTestStatFrames*sizeof(Float64));
+	Float64 *errors = (Float64*)malloc(kTestStatFrames*sizeof(Float64));
+	Float64 maxError = 0, shapedLowFraction, tpdfLowFraction;
+	UInt32 i, k;
+	bool isHistoryBounded = true;
+
+	//Sine just below full scale
+	AudioDitherInit(&dither, kAudioDitheringNoiseShaping);
+	for (i=0;i<kTestStatFrames;i++) samples[i] = 0.999 * sin(2*M_PI*1000.0*i/44100.0) * (maxValue-1)/maxValue;
+	for (i=0;i<kTestStatFrames;i++) errors[i] = samples[i];
+	AudioDitherRequantizeFloat64(&dither, samples, kTestStatFrames, 1, 16);
+	for (i=0;i<kTestStatFrames;i++) {
+		errors[i] = (samples[i] - errors[i]) * maxValue;
+		if (fabs(errors[i]) > maxError) maxError = fabs(errors[i]);
+	}
+	//Bound of the filtered error fed back plus the TPDF dither and rounding
+	AudioTestCheck(maxError < 2.0*(2.033 + 2.165 + 1.959 + 1.590 + 0.6149) + 1.5);
+	shapedLowFraction = lowBandErrorFraction(errors, kTestStatFrames);
+
+	//Clipped square wave: the error history has to stay limited
+	AudioDitherInit(&dither, kAudioDitheringNoiseShaping);
+	for (i=0;i<kTestStatFrames;i++) samples[i] = ((i / 50) & 1) ? 1.5 : -1.5;
+	AudioDitherRequantizeFloat64(&dither, samples, kTestStatFrames, 1, 16);
+	for (i=0;i<kTestStatFrames;i++)
+		AudioTestCheck(isfinite(samples[i]) && (samples[i] >= -1.0) && (samples[i] <= (maxValue-1)/maxValue));
+	for (k=0;k<kAudioDitherShapingOrder;k++)
+		if (!isfinite(dither.shapingError[0][k]) || (fabs(dither.shapingError[0][k]) > 2.0f)) isHistoryBounded = false;
+	AudioTestCheck(isHistoryBounded);
+
+	//Same sine with the TPDF dither only
+	AudioDitherInit(&dither, kAudioDitheringTriangle);
+	for (i=0;i<kTestStatFrames;i++) samples[i] = 0.999 * sin(2*M_PI*1000.0*i/44100.0) * (maxValue-1)/maxValue;
+	for (i=0;i<kTestStatFrames;i++) errors[i] = samples[i];
+	AudioDitherRequantizeFloat64(&dither, samples, kTestStatFrames, 1, 16);
+	for (i=0;i<kTestStatFrames;i++) errors[i] = (samples[i] - errors[i]) * maxValue;
+	tpdfLowFraction = lowBandErrorFraction(errors, kTestStatFrames);
+
+	AudioTestCheck(shapedLowFraction < 0.25*tpdfLowFraction);
+	if (shapedLowFraction >= 0.25*tpdfLowFraction)
+		fprintf(stderr, "  low band error fraction: shaped %f, TPDF %f\n", shapedLowFraction, tpdfLowFraction);
+
+	free(samples);
+	free(errors);
+}
+
+#pragma mark Benchmark
+
+typedef struct {
+	AudioDitherState dither;
+	Float32 samples32[kTestFrames*kTestChannels];
+	Float64 samples64[kTestFrames*kTestChannels];
+	UInt32 targetBits;
+} BenchContext;
+
+static void benchFloat32(void *context)
+{
+	BenchContext *bench = (BenchContext*)context;
+	AudioDitherRequantizeFloat32(&bench->dither, bench->samples32, kTestFrames, kTestChannels, bench->targetBits);
+}
+
+static void benchFloat64(void *context)
+{
+	BenchContext *bench = (BenchContext*)context;
+	AudioDitherRequantizeFloat64(&bench->dither, bench->samples64, kTestFrames, kTestChannels, bench->targetBits);
+}
+
+static void benchModes(void)
+{
+	BenchContext *bench = (BenchContext*)malloc(sizeof(BenchContext));
+	char name[128];
+	UInt32 m, i;
+
+	for (i=0;i<kTestFrames*kTestChannels;i++) {
+		bench->samples32[i] = (Float32)(0.5*sin(i*0.01));
+		bench->samples64[i] = 0.5*sin(i*0.01);
+	}
+	for (bench->targetBits=16;bench->targetBits<=24;bench->targetBits+=8)
+		for (m=1;m<countof(kTestModes);m++) {
+			AudioDitherInit(&bench->dither, kTestModes[m]);
+			snprintf(name, sizeof(name), "stereo float to %ubit, %s", (unsigned)bench->targetBits, kTestModeNames[m]);
+			AudioTestBenchmark(name, "frames", kTestFrames, benchFloat32, bench);
+			snprintf(name, sizeof(name), "stereo double to %ubit, %s", (unsigned)bench->targetBits, kTestModeNames[m]);
+			AudioTestBenchmark(name, "frames", kTestFrames, benchFloat64, bench);
+		}
+	free(bench);
+}
+
+int main(int argc, char *argv[])
+{
+	testDitherBounds();
+	testClipping();
+	testNoiseShaping();
+
+	if (AudioTestIsBenchmark(argc, argv))
+		benchModes();
+
+	return AudioTestResult("AudioDitherTest");
+}
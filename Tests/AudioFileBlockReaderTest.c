@@ -0,0 +1,243 @@
+/*
+ AudioFileBlockReaderTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+/* Block reader test and benchmark
+ Checks random seeks and reads return the file bytes, by blocks and mapped, across the blocks boundaries and at the
+ end of the file, and that read errors are reported. The benchmark reads a file through a throttled read function
+ standing in for a network share: the stdio sized reads the decoding libraries did, against the prefetched blocks */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "AudioTest.h"
+#include "AudioFileBlockReader.h"
+
+#define kTestFileSize (5*kAudioFileBlockReaderBlockSize/2 + 12345) //Last block partial
+#define kTestRandomReads 2000
+#define kTestMaxReadSize (kAudioFileBlockReaderBlockSize + 4096)
+
+#define kBenchFileSize (8*1024*1024)
+#define kBenchLatencyUs 500 //Per request, as an SMB round trip on a LAN
+#define kBenchBytesPerSecond (100.0*1024*1024) //Gigabit link
+#define kBenchStdioReadSize 4096 //stdio buffer of the decoding libraries
+#define kBenchDecoderReadSize 16384
+
+static UInt8 patternByte(SInt64 offset)
+{
+	UInt32 value = (UInt32)offset * 2654435761u;
+	return (UInt8)((value >> 24) ^ (UInt32)(offset >> 16));
+}
+
+static bool writeTestFile(const char *path, SInt64 size)
+{
+	FILE *file = fopen(path, "wb");
+	SInt64 i;
+
+	if (file == NULL) return false;
+	for (i=0;i<size;i++) fputc(patternByte(i), file);
+	return (fclose(file) == 0);
+}
+
+static bool isPattern(const UInt8 *data, SInt64 offset, SInt64 size)
+{
+	SInt64 i;
+
+	for (i=0;i<size;i++)
+		if (data[i] != patternByte(offset + i)) return false;
+	return true;
+}
+
+static SInt64 randomValue(SInt64 range)
+{
+	return (SInt64)((((UInt64)rand() << 31) ^ (UInt64)rand()) % (UInt64)range);
+}
+
+#pragma mark Random seeks and reads
+
+static void testRandomReads(const char *path, UInt32 options)
+{
+	AudioFileBlockReader *reader = AudioFileBlockReaderOpen(path, options);
+	UInt8 *buffer = (UInt8*)malloc(kTestMaxReadSize);
+	SInt64 position, size, expectedSize, bytesRead;
+	bool isDataCorrect = true, isPositionCorrect = true;
+	int i;
+
+	AudioTestCheck(reader != NULL);
+	if (reader == NULL) { free(buffer); return; }
+	AudioTestCheck(AudioFileBlockReaderLength(reader) == kTestFileSize);
+
+	//Whole file sequentially, by decoder sized reads
+	for (position=0;(bytesRead = AudioFileBlockReaderRead(reader, buffer, kBenchDecoderReadSize)) > 0;position+=bytesRead)
+		if (!isPattern(buffer, position, bytesRead)) isDataCorrect = false;
+	AudioTestCheck(isDataCorrect);
+	AudioTestCheck(position == kTestFileSize);
+	AudioTestCheck(AudioFileBlockReaderIsAtEnd(reader));
+	AudioTestCheck(AudioFileBlockReaderRead(reader, buffer, 1) == 0);
+
+	//Random seeks, the reads crossing blocks and the end of the file
+	for (i=0;i<kTestRandomReads;i++) {
+		switch (i % 4) {
+			case 0:
+				position = AudioFileBlockReaderSeek(reader, randomValue(kTestFileSize + 1), SEEK_SET);
+				break;
+			case 1: //Around a block boundary
+				position = AudioFileBlockReaderSeek(reader, (randomValue(2) + 1)*kAudioFileBlockReaderBlockSize - randomValue(64), SEEK_SET);
+				break;
+			case 2:
+				position = AudioFileBlockReaderSeek(reader, -randomValue(kAudioFileBlockReaderBlockSize), SEEK_END);
+				break;
+			default: //Backward and forward from the current position
+				position = AudioFileBlockReaderTell(reader);
+				size = randomValue(kAudioFileBlockReaderBlockSize) - position/2;
+				position = AudioFileBlockReaderSeek(reader, (position + size > kTestFileSize) ? -position/2 : size, SEEK_CUR);
+				break;
+		}
+		if ((position < 0) || (AudioFileBlockReaderTell(reader) != position)) { isPositionCorrect = false; continue; }
+
+		size = (i % 8 == 0) ? kTestMaxReadSize : randomValue(kBenchDecoderReadSize*4) + 1;
+		expectedSize = (size < kTestFileSize - position) ? size : kTestFileSize - position;
+		bytesRead = AudioFileBlockReaderRead(reader, buffer, size);
+		if ((bytesRead != expectedSize) || !isPattern(buffer, position, bytesRead)) isDataCorrect = false;
+		if (AudioFileBlockReaderTell(reader) != position + expectedSize) isPositionCorrect = false;
+	}
+	AudioTestCheck(isDataCorrect);
+	AudioTestCheck(isPositionCorrect);
+
+	//Out of the file seeks are refused, the position being kept
+	position = AudioFileBlockReaderTell(reader);
+	AudioTestCheck(AudioFileBlockReaderSeek(reader, -1, SEEK_SET) == -1);
+	AudioTestCheck(AudioFileBlockReaderSeek(reader, 1, SEEK_END) == -1);
+	AudioTestCheck(AudioFileBlockReaderTell(reader) == position);
+	AudioTestCheck(AudioFileBlockReaderSeek(reader, 0, SEEK_END) == kTestFileSize);
+	AudioTestCheck(AudioFileBlockReaderIsAtEnd(reader));
+
+	AudioFileBlockReaderClose(reader);
+	free(buffer);
+}
+
+static ssize_t failingRead(int fd, void *buffer, size_t size, off_t offset)
+{
+	(void)fd; (void)buffer; (void)size; (void)offset;
+	return -1;
+}
+
+static void testReadError(const char *path)
+{
+	AudioFileBlockReader *reader;
+	UInt8 buffer[16];
+
+	AudioFileBlockReaderSetReadProc(failingRead);
+	reader = AudioFileBlockReaderOpen(path, 0);
+	AudioTestCheck(reader != NULL);
+	if (reader) {
+		AudioTestCheck(AudioFileBlockReaderRead(reader, buffer, sizeof(buffer)) == -1);
+		AudioTestCheck(AudioFileBlockReaderRead(reader, buffer, sizeof(buffer)) == -1); //Retried, still failing
+		AudioFileBlockReaderClose(reader);
+	}
+	AudioFileBlockReaderSetReadProc(NULL);
+
+	AudioTestCheck(AudioFileBlockReaderOpen("/nonexistent/file", 0) == NULL);
+}
+
+#pragma mark Benchmark
+
+/* A network share stand in: a round trip latency per request, then the link bandwidth */
+static ssize_t throttledRead(int fd, void *buffer, size_t size, off_t offset)
+{
+	ssize_t bytesRead = pread(fd, buffer, size, offset);
+
+	if (bytesRead > 0)
+		usleep(kBenchLatencyUs + (useconds_t)(1e6*(double)bytesRead/kBenchBytesPerSecond));
+	return bytesRead;
+}
+
+/* Reads of the decoder through a stdio buffer, each refill being a request */
+static double benchStdioReads(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	UInt8 *buffer = (UInt8*)malloc(kBenchStdioReadSize);
+	double start = AudioTestTime();
+	SInt64 offset = 0;
+	ssize_t bytesRead;
+
+	while ((bytesRead = throttledRead(fd, buffer, kBenchStdioReadSize, (off_t)offset)) > 0)
+		offset += bytesRead;
+
+	free(buffer);
+	close(fd);
+	return (double)offset / (AudioTestTime() - start);
+}
+
+static double benchBlockReader(const char *path, UInt32 options)
+{
+	AudioFileBlockReader *reader;
+	UInt8 *buffer = (UInt8*)malloc(kBenchDecoderReadSize);
+	double start = AudioTestTime();
+	SInt64 offset = 0, bytesRead;
+
+	AudioFileBlockReaderSetReadProc(throttledRead);
+	reader = AudioFileBlockReaderOpen(path, options);
+	while ((bytesRead = AudioFileBlockReaderRead(reader, buffer, kBenchDecoderReadSize)) > 0)
+		offset += bytesRead;
+	AudioFileBlockReaderClose(reader);
+	AudioFileBlockReaderSetReadProc(NULL);
+
+	free(buffer);
+	return (double)offset / (AudioTestTime() - start);
+}
+
+static void benchmarkThrottledShare(void)
+{
+	char path[] = "/tmp/AudioFileBlockReaderBench.XXXXXX";
+	int fd = mkstemp(path);
+
+	if (fd < 0) return;
+	close(fd);
+	if (writeTestFile(path, kBenchFileSize)) {
+		AudioTestReportRate("throttled share, 4KB stdio reads", "B", benchStdioReads(path));
+		AudioTestReportRate("throttled share, 2MB prefetched blocks", "B", benchBlockReader(path, 0));
+		AudioTestReportRate("local file, mapped", "B", benchBlockReader(path, kAudioFileBlockReaderAllowMapping));
+	}
+	unlink(path);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[] = "/tmp/AudioFileBlockReaderTest.XXXXXX";
+	int fd = mkstemp(path);
+
+	AudioTestCheck(fd >= 0);
+	if (fd >= 0) {
+		close(fd);
+		AudioTestCheck(writeTestFile(path, kTestFileSize));
+		testRandomReads(path, 0);
+		testRandomReads(path, kAudioFileBlockReaderAllowMapping);
+		testReadError(path);
+		unlink(path);
+	}
+
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkThrottledShare();
+	return AudioTestResult("AudioFileBlockReaderTest");
+}
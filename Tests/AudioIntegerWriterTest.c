@@ -0,0 +1,235 @@
+/*
+ AudioIntegerWriterTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+/* Integer mode writers round trip test and benchmark
+ Writes random samples from each source format in each device format, and reads them back: the significant
+ bits must be kept, the bits above the aligned low ones being zero. Float samples must be rounded to the nearest
+ integer and saturated. The benchmark gives the samples/s of each writer */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "AudioTest.h"
+#include "AudioIntegerWriter.h"
+
+#define kTestMaxSamples 4099
+#define kTestBenchSamples 8192
+
+#define countof(array) (sizeof(array)/sizeof((array)[0]))
+
+static const AudioIntegerWriterFormat kTestFormats[] = {
+	{ 2, 16, false, false }, { 2, 16, true, false },
+	{ 3, 24, false, false }, { 3, 24, true, false }, { 3, 20, false, false },
+	{ 4, 32, false, false }, { 4, 32, true, false },
+	{ 4, 24, false, false }, { 4, 24, true, false },
+	{ 4, 24, false, true }, { 4, 24, true, true },
+	{ 4, 20, false, true }, { 4, 20, true, true }
+};
+static const UInt32 kTestSampleCounts[] = { 0, 1, 3, 4, 5, 8, 4099 };
+static const char *kTestSourceNames[] = { "int32", "float32", "float64" };
+
+/* Device container to its unsigned 32bit value, and to the significant bits value */
+static UInt32 readContainer(const AudioIntegerWriterFormat *format, const UInt8 *sample)
+{
+	UInt32 value = 0;
+	UInt32 i;
+
+	for (i=0;i<format->bytesPerSample;i++)
+		value |= (UInt32)sample[format->isBigEndian ? i : (format->bytesPerSample - 1 - i)] << (8*(format->bytesPerSample - 1 - i));
+	return value;
+}
+
+static SInt32 readSample(const AudioIntegerWriterFormat *format, const UInt8 *sample)
+{
+	UInt32 value = readContainer(format, sample);
+
+	if (format->isAlignedLow)
+		value <<= 32 - format->bitsPerSample;
+	else
+		value <<= 32 - 8*format->bytesPerSample;
+	return (SInt32)value >> (32 - format->bitsPerSample);
+}
+
+/* Random significant bits value, representable as a 32bit float for the float sources */
+static SInt32 randomValue(UInt32 bitsPerSample, bool isFloat32Exact)
+{
+	SInt32 value = (SInt32)(((UInt32)rand() << 16) ^ (UInt32)rand()) >> (32 - bitsPerSample);
+
+	if (isFloat32Exact && (bitsPerSample > 24))
+		value &= ~((1 << (bitsPerSample - 24)) - 1);
+	return value;
+}
+
+static void fillSource(UInt32 sourceFormat, void *src, SInt32 value, UInt32 index, UInt32 bitsPerSample)
+{
+	const Float64 fullScale = ldexp(1.0, bitsPerSample - 1);
+
+	switch (sourceFormat) {
+		case kAudioIntegerWriterSourceInt32:
+			//Bits below the significant ones are ignored
+			((SInt32*)src)[index] = (SInt32)((UInt32)value << (32 - bitsPerSample));
+			if (bitsPerSample < 32) ((SInt32*)src)[index] |= (SInt32)((UInt32)rand() >> bitsPerSample);
+			break;
+		case kAudioIntegerWriterSourceFloat32:
+			((Float32*)src)[index] = (Float32)((Float64)value / fullScale);
+			break;
+		case kAudioIntegerWriterSourceFloat64:
+			((Float64*)src)[index] = (Float64)value / fullScale;
+			break;
+	}
+}
+
+static void testRoundTrip(const AudioIntegerWriterFormat *format, const AudioIntegerWriter *writer, UInt32 sourceFormat)
+{
+	SInt32 *values = (SInt32*)malloc(kTestMaxSamples*sizeof(SInt32));
+	Float64 *src = (Float64*)malloc(kTestMaxSamples*sizeof(Float64));
+	UInt8 *dst = (UInt8*)malloc(kTestMaxSamples*format->bytesPerSample + 4);
+	UInt32 count,i;
+
+	for (count=0;count<countof(kTestSampleCounts);count++) {
+		const UInt32 nbSamples = kTestSampleCounts[count];
+		bool isKept = true, isUpperZero = true;
+
+		for (i=0;i<nbSamples;i++) {
+			values[i] = randomValue(format->bitsPerSample, sourceFormat == kAudioIntegerWriterSourceFloat32);
+			if (i == 0) values[i] = -1; //All the significant bits set
+			fillSource(sourceFormat, src, values[i], i, format->bitsPerSample);
+		}
+		memset(dst + nbSamples*format->bytesPerSample, 0xA5, 4); //Guard
+
+		AudioIntegerWriterWrite(writer, sourceFormat, dst, src, nbSamples);
+
+		for (i=0;i<nbSamples;i++) {
+			const UInt8 *sample = dst + i*format->bytesPerSample;
+
+			if (readSample(format, sample) != values[i]) isKept = false;
+			if (format->isAlignedLow && ((readContainer(format, sample) >> format->bitsPerSample) != 0)) isUpperZero = false;
+		}
+		AudioTestCheck(isKept);
+		AudioTestCheck(isUpperZero);
+		AudioTestCheck((dst[nbSamples*format->bytesPerSample] == 0xA5) && (dst[nbSamples*format->bytesPerSample + 3] == 0xA5));
+	}
+
+	free(values);
+	free(src);
+	free(dst);
+}
+
+/* Float samples between two integers, and beyond the full scale */
+static void testRoundingAndSaturation(const AudioIntegerWriterFormat *format, const AudioIntegerWriter *writer)
+{
+	const Float64 fullScale = ldexp(1.0, format->bitsPerSample - 1);
+	const SInt32 maxValue = (SInt32)(fullScale - 1.0);
+	const Float64 inputs[] = { 10.25, 10.75, -10.25, -10.75, 2.0*fullScale, -2.0*fullScale, fullScale, -fullScale,
+		3.25, -3.75, 1.0e9*fullScale, -1.0e9*fullScale };
+	const SInt32 expected[] = { 10, 11, -10, -11, maxValue, -maxValue - 1, maxValue, -maxValue - 1, 3, -4, maxValue, -maxValue - 1 };
+	Float32 src32[countof(inputs)];
+	Float64 src64[countof(inputs)];
+	UInt8 dst[countof(inputs)*4];
+	SInt32 written;
+	UInt32 i;
+	bool isCorrect32 = true, isCorrect64 = true;
+
+	for (i=0;i<countof(inputs);i++) {
+		src64[i] = inputs[i] / fullScale;
+		src32[i] = (Float32)src64[i];
+	}
+
+	AudioIntegerWriterWrite(writer, kAudioIntegerWriterSourceFloat64, dst, src64, countof(inputs));
+	for (i=0;i<countof(inputs);i++)
+		if (readSample(format, dst + i*format->bytesPerSample) != expected[i]) isCorrect64 = false;
+	AudioTestCheck(isCorrect64);
+
+	AudioIntegerWriterWrite(writer, kAudioIntegerWriterSourceFloat32, dst, src32, countof(inputs));
+	for (i=0;i<countof(inputs);i++) {
+		written = readSample(format, dst + i*format->bytesPerSample);
+		//The 32bit format full scale is not a float: its largest one is 128 below
+		if (written != expected[i] && !((format->bitsPerSample == 32) && (expected[i] == maxValue) && (written == maxValue - 127)))
+			isCorrect32 = false;
+	}
+	AudioTestCheck(isCorrect32);
+}
+
+static void testFormats(void)
+{
+	static const AudioIntegerWriterFormat invalidFormats[] = { { 4, 33, false, false }, { 2, 0, false, false }, { 1, 8, false, false } };
+	AudioIntegerWriter writer;
+	UInt32 format,source;
+
+	for (format=0;format<countof(kTestFormats);format++) {
+		AudioTestCheck(AudioIntegerWriterSelect(&writer, &kTestFormats[format]));
+		AudioTestCheck(writer.name != NULL);
+		for (source=0;source<kAudioIntegerWriterSourceCount;source++)
+			testRoundTrip(&kTestFormats[format], &writer, source);
+		testRoundingAndSaturation(&kTestFormats[format], &writer);
+	}
+
+	for (format=0;format<countof(invalidFormats);format++)
+		AudioTestCheck(!AudioIntegerWriterSelect(&writer, &invalidFormats[format]));
+}
+
+#pragma mark Benchmark
+
+typedef struct {
+	const AudioIntegerWriter *writer;
+	UInt32 sourceFormat;
+	const void *src;
+	void *dst;
+} WriterBench;
+
+static void benchWriter(void *context)
+{
+	WriterBench *bench = (WriterBench*)context;
+	AudioIntegerWriterWrite(bench->writer, bench->sourceFormat, bench->dst, bench->src, kTestBenchSamples);
+}
+
+static void benchmarkWriters(void)
+{
+	Float64 *src = (Float64*)calloc(kTestBenchSamples, sizeof(Float64));
+	AudioIntegerWriter writer;
+	WriterBench bench;
+	char name[128];
+	UInt32 format,source;
+
+	bench.writer = &writer;
+	bench.src = src;
+	bench.dst = malloc(kTestBenchSamples*4);
+	for (format=0;format<countof(kTestFormats);format++) {
+		if (!AudioIntegerWriterSelect(&writer, &kTestFormats[format])) continue;
+		for (source=0;source<kAudioIntegerWriterSourceCount;source++) {
+			bench.sourceFormat = source;
+			snprintf(name, sizeof(name), "%s to %ubit %s", kTestSourceNames[source], kTestFormats[format].bitsPerSample, writer.name);
+			AudioTestBenchmark(name, "samples", kTestBenchSamples, benchWriter, &bench);
+		}
+	}
+	free(bench.dst);
+	free(src);
+}
+
+int main(int argc, char *argv[])
+{
+	testFormats();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkWriters();
+	return AudioTestResult("AudioIntegerWriterTest");
+}
@@ -0,0 +1,291 @@
+/*
+ AudioOutputCopyKernelsTest.cpp
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+/* Output copy kernels test and microbenchmark
+ Each kernel is checked against a reference sample by sample copy, for all the sample sizes and streams layouts,
+ and benchmarked against that reference copy, which is the per sample loop the IO proc ran before the kernels */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioTest.h"
+#include "AudioOutputCopyKernels.h"
+
+#define kTestMaxStreams 8
+#define kTestMaxFrames 512 //Typical IO buffer size at 384kHz
+#define kTestDstFrameOffset 3
+#define kTestFiller 0xA5
+
+typedef struct {
+	const char *name;
+	UInt32 channels;
+	UInt32 streamsCount;
+	UInt32 streamChannels[kTestMaxStreams];
+	AudioChannelMapping channelMap[kAudioOutputMaxChannels];
+} TestLayout;
+
+typedef struct {
+	AudioBufferList *bufferList;
+	UInt8 *streams[kTestMaxStreams];
+	UInt8 *srcFrames;
+	UInt32 frames;
+	UInt32 bytesPerSample;
+	const TestLayout *layout;
+	AudioOutputCopyKernel kernel;
+} TestDevice;
+
+static const TestLayout kStereoLayouts[] = {
+	{ "stereo stream", 2, 1, {2}, {{0,0,0}, {0,0,1}} },
+	{ "adjacent pair in 8 channels stream", 2, 1, {8}, {{0,0,2}, {0,0,3}} },
+	{ "mono streams", 2, 2, {1,1}, {{0,0,0}, {1,1,0}} },
+	{ "stereo streams", 2, 2, {2,2}, {{0,0,0}, {1,1,1}} },
+	{ "swapped stereo stream", 2, 1, {2}, {{0,0,1}, {0,0,0}} },
+	{ "strided in 6 channels stream", 2, 1, {6}, {{0,0,0}, {0,0,3}} },
+	{ "mixed streams", 2, 2, {1,4}, {{0,0,0}, {1,1,2}} }
+};
+
+static const TestLayout kMultichannelLayouts[] = {
+	{ "5.1 stream", 6, 1, {6}, {{0,0,0}, {0,0,1}, {0,0,2}, {0,0,3}, {0,0,4}, {0,0,5}} },
+	{ "5.1 adjacent in 8 channels stream", 6, 1, {8}, {{0,0,1}, {0,0,2}, {0,0,3}, {0,0,4}, {0,0,5}, {0,0,6}} },
+	{ "5.1 mono streams", 6, 6, {1,1,1,1,1,1}, {{0,0,0}, {1,1,0}, {2,2,0}, {3,3,0}, {4,4,0}, {5,5,0}} },
+	{ "5.1 reversed in stream", 6, 1, {6}, {{0,0,5}, {0,0,4}, {0,0,3}, {0,0,2}, {0,0,1}, {0,0,0}} },
+	{ "3 channels stereo streams", 3, 2, {2,2}, {{0,0,0}, {0,0,1}, {1,1,0}} },
+	{ "7.1 stream", 8, 1, {8}, {{0,0,0}, {0,0,1}, {0,0,2}, {0,0,3}, {0,0,4}, {0,0,5}, {0,0,6}, {0,0,7}} },
+	{ "7.1 mono streams", 8, 8, {1,1,1,1,1,1,1,1},
+		{{0,0,0}, {1,1,0}, {2,2,0}, {3,3,0}, {4,4,0}, {5,5,0}, {6,6,0}, {7,7,0}} },
+	{ "7.1 stereo streams", 8, 4, {2,2,2,2},
+		{{0,0,0}, {0,0,1}, {1,1,0}, {1,1,1}, {2,2,0}, {2,2,1}, {3,3,0}, {3,3,1}} }
+};
+
+static const UInt32 kSampleSizes[] = { 2, 3, 4, 8 };
+
+#define countof(array) (sizeof(array)/sizeof((array)[0]))
+
+static void testDeviceInit(TestDevice *device, const TestLayout *layout, UInt32 bytesPerSample, UInt32 frames)
+{
+	UInt32 i, stream;
+
+	device->layout = layout;
+	device->bytesPerSample = bytesPerSample;
+	device->frames = frames;
+	device->bufferList = (AudioBufferList*)calloc(1, sizeof(AudioBufferList) + kTestMaxStreams*sizeof(AudioBuffer));
+	device->bufferList->mNumberBuffers = layout->streamsCount;
+	for (stream=0;stream<layout->streamsCount;stream++) {
+		UInt32 size = (kTestDstFrameOffset + frames + 1)*layout->streamChannels[stream]*bytesPerSample;
+		device->streams[stream] = (UInt8*)malloc(size);
+		memset(device->streams[stream], kTestFiller, size);
+		device->bufferList->mBuffers[stream].mNumberChannels = layout->streamChannels[stream];
+		device->bufferList->mBuffers[stream].mDataByteSize = size;
+		device->bufferList->mBuffers[stream].mData = device->streams[stream];
+	}
+	device->srcFrames = (UInt8*)malloc(frames*layout->channels*bytesPerSample);
+	for (i=0;i<frames*layout->channels*bytesPerSample;i++)
+		device->srcFrames[i] = (UInt8)(rand() & 0xFF);
+}
+
+static void testDeviceDispose(TestDevice *device)
+{
+	UInt32 stream;
+
+	for (stream=0;stream<device->layout->streamsCount;stream++)
+		free(device->streams[stream]);
+	free(device->bufferList);
+	free(device->srcFrames);
+}
+
+static void testDeviceDstChannels(const TestDevice *device, UInt32 *dstChannels)
+{
+	UInt32 channel;
+
+	for (channel=0;channel<device->layout->channels;channel++)
+		dstChannels[channel] = device->layout->streamChannels[device->layout->channelMap[channel].stream];
+}
+
+//Reference sample by sample copy: the strides and sample size are read in the loop, as the IO proc did before the kernels
+static void referenceCopy(const void *srcFrames, AudioBufferList *outOutputData,
+						  const AudioChannelMapping *channelMap, UInt32 channels,
+						  UInt32 dstFrameOffset, UInt32 framesToCopy, UInt32 bytesPerSample)
+{
+	const UInt8 *src = (const UInt8*)srcFrames;
+	UInt32 i, channel;
+
+	for (i=0;i<framesToCopy;i++)
+		for (channel=0;channel<channels;channel++) {
+			const AudioBuffer *buffer = &outOutputData->mBuffers[channelMap[channel].stream];
+			UInt8 *dst = (UInt8*)buffer->mData
+				+ ((dstFrameOffset + i)*buffer->mNumberChannels + channelMap[channel].channel)*bytesPerSample;
+
+			switch (bytesPerSample) {
+				case 2:
+					*(UInt16*)dst = *(const UInt16*)src;
+					break;
+				case 3:
+					*(UInt16*)dst = *(const UInt16*)src;
+					dst[2] = src[2];
+					break;
+				case 4:
+					*(UInt32*)dst = *(const UInt32*)src;
+					break;
+				default:
+					memcpy(dst, src, bytesPerSample);
+					break;
+			}
+			src += bytesPerSample;
+		}
+}
+
+//Checks each copied sample, and that no other byte of the streams has been written
+static bool checkCopy(const TestDevice *device, UInt32 dstFrameOffset, UInt32 framesCopied)
+{
+	const TestLayout *layout = device->layout;
+	const UInt32 bytesPerSample = device->bytesPerSample;
+	UInt8 *expected[kTestMaxStreams];
+	AudioBufferList *expectedList;
+	UInt32 stream;
+	bool isEqual = true;
+
+	expectedList = (AudioBufferList*)calloc(1, sizeof(AudioBufferList) + kTestMaxStreams*sizeof(AudioBuffer));
+	*expectedList = *device->bufferList;
+	memcpy(expectedList->mBuffers, device->bufferList->mBuffers, layout->streamsCount*sizeof(AudioBuffer));
+	for (stream=0;stream<layout->streamsCount;stream++) {
+		expected[stream] = (UInt8*)malloc(expectedList->mBuffers[stream].mDataByteSize);
+		memset(expected[stream], kTestFiller, expectedList->mBuffers[stream].mDataByteSize);
+		expectedList->mBuffers[stream].mData = expected[stream];
+	}
+
+	referenceCopy(device->srcFrames, expectedList, layout->channelMap, layout->channels,
+				  dstFrameOffset, framesCopied, bytesPerSample);
+
+	for (stream=0;stream<layout->streamsCount;stream++) {
+		if (memcmp(expected[stream], device->streams[stream], expectedList->mBuffers[stream].mDataByteSize) != 0)
+			isEqual = false;
+		free(expected[stream]);
+	}
+	free(expectedList);
+	return isEqual;
+}
+
+static AudioOutputCopyKernel selectKernel(const TestDevice *device, const char **kernelName)
+{
+	UInt32 dstChannels[kAudioOutputMaxChannels];
+
+	testDeviceDstChannels(device, dstChannels);
+	if (device->layout->channels == 2)
+		return AudioOutputSelectCopyKernel(device->bytesPerSample, dstChannels, device->layout->channelMap, kernelName);
+	return AudioOutputSelectMultichannelCopyKernel(device->bytesPerSample, device->layout->channels, dstChannels,
+												   device->layout->channelMap, kernelName);
+}
+
+static void testLayout(const TestLayout *layout)
+{
+	UInt32 i, frames, stream;
+
+	for (i=0;i<countof(kSampleSizes);i++) {
+		//Odd frames counts exercise the SIMD kernels tails
+		for (frames=0;frames<=37;frames++) {
+			TestDevice device;
+			const char *kernelName = NULL;
+			AudioOutputCopyKernel kernel;
+			UInt32 dstFrameOffset;
+
+			testDeviceInit(&device, layout, kSampleSizes[i], frames);
+			kernel = selectKernel(&device, &kernelName);
+			AudioTestCheck(kernel != NULL);
+			AudioTestCheck(kernelName != NULL);
+			if (kernel == NULL) {
+				testDeviceDispose(&device);
+				continue;
+			}
+			for (dstFrameOffset=0;dstFrameOffset<=kTestDstFrameOffset;dstFrameOffset+=kTestDstFrameOffset) {
+				bool isCorrect;
+
+				for (stream=0;stream<layout->streamsCount;stream++)
+					memset(device.streams[stream], kTestFiller, device.bufferList->mBuffers[stream].mDataByteSize);
+				kernel(device.srcFrames, device.bufferList, layout->channelMap, dstFrameOffset, frames, kSampleSizes[i]);
+				isCorrect = checkCopy(&device, dstFrameOffset, frames);
+				AudioTestCheck(isCorrect);
+				if (!isCorrect)
+					fprintf(stderr, "  %s, %u bytes samples, %u frames at offset %u: %s is wrong\n",
+							layout->name, (unsigned)kSampleSizes[i], (unsigned)frames, (unsigned)dstFrameOffset, kernelName);
+			}
+			testDeviceDispose(&device);
+		}
+	}
+}
+
+#pragma mark Microbenchmark
+
+static void benchKernel(void *context)
+{
+	TestDevice *device = (TestDevice*)context;
+
+	device->kernel(device->srcFrames, device->bufferList, device->layout->channelMap, 0, device->frames, device->bytesPerSample);
+}
+
+static void benchReference(void *context)
+{
+	TestDevice *device = (TestDevice*)context;
+
+	referenceCopy(device->srcFrames, device->bufferList, device->layout->channelMap, device->layout->channels,
+				  0, device->frames, device->bytesPerSample);
+}
+
+static void benchLayout(const TestLayout *layout, UInt32 bytesPerSample)
+{
+	TestDevice device;
+	const char *kernelName;
+	char name[128];
+	double kernelRate, referenceRate;
+
+	testDeviceInit(&device, layout, bytesPerSample, kTestMaxFrames);
+	device.kernel = selectKernel(&device, &kernelName);
+
+	snprintf(name, sizeof(name), "%s %ubit, %s", layout->name, (unsigned)bytesPerSample*8, kernelName);
+	kernelRate = AudioTestBenchmark(name, "frames", kTestMaxFrames, benchKernel, &device);
+	snprintf(name, sizeof(name), "%s %ubit, per sample reference", layout->name, (unsigned)bytesPerSample*8);
+	referenceRate = AudioTestBenchmark(name, "frames", kTestMaxFrames, benchReference, &device);
+	printf("%-72s %12.2fx\n", "  speedup", kernelRate/referenceRate);
+
+	testDeviceDispose(&device);
+}
+
+int main(int argc, char *argv[])
+{
+	UInt32 i;
+
+	srand(1);
+	for (i=0;i<countof(kStereoLayouts);i++)
+		testLayout(&kStereoLayouts[i]);
+	for (i=0;i<countof(kMultichannelLayouts);i++)
+		testLayout(&kMultichannelLayouts[i]);
+
+	if (AudioTestIsBenchmark(argc, argv)) {
+		for (i=0;i<countof(kStereoLayouts);i++) {
+			benchLayout(&kStereoLayouts[i], 4);
+			benchLayout(&kStereoLayouts[i], 3);
+		}
+		for (i=0;i<countof(kMultichannelLayouts);i++)
+			benchLayout(&kMultichannelLayouts[i], 4);
+	}
+
+	return AudioTestResult("AudioOutputCopyKernelsTest");
+}
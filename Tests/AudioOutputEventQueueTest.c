@@ -0,0 +1,226 @@
+/*
+ AudioOutputEventQueueTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+/* IO proc events queue test and benchmark
+ The memory allocator is interposed with a per thread counter: the producer threads standing in for the IO proc
+ and the HAL listener must not allocate while pushing. Checks the FIFO order of each producer events with several
+ producers and a consumer draining concurrently, and the queue full drops counting */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#endif
+
+#include "AudioTest.h"
+#include "AudioOutputEventQueue.h"
+
+#define kTestProducers 4
+#define kTestEventsPerProducer 100000
+
+#pragma mark Allocations counting
+
+static __thread long gThreadAllocations = 0;
+
+#ifdef __APPLE__
+#define realMalloc(size) malloc_zone_malloc(malloc_default_zone(), size)
+#define realCalloc(count, size) malloc_zone_calloc(malloc_default_zone(), count, size)
+#define realRealloc(ptr, size) malloc_zone_realloc(malloc_default_zone(), ptr, size)
+#define realFree(ptr) malloc_zone_free(malloc_default_zone(), ptr)
+#else
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+#define realMalloc(size) __libc_malloc(size)
+#define realCalloc(count, size) __libc_calloc(count, size)
+#define realRealloc(ptr, size) __libc_realloc(ptr, size)
+#define realFree(ptr) __libc_free(ptr)
+#endif
+
+void *malloc(size_t size)
+{
+	gThreadAllocations++;
+	return realMalloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	gThreadAllocations++;
+	return realCalloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	gThreadAllocations++;
+	return realRealloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if (ptr) gThreadAllocations++;
+	realFree(ptr);
+}
+
+#pragma mark Producers
+
+typedef struct {
+	AudioOutputEventQueue *queue;
+	UInt32 type;
+	long events;
+	long failedPushes; //Queue full, pushed again
+	long allocations; //By the producer thread while pushing
+} Producer;
+
+static void* producerEntry(void *arg)
+{
+	Producer *producer = (Producer*)arg;
+	long allocations = gThreadAllocations;
+	long i;
+
+	for (i=0;i<producer->events;i++)
+		while (!AudioOutputEventQueuePush(producer->queue, producer->type, (UInt32)i)) {
+			producer->failedPushes++;
+			sched_yield();
+		}
+	producer->allocations = gThreadAllocations - allocations;
+	return NULL;
+}
+
+#pragma mark Tests
+
+static void testQueueFull(void)
+{
+	AudioOutputEventQueue queue;
+	AudioOutputEvent event;
+	bool isOrdered = true;
+	UInt32 i;
+
+	AudioOutputEventQueueInit(&queue);
+	AudioTestCheck(!AudioOutputEventQueuePop(&queue, &event));
+
+	for (i=0;i<kAudioOutputEventQueueSize;i++)
+		AudioTestCheck(AudioOutputEventQueuePush(&queue, kAudioOutputEventBufferPlayed, i));
+	AudioTestCheck(!AudioOutputEventQueuePush(&queue, kAudioOutputEventUnderrun, 0));
+	AudioTestCheck(!AudioOutputEventQueuePush(&queue, kAudioOutputEventUnderrun, 0));
+	AudioTestCheck(queue.droppedEvents == 2);
+
+	//The queued events kept, in order, and the cells reusable once popped
+	for (i=0;i<kAudioOutputEventQueueSize/2;i++)
+		isOrdered &= AudioOutputEventQueuePop(&queue, &event) && (event.bufferIndex == i);
+	for (i=0;i<kAudioOutputEventQueueSize/2;i++)
+		AudioTestCheck(AudioOutputEventQueuePush(&queue, kAudioOutputEventPositionTick, kAudioOutputEventQueueSize + i));
+	for (i=kAudioOutputEventQueueSize/2;i<kAudioOutputEventQueueSize*3/2;i++)
+		isOrdered &= AudioOutputEventQueuePop(&queue, &event) && (event.bufferIndex == i);
+	AudioTestCheck(isOrdered);
+	AudioTestCheck(!AudioOutputEventQueuePop(&queue, &event));
+	AudioTestCheck(queue.droppedEvents == 2);
+}
+
+/* Producers pushing while the main thread drains, as the IO proc and the HAL listener */
+static void testConcurrentProducers(void)
+{
+	static AudioOutputEventQueue queue;
+	Producer producers[kTestProducers];
+	pthread_t threads[kTestProducers];
+	long nextIndex[kTestProducers];
+	long received = 0, failedPushes = 0;
+	AudioOutputEvent event;
+	bool isStarted[kTestProducers], isOrdered = true;
+	int i;
+
+	AudioOutputEventQueueInit(&queue);
+	for (i=0;i<kTestProducers;i++) {
+		producers[i].queue = &queue;
+		producers[i].type = (UInt32)i + 1;
+		producers[i].events = kTestEventsPerProducer;
+		producers[i].failedPushes = 0;
+		producers[i].allocations = -1;
+		nextIndex[i] = 0;
+		isStarted[i] = (pthread_create(&threads[i], NULL, producerEntry, &producers[i]) == 0);
+		AudioTestCheck(isStarted[i]);
+		if (!isStarted[i]) producers[i].events = 0;
+	}
+
+	while (received < kTestProducers * (long)kTestEventsPerProducer) {
+		if (!AudioOutputEventQueuePop(&queue, &event)) {
+			sched_yield();
+			continue;
+		}
+		if ((event.type == 0) || (event.type > kTestProducers)
+			|| (event.bufferIndex != (UInt32)nextIndex[event.type - 1])) {
+			isOrdered = false;
+			break;
+		}
+		nextIndex[event.type - 1]++;
+		received++;
+	}
+	AudioTestCheck(isOrdered);
+
+	for (i=0;i<kTestProducers;i++) {
+		if (isStarted[i]) pthread_join(threads[i], NULL);
+		AudioTestCheck(producers[i].allocations == 0);
+		failedPushes += producers[i].failedPushes;
+	}
+	AudioTestCheck(!AudioOutputEventQueuePop(&queue, &event));
+	AudioTestCheck(queue.droppedEvents == failedPushes);
+}
+
+/* The interposed allocator is the one the queue code would call */
+static void testAllocationsCounted(void)
+{
+	long allocations = gThreadAllocations;
+	void *ptr = malloc(16);
+
+	free(ptr);
+	AudioTestCheck(gThreadAllocations - allocations == 2);
+}
+
+#pragma mark Benchmark
+
+static void pushPopBenchmark(void *context)
+{
+	AudioOutputEventQueue *queue = (AudioOutputEventQueue*)context;
+	AudioOutputEvent event;
+	UInt32 i;
+
+	for (i=0;i<kAudioOutputEventQueueSize;i++)
+		AudioOutputEventQueuePush(queue, kAudioOutputEventPositionTick, i);
+	while (AudioOutputEventQueuePop(queue, &event));
+}
+
+int main(int argc, char *argv[])
+{
+	static AudioOutputEventQueue queue;
+
+	testAllocationsCounted();
+	testQueueFull();
+	testConcurrentProducers();
+	if (AudioTestIsBenchmark(argc, argv)) {
+		AudioOutputEventQueueInit(&queue);
+		AudioTestBenchmark("events push then pop, single thread", "events", kAudioOutputEventQueueSize, pushPopBenchmark, &queue);
+	}
+	return AudioTestResult("AudioOutputEventQueueTest");
+}
@@ -0,0 +1,345 @@
+/*
+ AudioOutputSinkTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+/* Output sinks test and render throughput benchmark
+ The WAV sink files are read back: their header must describe the samples they hold,
+ the samples being the rendered ones converted to little endian left justified samples,
+ and a sample rate change must start a new file at the new rate. Stereo and multichannel (5.1, 7.1) frames are covered */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "AudioTest.h"
+#include "AudioOutputSink.h"
+
+#define kTestFramesPerBuffer 512
+#define kTestBuffers 64
+#define kTestSampleRate 44100
+#define kTestSwitchedSampleRate 96000
+
+typedef struct {
+	const char *name;
+	AudioOutputSinkFormat format;
+} TestFormat;
+
+static const TestFormat kTestFormats[] = {
+	{ "16bit", {2, 2, 16, false, false, false} },
+	{ "24bit packed", {2, 3, 24, false, false, false} },
+	{ "32bit", {2, 4, 32, false, false, false} },
+	{ "24bit aligned high", {2, 4, 24, false, false, true} },
+	{ "24bit aligned low", {2, 4, 24, false, false, false} },
+	{ "20bit aligned low", {2, 4, 20, false, false, false} },
+	{ "16bit big endian", {2, 2, 16, false, true, false} },
+	{ "24bit packed big endian", {2, 3, 24, false, true, false} },
+	{ "24bit aligned low big endian", {2, 4, 24, false, true, false} },
+	{ "float", {2, 4, 32, true, false, false} },
+	{ "6 channels 16bit", {6, 2, 16, false, false, false} },
+	{ "6 channels 24bit packed", {6, 3, 24, false, false, false} },
+	{ "8 channels 24bit aligned low big endian", {8, 4, 24, false, true, false} },
+	{ "8 channels float", {8, 4, 32, true, false, false} }
+};
+
+typedef struct {
+	AudioOutputSink *sink;
+	const AudioOutputSinkFormat *format;
+	volatile uint64_t framesRendered;
+	uint64_t switchFrame; //Frame at which the render proc changes the sample rate, 0 for none
+} TestRenderContext;
+
+#define countof(array) (sizeof(array)/sizeof((array)[0]))
+
+static uint32_t validBits(const AudioOutputSinkFormat *format)
+{
+	return format->validBitsPerSample ? format->validBitsPerSample : 8*format->bytesPerSample;
+}
+
+//Signed sample of the format significant bits, deterministic from its position
+static int32_t testSample(const AudioOutputSinkFormat *format, uint64_t frame, uint32_t channel)
+{
+	uint32_t hash = (uint32_t)(frame*2654435761U) ^ (channel*0x9E3779B9U);
+	hash ^= hash >> 15;
+	hash *= 0x85EBCA6BU;
+	hash ^= hash >> 13;
+	return (int32_t)hash >> (32 - validBits(format));
+}
+
+//Sample as the device stream holds it
+static void encodeDeviceSample(const AudioOutputSinkFormat *format, int32_t sample, uint8_t *dst)
+{
+	uint32_t value, k;
+
+	if (format->isFloat) {
+		float x = (float)sample / 2147483648.0f;
+		memcpy(&value, &x, 4);
+	}
+	else if (format->isAlignedHigh)
+		value = (uint32_t)sample << (8*format->bytesPerSample - validBits(format));
+	else
+		value = (uint32_t)sample; //Low aligned samples are sign extended in their container
+
+	for (k=0;k<format->bytesPerSample;k++)
+		dst[format->isBigEndian ? (format->bytesPerSample-1-k) : k] = (uint8_t)(value >> (8*k));
+}
+
+//Sample as a WAV file holds it: little endian, left justified in its container
+static void encodeWAVSample(const AudioOutputSinkFormat *format, int32_t sample, uint8_t *dst)
+{
+	uint32_t value, k;
+
+	if (format->isFloat) {
+		float x = (float)sample / 2147483648.0f;
+		memcpy(&value, &x, 4);
+	}
+	else
+		value = (uint32_t)sample << (8*format->bytesPerSample - validBits(format));
+
+	for (k=0;k<format->bytesPerSample;k++)
+		dst[k] = (uint8_t)(value >> (8*k));
+}
+
+static void testRenderProc(void *renderContext, void *frames, uint32_t framesCount)
+{
+	TestRenderContext *context = (TestRenderContext*)renderContext;
+	const AudioOutputSinkFormat *format = context->format;
+	uint8_t *dst = (uint8_t*)frames;
+	uint32_t i, channel;
+
+	for (i=0;i<framesCount;i++)
+		for (channel=0;channel<format->channels;channel++) {
+			encodeDeviceSample(format, testSample(format, context->framesRendered + i, channel), dst);
+			dst += format->bytesPerSample;
+		}
+	context->framesRendered += framesCount;
+
+	if (context->switchFrame && (context->framesRendered == context->switchFrame))
+		AudioOutputSinkSetSampleRate(context->sink, kTestSwitchedSampleRate);
+}
+
+static uint32_t readLE32(const uint8_t *src)
+{
+	return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static uint16_t readLE16(const uint8_t *src)
+{
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static uint8_t* readFile(const char *path, size_t *size)
+{
+	FILE *file = fopen(path, "rb");
+	uint8_t *data;
+	long length;
+
+	if (!file) return NULL;
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	data = (uint8_t*)malloc(length > 0 ? (size_t)length : 1);
+	if (data && (fread(data, 1, (size_t)length, file) != (size_t)length)) {
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	*size = (size_t)length;
+	return data;
+}
+
+/* Checks the WAV file header, and that it holds the frames from firstFrame
+ @return the number of frames of the file */
+static uint64_t checkWAVFile(const char *path, const AudioOutputSinkFormat *format, uint32_t sampleRate, uint64_t firstFrame)
+{
+	const bool isExtensible = (!format->isFloat && (validBits(format) != 8*format->bytesPerSample)) || (format->channels > 2);
+	const uint32_t headerSize = isExtensible ? 68 : 44;
+	const uint32_t blockAlign = format->channels*format->bytesPerSample;
+	uint8_t expected[4];
+	uint64_t frames, frame;
+	uint32_t channel;
+	size_t size;
+	uint8_t *data = readFile(path, &size);
+	const uint8_t *samples;
+	bool isDataCorrect = true;
+
+	AudioTestCheck(data != NULL);
+	if (!data) return 0;
+	AudioTestCheck(size >= headerSize);
+	if (size < headerSize) {
+		free(data);
+		return 0;
+	}
+
+	AudioTestCheck(memcmp(data, "RIFF", 4) == 0);
+	AudioTestCheck(readLE32(data+4) == size - 8);
+	AudioTestCheck(memcmp(data+8, "WAVEfmt ", 8) == 0);
+	AudioTestCheck(readLE32(data+16) == (isExtensible ? 40U : 16U));
+	AudioTestCheck(readLE16(data+20) == (isExtensible ? 0xFFFE : (format->isFloat ? 3 : 1)));
+	AudioTestCheck(readLE16(data+22) == format->channels);
+	AudioTestCheck(readLE32(data+24) == sampleRate);
+	AudioTestCheck(readLE32(data+28) == sampleRate*blockAlign);
+	AudioTestCheck(readLE16(data+32) == blockAlign);
+	AudioTestCheck(readLE16(data+34) == 8*format->bytesPerSample);
+	if (isExtensible) {
+		AudioTestCheck(readLE16(data+36) == 22);
+		AudioTestCheck(readLE16(data+38) == validBits(format));
+		AudioTestCheck(readLE32(data+40) == ((format->channels == 2) ? 3U : 0U));
+		AudioTestCheck(readLE16(data+44) == (format->isFloat ? 3 : 1));
+	}
+	AudioTestCheck(memcmp(data+headerSize-8, "data", 4) == 0);
+	AudioTestCheck(readLE32(data+headerSize-4) == size - headerSize);
+	AudioTestCheck(((size - headerSize) % blockAlign) == 0);
+
+	frames = (size - headerSize) / blockAlign;
+	samples = data + headerSize;
+	for (frame=0;frame<frames;frame++)
+		for (channel=0;channel<format->channels;channel++) {
+			encodeWAVSample(format, testSample(format, firstFrame + frame, channel), expected);
+			if (memcmp(samples, expected, format->bytesPerSample) != 0) isDataCorrect = false;
+			samples += format->bytesPerSample;
+		}
+	AudioTestCheck(isDataCorrect);
+
+	free(data);
+	return frames;
+}
+
+static void waitForFrames(TestRenderContext *context, uint64_t frames)
+{
+	while (context->framesRendered < frames)
+		usleep(1000);
+}
+
+static void testWAVSink(const char *directory, const TestFormat *testFormat, bool isSwitchingSampleRate)
+{
+	char path[1024], segmentPath[1024];
+	TestRenderContext context;
+	uint64_t frames;
+
+	snprintf(path, sizeof(path), "%s/output.wav", directory);
+	snprintf(segmentPath, sizeof(segmentPath), "%s/output-2.wav", directory);
+	unlink(path);
+	unlink(segmentPath);
+
+	memset(&context, 0, sizeof(context));
+	context.format = &testFormat->format;
+	context.switchFrame = isSwitchingSampleRate ? (kTestBuffers/2)*kTestFramesPerBuffer : 0;
+	context.sink = AudioOutputSinkCreate(kAudioOutputSinkWAVFile, path, &testFormat->format, kTestFramesPerBuffer, 0,
+										 testRenderProc, &context);
+	AudioTestCheck(context.sink != NULL);
+	if (!context.sink) return;
+
+	AudioTestCheck(AudioOutputSinkStart(context.sink, kTestSampleRate) == 0);
+	waitForFrames(&context, kTestBuffers*kTestFramesPerBuffer);
+	AudioOutputSinkStop(context.sink);
+	AudioTestCheck(AudioOutputSinkFramesRendered(context.sink) == context.framesRendered);
+
+	frames = checkWAVFile(path, &testFormat->format, kTestSampleRate, 0);
+	if (isSwitchingSampleRate) {
+		//The frames rendered after the switch are in the second segment, at the new rate
+		AudioTestCheck(frames == context.switchFrame);
+		frames += checkWAVFile(segmentPath, &testFormat->format, kTestSwitchedSampleRate, frames);
+	}
+	else
+		AudioTestCheck(access(segmentPath, F_OK) != 0);
+	AudioTestCheck(frames == context.framesRendered);
+	if (frames != context.framesRendered)
+		fprintf(stderr, "  %s: %llu frames written out of %llu rendered\n", testFormat->name,
+				(unsigned long long)frames, (unsigned long long)context.framesRendered);
+
+	AudioOutputSinkDispose(context.sink);
+	unlink(path);
+	unlink(segmentPath);
+}
+
+static void testNullSink(void)
+{
+	TestRenderContext context;
+
+	memset(&context, 0, sizeof(context));
+	context.format = &kTestFormats[0].format;
+	context.sink = AudioOutputSinkCreate(kAudioOutputSinkNull, NULL, context.format, kTestFramesPerBuffer, 0,
+										 testRenderProc, &context);
+	AudioTestCheck(context.sink != NULL);
+	if (!context.sink) return;
+	AudioTestCheck(AudioOutputSinkStart(context.sink, kTestSampleRate) == 0);
+	AudioTestCheck(AudioOutputSinkStart(context.sink, kTestSampleRate) != 0);
+	waitForFrames(&context, kTestBuffers*kTestFramesPerBuffer);
+	AudioOutputSinkDispose(context.sink);
+	AudioTestCheck(context.framesRendered >= kTestBuffers*kTestFramesPerBuffer);
+
+	//A WAV sink needs a file
+	AudioTestCheck(AudioOutputSinkCreate(kAudioOutputSinkWAVFile, NULL, context.format, kTestFramesPerBuffer, 0,
+										 testRenderProc, &context) == NULL);
+}
+
+#pragma mark Benchmark
+
+static void silentRenderProc(void *renderContext, void *frames, uint32_t framesCount)
+{
+	(void)frames;
+	*(volatile uint64_t*)renderContext += framesCount;
+}
+
+static void benchSink(const char *name, int sinkType, const char *path, const AudioOutputSinkFormat *format)
+{
+	volatile uint64_t framesRendered = 0;
+	AudioOutputSink *sink = AudioOutputSinkCreate(sinkType, path, format, kTestFramesPerBuffer, 0,
+												  silentRenderProc, (void*)&framesRendered);
+	double start;
+
+	if (!sink) return;
+	start = AudioTestTime();
+	AudioOutputSinkStart(sink, kTestSampleRate);
+	usleep((useconds_t)(kAudioTestBenchmarkMinDuration*1e6));
+	AudioOutputSinkStop(sink);
+	AudioTestReportRate(name, "frames", (double)framesRendered/(AudioTestTime() - start));
+	AudioOutputSinkDispose(sink);
+	if (path) unlink(path);
+}
+
+int main(int argc, char *argv[])
+{
+	char directory[] = "/tmp/AudioOutputSinkTest.XXXXXX";
+	char path[1024];
+	uint32_t i;
+
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	testNullSink();
+	for (i=0;i<countof(kTestFormats);i++) {
+		testWAVSink(directory, &kTestFormats[i], false);
+		testWAVSink(directory, &kTestFormats[i], true);
+	}
+
+	if (AudioTestIsBenchmark(argc, argv)) {
+		snprintf(path, sizeof(path), "%s/bench.wav", directory);
+		benchSink("null sink, 16bit", kAudioOutputSinkNull, NULL, &kTestFormats[0].format);
+		benchSink("WAV sink, 32bit", kAudioOutputSinkWAVFile, path, &kTestFormats[2].format);
+		benchSink("WAV sink, 24bit aligned low big endian (converted)", kAudioOutputSinkWAVFile, path, &kTestFormats[8].format);
+		benchSink("WAV sink, 8 channels 24bit aligned low big endian (converted)", kAudioOutputSinkWAVFile, path, &kTestFormats[12].format);
+	}
+
+	rmdir(directory);
+	return AudioTestResult("AudioOutputSinkTest");
+}
@@ -0,0 +1,251 @@
+/*
+ AudioPolyphaseResamplerTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+/* Polyphase resampler test and benchmark
+ Checks that the frames converted by blocks on several threads, in any order, are bit identical to the ones
+ converted on the reading thread, whatever the reads and the input callback chunks sizes, and the output length.
+ The benchmark compares the reads throughput on the reading thread and split on threads */
+
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "AudioTest.h"
+#include "AudioPolyphaseResampler.h"
+
+#define countof(a) (sizeof(a)/sizeof((a)[0]))
+#define kTestInputFrames 200000
+#define kTestThreads 4
+#define kTestTapsPerPhase 64
+#define kTestAttenuation 140.0
+
+/* Input supplied by chunks of varying sizes, as decoded packets */
+typedef struct {
+	const Float32 *frames;
+	long nbFrames;
+	long position;
+	UInt32 channels;
+	long chunkFrames;
+} TestInput;
+
+static long inputCallback(void *cbData, float **data)
+{
+	TestInput *input = (TestInput*)cbData;
+	long frames = input->chunkFrames + (input->position % 7);
+
+	if (frames > input->nbFrames - input->position) frames = input->nbFrames - input->position;
+	*data = (float*)(input->frames + input->position * input->channels);
+	input->position += frames;
+	return frames;
+}
+
+static Float32* newInputFrames(long nbFrames, UInt32 channels)
+{
+	Float32 *frames = (Float32*)malloc(nbFrames * channels * sizeof(Float32));
+	long i;
+	UInt32 channel;
+
+	if (frames == NULL) return NULL;
+	srand(1);
+	for (i=0;i<nbFrames;i++)
+		for (channel=0;channel<channels;channel++)
+			frames[i*channels + channel] = 0.5f*(Float32)sin(0.01*(channel + 1)*i)
+				+ 0.25f*((Float32)rand()/RAND_MAX - 0.5f);
+	return frames;
+}
+
+#pragma mark Apply procs
+
+typedef struct {
+	size_t iterations;
+	size_t firstIteration;
+	void *context;
+	void (*work)(void *context, size_t iteration);
+} ApplyThread;
+
+static void* applyThreadEntry(void *arg)
+{
+	ApplyThread *apply = (ApplyThread*)arg;
+	size_t i;
+
+	for (i=apply->firstIteration;i<apply->iterations;i+=kTestThreads)
+		apply->work(apply->context, i);
+	return NULL;
+}
+
+/* Interleaved iterations on kTestThreads threads */
+static void applyOnThreads(size_t iterations, void *context, void (*work)(void *context, size_t iteration))
+{
+	pthread_t threads[kTestThreads];
+	ApplyThread applies[kTestThreads];
+	bool isStarted[kTestThreads];
+	size_t i;
+
+	for (i=0;i<kTestThreads;i++) {
+		applies[i].iterations = iterations;
+		applies[i].firstIteration = i;
+		applies[i].context = context;
+		applies[i].work = work;
+		isStarted[i] = (pthread_create(&threads[i], NULL, applyThreadEntry, &applies[i]) == 0);
+		if (!isStarted[i]) applyThreadEntry(&applies[i]);
+	}
+	for (i=0;i<kTestThreads;i++)
+		if (isStarted[i]) pthread_join(threads[i], NULL);
+}
+
+/* Last block first: the blocks do not depend on the previous ones */
+static void applyReversed(size_t iterations, void *context, void (*work)(void *context, size_t iteration))
+{
+	while (iterations > 0) work(context, --iterations);
+}
+
+#pragma mark Tests
+
+/* Converts the whole input by reads of readFrames frames
+ @return the number of frames output, -1 on failure */
+static long resample(const Float32 *inFrames, UInt32 channels, Float64 inSampleRate, Float64 outSampleRate,
+					 long chunkFrames, long readFrames, AudioPolyphaseApplyProc applyProc, Float32 *out, long maxOutFrames)
+{
+	TestInput input = { inFrames, kTestInputFrames, 0, channels, chunkFrames };
+	AudioPolyphaseResampler *resampler;
+	long outFrames = 0, framesRead;
+
+	resampler = AudioPolyphaseResamplerNew(inputCallback, &input, inSampleRate, outSampleRate,
+										   kTestTapsPerPhase, kTestAttenuation, channels, applyProc);
+	if (resampler == NULL) return -1;
+
+	do {
+		if (readFrames > maxOutFrames - outFrames) readFrames = maxOutFrames - outFrames;
+		framesRead = AudioPolyphaseResamplerRead(resampler, readFrames, out + outFrames * channels);
+		if (framesRead > 0) outFrames += framesRead;
+	} while ((framesRead > 0) && (outFrames < maxOutFrames));
+
+	AudioPolyphaseResamplerDelete(resampler);
+	return (framesRead < 0) ? -1 : outFrames;
+}
+
+static void testBitIdentity(void)
+{
+	static const struct { Float64 inSampleRate, outSampleRate; UInt32 channels; } conversions[] = {
+		{ 44100.0, 192000.0, 2 }, { 48000.0, 96000.0, 3 }, { 96000.0, 44100.0, 1 }, { 44100.0, 48000.0, 2 }
+	};
+	static const long readSizes[] = { 1, 333, 4096, 3*kAudioPolyphaseBlockFrames + 17, 16*kAudioPolyphaseBlockFrames };
+	static const AudioPolyphaseApplyProc applyProcs[] = { NULL, applyOnThreads, applyReversed };
+	Float32 *inFrames, *reference, *out;
+	long maxOutFrames, expectedFrames, referenceFrames, outFrames;
+	UInt32 i, j, k;
+
+	for (i=0;i<countof(conversions);i++) {
+		maxOutFrames = (long)ceil(kTestInputFrames * conversions[i].outSampleRate / conversions[i].inSampleRate) + 1;
+		expectedFrames = (long)ceil(kTestInputFrames * conversions[i].outSampleRate / conversions[i].inSampleRate);
+		inFrames = newInputFrames(kTestInputFrames, conversions[i].channels);
+		reference = (Float32*)malloc(maxOutFrames * conversions[i].channels * sizeof(Float32));
+		out = (Float32*)malloc(maxOutFrames * conversions[i].channels * sizeof(Float32));
+		AudioTestCheck(inFrames && reference && out);
+		if ((inFrames == NULL) || (reference == NULL) || (out == NULL)) {
+			free(inFrames); free(reference); free(out);
+			return;
+		}
+
+		//Single threaded reference: one block at a time
+		referenceFrames = resample(inFrames, conversions[i].channels, conversions[i].inSampleRate, conversions[i].outSampleRate,
+								   4096, kAudioPolyphaseBlockFrames, NULL, reference, maxOutFrames);
+		AudioTestCheck(referenceFrames == expectedFrames);
+
+		for (j=0;j<countof(readSizes);j++)
+			for (k=0;k<countof(applyProcs);k++) {
+				memset(out, 0xff, maxOutFrames * conversions[i].channels * sizeof(Float32));
+				outFrames = resample(inFrames, conversions[i].channels, conversions[i].inSampleRate, conversions[i].outSampleRate,
+									 (j & 1) ? 1000 : 37, readSizes[j], applyProcs[k], out, maxOutFrames);
+				AudioTestCheck(outFrames == referenceFrames);
+				if (outFrames == referenceFrames)
+					AudioTestCheck(memcmp(out, reference, referenceFrames * conversions[i].channels * sizeof(Float32)) == 0);
+			}
+
+		free(inFrames);
+		free(reference);
+		free(out);
+	}
+}
+
+static void testUnsupportedRatios(void)
+{
+	TestInput input = { NULL, 0, 0, 2, 0 };
+
+	AudioTestCheck(AudioPolyphaseResamplerIsRatioSupported(44100.0, 192000.0));
+	AudioTestCheck(!AudioPolyphaseResamplerIsRatioSupported(44100.0, 44101.0));
+	AudioTestCheck(AudioPolyphaseResamplerNew(inputCallback, &input, 44100.0, 44101.0, kTestTapsPerPhase,
+											  kTestAttenuation, 2, NULL) == NULL);
+	AudioTestCheck(AudioPolyphaseResamplerNew(inputCallback, &input, 44100.0, 88200.0, kTestTapsPerPhase,
+											  kTestAttenuation, 0, applyOnThreads) == NULL);
+}
+
+#pragma mark Benchmark
+
+typedef struct {
+	const Float32 *inFrames;
+	Float32 *out;
+	long maxOutFrames;
+	AudioPolyphaseApplyProc applyProc;
+} ResampleBenchmark;
+
+static void resampleBenchmark(void *context)
+{
+	ResampleBenchmark *bench = (ResampleBenchmark*)context;
+	resample(bench->inFrames, 2, 44100.0, 192000.0, 4096, 8*kAudioPolyphaseBlockFrames, bench->applyProc,
+			 bench->out, bench->maxOutFrames);
+}
+
+static void benchmarkResampling(void)
+{
+	ResampleBenchmark bench;
+	double outFrames;
+
+	bench.maxOutFrames = (long)ceil(kTestInputFrames * 192000.0 / 44100.0) + 1;
+	bench.inFrames = newInputFrames(kTestInputFrames, 2);
+	bench.out = (Float32*)malloc(bench.maxOutFrames * 2 * sizeof(Float32));
+	if ((bench.inFrames == NULL) || (bench.out == NULL)) {
+		free((void*)bench.inFrames);
+		free(bench.out);
+		return;
+	}
+	outFrames = (double)bench.maxOutFrames - 1;
+
+	bench.applyProc = NULL;
+	AudioTestBenchmark("44.1kHz to 192kHz stereo, on the reading thread", "frames", outFrames, resampleBenchmark, &bench);
+	bench.applyProc = applyOnThreads;
+	AudioTestBenchmark("44.1kHz to 192kHz stereo, blocks on 4 threads", "frames", outFrames, resampleBenchmark, &bench);
+
+	free((void*)bench.inFrames);
+	free(bench.out);
+}
+
+int main(int argc, char *argv[])
+{
+	testBitIdentity();
+	testUnsupportedRatios();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkResampling();
+	return AudioTestResult("AudioPolyphaseResamplerTest");
+}
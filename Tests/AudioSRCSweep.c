@@ -0,0 +1,57 @@
+/*
+ AudioSRCSweep.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+/* Sample rate converters benchmark sweep
+ Headless counterpart of the application SRC benchmark: measures the built-in polyphase FIR converter, and
+ libsamplerate when installed, at each AUDSampleRateConverterQuality setting on the common sample rate pairs.
+ Throughput, peak memory, THD+N, passband ripple and alias rejection are written to the standard output in the
+ application SRC benchmark CSV format, to track regressions and pick the defaults of a machine class */
+
+#include "AudioSRCTestConverters.h"
+
+static int sweepModel(const char *model, AudioSRCMeasureConvertProc convert)
+{
+	AudioSRCMeasureResults results[countof(kSampleRatePairs)];
+	UInt32 quality;
+	int failures = 0;
+
+	for (quality=0;quality<countof(kQualityNames);quality++)
+		if (!measureQuality(convert, quality, results, model)) failures++;
+	return failures;
+}
+
+int main(void)
+{
+	int failures = 0;
+
+	AudioSRCMeasureWriteCSVHeader(stdout);
+	failures += sweepModel("PolyphaseFIR", convertPolyphaseFIR);
+#ifdef AUDIO_TEST_HAVE_SAMPLERATE
+	failures += sweepModel("libSampleRate", convertlibSampleRate);
+#else
+	fprintf(stderr, "AudioSRCSweep: libsamplerate not found, only the polyphase FIR converter is measured\n");
+#endif
+	if (failures) fprintf(stderr, "AudioSRCSweep: %d quality settings not completely measured\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+/*
+ AudioSRCTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+/* Sample rate converters accuracy test and benchmark
+ Measures the polyphase FIR converter at each quality setting on the sample rate pairs of the application SRC
+ benchmark, and checks its THD+N, passband ripple and alias rejection against the filter design. When libsamplerate
+ is installed, the polyphase converter is also checked to be at least as accurate as libsamplerate at the same
+ quality setting. The benchmark prints the polyphase converter throughput, the full measures report being the
+ AudioSRCSweep one */
+
+#include "AudioTest.h"
+#include "AudioSRCTestConverters.h"
+
+#pragma mark Tests
+
+/* The filter design attenuation bounds THD+N and the aliases. The upsampling images of a tone near the input
+ Nyquist frequency fall in the transition band of the shorter filters: only improving with the quality */
+static void testPolyphaseAccuracy(bool isBenchmark)
+{
+	AudioSRCMeasureResults results[countof(kPolyphaseQualities)][countof(kSampleRatePairs)];
+	Float64 attenuation;
+	UInt32 quality;
+	size_t pair;
+	char name[128];
+
+	for (quality=0;quality<countof(kPolyphaseQualities);quality++) {
+		AudioTestCheck(measureQuality(convertPolyphaseFIR, quality, results[quality], NULL));
+		attenuation = kPolyphaseQualities[quality].attenuation;
+
+		for (pair=0;pair<countof(kSampleRatePairs);pair++) {
+			AudioTestCheck(results[quality][pair].thdPlusNoise <= kAudioSRCMeasureToleranceDB - attenuation);
+			if ((kSampleRatePairs[pair][1] < kSampleRatePairs[pair][0]) || (quality == countof(kPolyphaseQualities) - 1))
+				AudioTestCheck(results[quality][pair].aliasRejection >= attenuation - kAudioSRCMeasureToleranceDB);
+			if (quality > 0) {
+				AudioTestCheck(results[quality][pair].aliasRejection >= results[quality-1][pair].aliasRejection);
+				AudioTestCheck(results[quality][pair].passbandRipple <= results[quality-1][pair].passbandRipple);
+			}
+		}
+	}
+
+	for (pair=0;pair<countof(kSampleRatePairs);pair++)
+		AudioTestCheck(results[countof(kPolyphaseQualities) - 1][pair].passbandRipple < 0.001);
+
+	if (isBenchmark)
+		for (quality=0;quality<countof(kPolyphaseQualities);quality++)
+			for (pair=0;pair<countof(kSampleRatePairs);pair++) {
+				snprintf(name, sizeof(name), "polyphase FIR, %s quality, %.0fHz -> %.0fHz", kQualityNames[quality],
+						 kSampleRatePairs[pair][0], kSampleRatePairs[pair][1]);
+				AudioTestReportRate(name, "frames", results[quality][pair].framesPerSecond);
+			}
+}
+
+#ifdef AUDIO_TEST_HAVE_SAMPLERATE
+/* The polyphase converter, when selected, is to be at least as accurate as libsamplerate at the same quality */
+static void testAgainstLibSampleRate(void)
+{
+	AudioSRCMeasureResults polyphaseResults[countof(kSampleRatePairs)], libSampleRateResults[countof(kSampleRatePairs)];
+	UInt32 quality;
+	size_t pair;
+
+	for (quality=0;quality<countof(kPolyphaseQualities);quality++) {
+		AudioTestCheck(measureQuality(convertPolyphaseFIR, quality, polyphaseResults, NULL));
+		AudioTestCheck(measureQuality(convertlibSampleRate, quality, libSampleRateResults, NULL));
+		for (pair=0;pair<countof(kSampleRatePairs);pair++)
+			AudioTestCheck(AudioSRCMeasureIsAsAccurate(&polyphaseResults[pair], &libSampleRateResults[pair]));
+	}
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	testPolyphaseAccuracy(AudioTestIsBenchmark(argc, argv));
+#ifdef AUDIO_TEST_HAVE_SAMPLERATE
+	testAgainstLibSampleRate();
+#else
+	printf("AudioSRCTest: libsamplerate not found, not compared against it\n");
+#endif
+	return AudioTestResult("AudioSRCTest");
+}
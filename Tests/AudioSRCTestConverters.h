@@ -0,0 +1,140 @@
+/*
+ AudioSRCTestConverters.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+#ifndef __AUDIOSRCTESTCONVERTERS_H__
+#define __AUDIOSRCTESTCONVERTERS_H__
+
+/* Sample rate converters measured by the SRC accuracy test and the SRC benchmark sweep, with the quality settings
+ of AudioFileLoader getSRCSettingsForModel and the sample rate pairs of the application SRC benchmark */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#ifdef AUDIO_TEST_HAVE_SAMPLERATE
+#include <samplerate/samplerate.h>
+#endif
+
+#include "AudioSRCMeasure.h"
+#include "AudioPolyphaseResampler.h"
+
+#define countof(a) (sizeof(a)/sizeof((a)[0]))
+
+static const Float64 kSampleRatePairs[][2] = {
+	{ 44100.0, 88200.0 }, { 44100.0, 176400.0 }, { 44100.0, 192000.0 },
+	{ 48000.0, 96000.0 }, { 48000.0, 192000.0 }, { 96000.0, 44100.0 }
+};
+
+/* Polyphase settings of AudioFileLoader getSRCSettingsForModel, from the Lowest to the Max quality */
+static const struct { UInt32 tapsPerPhase; Float64 attenuation; } kPolyphaseQualities[] = {
+	{ 24, 70.0 }, { 32, 80.0 }, { 48, 100.0 }, { 64, 120.0 }, { 128, 140.0 }
+};
+
+static const char * const kQualityNames[] = { "Lowest", "Low", "Medium", "High", "Max" };
+
+typedef struct {
+	Float64 inSampleRate;
+	Float64 outSampleRate;
+	UInt32 quality;
+	const Float32 *inData;
+	long inFrames;
+	bool isInputSupplied;
+} TestConverter;
+
+#pragma mark Converters
+
+static long polyphaseInputCallback(void *cbData, float **data)
+{
+	TestConverter *converter = (TestConverter*)cbData;
+
+	if (converter->isInputSupplied) return 0;
+	converter->isInputSupplied = true;
+	*data = (float*)converter->inData;
+	return converter->inFrames;
+}
+
+static long convertPolyphaseFIR(void *userData, const Float32 *in, long inFrames, Float32 *out, long maxOutFrames)
+{
+	TestConverter *converter = (TestConverter*)userData;
+	AudioPolyphaseResampler *resampler;
+	long framesRead;
+
+	converter->inData = in;
+	converter->inFrames = inFrames;
+	converter->isInputSupplied = false;
+	resampler = AudioPolyphaseResamplerNew(polyphaseInputCallback, converter, converter->inSampleRate, converter->outSampleRate,
+										   kPolyphaseQualities[converter->quality].tapsPerPhase,
+										   kPolyphaseQualities[converter->quality].attenuation, 1, NULL);
+	if (resampler == NULL) return -1;
+
+	framesRead = AudioPolyphaseResamplerRead(resampler, maxOutFrames, out);
+	AudioPolyphaseResamplerDelete(resampler);
+	return framesRead;
+}
+
+#ifdef AUDIO_TEST_HAVE_SAMPLERATE
+/* libsamplerate converter of AudioFileLoader getSRCSettingsForModel, from the Lowest to the Max quality */
+static const int kLibSampleRateQualities[] = { SRC_LINEAR, SRC_ZERO_ORDER_HOLD, SRC_SINC_FASTEST,
+	SRC_SINC_MEDIUM_QUALITY, SRC_SINC_BEST_QUALITY };
+
+static long convertlibSampleRate(void *userData, const Float32 *in, long inFrames, Float32 *out, long maxOutFrames)
+{
+	TestConverter *converter = (TestConverter*)userData;
+	SRC_DATA srcData;
+
+	srcData.data_in = (float*)in; //Not const in the libsamplerate 0.1 headers
+	srcData.input_frames = inFrames;
+	srcData.data_out = out;
+	srcData.output_frames = maxOutFrames;
+	srcData.src_ratio = converter->outSampleRate / converter->inSampleRate;
+	if (src_simple(&srcData, kLibSampleRateQualities[converter->quality], 1) != 0) return -1;
+
+	return srcData.output_frames_gen;
+}
+#endif
+
+#pragma mark Measures
+
+/* Measures a converter on all the sample rate pairs at one quality
+ @return true if all the measures succeeded */
+static bool measureQuality(AudioSRCMeasureConvertProc convert, UInt32 quality, AudioSRCMeasureResults results[],
+						   const char *reportedModel)
+{
+	TestConverter converter;
+	bool isMeasured = true;
+	size_t pair;
+
+	for (pair=0;pair<countof(kSampleRatePairs);pair++) {
+		converter.inSampleRate = kSampleRatePairs[pair][0];
+		converter.outSampleRate = kSampleRatePairs[pair][1];
+		converter.quality = quality;
+		if (AudioSRCMeasure(convert, &converter, converter.inSampleRate, converter.outSampleRate, &results[pair]) != 0) {
+			isMeasured = false;
+			continue;
+		}
+		if (reportedModel)
+			AudioSRCMeasureWriteCSVLine(stdout, reportedModel, kQualityNames[quality],
+										converter.inSampleRate, converter.outSampleRate, &results[pair]);
+	}
+	return isMeasured;
+}
+
+#endif
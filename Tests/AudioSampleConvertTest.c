@@ -0,0 +1,261 @@
+/*
+ AudioSampleConvertTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+/* Planar to interleaved sample conversion test and benchmark
+ Checks the kernels selected for each channels layout give the same frames as a per-sample reference,
+ silent extra channels and duplicated mono included. The benchmark gives the frames/s of the selected
+ kernels and of the per-sample conversion they replace, for each bit depth */
+
+#include <stdlib.h>
+
+#include "AudioTest.h"
+#include "AudioSampleConvert.h"
+
+#define kTestMaxChannels 8
+#define kTestBenchFrames 4608 //Largest FLAC block of the common encoder settings
+#define kTestMaxFrames 4608
+
+#define countof(array) (sizeof(array)/sizeof((array)[0]))
+
+static const UInt32 kTestBits[] = { 16, 20, 24 };
+static const UInt32 kTestFrameCounts[] = { 0, 1, 3, 4, 7, 4096, 4099 };
+static const struct { UInt32 srcChannels, dstChannels; } kTestLayouts[] = { {1,1}, {1,2}, {1,6}, {2,2}, {2,4}, {6,6}, {6,8} };
+
+static SInt32 *gSamples[kTestMaxChannels];
+static Float32 *gFloatSamples[kTestMaxChannels];
+
+/* Random samples over the whole range of the bit depth, the extremes included */
+static void fillSamples(UInt32 nbFrames, UInt32 bitsPerSample)
+{
+	const SInt32 maxValue = (SInt32)((1L << (bitsPerSample-1)) - 1);
+	UInt32 channel,frame;
+
+	for (channel=0;channel<kTestMaxChannels;channel++) {
+		for (frame=0;frame<nbFrames;frame++) {
+			SInt32 value = (SInt32)(((UInt32)rand() << 16) ^ (UInt32)rand());
+			gSamples[channel][frame] = value >> (32 - bitsPerSample);
+			gFloatSamples[channel][frame] = (Float32)gSamples[channel][frame] / (Float32)(maxValue + 1);
+		}
+		if (nbFrames > 1) {
+			gSamples[channel][0] = maxValue;
+			gSamples[channel][1] = -maxValue - 1;
+		}
+	}
+}
+
+/* Expected source sample of a destination channel, or -1 for a silent one */
+static int sourceChannel(UInt32 channel, UInt32 srcChannels, bool duplicateMono)
+{
+	if (channel < srcChannels) return (int)channel;
+	if (duplicateMono && (srcChannels == 1) && (channel == 1)) return 0;
+	return -1;
+}
+
+static bool checkFloat32Kernel(AudioSampleConvertKernel kernel, UInt32 nbFrames, UInt32 srcChannels, UInt32 dstChannels,
+							   UInt32 bitsPerSample, bool duplicateMono)
+{
+	const Float32 fullScale = (Float32)(1L << (((bitsPerSample + 7) / 8) * 8 - 1));
+	Float32 *out = (Float32*)malloc((nbFrames*dstChannels + 1)*sizeof(Float32));
+	bool isCorrect = true;
+	UInt32 frame,channel;
+	int src;
+
+	out[nbFrames*dstChannels] = 1234.0f; //Guard
+	kernel(out, (const SInt32* const*)gSamples, nbFrames, srcChannels, dstChannels, bitsPerSample);
+	for (frame=0;frame<nbFrames;frame++)
+		for (channel=0;channel<dstChannels;channel++) {
+			src = sourceChannel(channel, srcChannels, duplicateMono);
+			if (out[frame*dstChannels + channel] != ((src < 0) ? 0.0f : (Float32)gSamples[src][frame] / fullScale))
+				isCorrect = false;
+		}
+	if (out[nbFrames*dstChannels] != 1234.0f) isCorrect = false;
+	free(out);
+	return isCorrect;
+}
+
+static bool checkInt32Kernel(AudioSampleConvertKernel kernel, UInt32 nbFrames, UInt32 srcChannels, UInt32 dstChannels,
+							 UInt32 bitsPerSample, bool duplicateMono)
+{
+	SInt32 *out = (SInt32*)malloc((nbFrames*dstChannels + 1)*sizeof(SInt32));
+	bool isCorrect = true;
+	UInt32 frame,channel;
+	int src;
+
+	out[nbFrames*dstChannels] = 1234; //Guard
+	kernel(out, (const SInt32* const*)gSamples, nbFrames, srcChannels, dstChannels, bitsPerSample);
+	for (frame=0;frame<nbFrames;frame++)
+		for (channel=0;channel<dstChannels;channel++) {
+			src = sourceChannel(channel, srcChannels, duplicateMono);
+			if (out[frame*dstChannels + channel] != ((src < 0) ? 0 : (SInt32)((UInt32)gSamples[src][frame] << (32 - bitsPerSample))))
+				isCorrect = false;
+		}
+	if (out[nbFrames*dstChannels] != 1234) isCorrect = false;
+	free(out);
+	return isCorrect;
+}
+
+static bool checkFloatKernel(AudioSampleFloatConvertKernel kernel, UInt32 nbFrames, UInt32 srcChannels, UInt32 dstChannels,
+							 bool duplicateMono)
+{
+	Float32 *out = (Float32*)malloc((nbFrames*dstChannels + 1)*sizeof(Float32));
+	bool isCorrect = true;
+	UInt32 frame,channel;
+	int src;
+
+	out[nbFrames*dstChannels] = 1234.0f; //Guard
+	kernel(out, (const Float32* const*)gFloatSamples, nbFrames, srcChannels, dstChannels);
+	for (frame=0;frame<nbFrames;frame++)
+		for (channel=0;channel<dstChannels;channel++) {
+			src = sourceChannel(channel, srcChannels, duplicateMono);
+			if (out[frame*dstChannels + channel] != ((src < 0) ? 0.0f : gFloatSamples[src][frame]))
+				isCorrect = false;
+		}
+	if (out[nbFrames*dstChannels] != 1234.0f) isCorrect = false;
+	free(out);
+	return isCorrect;
+}
+
+static void testKernels(void)
+{
+	const char *kernelName;
+	UInt32 bits,layout,count,options;
+	bool duplicateMono;
+
+	for (bits=0;bits<countof(kTestBits);bits++) {
+		for (layout=0;layout<countof(kTestLayouts);layout++) {
+			for (options=0;options<2;options++) {
+				const UInt32 srcChannels = kTestLayouts[layout].srcChannels;
+				const UInt32 dstChannels = kTestLayouts[layout].dstChannels;
+				AudioSampleConvertKernel toFloat32 = AudioSampleSelectPlanarToFloat32Kernel(srcChannels, dstChannels, options, &kernelName);
+				AudioSampleConvertKernel toInt32 = AudioSampleSelectPlanarToInt32Kernel(srcChannels, dstChannels, options, &kernelName);
+				AudioSampleFloatConvertKernel interleave = AudioSampleSelectPlanarFloat32Kernel(srcChannels, dstChannels, options, &kernelName);
+
+				duplicateMono = (options & kAudioSampleConvertDuplicateMono) != 0;
+				AudioTestCheck(kernelName != NULL);
+				for (count=0;count<countof(kTestFrameCounts);count++) {
+					fillSamples(kTestFrameCounts[count], kTestBits[bits]);
+					AudioTestCheck(checkFloat32Kernel(toFloat32, kTestFrameCounts[count], srcChannels, dstChannels,
+													  kTestBits[bits], duplicateMono));
+					AudioTestCheck(checkInt32Kernel(toInt32, kTestFrameCounts[count], srcChannels, dstChannels,
+													kTestBits[bits], duplicateMono));
+					AudioTestCheck(checkFloatKernel(interleave, kTestFrameCounts[count], srcChannels, dstChannels,
+													duplicateMono));
+				}
+			}
+		}
+	}
+}
+
+#pragma mark Benchmark
+
+typedef struct {
+	AudioSampleConvertKernel kernel;
+	UInt32 srcChannels;
+	UInt32 bitsPerSample;
+	void *out;
+} ConvertBench;
+
+static void benchKernel(void *context)
+{
+	ConvertBench *bench = (ConvertBench*)context;
+	bench->kernel(bench->out, (const SInt32* const*)gSamples, kTestBenchFrames, bench->srcChannels, 2, bench->bitsPerSample);
+}
+
+/* The per-sample conversion the kernels replace: a divide per sample and a channels test per frame */
+static void benchPerSampleFloat32(void *context)
+{
+	ConvertBench *bench = (ConvertBench*)context;
+	const Float32 bitDepthFactor = (Float32)(1L << (((bench->bitsPerSample + 7) / 8) * 8 - 1));
+	Float32 *out = (Float32*)bench->out;
+	UInt32 frame;
+
+	for (frame=0;frame<kTestBenchFrames;frame++) {
+		out[frame*2] = gSamples[0][frame] / bitDepthFactor;
+		out[frame*2+1] = bench->srcChannels>1 ? gSamples[1][frame] / bitDepthFactor : (Float32)0.0;
+	}
+}
+
+static void benchPerSampleInt32(void *context)
+{
+	ConvertBench *bench = (ConvertBench*)context;
+	SInt32 *out = (SInt32*)bench->out;
+	UInt32 frame;
+
+	for (frame=0;frame<kTestBenchFrames;frame++) {
+		out[frame*2] = gSamples[0][frame] << (32 - bench->bitsPerSample);
+		out[frame*2+1] = bench->srcChannels>1 ? gSamples[1][frame] << (32 - bench->bitsPerSample) : 0;
+	}
+}
+
+static void benchmarkKernels(void)
+{
+	static const UInt32 benchBits[] = { 16, 24 };
+	const char *kernelName;
+	char name[128];
+	ConvertBench bench;
+	UInt32 bits,srcChannels,options;
+
+	bench.out = malloc(kTestBenchFrames*2*sizeof(SInt32));
+	for (bits=0;bits<countof(benchBits);bits++) {
+		fillSamples(kTestBenchFrames, benchBits[bits]);
+		bench.bitsPerSample = benchBits[bits];
+		for (srcChannels=1;srcChannels<=2;srcChannels++) {
+			bench.srcChannels = srcChannels;
+
+			snprintf(name, sizeof(name), "%ubit %s to float32 per sample", benchBits[bits], (srcChannels == 1) ? "mono" : "stereo");
+			AudioTestBenchmark(name, "frames", kTestBenchFrames, benchPerSampleFloat32, &bench);
+			snprintf(name, sizeof(name), "%ubit %s to int32 per sample", benchBits[bits], (srcChannels == 1) ? "mono" : "stereo");
+			AudioTestBenchmark(name, "frames", kTestBenchFrames, benchPerSampleInt32, &bench);
+
+			for (options=0;options<=((srcChannels == 1) ? (UInt32)kAudioSampleConvertDuplicateMono : 0);options++) {
+				bench.kernel = AudioSampleSelectPlanarToFloat32Kernel(srcChannels, 2, options, &kernelName);
+				snprintf(name, sizeof(name), "%ubit %s", benchBits[bits], kernelName);
+				AudioTestBenchmark(name, "frames", kTestBenchFrames, benchKernel, &bench);
+				bench.kernel = AudioSampleSelectPlanarToInt32Kernel(srcChannels, 2, options, &kernelName);
+				snprintf(name, sizeof(name), "%ubit %s", benchBits[bits], kernelName);
+				AudioTestBenchmark(name, "frames", kTestBenchFrames, benchKernel, &bench);
+			}
+		}
+	}
+	free(bench.out);
+}
+
+int main(int argc, char *argv[])
+{
+	UInt32 channel;
+
+	for (channel=0;channel<kTestMaxChannels;channel++) {
+		gSamples[channel] = (SInt32*)malloc(kTestMaxFrames*sizeof(SInt32));
+		gFloatSamples[channel] = (Float32*)malloc(kTestMaxFrames*sizeof(Float32));
+	}
+
+	testKernels();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkKernels();
+
+	for (channel=0;channel<kTestMaxChannels;channel++) {
+		free(gSamples[channel]);
+		free(gFloatSamples[channel]);
+	}
+	return AudioTestResult("AudioSampleConvertTest");
+}
@@ -0,0 +1,219 @@
+/*
+ AudioSampleRatePolicyTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+/* Sample rate switch policy test
+ Checks that the bit-perfect mode never converts and the adaptive one never downsamples, the run of tracks at the
+ next rate and the switch back to the playing rate counted from the lookahead, and the integer and fractional
+ ratios conversion costs */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "AudioTest.h"
+#include "AudioSampleRatePolicy.h"
+
+#define countof(a) (sizeof(a)/sizeof((a)[0]))
+
+static void setTransition(AudioSampleRatePolicyTransition *transition, UInt32 mode, Float64 playingRate, Float64 nextRate,
+						  const Float64 *upcomingRates, UInt32 upcomingCount, Float64 switchDuration)
+{
+	UInt32 i;
+
+	transition->mode = mode;
+	transition->playingRate = playingRate;
+	transition->playingNativeRate = playingRate;
+	transition->nextRate = nextRate;
+	transition->nextNativeRate = nextRate;
+	transition->switchDuration = switchDuration;
+	transition->upcomingCount = upcomingCount;
+	for (i=0;i<upcomingCount;i++)
+		transition->upcomingNativeRates[i] = upcomingRates[i];
+}
+
+static void testBitPerfectNeverConverts(void)
+{
+	static const Float64 rates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+	static const Float64 upcoming[] = { 44100, 44100, 48000 };
+	static const Float64 switchDurations[] = { 0.0, 0.5, 10.0, 1000.0 };
+	AudioSampleRatePolicyTransition transition;
+	AudioSampleRatePolicyDecision decision;
+	UInt32 playing, next, duration;
+
+	for (playing=0;playing<countof(rates);playing++)
+		for (next=0;next<countof(rates);next++)
+			for (duration=0;duration<countof(switchDurations);duration++) {
+				if (playing == next) continue;
+				setTransition(&transition, kAudioSampleRatePolicyBitPerfect, rates[playing], rates[next],
+							  upcoming, countof(upcoming), switchDurations[duration]);
+				AudioSampleRatePolicyDecide(&transition, &decision);
+				AudioTestCheck(decision.action == kAudioSampleRatePolicyReclock);
+			}
+}
+
+static void testAdaptiveNeverDownsamples(void)
+{
+	static const Float64 upcoming[] = { 44100, 44100 };
+	AudioSampleRatePolicyTransition transition;
+	AudioSampleRatePolicyDecision decision;
+
+	//Returning to the playing rate after a single track, with a huge switch gap: converting would still lose resolution
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 44100, 88200, upcoming, countof(upcoming), 1000.0);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyReclock);
+
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 44100, 48000, upcoming, countof(upcoming), 1000.0);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyReclock);
+
+	//The same transition upwards is converted
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 88200, 44100, upcoming, 0, 1000.0);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyResample);
+
+	//Gapless mode converts in both directions
+	setTransition(&transition, kAudioSampleRatePolicyGapless, 44100, 88200, upcoming, 0, 0.0);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyResample);
+}
+
+static void testRunLength(void)
+{
+	static const Float64 runThenBack[] = { 48000, 48000, 96000, 48000 };
+	static const Float64 runThenOther[] = { 48000, 44100, 96000 };
+	static const Float64 runToEnd[] = { 48000, 48000, 48000 };
+	AudioSampleRatePolicyTransition transition;
+	AudioSampleRatePolicyDecision decision;
+
+	//Two tracks after the next one at its rate, then back to the playing rate: both switches avoided
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, runThenBack, countof(runThenBack), 0.5);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.runLength == 3);
+	AudioTestCheck(decision.switchesAvoided == 2);
+	AudioTestCheck(decision.switchCost == 2*0.5);
+	AudioTestCheck(decision.conversionCost == 3*kAudioSampleRatePolicyIntegerRatioCost);
+
+	//Followed by a third rate: the device switches anyway after the run
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, runThenOther, countof(runThenOther), 0.5);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.runLength == 2);
+	AudioTestCheck(decision.switchesAvoided == 1);
+
+	//Run up to the lookahead end, and no lookahead
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, runToEnd, countof(runToEnd), 0.5);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.runLength == 4);
+	AudioTestCheck(decision.switchesAvoided == 1);
+
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, NULL, 0, 0.5);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.runLength == 1);
+	AudioTestCheck(decision.switchesAvoided == 1);
+}
+
+static void testReturnToConvertedPlayingTrack(void)
+{
+	static const Float64 backToPlayingNative[] = { 44100 };
+	static const Float64 backToDevice[] = { 88200 };
+	static const Float64 toOther[] = { 176400 };
+	AudioSampleRatePolicyTransition transition;
+	AudioSampleRatePolicyDecision decision;
+
+	//Playing track at 44.1kHz converted to the 88.2kHz device rate, next one at 48kHz
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 88200, 48000, backToPlayingNative, 1, 0.5);
+	transition.playingNativeRate = 44100;
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.switchesAvoided == 2);
+
+	//Track after the run natively at the device rate
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 88200, 48000, backToDevice, 1, 0.5);
+	transition.playingNativeRate = 44100;
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.switchesAvoided == 2);
+
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 88200, 48000, toOther, 1, 0.5);
+	transition.playingNativeRate = 44100;
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.switchesAvoided == 1);
+}
+
+static void testConversionCost(void)
+{
+	static const Float64 backToPlaying[] = { 96000 };
+	static const Float64 backToPlayingFractional[] = { 88200 };
+	AudioSampleRatePolicyTransition transition;
+	AudioSampleRatePolicyDecision decision;
+
+	AudioTestCheck(AudioSampleRatePolicyConversionCost(44100, 88200) == kAudioSampleRatePolicyIntegerRatioCost);
+	AudioTestCheck(AudioSampleRatePolicyConversionCost(192000, 48000) == kAudioSampleRatePolicyIntegerRatioCost);
+	AudioTestCheck(AudioSampleRatePolicyConversionCost(48000, 144000) == kAudioSampleRatePolicyIntegerRatioCost);
+	AudioTestCheck(AudioSampleRatePolicyConversionCost(44100, 48000) == kAudioSampleRatePolicyFractionalRatioCost);
+	AudioTestCheck(AudioSampleRatePolicyConversionCost(96000, 88200) == kAudioSampleRatePolicyFractionalRatioCost);
+	AudioTestCheck(AudioSampleRatePolicyConversionCost(44100, 192000) == kAudioSampleRatePolicyFractionalRatioCost);
+
+	//Two switches of 0.3s avoided: worth an integer ratio conversion, not a fractional one
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, backToPlaying, 1, 0.3);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.conversionCost == kAudioSampleRatePolicyIntegerRatioCost);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyResample);
+
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 88200, 48000, backToPlayingFractional, 1, 0.3);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.conversionCost == kAudioSampleRatePolicyFractionalRatioCost);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyReclock);
+
+	//A single switch of 0.3s avoided is not worth even an integer ratio conversion
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, NULL, 0, 0.3);
+	AudioSampleRatePolicyDecide(&transition, &decision);
+	AudioTestCheck(decision.action == kAudioSampleRatePolicyReclock);
+}
+
+static void decideWithFullLookahead(void *context)
+{
+	AudioSampleRatePolicyDecision decision;
+
+	AudioSampleRatePolicyDecide((const AudioSampleRatePolicyTransition*)context, &decision);
+}
+
+static void benchmarkDecide(void)
+{
+	static Float64 upcoming[kAudioSampleRatePolicyMaxLookahead];
+	AudioSampleRatePolicyTransition transition;
+	UInt32 i;
+
+	for (i=0;i<kAudioSampleRatePolicyMaxLookahead;i++) upcoming[i] = 48000;
+	setTransition(&transition, kAudioSampleRatePolicyAdaptive, 96000, 48000, upcoming, kAudioSampleRatePolicyMaxLookahead, 0.5);
+	AudioTestBenchmark("adaptive decision, full lookahead", "decisions", 1, decideWithFullLookahead, &transition);
+}
+
+int main(int argc, char *argv[])
+{
+	testBitPerfectNeverConverts();
+	testAdaptiveNeverDownsamples();
+	testRunLength();
+	testReturnToConvertedPlayingTrack();
+	testConversionCost();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkDecide();
+	return AudioTestResult("AudioSampleRatePolicyTest");
+}
@@ -0,0 +1,315 @@
+/*
+ AudioSndFileIntegerTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+/* Integer mode PCM files read test and benchmark
+ The PCM 16, 24 and 32bit files are read as the integer mode loader does: sf_readf_int samples aligned high,
+ written in the device format by the integer writers. Every device sample must be the file one, moved to the
+ device width. The benchmark gives the frames/s of this path, and of the sf_readf_double one it replaced.
+ Without libsndfile, the files are read by a minimal WAV reader with the sf_readf_int and sf_readf_double
+ scaling, so that the writers part is still checked */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "AudioTest.h"
+#include "AudioIntegerWriter.h"
+
+#ifdef AUDIO_TEST_HAVE_SNDFILE
+#include <sndfile/sndfile.h>
+#endif
+
+#define kTestChannels 2
+#define kTestFrames 100003 //Not a multiple of the read size
+#define kTestReadFrames 4096 //Loader read step
+#define kBenchFrames (10*44100)
+
+#define countof(array) (sizeof(array)/sizeof((array)[0]))
+
+static const UInt32 kTestFileBits[] = { 16, 24, 32 };
+static const AudioIntegerWriterFormat kTestDeviceFormats[] = {
+	{ 2, 16, false, false }, { 3, 24, false, false }, { 3, 24, true, false },
+	{ 4, 24, false, false }, { 4, 32, false, false }, { 4, 32, true, false }
+};
+
+#pragma mark PCM files
+
+static void writeLE(FILE *file, UInt32 value, UInt32 bytes)
+{
+	UInt32 i;
+	for (i=0;i<bytes;i++) fputc((int)((value >> (8*i)) & 0xFF), file);
+}
+
+/* Random samples, the extreme values included, in a WAV file
+ @return the samples, low aligned, to be freed */
+static SInt32* writePCMFile(const char *path, UInt32 bitsPerSample, UInt32 nbFrames)
+{
+	const UInt32 bytesPerSample = bitsPerSample / 8;
+	const UInt32 dataSize = nbFrames*kTestChannels*bytesPerSample;
+	SInt32 *samples = (SInt32*)malloc(nbFrames*kTestChannels*sizeof(SInt32));
+	FILE *file = fopen(path, "wb");
+	UInt32 i;
+
+	if ((file == NULL) || (samples == NULL)) {
+		if (file) fclose(file);
+		free(samples);
+		return NULL;
+	}
+
+	fwrite("RIFF", 1, 4, file); writeLE(file, 36 + dataSize, 4); fwrite("WAVE", 1, 4, file);
+	fwrite("fmt ", 1, 4, file); writeLE(file, 16, 4);
+	writeLE(file, 1, 2); writeLE(file, kTestChannels, 2); writeLE(file, 44100, 4);
+	writeLE(file, 44100*kTestChannels*bytesPerSample, 4); writeLE(file, kTestChannels*bytesPerSample, 2); writeLE(file, bitsPerSample, 2);
+	fwrite("data", 1, 4, file); writeLE(file, dataSize, 4);
+
+	for (i=0;i<nbFrames*kTestChannels;i++) {
+		samples[i] = (SInt32)(((UInt32)rand() << 16) ^ (UInt32)rand()) >> (32 - bitsPerSample);
+		if (i == 0) samples[i] = (SInt32)((1LL << (bitsPerSample - 1)) - 1);
+		else if (i == 1) samples[i] = (SInt32)(-(1LL << (bitsPerSample - 1)));
+		writeLE(file, (UInt32)samples[i], bytesPerSample);
+	}
+
+	if (fclose(file) != 0) {
+		free(samples);
+		return NULL;
+	}
+	return samples;
+}
+
+#ifdef AUDIO_TEST_HAVE_SNDFILE
+typedef SNDFILE TestPCMFile;
+
+static TestPCMFile* openPCMFile(const char *path)
+{
+	SF_INFO info;
+	memset(&info, 0, sizeof(info));
+	return sf_open(path, SFM_READ, &info);
+}
+
+static void closePCMFile(TestPCMFile *file) { sf_close(file); }
+static SInt64 readFramesInt(TestPCMFile *file, SInt32 *frames, SInt64 nbFrames) { return sf_readf_int(file, frames, nbFrames); }
+static SInt64 readFramesDouble(TestPCMFile *file, Float64 *frames, SInt64 nbFrames) { return sf_readf_double(file, frames, nbFrames); }
+#else
+/* Minimal reader of the files written above */
+typedef struct {
+	FILE *file;
+	UInt32 bitsPerSample;
+	UInt8 *data;
+} TestPCMFile;
+
+static TestPCMFile* openPCMFile(const char *path)
+{
+	TestPCMFile *pcmFile = (TestPCMFile*)calloc(1, sizeof(TestPCMFile));
+	UInt8 header[44];
+
+	pcmFile->file = fopen(path, "rb");
+	if ((pcmFile->file == NULL) || (fread(header, 1, sizeof(header), pcmFile->file) != sizeof(header))) {
+		if (pcmFile->file) fclose(pcmFile->file);
+		free(pcmFile);
+		return NULL;
+	}
+	pcmFile->bitsPerSample = header[34] | ((UInt32)header[35] << 8);
+	pcmFile->data = (UInt8*)malloc(kTestReadFrames*kTestChannels*4);
+	return pcmFile;
+}
+
+static void closePCMFile(TestPCMFile *pcmFile)
+{
+	fclose(pcmFile->file);
+	free(pcmFile->data);
+	free(pcmFile);
+}
+
+/* Samples aligned high, as sf_readf_int */
+static SInt64 readFramesInt(TestPCMFile *pcmFile, SInt32 *frames, SInt64 nbFrames)
+{
+	const UInt32 bytesPerSample = pcmFile->bitsPerSample / 8;
+	SInt64 framesRead = 0, readStep, i;
+	UInt32 byte;
+
+	while (framesRead < nbFrames) {
+		readStep = nbFrames - framesRead;
+		if (readStep > kTestReadFrames) readStep = kTestReadFrames;
+		readStep = (SInt64)fread(pcmFile->data, bytesPerSample*kTestChannels, (size_t)readStep, pcmFile->file);
+		if (readStep <= 0) break;
+		for (i=0;i<readStep*kTestChannels;i++) {
+			UInt32 value = 0;
+			for (byte=0;byte<bytesPerSample;byte++)
+				value |= (UInt32)pcmFile->data[i*bytesPerSample + byte] << (8*(4 - bytesPerSample + byte));
+			frames[framesRead*kTestChannels + i] = (SInt32)value;
+		}
+		framesRead += readStep;
+	}
+	return framesRead;
+}
+
+/* Samples normalized to [-1.0,1.0[, as sf_readf_double */
+static SInt64 readFramesDouble(TestPCMFile *pcmFile, Float64 *frames, SInt64 nbFrames)
+{
+	SInt32 *intFrames = (SInt32*)frames; //Expanded in place, from the end
+	SInt64 framesRead = readFramesInt(pcmFile, intFrames, nbFrames), i;
+
+	for (i=framesRead*kTestChannels-1;i>=0;i--)
+		frames[i] = (Float64)intFrames[i] * (1.0 / 2147483648.0);
+	return framesRead;
+}
+#endif
+
+#pragma mark Bit exactness
+
+/* Device sample back to its value aligned high */
+static SInt32 readDeviceSample(const AudioIntegerWriterFormat *format, const UInt8 *sample)
+{
+	UInt32 value = 0, i;
+
+	for (i=0;i<format->bytesPerSample;i++)
+		value |= (UInt32)sample[format->isBigEndian ? i : (format->bytesPerSample - 1 - i)] << (8*(format->bytesPerSample - 1 - i));
+	return (SInt32)(value << (32 - 8*format->bytesPerSample));
+}
+
+/* Reads the file by loader steps as the integer mode loader, and checks each device sample */
+static bool checkIntegerRead(const char *path, const SInt32 *samples, UInt32 fileBits, const AudioIntegerWriterFormat *format)
+{
+	TestPCMFile *file = openPCMFile(path);
+	AudioIntegerWriter writer;
+	SInt32 *intFrames = (SInt32*)malloc(kTestReadFrames*kTestChannels*sizeof(SInt32));
+	UInt8 *deviceFrames = (UInt8*)malloc(kTestReadFrames*kTestChannels*format->bytesPerSample);
+	SInt64 framesRead, totalFrames = 0, i;
+	bool isExact = (file != NULL) && AudioIntegerWriterSelect(&writer, format);
+
+	while (isExact && ((framesRead = readFramesInt(file, intFrames, kTestReadFrames)) > 0)) {
+		AudioIntegerWriterWrite(&writer, kAudioIntegerWriterSourceInt32, deviceFrames, intFrames, (UInt64)framesRead*kTestChannels);
+		for (i=0;i<framesRead*kTestChannels;i++)
+			if (readDeviceSample(format, deviceFrames + i*format->bytesPerSample)
+				!= (SInt32)((UInt32)samples[totalFrames*kTestChannels + i] << (32 - fileBits)))
+				isExact = false;
+		totalFrames += framesRead;
+	}
+	if (totalFrames != kTestFrames) isExact = false;
+
+	if (file) closePCMFile(file);
+	free(intFrames);
+	free(deviceFrames);
+	return isExact;
+}
+
+static void testBitExactness(void)
+{
+	char path[] = "/tmp/AudioSndFileIntegerTest.XXXXXX";
+	UInt32 bits,format;
+	int fd;
+
+	for (bits=0;bits<countof(kTestFileBits);bits++) {
+		SInt32 *samples;
+
+		fd = mkstemp(path);
+		AudioTestCheck(fd >= 0);
+		if (fd < 0) return;
+		close(fd);
+
+		samples = writePCMFile(path, kTestFileBits[bits], kTestFrames);
+		AudioTestCheck(samples != NULL);
+		if (samples) {
+			//Device formats at least as wide as the file, as the loader selects the integer path for
+			for (format=0;format<countof(kTestDeviceFormats);format++)
+				if (kTestDeviceFormats[format].bitsPerSample >= kTestFileBits[bits])
+					AudioTestCheck(checkIntegerRead(path, samples, kTestFileBits[bits], &kTestDeviceFormats[format]));
+			free(samples);
+		}
+		unlink(path);
+		strcpy(path, "/tmp/AudioSndFileIntegerTest.XXXXXX");
+	}
+}
+
+#pragma mark Benchmark
+
+/* Whole file read and written in the device format, in the loader steps
+ @return frames/s */
+static double benchRead(const char *path, const AudioIntegerWriter *writer, bool isIntegerPath, UInt32 deviceBytesPerSample)
+{
+	TestPCMFile *file = openPCMFile(path);
+	void *frames = malloc(kTestReadFrames*kTestChannels*sizeof(Float64));
+	UInt8 *deviceFrames = (UInt8*)malloc(kTestReadFrames*kTestChannels*deviceBytesPerSample);
+	double start = AudioTestTime();
+	SInt64 framesRead, totalFrames = 0;
+
+	if (file == NULL) {
+		free(frames);
+		free(deviceFrames);
+		return 0.0;
+	}
+	for (;;) {
+		if (isIntegerPath) {
+			framesRead = readFramesInt(file, (SInt32*)frames, kTestReadFrames);
+			if (framesRead <= 0) break;
+			AudioIntegerWriterWrite(writer, kAudioIntegerWriterSourceInt32, deviceFrames, frames, (UInt64)framesRead*kTestChannels);
+		}
+		else {
+			framesRead = readFramesDouble(file, (Float64*)frames, kTestReadFrames);
+			if (framesRead <= 0) break;
+			AudioIntegerWriterWrite(writer, kAudioIntegerWriterSourceFloat64, deviceFrames, frames, (UInt64)framesRead*kTestChannels);
+		}
+		totalFrames += framesRead;
+	}
+	closePCMFile(file);
+	free(frames);
+	free(deviceFrames);
+	return (double)totalFrames / (AudioTestTime() - start);
+}
+
+static void benchmarkPaths(void)
+{
+	static const AudioIntegerWriterFormat deviceFormats[] = { { 2, 16, false, false }, { 4, 24, false, false }, { 4, 32, false, false } };
+	char path[] = "/tmp/AudioSndFileIntegerBench.XXXXXX";
+	char name[128];
+	AudioIntegerWriter writer;
+	SInt32 *samples;
+	UInt32 bits;
+	int fd = mkstemp(path);
+
+	if (fd < 0) return;
+	close(fd);
+	for (bits=0;bits<countof(kTestFileBits);bits++) {
+		samples = writePCMFile(path, kTestFileBits[bits], kBenchFrames);
+		if (samples == NULL) continue;
+		free(samples);
+		AudioIntegerWriterSelect(&writer, &deviceFormats[bits]);
+
+		benchRead(path, &writer, true, deviceFormats[bits].bytesPerSample); //Warm up the file cache
+		snprintf(name, sizeof(name), "PCM %u to %s, sf_readf_int", kTestFileBits[bits], writer.name);
+		AudioTestReportRate(name, "frames", benchRead(path, &writer, true, deviceFormats[bits].bytesPerSample));
+		snprintf(name, sizeof(name), "PCM %u to %s, sf_readf_double", kTestFileBits[bits], writer.name);
+		AudioTestReportRate(name, "frames", benchRead(path, &writer, false, deviceFormats[bits].bytesPerSample));
+	}
+	unlink(path);
+}
+
+int main(int argc, char *argv[])
+{
+#ifndef AUDIO_TEST_HAVE_SNDFILE
+	printf("AudioSndFileIntegerTest: libsndfile not found, the files are read by the test WAV reader\n");
+#endif
+	testBitExactness();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkPaths();
+	return AudioTestResult("AudioSndFileIntegerTest");
+}
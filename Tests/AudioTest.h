@@ -0,0 +1,114 @@
+/*
+ AudioTest.h
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+#ifndef __AUDIOTEST_H__
+#define __AUDIOTEST_H__
+
+/* Minimal test and microbenchmark harness shared by the portable code tests
+ Each test program runs its checks, and its microbenchmarks too when launched with -bench */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define kAudioTestBenchmarkMinDuration 0.25 //seconds each microbenchmark runs at least
+
+static int gAudioTestChecks = 0;
+static int gAudioTestFailures = 0;
+
+/** AudioTestCheck
+ Counts a failure and prints the failed condition, without stopping the test */
+#define AudioTestCheck(cond) do { \
+	gAudioTestChecks++; \
+	if (!(cond)) { \
+		gAudioTestFailures++; \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+	} \
+} while (0)
+
+static inline double AudioTestTime(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec*1e-6;
+}
+
+/** AudioTestIsBenchmark
+ @return true when the microbenchmarks are requested on the command line */
+static inline bool AudioTestIsBenchmark(int argc, char *argv[])
+{
+	int i;
+	for (i=1;i<argc;i++)
+		if (strcmp(argv[i], "-bench") == 0) return true;
+	return false;
+}
+
+/** AudioTestReportRate
+ Prints a benchmark throughput, in millions of items per second */
+static inline void AudioTestReportRate(const char *name, const char *unit, double rate)
+{
+	printf("%-72s %12.2f M%s/s\n", name, rate*1e-6, unit);
+}
+
+/** AudioTestBenchmark
+ Calls the benchmarked function until kAudioTestBenchmarkMinDuration is elapsed, and prints its throughput
+ @param name benchmark name
+ @param unit name of the processed items, e.g. "frames"
+ @param itemsPerCall items processed by each call
+ @param function the benchmarked function
+ @param context passed to function
+ @return the throughput, in items per second */
+static inline double AudioTestBenchmark(const char *name, const char *unit, double itemsPerCall,
+										void (*function)(void *context), void *context)
+{
+	double start, elapsed, rate;
+	unsigned long calls = 0, batch = 1, i;
+
+	function(context); //Warm up caches and page tables
+	start = AudioTestTime();
+	do {
+		for (i=0;i<batch;i++) function(context);
+		calls += batch;
+		batch *= 2;
+		elapsed = AudioTestTime() - start;
+	} while (elapsed < kAudioTestBenchmarkMinDuration);
+
+	rate = itemsPerCall*(double)calls/elapsed;
+	AudioTestReportRate(name, unit, rate);
+	return rate;
+}
+
+/** AudioTestResult
+ Prints the test summary
+ @return the process exit status */
+static inline int AudioTestResult(const char *testName)
+{
+	if (gAudioTestFailures) {
+		printf("%s: %d of %d checks FAILED\n", testName, gAudioTestFailures, gAudioTestChecks);
+		return 1;
+	}
+	printf("%s: %d checks passed\n", testName, gAudioTestChecks);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ AudioVorbisDecoderTest.c
+
+ This file is part of AudioNirvana.
+
+ Audirvana is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Audirvana is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Audirvana.  If not, see <http://www.gnu.org/licenses/>.
+
+ Original code written by Damien Plisson 06/2011
+ */
+
+
+
+
+/* Vorbis decoder core test and benchmark
+ The decoder reads a synthetic stream through fake ov_read_float and ov_info procs, supplying the decoded packets
+ of varying sizes, gaps, errors and chained sections. Checks the frames interleaving in the WAV channels order, the
+ gaps skipping, the errors and the channels count changes ending the stream. The benchmark measures the interleaving
+ throughput of decoded packets */
+
+#include <stdlib.h>
+
+#include "AudioTest.h"
+#include "AudioVorbisDecoder.h"
+
+#define countof(a) (sizeof(a)/sizeof((a)[0]))
+#define kTestFrames 20000
+#define kTestMaxChannels 8
+#define kBenchPacketFrames 1024 //Long blocks of a 44.1kHz stream
+
+/* WAV order channel of each Vorbis order one, from the Vorbis I specification and the WAVEFORMATEXTENSIBLE masks:
+ e.g. 5.1 is L C R Ls Rs LFE in Vorbis and L R C LFE Ls Rs in WAV */
+static const int kExpectedOrder[kTestMaxChannels][kTestMaxChannels] = {
+	{0},
+	{0,1},
+	{0,2,1},
+	{0,1,2,3},
+	{0,2,1,3,4},
+	{0,2,1,5,3,4},
+	{0,2,1,6,5,3,4},
+	{0,2,1,7,5,6,3,4}
+};
+
+/* Synthetic stream, the OggVorbis_File datasource */
+typedef struct {
+	float *samples[kTestMaxChannels]; //Planar, sample value = channel * 1e6 + frame
+	float *pcm[kTestMaxChannels]; //Returned by the read proc
+	long nbFrames;
+	long position;
+	long holeAt; //OV_HOLE returned once there, -1 for none
+	long errorAt; //OV_EREAD returned there, -1 for none
+	long sectionAt; //Second section start, -1 for none
+	long packetFrames; //0 for varying sizes
+	vorbis_info sections[2];
+} TestStream;
+
+static long testReadFloat(OggVorbis_File *vorbisFile, float ***pcm, int samples, int *section)
+{
+	TestStream *stream = (TestStream*)vorbisFile->datasource;
+	long frames = stream->packetFrames ? stream->packetFrames : 64 + (stream->position % 5)*100;
+	int channel;
+
+	if (stream->position == stream->holeAt) {
+		stream->holeAt = -1;
+		return OV_HOLE;
+	}
+	if (stream->position == stream->errorAt) return OV_EREAD;
+	if (stream->position >= stream->nbFrames) return 0;
+
+	*section = ((stream->sectionAt >= 0) && (stream->position >= stream->sectionAt)) ? 1 : 0;
+	if (frames > samples) frames = samples;
+	if (frames > stream->nbFrames - stream->position) frames = stream->nbFrames - stream->position;
+	if ((*section == 0) && (stream->sectionAt >= 0) && (frames > stream->sectionAt - stream->position))
+		frames = stream->sectionAt - stream->position;
+	if ((stream->holeAt > stream->position) && (frames > stream->holeAt - stream->position))
+		frames = stream->holeAt - stream->position;
+	if ((stream->errorAt > stream->position) && (frames > stream->errorAt - stream->position))
+		frames = stream->errorAt - stream->position;
+
+	for (channel=0;channel<stream->sections[*section].channels;channel++)
+		stream->pcm[channel] = stream->samples[channel] + stream->position;
+	*pcm = stream->pcm;
+	stream->position += frames;
+	return frames;
+}
+
+static vorbis_info* testInfo(OggVorbis_File *vorbisFile, int section)
+{
+	TestStream *stream = (TestStream*)vorbisFile->datasource;
+	return &stream->sections[(section < 0) ? 0 : section];
+}
+
+static bool testStreamInit(TestStream *stream, OggVorbis_File *vorbisFile, int channels, long nbFrames)
+{
+	long frame;
+	int channel;
+
+	memset(stream, 0, sizeof(TestStream));
+	for (channel=0;channel<kTestMaxChannels;channel++) {
+		stream->samples[channel] = (float*)malloc(nbFrames * sizeof(float));
+		if (stream->samples[channel] == NULL) return false;
+		for (frame=0;frame<nbFrames;frame++)
+			stream->samples[channel][frame] = (float)(channel * 1000000 + frame);
+	}
+	stream->nbFrames = nbFrames;
+	stream->holeAt = stream->errorAt = stream->sectionAt = -1;
+	stream->sections[0].channels = stream->sections[1].channels = channels;
+	stream->sections[0].rate = stream->sections[1].rate = 44100;
+	memset(vorbisFile, 0, sizeof(OggVorbis_File));
+	vorbisFile->datasource = stream;
+	return true;
+}
+
+static void testStreamFree(TestStream *stream)
+{
+	int channel;
+	for (channel=0;channel<kTestMaxChannels;channel++) free(stream->samples[channel]);
+}
+
+/* Output frame of a stream frame, mono duplicated or not */
+static bool isFrameExpected(const Float32 *outFrame, long frame, UInt32 channels, UInt32 outputChannels, bool isMonoDuplicated)
+{
+	UInt32 channel;
+	Float32 expected;
+
+	for (channel=0;channel<outputChannels;channel++) {
+		if (channel < channels) expected = (Float32)(kExpectedOrder[channels-1][channel] * 1000000 + frame);
+		else if (isMonoDuplicated && (channels == 1) && (channel == 1)) expected = (Float32)frame;
+		else expected = 0.0f;
+		if (outFrame[channel] != expected) return false;
+	}
+	return true;
+}
+
+#pragma mark Tests
+
+static void testInterleaving(void)
+{
+	static const UInt32 outputChannels[] = { 1, 2, 6, 8 };
+	static const long readSizes[] = { 1, 100, 4096, kTestFrames };
+	AudioVorbisDecoder decoder;
+	OggVorbis_File vorbisFile;
+	TestStream stream;
+	Float32 *out;
+	long frame, framesRead, readStep;
+	UInt32 channels, output, read, options;
+	bool isExpected;
+
+	out = (Float32*)malloc(kTestFrames * kTestMaxChannels * sizeof(Float32));
+	AudioTestCheck(out != NULL);
+	if (out == NULL) return;
+
+	for (channels=1;channels<=kTestMaxChannels;channels++)
+		for (output=0;output<countof(outputChannels);output++)
+			for (read=0;read<countof(readSizes);read++)
+				for (options=0;options<=kAudioSampleConvertDuplicateMono;options+=kAudioSampleConvertDuplicateMono) {
+					if (!testStreamInit(&stream, &vorbisFile, (int)channels, kTestFrames)) {
+						AudioTestCheck(false);
+						testStreamFree(&stream);
+						free(out);
+						return;
+					}
+					AudioTestCheck(AudioVorbisDecoderInit(&decoder, &vorbisFile, testReadFloat, testInfo,
+														  outputChannels[output], options) == 0);
+
+					framesRead = 0;
+					do {
+						readStep = AudioVorbisDecoderRead(&decoder, out + framesRead*outputChannels[output],
+														  (readSizes[read] < kTestFrames - framesRead) ? readSizes[read] : kTestFrames - framesRead);
+						if (readStep > 0) framesRead += readStep;
+					} while ((readStep > 0) && (framesRead < kTestFrames));
+					AudioTestCheck(framesRead == kTestFrames);
+					AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 1) == 0);
+
+					for (frame=0,isExpected=true;(frame<framesRead) && isExpected;frame++)
+						isExpected = isFrameExpected(out + frame*outputChannels[output], frame, channels, outputChannels[output],
+													 options == kAudioSampleConvertDuplicateMono);
+					AudioTestCheck(isExpected);
+					testStreamFree(&stream);
+				}
+	free(out);
+}
+
+static void testStreamEvents(void)
+{
+	AudioVorbisDecoder decoder;
+	OggVorbis_File vorbisFile;
+	TestStream stream;
+	Float32 *out;
+	long frame;
+	bool isExpected;
+
+	out = (Float32*)malloc(kTestFrames * 2 * sizeof(Float32));
+	AudioTestCheck(out != NULL);
+	if ((out == NULL) || !testStreamInit(&stream, &vorbisFile, 2, kTestFrames)) {
+		free(out);
+		return;
+	}
+	AudioTestCheck(AudioVorbisDecoderInit(&decoder, &vorbisFile, testReadFloat, testInfo, 2, 0) == 0);
+
+	//Gap in the stream: skipped, the frames continuing after it
+	stream.holeAt = 1000;
+	AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 2000) == 2000);
+	for (frame=0,isExpected=true;frame<2000;frame++)
+		isExpected &= isFrameExpected(out + frame*2, frame, 2, 2, false);
+	AudioTestCheck(isExpected);
+
+	//Decoding error: the frames before it, then the error
+	stream.errorAt = 3000;
+	AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 2000) == 1000);
+	AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 2000) == -1);
+
+	//Chained section with the same channels count: decoding continues
+	stream.errorAt = -1;
+	stream.sectionAt = 4000;
+	AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 2000) == 2000);
+	AudioTestCheck(isFrameExpected(out + 1999*2, 4999, 2, 2, false));
+
+	//Chained section changing the channels count: end of the stream
+	stream.position = 0;
+	stream.sections[1].channels = 6;
+	AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 8000) == 4000);
+	AudioTestCheck(AudioVorbisDecoderRead(&decoder, out, 8000) == 0);
+
+	//Unsupported channels counts
+	stream.sections[0].channels = 0;
+	AudioTestCheck(AudioVorbisDecoderInit(&decoder, &vorbisFile, testReadFloat, testInfo, 2, 0) != 0);
+	stream.sections[0].channels = kAudioVorbisMaxChannels + 1;
+	AudioTestCheck(AudioVorbisDecoderInit(&decoder, &vorbisFile, testReadFloat, testInfo, 2, 0) != 0);
+
+	testStreamFree(&stream);
+	free(out);
+}
+
+#pragma mark Benchmark
+
+typedef struct {
+	AudioVorbisDecoder decoder;
+	OggVorbis_File vorbisFile;
+	TestStream stream;
+	Float32 *out;
+} DecodeBenchmark;
+
+static void decodeBenchmark(void *context)
+{
+	DecodeBenchmark *bench = (DecodeBenchmark*)context;
+
+	bench->stream.position = 0;
+	AudioVorbisDecoderRead(&bench->decoder, bench->out, kTestFrames);
+}
+
+static void benchmarkDecoding(void)
+{
+	static const UInt32 channels[][2] = { { 2, 2 }, { 6, 6 }, { 6, 8 }, { 1, 2 } };
+	DecodeBenchmark bench;
+	char name[128];
+	UInt32 i;
+
+	bench.out = (Float32*)malloc(kTestFrames * kTestMaxChannels * sizeof(Float32));
+	for (i=0;(i<countof(channels)) && bench.out;i++) {
+		if (testStreamInit(&bench.stream, &bench.vorbisFile, (int)channels[i][0], kTestFrames)
+			&& (AudioVorbisDecoderInit(&bench.decoder, &bench.vorbisFile, testReadFloat, testInfo, channels[i][1], 0) == 0)) {
+			bench.stream.packetFrames = kBenchPacketFrames;
+			snprintf(name, sizeof(name), "decoded packets interleaving, %u to %u channels", channels[i][0], channels[i][1]);
+			AudioTestBenchmark(name, "frames", kTestFrames, decodeBenchmark, &bench);
+		}
+		testStreamFree(&bench.stream);
+	}
+	free(bench.out);
+}
+
+int main(int argc, char *argv[])
+{
+	testInterleaving();
+	testStreamEvents();
+	if (AudioTestIsBenchmark(argc, argv))
+		benchmarkDecoding();
+	return AudioTestResult("AudioVorbisDecoderTest");
+}
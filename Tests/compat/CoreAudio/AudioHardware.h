@@ -0,0 +1,14 @@
+/*
+ Minimal AudioHardware.h replacement, so that the portable audio code can be built and tested on non Apple systems
+ */
+
+#ifndef __COMPAT_AUDIOHARDWARE_H__
+#define __COMPAT_AUDIOHARDWARE_H__
+
+#include <CoreAudio/CoreAudioTypes.h>
+
+typedef UInt32 AudioObjectID;
+typedef AudioObjectID AudioDeviceID;
+typedef AudioObjectID AudioStreamID;
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ Minimal CoreAudioTypes.h replacement, so that the portable audio code can be built and tested on non Apple systems
+ Only the declarations used by the portable files are provided, with the Apple SDK values
+ */
+
+#ifndef __COMPAT_COREAUDIOTYPES_H__
+#define __COMPAT_COREAUDIOTYPES_H__
+
+#include <MacTypes.h>
+
+typedef struct AudioStreamBasicDescription {
+	Float64 mSampleRate;
+	UInt32 mFormatID;
+	UInt32 mFormatFlags;
+	UInt32 mBytesPerPacket;
+	UInt32 mFramesPerPacket;
+	UInt32 mBytesPerFrame;
+	UInt32 mChannelsPerFrame;
+	UInt32 mBitsPerChannel;
+	UInt32 mReserved;
+} AudioStreamBasicDescription;
+
+enum {
+	kAudioFormatLinearPCM = 0x6C70636D //'lpcm'
+};
+
+enum {
+	kAudioFormatFlagIsFloat = (1U << 0),
+	kAudioFormatFlagIsBigEndian = (1U << 1),
+	kAudioFormatFlagIsSignedInteger = (1U << 2),
+	kAudioFormatFlagIsPacked = (1U << 3),
+	kAudioFormatFlagIsAlignedHigh = (1U << 4),
+	kAudioFormatFlagIsNonInterleaved = (1U << 5),
+	kAudioFormatFlagIsNonMixable = (1U << 6)
+};
+
+typedef struct AudioBuffer {
+	UInt32 mNumberChannels;
+	UInt32 mDataByteSize;
+	void *mData;
+} AudioBuffer;
+
+typedef struct AudioBufferList {
+	UInt32 mNumberBuffers;
+	AudioBuffer mBuffers[1];
+} AudioBufferList;
+
+#endif
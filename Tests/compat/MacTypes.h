@@ -0,0 +1,23 @@
+/*
+ Minimal MacTypes.h replacement, so that the portable audio code can be built and tested on non Apple systems
+ */
+
+#ifndef __COMPAT_MACTYPES_H__
+#define __COMPAT_MACTYPES_H__
+
+#include <stdint.h>
+
+typedef uint8_t UInt8;
+typedef int8_t SInt8;
+typedef uint16_t UInt16;
+typedef int16_t SInt16;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+typedef float Float32;
+typedef double Float64;
+typedef SInt32 OSStatus;
+typedef unsigned char Boolean;
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ Minimal libdispatch replacement, so that the portable audio code can be built and tested on non Apple systems
+ dispatch_apply_f runs the iterations on a few pthreads, with the same (unordered) semantics.
+ Serial queues run their work items in order on their own pthread, the global queue on a new pthread each
+ */
+
+#ifndef __COMPAT_DISPATCH_H__
+#define __COMPAT_DISPATCH_H__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef void *dispatch_queue_t;
+
+#define DISPATCH_QUEUE_PRIORITY_DEFAULT 0
+#define kCompatDispatchApplyThreads 4
+
+static inline dispatch_queue_t dispatch_get_global_queue(long priority, unsigned long flags)
+{
+	(void)priority; (void)flags;
+	return NULL;
+}
+
+typedef struct {
+	void *context;
+	void (*work)(void*, size_t);
+	size_t iterations;
+	size_t next;
+	pthread_mutex_t lock;
+} CompatDispatchApply;
+
+static inline void *CompatDispatchApplyWorker(void *arg)
+{
+	CompatDispatchApply *apply = (CompatDispatchApply*)arg;
+	for (;;) {
+		size_t i;
+		pthread_mutex_lock(&apply->lock);
+		i = apply->next++;
+		pthread_mutex_unlock(&apply->lock);
+		if (i >= apply->iterations) break;
+		apply->work(apply->context, i);
+	}
+	return NULL;
+}
+
+static inline void dispatch_apply_f(size_t iterations, dispatch_queue_t queue, void *context, void (*work)(void*, size_t))
+{
+	CompatDispatchApply apply;
+	pthread_t threads[kCompatDispatchApplyThreads];
+	int i;
+	(void)queue;
+	apply.context = context;
+	apply.work = work;
+	apply.iterations = iterations;
+	apply.next = 0;
+	pthread_mutex_init(&apply.lock, NULL);
+	for (i = 0; i < kCompatDispatchApplyThreads; i++) pthread_create(&threads[i], NULL, CompatDispatchApplyWorker, &apply);
+	for (i = 0; i < kCompatDispatchApplyThreads; i++) pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&apply.lock);
+}
+
+
+#pragma mark Serial queues
+
+typedef struct CompatDispatchWork {
+	void *context;
+	void (*work)(void*);
+	struct CompatDispatchWork *next;
+} CompatDispatchWork;
+
+typedef struct {
+	CompatDispatchWork *head;
+	CompatDispatchWork *tail;
+	int isReleased;
+	pthread_mutex_t lock;
+	pthread_cond_t workAdded;
+} CompatDispatchQueue;
+
+static inline void *CompatDispatchQueueWorker(void *arg)
+{
+	CompatDispatchQueue *queue = (CompatDispatchQueue*)arg;
+	CompatDispatchWork *item;
+
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		while ((queue->head == NULL) && !queue->isReleased)
+			pthread_cond_wait(&queue->workAdded, &queue->lock);
+		if (queue->head == NULL) break; //Released and drained
+		item = queue->head;
+		queue->head = item->next;
+		if (queue->head == NULL) queue->tail = NULL;
+		pthread_mutex_unlock(&queue->lock);
+		item->work(item->context);
+		free(item);
+		pthread_mutex_lock(&queue->lock);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	pthread_cond_destroy(&queue->workAdded);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
+	return NULL;
+}
+
+static inline dispatch_queue_t dispatch_queue_create(const char *label, void *attr)
+{
+	CompatDispatchQueue *queue = (CompatDispatchQueue*)calloc(1, sizeof(CompatDispatchQueue));
+	pthread_t thread;
+	(void)label; (void)attr;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->workAdded, NULL);
+	pthread_create(&thread, NULL, CompatDispatchQueueWorker, queue);
+	pthread_detach(thread);
+	return queue;
+}
+
+/* Pending work items still run, as with libdispatch */
+static inline void dispatch_release(dispatch_queue_t object)
+{
+	CompatDispatchQueue *queue = (CompatDispatchQueue*)object;
+	pthread_mutex_lock(&queue->lock);
+	queue->isReleased = 1;
+	pthread_cond_signal(&queue->workAdded);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static inline void *CompatDispatchGlobalWorker(void *arg)
+{
+	CompatDispatchWork *item = (CompatDispatchWork*)arg;
+	item->work(item->context);
+	free(item);
+	return NULL;
+}
+
+static inline void dispatch_async_f(dispatch_queue_t object, void *context, void (*work)(void*))
+{
+	CompatDispatchQueue *queue = (CompatDispatchQueue*)object;
+	CompatDispatchWork *item = (CompatDispatchWork*)calloc(1, sizeof(CompatDispatchWork));
+	item->context = context;
+	item->work = work;
+
+	if (queue == NULL) {
+		pthread_t thread;
+		pthread_create(&thread, NULL, CompatDispatchGlobalWorker, item);
+		pthread_detach(thread);
+		return;
+	}
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail) queue->tail->next = item;
+	else queue->head = item;
+	queue->tail = item;
+	pthread_cond_signal(&queue->workAdded);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+typedef struct {
+	void *context;
+	void (*work)(void*);
+	int isDone;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+} CompatDispatchSync;
+
+static inline void CompatDispatchSyncWork(void *arg)
+{
+	CompatDispatchSync *sync = (CompatDispatchSync*)arg;
+	sync->work(sync->context);
+	pthread_mutex_lock(&sync->lock);
+	sync->isDone = 1;
+	pthread_cond_signal(&sync->done);
+	pthread_mutex_unlock(&sync->lock);
+}
+
+static inline void dispatch_sync_f(dispatch_queue_t queue, void *context, void (*work)(void*))
+{
+	CompatDispatchSync sync;
+	sync.context = context;
+	sync.work = work;
+	sync.isDone = 0;
+	pthread_mutex_init(&sync.lock, NULL);
+	pthread_cond_init(&sync.done, NULL);
+	dispatch_async_f(queue, &sync, CompatDispatchSyncWork);
+	pthread_mutex_lock(&sync.lock);
+	while (!sync.isDone) pthread_cond_wait(&sync.done, &sync.lock);
+	pthread_mutex_unlock(&sync.lock);
+	pthread_cond_destroy(&sync.done);
+	pthread_mutex_destroy(&sync.lock);
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ Minimal OSAtomic.h replacement, so that the portable audio code can be built and tested on non Apple systems
+ */
+
+#ifndef __COMPAT_OSATOMIC_H__
+#define __COMPAT_OSATOMIC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OSMemoryBarrier() __sync_synchronize()
+
+static inline bool OSAtomicCompareAndSwap32Barrier(int32_t oldValue, int32_t newValue, volatile int32_t *theValue)
+{
+	return __sync_bool_compare_and_swap(theValue, oldValue, newValue);
+}
+
+static inline int32_t OSAtomicIncrement32(volatile int32_t *theValue)
+{
+	return __sync_add_and_fetch(theValue, 1);
+}
+
+#endif
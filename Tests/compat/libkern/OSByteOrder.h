@@ -0,0 +1,12 @@
+/*
+ Minimal OSByteOrder.h replacement, so that the portable audio code can be built and tested on non Apple systems
+ */
+
+#ifndef __COMPAT_OSBYTEORDER_H__
+#define __COMPAT_OSBYTEORDER_H__
+
+#define OSSwapInt16(x) __builtin_bswap16(x)
+#define OSSwapInt32(x) __builtin_bswap32(x)
+#define OSSwapInt64(x) __builtin_bswap64(x)
+
+#endif
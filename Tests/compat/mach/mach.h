@@ -0,0 +1,42 @@
+/*
+ Minimal mach.h replacement, so that the portable audio code can be built and tested on non Apple systems
+ Virtual memory allocations are mapped to anonymous mmap
+ */
+
+#ifndef __COMPAT_MACH_H__
+#define __COMPAT_MACH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+typedef uintptr_t vm_address_t;
+typedef size_t vm_size_t;
+typedef int kern_return_t;
+typedef int vm_map_t;
+
+#define KERN_SUCCESS 0
+#define KERN_NO_SPACE 3
+#define VM_FLAGS_ANYWHERE 0x0001
+#define VM_FLAGS_SUPERPAGE_SIZE_2MB 0x20000
+
+static inline vm_map_t mach_task_self(void) { return 0; }
+
+static inline kern_return_t vm_allocate(vm_map_t task, vm_address_t *address, vm_size_t size, int flags)
+{
+	void *p;
+	(void)task;
+	if (flags & VM_FLAGS_SUPERPAGE_SIZE_2MB) return KERN_NO_SPACE;
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (p == MAP_FAILED) return KERN_NO_SPACE;
+	*address = (vm_address_t)p;
+	return KERN_SUCCESS;
+}
+
+static inline kern_return_t vm_deallocate(vm_map_t task, vm_address_t address, vm_size_t size)
+{
+	(void)task;
+	return munmap((void*)address, size) == 0 ? KERN_SUCCESS : KERN_NO_SPACE;
+}
+
+#endif